@@ -0,0 +1,415 @@
+#!/usr/bin/env python3
+"""
+Compile the INTERNAL_YAML metric catalog from src/include/internal.h into C tables.
+
+The generated translation unit contains one balanced, version-sorted tree of
+query alternatives per metric together with the metric definitions and the
+derived metric names. pgexporter links the tables in directly, so the built-in
+catalog does not need to be parsed, validated or allocated at runtime.
+
+The conversion follows the rules of the runtime YAML loader (semantics_yaml):
+the first query for a version wins and only its columns name metrics, a
+version of 0 means the default version, and strings are truncated to the size
+of the shared memory fields. test_metrics_internal_catalog compares the
+generated tables with a runtime parse of the same YAML, so a difference
+between the two fails the test suite.
+
+Usage:
+    generate_internal_metrics.py --internal-h <path> --output <file.c> [--verbose]
+"""
+
+import argparse
+import logging
+import re
+import sys
+from pathlib import Path
+from typing import Any, Dict, List, Optional, Tuple
+
+try:
+    import yaml
+except ImportError as exc:
+    raise SystemExit(
+        "PyYAML is required. Install with: python3 -m pip install pyyaml"
+    ) from exc
+
+sys.path.insert(0, str(Path(__file__).resolve().parent))
+from generate_yaml_json import extract_internal_yaml  # noqa: E402
+
+# Keep in sync with src/include/pgexporter.h
+MAX_NUMBER_OF_COLUMNS = 32
+MAX_NUMBER_OF_BUCKETS = 32
+PROMETHEUS_LENGTH = 256
+MAX_QUERY_LENGTH = 2048
+MAX_COLLECTOR_LENGTH = 1024
+NUMBER_OF_METRICS = 256
+
+# Keep in sync with src/include/slice.h
+SLICE_MAX = 256
+
+COLUMN_TYPES = {
+    'label': 'LABEL_TYPE',
+    'counter': 'COUNTER_TYPE',
+    'gauge': 'GAUGE_TYPE',
+    'histogram': 'HISTOGRAM_TYPE',
+}
+
+SORT_TYPES = {
+    'name': 'SORT_NAME',
+    'data': 'SORT_DATA0',
+}
+
+DERIVE_TYPES = {
+    'none': 'DERIVE_NONE',
+    'rate': 'DERIVE_RATE',
+    'delta': 'DERIVE_DELTA',
+    'rate_only': 'DERIVE_RATE | DERIVE_ONLY',
+    'delta_only': 'DERIVE_DELTA | DERIVE_ONLY',
+}
+
+SERVER_TYPES = {
+    'both': 'SERVER_QUERY_BOTH',
+    'primary': 'SERVER_QUERY_PRIMARY',
+    'replica': 'SERVER_QUERY_REPLICA',
+    'cluster': 'SERVER_QUERY_CLUSTER',
+}
+
+METRIC_NAME_PATTERN = re.compile(r'^[a-zA-Z_:][a-zA-Z0-9_:]*$')
+
+
+def setup_logging(verbose: bool = False) -> logging.Logger:
+    level = logging.DEBUG if verbose else logging.INFO
+    logging.basicConfig(
+        level=level,
+        format='%(levelname)s: %(message)s'
+    )
+    return logging.getLogger(__name__)
+
+
+def parse_buckets(value: Any) -> List[float]:
+    # Mirror pgexporter_parse_buckets(): a sequence or a comma separated string
+    if isinstance(value, list):
+        items = value
+    else:
+        items = [v for v in str(value).replace('\t', ' ').split(',') if v.strip()]
+    buckets = [float(v) for v in items]
+    if not buckets or len(buckets) > MAX_NUMBER_OF_BUCKETS:
+        raise ValueError(f"unexpected number of buckets {len(buckets)}")
+    for k, bound in enumerate(buckets):
+        if bound != bound or bound in (float('inf'), float('-inf')):
+            raise ValueError(f"unexpected bucket {bound}")
+        if k > 0 and bound <= buckets[k - 1]:
+            raise ValueError(f"buckets must be increasing at {bound}")
+    return buckets
+
+
+def c_string(value: str, size: int) -> str:
+    # Mirror memcpy(dst, src, MIN(size - 1, strlen(src))) on the UTF-8 bytes
+    data = value.encode('utf-8')[:size - 1]
+    out = []
+    for b in data:
+        c = chr(b)
+        if c == '"' or c == '\\':
+            out.append('\\' + c)
+        elif c == '\n':
+            out.append('\\n')
+        elif c == '\t':
+            out.append('\\t')
+        elif c == '\r':
+            out.append('\\r')
+        elif 32 <= b < 127 and c != '?':
+            out.append(c)
+        else:
+            out.append(f'\\{b:03o}')
+    return '"' + ''.join(out) + '"'
+
+
+def c_atoi(value: Optional[str]) -> int:
+    # atoi(): optional whitespace, optional sign, leading digits
+    if value is None:
+        return 0
+    match = re.match(r'\s*([+-]?\d+)', value)
+    return int(match.group(1)) if match else 0
+
+
+def parse_catalog(data: Dict[str, Any], logger: logging.Logger) -> List[Dict[str, Any]]:
+    if not isinstance(data, dict):
+        raise ValueError("YAML root must be a mapping")
+
+    default_version = c_atoi(data.get('version'))
+    metrics = data.get('metrics')
+
+    if not isinstance(metrics, list) or not metrics:
+        raise ValueError("'metrics' must be a non-empty list")
+
+    if len(metrics) > NUMBER_OF_METRICS:
+        raise ValueError(f"The number of metrics exceed the maximum limit of {NUMBER_OF_METRICS}")
+
+    catalog = []
+    seen_names = set()
+
+    for i, metric in enumerate(metrics):
+        tag = metric.get('tag', metric.get('metric'))
+        collector = metric.get('collector')
+        sort = metric.get('sort', 'name')
+        server = metric.get('server', 'both')
+        derive = metric.get('derive', 'none')
+        slices = c_atoi(metric.get('slices'))
+
+        if tag is None:
+            raise ValueError(f"Metric {i}: no tag defined")
+        if collector is None:
+            raise ValueError(f"Metric {i} ({tag}): no collector defined")
+        if sort not in SORT_TYPES:
+            raise ValueError(f"Metric {i} ({tag}): unexpected sort_type {sort}")
+        if server not in SERVER_TYPES:
+            raise ValueError(f"Metric {i} ({tag}): unexpected server {server}")
+        if derive not in DERIVE_TYPES:
+            raise ValueError(f"Metric {i} ({tag}): unexpected derive {derive}")
+
+        queries = metric.get('queries') or []
+
+        # Mirror pgexporter_slice_validate()
+        if slices < 0 or slices > SLICE_MAX:
+            raise ValueError(f"Metric {i} ({tag}): unexpected slices {slices}")
+        if slices > 1:
+            if derive != 'none':
+                raise ValueError(f"Metric {i} ({tag}): slices cannot be derived")
+            for j, query in enumerate(queries):
+                if '{slice}' not in (query.get('query') or ''):
+                    raise ValueError(f"Metric {i} ({tag}) query {j}: slices without {{slice}}")
+
+        alternatives: Dict[int, Dict[str, Any]] = {}
+        names: List[str] = []
+        metric_names = set()
+
+        for j, query in enumerate(queries):
+            version = c_atoi(query.get('version'))
+            if version == 0:
+                version = default_version
+            if not 0 < version < 128:
+                raise ValueError(f"Metric {i} ({tag}) query {j}: version {version} out of range")
+
+            columns = query.get('columns') or []
+            compiled_columns = []
+
+            for k, column in enumerate(columns):
+                column_type = column.get('type')
+                if column_type not in COLUMN_TYPES:
+                    raise ValueError(f"Metric {i} ({tag}) query {j} column {k}: unexpected type {column_type}")
+
+                name = column.get('name') or ''
+                buckets: List[float] = []
+                if column.get('buckets') is not None:
+                    if column_type != 'histogram':
+                        raise ValueError(f"Metric {i} ({tag}) query {j} column {k}: buckets on a {column_type}")
+                    try:
+                        buckets = parse_buckets(column['buckets'])
+                    except ValueError as e:
+                        raise ValueError(f"Metric {i} ({tag}) query {j} column {k}: {e}") from e
+                compiled_columns.append({
+                    'type': COLUMN_TYPES[column_type],
+                    'name': name,
+                    'description': column.get('description') or '',
+                    'buckets': buckets,
+                })
+
+            if version in alternatives:
+                logger.debug(f"{tag}: ignoring duplicate query for version {version}")
+                continue
+
+            for column in columns:
+                if column['type'] == 'label':
+                    continue
+
+                name = column.get('name') or ''
+                final_name = f"{tag}_{name}" if name else tag
+                final_name = final_name.encode('utf-8')[:PROMETHEUS_LENGTH - 1].decode('utf-8', 'ignore')
+
+                if not METRIC_NAME_PATTERN.match(final_name):
+                    raise ValueError(f"Metric {i} ({tag}): invalid metric name '{final_name}'")
+
+                if final_name in seen_names and final_name not in metric_names:
+                    raise ValueError(f"Metric {i} ({tag}): duplicate metric name '{final_name}'")
+
+                if final_name not in metric_names:
+                    metric_names.add(final_name)
+                    names.append(final_name)
+
+            compiled_columns = compiled_columns[:MAX_NUMBER_OF_COLUMNS]
+            alternatives[version] = {
+                'version': version,
+                'query': query.get('query') or '',
+                'columns': compiled_columns,
+                'is_histogram': any(c['type'] == 'HISTOGRAM_TYPE' for c in compiled_columns),
+            }
+
+        seen_names.update(metric_names)
+
+        catalog.append({
+            'tag': tag,
+            'collector': collector,
+            'sort': SORT_TYPES[sort],
+            'server': SERVER_TYPES[server],
+            'exec_on_all_dbs': metric.get('database') == 'all',
+            'optional': metric.get('optional') == 'true',
+            'derive': DERIVE_TYPES[derive],
+            'slices': slices,
+            'alternatives': [alternatives[v] for v in sorted(alternatives)],
+            'names': names,
+        })
+
+    return catalog
+
+
+def build_tree(alternatives: List[Dict[str, Any]], base: int) -> Tuple[Optional[int], List[Dict[str, Any]]]:
+    # Balanced BST over the sorted versions; indexes are global into the node table
+    nodes: List[Dict[str, Any]] = []
+
+    def build(lo: int, hi: int) -> Tuple[Optional[int], int]:
+        if lo > hi:
+            return None, 0
+        mid = (lo + hi) // 2
+        node = dict(alternatives[mid])
+        index = base + len(nodes)
+        nodes.append(node)
+        node['left'], left_height = build(lo, mid - 1)
+        node['right'], right_height = build(mid + 1, hi)
+        node['height'] = max(left_height, right_height) + 1
+        return index, node['height']
+
+    root, _ = build(0, len(alternatives) - 1)
+    return root, nodes
+
+
+def emit(catalog: List[Dict[str, Any]]) -> str:
+    nodes: List[Dict[str, Any]] = []
+    roots: List[Optional[int]] = []
+
+    for metric in catalog:
+        root, tree = build_tree(metric['alternatives'], len(nodes))
+        roots.append(root)
+        nodes.extend(tree)
+
+    def node_ref(index: Optional[int]) -> str:
+        if index is None:
+            return 'NULL'
+        return f'(struct pg_query_alts*)&internal_query_alts[{index}]'
+
+    out = []
+    out.append('/* Generated by scripts/generate_internal_metrics.py from src/include/internal.h. Do not edit. */')
+    out.append('')
+    out.append('/* pgexporter */')
+    out.append('#include <pgexporter.h>')
+    out.append('#include <derive.h>')
+    out.append('#include <internal_metrics.h>')
+    out.append('#include <pg_query_alts.h>')
+    out.append('')
+    out.append('/* system */')
+    out.append('#include <stdbool.h>')
+    out.append('#include <stdlib.h>')
+    out.append('')
+    out.append(f'static const struct pg_query_alts internal_query_alts[{max(len(nodes), 1)}] = {{')
+    for node in nodes:
+        out.append('   {')
+        out.append(f'      .pg_version = {node["version"]},')
+        out.append('      .node = {')
+        out.append(f'         .query = {c_string(node["query"], MAX_QUERY_LENGTH)},')
+        out.append('         .columns = {')
+        for column in node['columns']:
+            buckets = ''
+            if column['buckets']:
+                buckets = (f', .n_buckets = {len(column["buckets"])}, '
+                           f'.buckets = {{{", ".join(repr(b) for b in column["buckets"])}}}')
+            out.append(f'            {{.type = {column["type"]}, '
+                       f'.name = {c_string(column["name"], PROMETHEUS_LENGTH)}, '
+                       f'.description = {c_string(column["description"], PROMETHEUS_LENGTH)}{buckets}}},')
+        out.append('         },')
+        out.append(f'         .n_columns = {len(node["columns"])},')
+        out.append(f'         .is_histogram = {"true" if node["is_histogram"] else "false"},')
+        out.append('      },')
+        out.append(f'      .height = {node["height"]},')
+        out.append(f'      .left = {node_ref(node["left"])},')
+        out.append(f'      .right = {node_ref(node["right"])},')
+        out.append('   },')
+    out.append('};')
+    out.append('')
+
+    out.append(f'const int pgexporter_internal_number_of_metrics = {len(catalog)};')
+    out.append('')
+    out.append(f'const struct prometheus pgexporter_internal_metrics[{len(catalog)}] = {{')
+    for metric, root in zip(catalog, roots):
+        out.append('   {')
+        out.append(f'      .tag = {c_string(metric["tag"], PROMETHEUS_LENGTH)},')
+        out.append(f'      .sort_type = {metric["sort"]},')
+        out.append(f'      .server_query_type = {metric["server"]},')
+        out.append(f'      .exec_on_all_dbs = {"true" if metric["exec_on_all_dbs"] else "false"},')
+        out.append(f'      .optional = {"true" if metric["optional"] else "false"},')
+        out.append(f'      .derive = {metric["derive"]},')
+        out.append(f'      .slices = {metric["slices"]},')
+        out.append(f'      .collector = {c_string(metric["collector"], MAX_COLLECTOR_LENGTH)},')
+        out.append(f'      .pg_root = {node_ref(root)},')
+        out.append('      .ext_root = NULL,')
+        out.append('      .compiled = true,')
+        out.append('   },')
+    out.append('};')
+    out.append('')
+
+    names = [name for metric in catalog for name in metric['names']]
+    out.append(f'const int pgexporter_internal_number_of_metric_names = {len(names)};')
+    out.append('')
+    out.append(f'const char* const pgexporter_internal_metric_names[{max(len(names), 1)}] = {{')
+    for name in names:
+        out.append(f'   {c_string(name, PROMETHEUS_LENGTH)},')
+    out.append('};')
+    out.append('')
+
+    return '\n'.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter
+    )
+    parser.add_argument(
+        '--internal-h',
+        required=True,
+        type=Path,
+        help='Path to src/include/internal.h'
+    )
+    parser.add_argument(
+        '--output',
+        required=True,
+        type=Path,
+        help='Path of the generated C file'
+    )
+    parser.add_argument(
+        '--verbose',
+        action='store_true',
+        help='Verbose logging'
+    )
+
+    args = parser.parse_args()
+    logger = setup_logging(args.verbose)
+
+    try:
+        yaml_str = extract_internal_yaml(args.internal_h)
+        # BaseLoader keeps every scalar as a string, like the libyaml event parser
+        data = yaml.load(yaml_str, Loader=yaml.BaseLoader)
+        catalog = parse_catalog(data, logger)
+        source = emit(catalog)
+
+        # Always write, so the output is newer than its inputs and the build settles
+        args.output.parent.mkdir(parents=True, exist_ok=True)
+        args.output.write_text(source)
+        logger.info(f"Wrote {args.output} ({len(catalog)} metrics)")
+
+        sys.exit(0)
+
+    except Exception as e:
+        logger.error(f"{type(e).__name__}: {e}")
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
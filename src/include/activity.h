@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_ACTIVITY_H
+#define PGEXPORTER_ACTIVITY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of samples per second
+ */
+#define ACTIVITY_MAX_SAMPLING 10
+
+/**
+ * The length of a name of a backend type or a wait event
+ */
+#define ACTIVITY_NAME_LENGTH 64
+
+#define ACTIVITY_NUMBER_OF_STATES        6
+#define ACTIVITY_NUMBER_OF_WAIT_TYPES    11
+#define ACTIVITY_NUMBER_OF_BACKEND_TYPES 32
+#define ACTIVITY_NUMBER_OF_WAIT_EVENTS   256
+#define ACTIVITY_NUMBER_OF_BUCKETS       10
+
+/**
+ * The interval between the connection attempts to a server in milliseconds
+ */
+#define ACTIVITY_RECONNECT_INTERVAL 5000
+
+/** @struct activity_counter
+ * The number of sessions seen with a backend type or a wait event,
+ * summed over the samples
+ */
+struct activity_counter
+{
+   atomic_bool used;                  /**< Is the counter in use */
+   char type[ACTIVITY_NAME_LENGTH];   /**< The wait event type */
+   char name[ACTIVITY_NAME_LENGTH];   /**< The backend type or the wait event */
+   atomic_ullong samples;             /**< The number of sessions over all samples */
+};
+
+/** @struct activity_histogram
+ * A histogram over the buckets of its kind
+ */
+struct activity_histogram
+{
+   atomic_ullong buckets[ACTIVITY_NUMBER_OF_BUCKETS]; /**< The observations of each bucket, not cumulative */
+   atomic_ullong count;                               /**< The number of observations */
+   atomic_ullong sum;                                 /**< The sum of the observations */
+};
+
+/** @struct activity_server
+ * The aggregates of pg_stat_activity of a server
+ */
+struct activity_server
+{
+   char server[MISC_LENGTH];                                                   /**< The server of the aggregates */
+   atomic_ullong samples;                                                      /**< The number of samples */
+   atomic_ullong errors;                                                       /**< The number of failed samples */
+   atomic_ullong states[ACTIVITY_NUMBER_OF_STATES];                            /**< The sessions of each state over all samples */
+   struct activity_histogram active;                                           /**< The active sessions of each sample */
+   struct activity_histogram waits[ACTIVITY_NUMBER_OF_WAIT_TYPES];             /**< The wait durations in milliseconds of each wait event type */
+   struct activity_counter backend_types[ACTIVITY_NUMBER_OF_BACKEND_TYPES];    /**< The sessions of each backend type */
+   struct activity_counter wait_events[ACTIVITY_NUMBER_OF_WAIT_EVENTS];        /**< The sessions of each wait event */
+} __attribute__((aligned(64)));
+
+/** @struct activity_session
+ * A session of a sample
+ */
+struct activity_session
+{
+   int pid;                                    /**< The process */
+   char state[ACTIVITY_NAME_LENGTH];           /**< The state */
+   char wait_event_type[ACTIVITY_NAME_LENGTH]; /**< The wait event type */
+   char wait_event[ACTIVITY_NAME_LENGTH];      /**< The wait event */
+   char backend_type[ACTIVITY_NAME_LENGTH];    /**< The backend type */
+};
+
+/**
+ * The names of the session states
+ */
+extern const char* const pgexporter_activity_states[ACTIVITY_NUMBER_OF_STATES];
+
+/**
+ * The names of the wait event types, the last one is for any other type
+ */
+extern const char* const pgexporter_activity_wait_types[ACTIVITY_NUMBER_OF_WAIT_TYPES];
+
+/**
+ * The upper bounds of the buckets of the active sessions
+ */
+extern const uint64_t pgexporter_activity_session_bounds[ACTIVITY_NUMBER_OF_BUCKETS];
+
+/**
+ * The upper bounds of the buckets of the wait durations in milliseconds
+ */
+extern const uint64_t pgexporter_activity_wait_bounds[ACTIVITY_NUMBER_OF_BUCKETS];
+
+/**
+ * Is the sampler enabled
+ * @return True if enabled, otherwise false
+ */
+bool
+pgexporter_activity_enabled(void);
+
+/**
+ * Create the shared memory of the sampler
+ * @param p_size The size of the shared memory
+ * @param p_shmem The shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_activity_init(size_t* p_size, void** p_shmem);
+
+/**
+ * Get the aggregates of a server
+ * @param server The server
+ * @return The aggregates, or NULL if the sampler isn't enabled
+ */
+struct activity_server*
+pgexporter_activity_server(int server);
+
+/**
+ * Add a sample of a server to its aggregates. A wait is measured from the
+ * first sample that saw it to the sample that saw it end, so its
+ * resolution is the sampling interval
+ * @param server The server
+ * @param sessions The sessions of the sample
+ * @param number_of_sessions The number of sessions
+ * @param now The time of the sample in milliseconds
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_activity_record(int server, struct activity_session* sessions, int number_of_sessions, int64_t now);
+
+/**
+ * Forget the sessions that are waiting, so their waits aren't measured
+ */
+void
+pgexporter_activity_clear(void);
+
+/**
+ * Run the sampler. Samples pg_stat_activity of every server over
+ * connections of its own. Never returns
+ */
+void
+pgexporter_activity_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
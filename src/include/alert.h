@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_ALERT_H
+#define PGEXPORTER_ALERT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Does an alert apply to a server
+ * @param alert The alert
+ * @param server The server
+ * @return True if the alert targets the server, otherwise false
+ */
+bool
+pgexporter_alert_applies(struct alert_definition* alert, int server);
+
+/**
+ * Compare a value against a threshold
+ * @param value The value
+ * @param op The operator
+ * @param threshold The threshold
+ * @return True if the condition holds, otherwise false
+ */
+bool
+pgexporter_alert_compare(int64_t value, enum alert_operator op, int64_t threshold);
+
+/**
+ * Apply a result to the state of an alert on a server.
+ *
+ * A condition that holds makes an inactive alert pending, and a pending
+ * alert fires once the condition has held for the 'for' duration. With a
+ * clear threshold a firing alert is compared against that threshold
+ * instead, so it only resolves once the value is clearly back.
+ * @param alert The alert
+ * @param server The server
+ * @param value The value
+ * @param now The time of the evaluation
+ * @return The new alert_state
+ */
+int
+pgexporter_alert_transition(struct alert_definition* alert, int server, int64_t value, time_t now);
+
+/**
+ * Evaluate all alerts on the servers of this process. The connections must be open
+ */
+void
+pgexporter_alert_evaluate(void);
+
+/**
+ * Periodic callback that forks the alert evaluator
+ */
+void
+pgexporter_alert_tick_cb(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -43,6 +43,7 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_UNIX_SOCKET_DIR            "unix_socket_dir"
 #define CONFIGURATION_ARGUMENT_METRICS                    "metrics"
 #define CONFIGURATION_ARGUMENT_METRICS_PATH               "metrics_path"
+#define CONFIGURATION_ARGUMENT_YAML_CACHE_PATH            "yaml_cache_path"
 #define CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_AGE      "metrics_cache_max_age"
 #define CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_SIZE     "metrics_cache_max_size"
 #define CONFIGURATION_ARGUMENT_BRIDGE                     "bridge"
@@ -57,6 +58,7 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_BRIDGE_HISTORY_BACKEND     "bridge_history_backend"
 #define CONFIGURATION_ARGUMENT_BRIDGE_HISTORY_PATH        "bridge_history_path"
 #define CONFIGURATION_ARGUMENT_ALERTS                     "alerts"
+#define CONFIGURATION_ARGUMENT_ALERTS_INTERVAL            "alerts_interval"
 #define CONFIGURATION_ARGUMENT_HISTORY                    "history"
 #define CONFIGURATION_ARGUMENT_HISTORY_INTERVAL           "history_interval"
 #define CONFIGURATION_ARGUMENT_HISTORY_RETENTION          "history_retention"
@@ -79,7 +81,10 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_METRICS_CERT_FILE          "metrics_cert_file"
 #define CONFIGURATION_ARGUMENT_METRICS_KEY_FILE           "metrics_key_file"
 #define CONFIGURATION_ARGUMENT_METRICS_CA_FILE            "metrics_ca_file"
+#define CONFIGURATION_ARGUMENT_METRICS_KTLS               "metrics_ktls"
 #define CONFIGURATION_ARGUMENT_METRICS_QUERY_TIMEOUT      "metrics_query_timeout"
+#define CONFIGURATION_ARGUMENT_METRICS_SHARDS             "metrics_shards"
+#define CONFIGURATION_ARGUMENT_ACTIVITY_SAMPLING          "activity_sampling"
 #define CONFIGURATION_ARGUMENT_EV_BACKEND                 "ev_backend"
 #define CONFIGURATION_ARGUMENT_KEEP_ALIVE                 "keep_alive"
 #define CONFIGURATION_ARGUMENT_NODELAY                    "nodelay"
@@ -92,6 +97,12 @@ extern "C" {
 #define CONFIGURATION_ARGUMENT_USER                       "user"
 #define CONFIGURATION_ARGUMENT_DATA_DIR                   "data_dir"
 #define CONFIGURATION_ARGUMENT_WAL_DIR                    "wal_dir"
+#define CONFIGURATION_ARGUMENT_SHARD                      "shard"
+#define CONFIGURATION_ARGUMENT_APPLICATION_NAME           "application_name"
+#define CONFIGURATION_ARGUMENT_STATEMENT_TIMEOUT          "statement_timeout"
+#define CONFIGURATION_ARGUMENT_LOCK_TIMEOUT               "lock_timeout"
+#define CONFIGURATION_ARGUMENT_JIT                        "jit"
+#define CONFIGURATION_ARGUMENT_WORK_MEM                   "work_mem"
 #define CONFIGURATION_RESPONSE_STATUS                     "status"
 #define CONFIGURATION_RESPONSE_MESSAGE                    "message"
 #define CONFIGURATION_RESPONSE_OLD_VALUE                  "old_value"
@@ -49,6 +49,16 @@ extern "C" {
 int
 pgexporter_transfer_connection_write(int server);
 
+/**
+ * Transfer a descriptor to the process listening on a unix domain socket
+ * @param uds The name of the unix domain socket
+ * @param id The identifier sent along with the descriptor
+ * @param descriptor The descriptor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_transfer_descriptor_write(char* uds, int32_t id, int descriptor);
+
 /**
  * Read the connection
  * @param client_fd The client descriptor
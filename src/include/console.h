@@ -35,6 +35,18 @@ extern "C" {
 
 #include <pgexporter.h>
 
+#include <stdlib.h>
+
+/**
+ * Create the shared memory of the console, which keeps the selected
+ * categories between the requests
+ * @param p_size The size of the shared memory
+ * @param p_shmem The shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_console_init(size_t* p_size, void** p_shmem);
+
 /**
  * Handle console HTTP request
  * @param client_ssl The client SSL connection (can be NULL)
@@ -43,6 +55,16 @@ extern "C" {
 void
 pgexporter_console(SSL* client_ssl, int client_fd);
 
+/**
+ * Run the console stream worker. Viewers of /api/stream are handed over
+ * by the console on the stream socket, and after each metrics snapshot
+ * the values that changed are pushed to them as server-sent events.
+ * Runs until pgexporter shuts down and never returns
+ * @param stream_fd The listening stream socket
+ */
+void
+pgexporter_console_stream(int stream_fd);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_DERIVE_H
+#define PGEXPORTER_DERIVE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DERIVE_NONE  0
+#define DERIVE_RATE  1
+#define DERIVE_DELTA 2
+#define DERIVE_ONLY  4 /* The derived gauge replaces the counter */
+
+/**
+ * The number of series in the table
+ */
+#define DERIVE_NUMBER_OF_SERIES 65536
+
+/**
+ * The number of slots probed for a series
+ */
+#define DERIVE_PROBE 16
+
+/**
+ * The difference in seconds between two stats_reset values
+ * that is considered a reset of the statistics
+ */
+#define DERIVE_RESET_TOLERANCE 2
+
+/** @struct derive_series
+ * The previous sample of a counter series
+ */
+struct derive_series
+{
+   uint64_t key;  /**< The hash of the series, 0 if the slot is free */
+   int64_t time;  /**< The time of the sample in milliseconds */
+   int64_t reset; /**< The time of the last statistics reset in seconds, 0 if unknown */
+   double value;  /**< The value of the sample */
+};
+
+/** @struct derive_table
+ * The previous samples of the derived counters, shared by all scrapes.
+ * A series lives in one of DERIVE_PROBE slots from its hash and the
+ * oldest of them is replaced when they are all taken
+ */
+struct derive_table
+{
+   atomic_schar lock;                                    /**< The lock */
+   struct derive_series series[DERIVE_NUMBER_OF_SERIES]; /**< The series */
+};
+
+/**
+ * Create the shared memory of the derived counters
+ * @param p_size The size of the shared memory
+ * @param p_shmem The shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_derive_init(size_t* p_size, void** p_shmem);
+
+/**
+ * Parse the derive setting of a metric
+ * @param str The setting; rate, delta, rate_only or delta_only
+ * @param derive The derive flags
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_derive_parse(char* str, int* derive);
+
+/**
+ * Get the suffix of a derived gauge
+ * @param derive The derive flags
+ * @return The suffix
+ */
+char*
+pgexporter_derive_suffix(int derive);
+
+/**
+ * Is the column the statistics reset of a query
+ * @param name The column name
+ * @return True if stats_reset or stats_reset_seconds, otherwise false
+ */
+bool
+pgexporter_derive_is_reset(char* name);
+
+/**
+ * Hash a string into a series key
+ * @param hash The current hash, 0 to start a new key
+ * @param str The string
+ * @return The hash
+ */
+uint64_t
+pgexporter_derive_hash(uint64_t hash, char* str);
+
+/**
+ * Get the current time of the derived counters
+ * @return The time in milliseconds
+ */
+int64_t
+pgexporter_derive_now(void);
+
+/**
+ * Record a sample of a counter and derive its rate or delta
+ * from the previous sample. A counter that went backwards, or whose
+ * statistics reset moved, is treated as restarted from zero
+ * @param key The series key
+ * @param derive The derive flags
+ * @param now The time of the sample in milliseconds
+ * @param value The value of the counter
+ * @param reset The time of the last statistics reset in seconds, 0 if unknown
+ * @param result The rate per second or the delta
+ * @return True if a value was derived, false for the first sample of a series
+ */
+bool
+pgexporter_derive_sample(uint64_t key, int derive, int64_t now, double value, int64_t reset, double* result);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_DISK_H
+#define PGEXPORTER_DISK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * The data directory of a server
+ */
+#define DISK_DATA 0
+
+/**
+ * The WAL directory of a server
+ */
+#define DISK_WAL 1
+
+/**
+ * The interval between the refreshes of the disk process in milliseconds
+ */
+#define DISK_REFRESH_INTERVAL 1000
+
+/**
+ * The interval between the scans of the directories that aren't
+ * watched in seconds
+ */
+#define DISK_POLL_INTERVAL 60
+
+/**
+ * The interval between the full scans in seconds
+ */
+#define DISK_FULL_SCAN_INTERVAL 3600
+
+/** @struct disk
+ * The cached directory trees of the data and WAL directories
+ */
+struct disk;
+
+/**
+ * Is there a data or WAL directory to report
+ * @return True if so, otherwise false
+ */
+bool
+pgexporter_disk_enabled(void);
+
+/**
+ * Create a disk usage cache
+ * @param disk The resulting cache
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_disk_create(struct disk** disk);
+
+/**
+ * Add a directory to a disk usage cache. The directory isn't
+ * scanned until the next refresh
+ * @param disk The cache
+ * @param server The server
+ * @param kind The kind of directory (DISK_DATA or DISK_WAL)
+ * @param path The path of the directory
+ * @param pgdata Is the directory a data directory. If so, pg_wal is
+ *               skipped and the tablespaces are included
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_disk_add(struct disk* disk, int server, int kind, char* path, bool pgdata);
+
+/**
+ * Refresh a disk usage cache. Waits up to the timeout for changes, and then
+ * scans the directories that changed since the last refresh
+ * @param disk The cache
+ * @param timeout The timeout in milliseconds
+ * @return The number of directories scanned
+ */
+int
+pgexporter_disk_refresh(struct disk* disk, int timeout);
+
+/**
+ * Get the usage of the directories of a server
+ * @param disk The cache
+ * @param server The server
+ * @param kind The kind of directory (DISK_DATA or DISK_WAL)
+ * @param bytes The size of the files in bytes
+ * @param files The number of files
+ * @return 0 upon success, otherwise 1 if there is no such directory
+ */
+int
+pgexporter_disk_usage(struct disk* disk, int server, int kind, uint64_t* bytes, uint64_t* files);
+
+/**
+ * Destroy a disk usage cache
+ * @param disk The cache
+ */
+void
+pgexporter_disk_destroy(struct disk* disk);
+
+/**
+ * Run the disk process. Maintains the usage of the data and WAL
+ * directories of the servers in shared memory. Never returns
+ */
+void
+pgexporter_disk_run(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
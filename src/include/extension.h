@@ -77,7 +77,8 @@ int
 pgexporter_version_to_string(struct version* version, char* buffer, size_t buffer_size);
 
 /**
- * Load extension YAML files for all servers based on detected extensions
+ * Load extension YAML files for all servers based on detected extensions.
+ * Only the catalogs that are not loaded yet are read
  * @param config The configuration struct
  * @return 0 on success, 1 on error
  */
@@ -84,8 +84,22 @@ struct http_response
 {
    struct http_payload payload;                                   /**< Response payload */
    int status_code;                                               /**< HTTP status code */
-   size_t (*write_cb)(void* buffer, size_t size, void* userdata); /**< Write callback for streaming download */
+   size_t (*write_cb)(void* buffer, size_t size, void* userdata); /**< Body sink, called with the decoded body as it arrives. Returns size on success */
    void* write_userdata;                                          /**< User data for write callback */
+   bool decompress;                                               /**< Decompress a gzip or deflate Content-Encoding on the fly */
+};
+
+/** @struct http_line_sink
+ * A body sink that splits the body into lines. Use
+ * pgexporter_http_line_sink_write as the write_cb of the response
+ */
+struct http_line_sink
+{
+   int (*line_cb)(char* line, void* userdata); /**< Called for each line without the newline. Returns 0 on success */
+   void* userdata;                             /**< User data for the line callback */
+   char* line;                                 /**< The incomplete line */
+   size_t line_size;                           /**< The size of the incomplete line */
+   size_t line_capacity;                       /**< The capacity of the line buffer */
 };
 
 /** @struct http
@@ -179,10 +193,31 @@ char*
 pgexporter_http_get_response_header(struct http_response* response, char* name);
 
 /**
- * Execute a HTTP request
+ * Body sink callback that passes the complete lines to the line callback
+ * of a struct http_line_sink
+ * @param buffer The body data
+ * @param size The size of the body data
+ * @param userdata The line sink
+ * @return size upon success, otherwise 0
+ */
+size_t
+pgexporter_http_line_sink_write(void* buffer, size_t size, void* userdata);
+
+/**
+ * Pass the last line of the body to the line callback, and release the line buffer
+ * @param sink The line sink
+ * @return PGEXPORTER_HTTP_STATUS_OK upon success, otherwise PGEXPORTER_HTTP_STATUS_ERROR
+ */
+int
+pgexporter_http_line_sink_finish(struct http_line_sink* sink);
+
+/**
+ * Execute a HTTP request. A caller provided response can set a write_cb to
+ * receive the body in pieces as it arrives instead of in the payload, and
+ * decompress to have a compressed body decoded on the fly
  * @param connection The HTTP connection
  * @param request The HTTP request
- * @param response The resulting HTTP response
+ * @param response The resulting HTTP response, or a caller provided response
  * @return PGEXPORTER_HTTP_STATUS_OK upon success, otherwise PGEXPORTER_HTTP_STATUS_ERROR
  */
 int
@@ -34,14 +34,70 @@ extern "C" {
 #endif
 
 #include <openssl/ssl.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <sys/uio.h>
+
+#define HTTP_SERVER_MAX_HEADERS  64  /**< Maximum number of headers in a request */
+#define HTTP_SERVER_MAX_REQUESTS 100 /**< Maximum number of requests on a keep-alive connection */
+#define HTTP_SERVER_CHUNK_PIECES 64  /**< Maximum number of pieces in a chunk */
+
+#define HTTP_SERVER_KEEP_ALIVE_TIMEOUT 5000  /**< Milliseconds an idle keep-alive connection waits for its next request */
+#define HTTP_SERVER_WRITE_TIMEOUT      10000 /**< Milliseconds a response waits for a client that doesn't read */
+
+/** @struct http_server_slice
+ * A view into the receive buffer. The data is not zero terminated.
+ */
+struct http_server_slice
+{
+   char* data;    /**< Start of the slice, or NULL when not present */
+   size_t length; /**< Length of the slice in bytes */
+};
+
+/** @struct http_server_header
+ * A request header as views into the receive buffer.
+ */
+struct http_server_header
+{
+   struct http_server_slice name;  /**< The header name */
+   struct http_server_slice value; /**< The header value without surrounding whitespace */
+};
 
 /** @struct http_server_request
- * Parsed inbound HTTP request. Populated by pgexporter_http_server_parse().
+ * Parsed inbound HTTP request. All slices point into the receive buffer of
+ * the parser and are valid until the next request is read.
  */
 struct http_server_request
 {
-   char path[256]; /**< Request path extracted from the GET line (e.g. "/metrics") */
+   struct http_server_slice method;                            /**< The method (e.g. "GET") */
+   struct http_server_slice target;                            /**< The request target including the query */
+   struct http_server_slice path;                              /**< The path of the target (e.g. "/metrics") */
+   struct http_server_slice query;                             /**< The query of the target without the '?' */
+   int minor_version;                                          /**< The HTTP/1.x minor version */
+   struct http_server_header headers[HTTP_SERVER_MAX_HEADERS]; /**< The headers */
+   int number_of_headers;                                      /**< The number of headers */
+   struct http_server_slice body;                              /**< The body, framed by Content-Length */
+   bool keep_alive;                                            /**< Can the connection be reused */
+};
+
+/** @struct http_server_parser
+ * Incremental HTTP/1.1 request parser for one connection. Requests are parsed
+ * in place in the receive buffer, also when they are split across reads or
+ * when several requests arrive in one read (pipelining).
+ */
+struct http_server_parser
+{
+   SSL* ssl;                           /**< The SSL connection, or NULL for plain HTTP */
+   int fd;                             /**< The client socket file descriptor */
+   char* buffer;                       /**< The receive buffer */
+   size_t size;                        /**< The size of the receive buffer */
+   size_t length;                      /**< The number of bytes in the receive buffer */
+   size_t offset;                      /**< The start of the current request */
+   size_t scanned;                     /**< Bytes of the current request searched for the end of the headers */
+   int number_of_requests;             /**< The number of requests parsed on the connection */
+   struct http_server_request request; /**< The current request */
+   bool keep_alive;                    /**< Is the connection kept open after the current response */
+   struct http_server_parser* next;    /**< The next connection served by the process */
 };
 
 /**
@@ -78,50 +134,136 @@ int
 pgexporter_http_server_ssl_accept(SSL* ssl, int fd);
 
 /**
- * Read and parse an inbound HTTP request from the socket.
+ * Parse one HTTP request at the start of a buffer, in place.
  *
- * Calls pgexporter_read_timeout_message() using the configured authentication
- * timeout, then extracts the request path into a newly allocated
- * http_server_request. On failure (read error or malformed request) the
- * function returns MESSAGE_STATUS_ERROR and @p *req is set to NULL.
+ * Returns MESSAGE_STATUS_ZERO when the buffer doesn't hold a complete
+ * request yet, and MESSAGE_STATUS_ERROR when the request is malformed.
+ *
+ * @param data     The buffer
+ * @param length   The number of bytes in @p data
+ * @param req      Output: the request, as views into @p data
+ * @param consumed Output: the number of bytes of the request
+ * @return MESSAGE_STATUS_OK, MESSAGE_STATUS_ZERO, or MESSAGE_STATUS_ERROR
+ */
+int
+pgexporter_http_server_parse(char* data, size_t length, struct http_server_request* req, size_t* consumed);
+
+/**
+ * Create a request parser for a connection. Reads use the configured
+ * authentication timeout, and the wait for the next request on an idle
+ * keep-alive connection HTTP_SERVER_KEEP_ALIVE_TIMEOUT.
+ * @param ssl    The SSL connection, or NULL for plain HTTP
+ * @param fd     The client socket file descriptor
+ * @param parser Output: the parser
+ * @return 0 on success, otherwise 1
+ */
+int
+pgexporter_http_server_parser_create(SSL* ssl, int fd, struct http_server_parser** parser);
+
+/**
+ * Get the next request on the connection, reading from the socket only when
+ * the buffer doesn't hold a complete request. The previous request is
+ * invalidated.
  *
- * The caller must free the returned struct with
- * pgexporter_http_server_request_destroy() when done.
+ * Returns MESSAGE_STATUS_ZERO when the connection is closed or idle between
+ * requests, and MESSAGE_STATUS_ERROR on a read error or a malformed request.
  *
- * @param ssl The SSL connection, or NULL for plain HTTP
- * @param fd  The client socket file descriptor
- * @param req Output: pointer to the allocated request struct
- * @return MESSAGE_STATUS_OK on success, otherwise MESSAGE_STATUS_ERROR
+ * @param parser The parser
+ * @param req    Output: the request, owned by the parser
+ * @return MESSAGE_STATUS_OK, MESSAGE_STATUS_ZERO, or MESSAGE_STATUS_ERROR
  */
 int
-pgexporter_http_server_parse(SSL* ssl, int fd, struct http_server_request** req);
+pgexporter_http_server_parser_next(struct http_server_parser* parser, struct http_server_request** req);
 
 /**
- * Free an http_server_request allocated by pgexporter_http_server_parse().
- * Safe to call with NULL.
- * @param req The request to free
+ * Destroy a request parser. Safe to call with NULL.
+ * @param parser The parser
  */
 void
-pgexporter_http_server_request_destroy(struct http_server_request* req);
+pgexporter_http_server_parser_destroy(struct http_server_parser* parser);
+
+/**
+ * Find a header of a request. Header names are case insensitive.
+ * @param req   The request
+ * @param name  The header name
+ * @param value Output: the header value
+ * @return True if found, otherwise false
+ */
+bool
+pgexporter_http_server_header(struct http_server_request* req, const char* name, struct http_server_slice* value);
+
+/**
+ * Find a parameter in the query of a request. The value is not decoded.
+ * @param req   The request
+ * @param name  The parameter name
+ * @param value Output: the parameter value
+ * @return True if found, otherwise false
+ */
+bool
+pgexporter_http_server_query_param(struct http_server_request* req, const char* name, struct http_server_slice* value);
+
+/**
+ * Compare a slice with a string
+ * @param slice The slice
+ * @param str   The string
+ * @return True if equal, otherwise false
+ */
+bool
+pgexporter_http_server_slice_equals(struct http_server_slice* slice, const char* str);
+
+/**
+ * Copy a slice into a zero terminated string
+ * @param slice The slice
+ * @param out   The output buffer
+ * @param size  The size of @p out
+ * @return 0 on success, 1 if the slice doesn't fit
+ */
+int
+pgexporter_http_server_slice_copy(struct http_server_slice* slice, char* out, size_t size);
 
 /**
  * Dispatch a parsed request against a route table.
  *
  * Walks @p routes for an exact path match and calls the matching handler.
- * Sends a 403 if no route matches. The dispatch always returns after the
- * first matching route (or after sending the 403).
+ * Sends a 404 if no route matches, and a 400 for a method other than GET.
+ * The dispatch always returns after the first matching route (or after
+ * sending the error).
  *
  * @param ssl      The SSL connection, or NULL for plain HTTP
  * @param fd       The client socket file descriptor
- * @param req      The parsed request from pgexporter_http_server_parse()
+ * @param req      The parsed request
  * @param routes   Route table array
  * @param n_routes Number of entries in @p routes
- * @return MESSAGE_STATUS_OK on success, otherwise MESSAGE_STATUS_ERROR
+ * @return The status of the handler, or of the error response
  */
 int
 pgexporter_http_server_dispatch(SSL* ssl, int fd, struct http_server_request* req,
                                 struct http_route* routes, int n_routes);
 
+/**
+ * Serve the requests of a connection against a route table.
+ *
+ * Requests are answered in order until the client closes the connection,
+ * asks for it to be closed, or HTTP_SERVER_MAX_REQUESTS is reached.
+ * A malformed request is answered with a 400 and ends the connection.
+ *
+ * @param ssl      The SSL connection, or NULL for plain HTTP
+ * @param fd       The client socket file descriptor
+ * @param routes   Route table array
+ * @param n_routes Number of entries in @p routes
+ * @return MESSAGE_STATUS_OK on success, otherwise MESSAGE_STATUS_ERROR
+ */
+int
+pgexporter_http_server_serve(SSL* ssl, int fd, struct http_route* routes, int n_routes);
+
+/**
+ * Close the connection after the current request instead of waiting for
+ * the next one, e.g. when the handler handed the socket to another process.
+ * @param fd The client socket file descriptor
+ */
+void
+pgexporter_http_server_close(int fd);
+
 /**
  * Send an HTTP 200 OK response with a fixed-size body.
  * @param ssl          The SSL connection, or NULL for plain HTTP
@@ -195,6 +337,19 @@ pgexporter_http_respond_chunked_start(SSL* ssl, int fd, const char* content_type
 int
 pgexporter_http_respond_chunked_write(SSL* ssl, int fd, const char* data);
 
+/**
+ * Write one chunk made of several pieces in a chunked response.
+ * The pieces are written in place without being copied into a buffer.
+ * Must be called after pgexporter_http_respond_chunked_start().
+ * @param ssl   The SSL connection, or NULL for plain HTTP
+ * @param fd    The client socket file descriptor
+ * @param iov   The pieces of the chunk
+ * @param count The number of pieces
+ * @return MESSAGE_STATUS_OK on success, otherwise MESSAGE_STATUS_ERROR
+ */
+int
+pgexporter_http_respond_chunked_writev(SSL* ssl, int fd, struct iovec* iov, int count);
+
 /**
  * Finish a chunked response by sending the terminal zero-length chunk.
  * Must be called exactly once after all pgexporter_http_respond_chunked_write() calls.
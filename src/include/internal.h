@@ -75,6 +75,7 @@ extern "C" {
                       "    tag: pg_database_size\n"                                                                                                                                     \
                       "    sort: data\n"                                                                                                                                                \
                       "    collector: db\n"                                                                                                                                             \
+                      "    server: cluster\n"                                                                                                                                           \
                       "\n"                                                                                                                                                              \
                       "# locks_information()\n"                                                                                                                                         \
                       "  - queries:\n"                                                                                                                                                  \
@@ -261,48 +262,20 @@ extern "C" {
                       "    tag: pg_stat_bgwriter\n"                                                                                                                                     \
                       "    collector: stat_bgwriter\n"                                                                                                                                  \
                       "\n"                                                                                                                                                              \
-                      "# histogram sample\n"                                                                                                                                            \
+                      "# Idle seconds of each idle backend, bucketed by pgexporter\n"                                                                                                   \
                       "  - queries:\n"                                                                                                                                                  \
-                      "    - query: WITH\n"                                                                                                                                             \
-                      "              metrics AS (\n"                                                                                                                                    \
-                      "                SELECT\n"                                                                                                                                        \
-                      "                  application_name,\n"                                                                                                                           \
-                      "                  SUM(EXTRACT(EPOCH FROM (CURRENT_TIMESTAMP - state_change))::bigint)::float AS process_idle_seconds_sum,\n"                                     \
-                      "                  COUNT(*) AS process_idle_seconds_count\n"                                                                                                      \
-                      "                FROM pg_stat_activity\n"                                                                                                                         \
-                      "                WHERE state = 'idle'\n"                                                                                                                          \
-                      "                GROUP BY application_name\n"                                                                                                                     \
-                      "              ),\n"                                                                                                                                              \
-                      "              buckets AS (\n"                                                                                                                                    \
-                      "                SELECT\n"                                                                                                                                        \
-                      "                  application_name,\n"                                                                                                                           \
-                      "                  le,\n"                                                                                                                                         \
-                      "                  SUM(\n"                                                                                                                                        \
-                      "                    CASE WHEN EXTRACT(EPOCH FROM (CURRENT_TIMESTAMP - state_change)) <= le\n"                                                                    \
-                      "                      THEN 1\n"                                                                                                                                  \
-                      "                      ELSE 0\n"                                                                                                                                  \
-                      "                    END\n"                                                                                                                                       \
-                      "                  )::bigint AS bucket\n"                                                                                                                         \
-                      "                FROM\n"                                                                                                                                          \
-                      "                  pg_stat_activity,\n"                                                                                                                           \
-                      "                  UNNEST(ARRAY[1, 2, 5, 15, 30, 60, 90, 120, 300]) AS le\n"                                                                                      \
-                      "                GROUP BY application_name, le\n"                                                                                                                 \
-                      "                ORDER BY application_name, le\n"                                                                                                                 \
-                      "              )\n"                                                                                                                                               \
-                      "              SELECT\n"                                                                                                                                          \
+                      "    - query: SELECT\n"                                                                                                                                           \
                       "                application_name,\n"                                                                                                                             \
-                      "                process_idle_seconds_sum as seconds_sum,\n"                                                                                                      \
-                      "                process_idle_seconds_count as seconds_count,\n"                                                                                                  \
-                      "                ARRAY_AGG(le) AS seconds,\n"                                                                                                                     \
-                      "                ARRAY_AGG(bucket) AS seconds_bucket\n"                                                                                                           \
-                      "              FROM metrics JOIN buckets USING (application_name)\n"                                                                                              \
-                      "              GROUP BY 1, 2, 3;\n"                                                                                                                               \
+                      "                EXTRACT(EPOCH FROM (CURRENT_TIMESTAMP - state_change))::float AS seconds\n"                                                                      \
+                      "              FROM pg_stat_activity\n"                                                                                                                           \
+                      "              WHERE state = 'idle';\n"                                                                                                                           \
                       "      version: 10\n"                                                                                                                                             \
                       "      columns:\n"                                                                                                                                                \
                       "        - name: application_name\n"                                                                                                                              \
                       "          type: label\n"                                                                                                                                         \
                       "        - name: seconds\n"                                                                                                                                       \
                       "          type: histogram\n"                                                                                                                                     \
+                      "          buckets: [1, 2, 5, 15, 30, 60, 90, 120, 300]\n"                                                                                                        \
                       "          description: Histogram of idle processes\n"                                                                                                            \
                       "    tag: pg_process_idle_seconds\n"                                                                                                                              \
                       "    collector: idle_procs\n"                                                                                                                                     \
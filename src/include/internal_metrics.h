@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_INTERNAL_METRICS_H
+#define PGEXPORTER_INTERNAL_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+
+/**
+ * The internal metric catalog compiled from `INTERNAL_YAML` at build time
+ * by scripts/generate_internal_metrics.py. Only available when the build
+ * defines HAVE_INTERNAL_METRICS.
+ *
+ * The query alternatives of each metric point into a constant, pre-balanced
+ * AVL tree that is shared by all processes and must never be freed.
+ */
+
+/** The number of compiled metrics */
+extern const int pgexporter_internal_number_of_metrics;
+
+/** The compiled metrics */
+extern const struct prometheus pgexporter_internal_metrics[];
+
+/** The number of metric names derived from the compiled metrics */
+extern const int pgexporter_internal_number_of_metric_names;
+
+/** The metric names derived from the compiled metrics */
+extern const char* const pgexporter_internal_metric_names[];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -89,27 +89,39 @@ extern "C" {
 /**
  * Management arguments
  */
-#define MANAGEMENT_ARGUMENT_ACTIVE            "Active"
-#define MANAGEMENT_ARGUMENT_CLIENT_VERSION    "ClientVersion"
-#define MANAGEMENT_ARGUMENT_COMMAND           "Command"
-#define MANAGEMENT_ARGUMENT_COMPRESSION       "Compression"
-#define MANAGEMENT_ARGUMENT_CONFIG_KEY        "ConfigKey"
-#define MANAGEMENT_ARGUMENT_CONFIG_VALUE      "ConfigValue"
-#define MANAGEMENT_ARGUMENT_ENCRYPTION        "Encryption"
-#define MANAGEMENT_ARGUMENT_ERROR             "Error"
-#define MANAGEMENT_ARGUMENT_FIPS              "Fips"
-#define MANAGEMENT_ARGUMENT_MAJOR_VERSION     "MajorVersion"
-#define MANAGEMENT_ARGUMENT_MINOR_VERSION     "MinorVersion"
-#define MANAGEMENT_ARGUMENT_NUMBER_OF_SERVERS "NumberOfServers"
-#define MANAGEMENT_ARGUMENT_OUTPUT            "Output"
-#define MANAGEMENT_ARGUMENT_PGEXPORTER_FIPS   "PgexporterFips"
-#define MANAGEMENT_ARGUMENT_RESTART           "Restart"
-#define MANAGEMENT_ARGUMENT_SERVER            "Server"
-#define MANAGEMENT_ARGUMENT_SERVERS           "Servers"
-#define MANAGEMENT_ARGUMENT_SERVER_VERSION    "ServerVersion"
-#define MANAGEMENT_ARGUMENT_STATUS            "Status"
-#define MANAGEMENT_ARGUMENT_TIME              "Time"
-#define MANAGEMENT_ARGUMENT_TIMESTAMP         "Timestamp"
+#define MANAGEMENT_ARGUMENT_ACTIVE               "Active"
+#define MANAGEMENT_ARGUMENT_BYTES_RECEIVED       "BytesReceived"
+#define MANAGEMENT_ARGUMENT_CLIENT_VERSION       "ClientVersion"
+#define MANAGEMENT_ARGUMENT_COMMAND              "Command"
+#define MANAGEMENT_ARGUMENT_COMPRESSION          "Compression"
+#define MANAGEMENT_ARGUMENT_CONFIG_KEY           "ConfigKey"
+#define MANAGEMENT_ARGUMENT_CONFIG_VALUE         "ConfigValue"
+#define MANAGEMENT_ARGUMENT_CONNECTIONS          "Connections"
+#define MANAGEMENT_ARGUMENT_CONNECTIONS_REUSED   "ConnectionsReused"
+#define MANAGEMENT_ARGUMENT_CONNECTION_ERRORS    "ConnectionErrors"
+#define MANAGEMENT_ARGUMENT_DISCOVERY_AGE        "DiscoveryAge"
+#define MANAGEMENT_ARGUMENT_ENCRYPTION           "Encryption"
+#define MANAGEMENT_ARGUMENT_ERROR                "Error"
+#define MANAGEMENT_ARGUMENT_FAILED_SCRAPES       "FailedScrapes"
+#define MANAGEMENT_ARGUMENT_FIPS                 "Fips"
+#define MANAGEMENT_ARGUMENT_LAST_SCRAPE          "LastScrape"
+#define MANAGEMENT_ARGUMENT_LAST_SCRAPE_DURATION "LastScrapeDuration"
+#define MANAGEMENT_ARGUMENT_LAST_SUCCESS         "LastSuccess"
+#define MANAGEMENT_ARGUMENT_MAJOR_VERSION        "MajorVersion"
+#define MANAGEMENT_ARGUMENT_MINOR_VERSION        "MinorVersion"
+#define MANAGEMENT_ARGUMENT_NUMBER_OF_SERVERS    "NumberOfServers"
+#define MANAGEMENT_ARGUMENT_OUTPUT               "Output"
+#define MANAGEMENT_ARGUMENT_PGEXPORTER_FIPS      "PgexporterFips"
+#define MANAGEMENT_ARGUMENT_QUERIES              "Queries"
+#define MANAGEMENT_ARGUMENT_QUERY_ERRORS         "QueryErrors"
+#define MANAGEMENT_ARGUMENT_RESTART              "Restart"
+#define MANAGEMENT_ARGUMENT_SCRAPES              "Scrapes"
+#define MANAGEMENT_ARGUMENT_SERVER               "Server"
+#define MANAGEMENT_ARGUMENT_SERVERS              "Servers"
+#define MANAGEMENT_ARGUMENT_SERVER_VERSION       "ServerVersion"
+#define MANAGEMENT_ARGUMENT_STATUS               "Status"
+#define MANAGEMENT_ARGUMENT_TIME                 "Time"
+#define MANAGEMENT_ARGUMENT_TIMESTAMP            "Timestamp"
 
 /**
  * Management error
@@ -34,6 +34,7 @@ extern "C" {
 #endif
 
 #include <pgexporter.h>
+#include <deque.h>
 
 #include <stdbool.h>
 #include <stdlib.h>
@@ -303,11 +304,12 @@ pgexporter_create_ssl_message(struct message** msg);
  * Create a startup message
  * @param username The user name
  * @param database The database
+ * @param parameters The run-time parameters of the session, or NULL
  * @param msg The resulting message
  * @return 0 upon success, otherwise 1
  */
 int
-pgexporter_create_startup_message(char* username, char* database, struct message** msg);
+pgexporter_create_startup_message(char* username, char* database, struct deque* parameters, struct message** msg);
 
 #ifdef __cplusplus
 }
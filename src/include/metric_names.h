@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_METRIC_NAMES_H
+#define PGEXPORTER_METRIC_NAMES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#define METRIC_NAMES_INITIAL_CAPACITY 1024
+#define METRIC_NAMES_INITIAL_STRINGS  (64 * 1024)
+
+/**
+ * The metric name registry is an open-addressing hash set of the metric
+ * names loaded into a configuration. The names are interned in one shared
+ * memory segment together with the slots, and are kept in insertion order.
+ * The registry grows by rebuilding into a segment twice the size.
+ */
+
+/** @struct metric_names
+ * Defines the metric name registry. The slots, the insertion order and
+ * the interned strings follow the structure in the same segment
+ */
+struct metric_names
+{
+   size_t size;              /**< The size of the segment */
+   uint32_t capacity;        /**< The number of slots, a power of two */
+   uint32_t number_of_names; /**< The number of names */
+   size_t strings_size;      /**< The size of the string area */
+   size_t strings_used;      /**< The used part of the string area */
+};
+
+/**
+ * Create a metric name registry
+ * @param capacity The minimum number of slots
+ * @param strings_size The minimum size of the string area
+ * @param names The resulting registry
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_metric_names_create(uint32_t capacity, size_t strings_size, struct metric_names** names);
+
+/**
+ * Add a name to a registry. The registry is created or grown when needed,
+ * and adding a name already present is a no-op
+ * @param names The registry, may point to NULL
+ * @param name The name
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_metric_names_add(struct metric_names** names, char* name);
+
+/**
+ * Check if a registry contains a name
+ * @param names The registry, may be NULL
+ * @param name The name
+ * @return true if the name is present, otherwise false
+ */
+bool
+pgexporter_metric_names_contains(struct metric_names* names, char* name);
+
+/**
+ * Get the number of names in a registry
+ * @param names The registry, may be NULL
+ * @return The number of names
+ */
+int
+pgexporter_metric_names_count(struct metric_names* names);
+
+/**
+ * Get a name by its insertion index
+ * @param names The registry
+ * @param index The index
+ * @return The name, or NULL if out of range
+ */
+char*
+pgexporter_metric_names_get(struct metric_names* names, int index);
+
+/**
+ * Destroy a registry
+ * @param names The registry, may be NULL
+ */
+void
+pgexporter_metric_names_destroy(struct metric_names* names);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
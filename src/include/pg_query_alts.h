@@ -85,6 +85,15 @@ pgexporter_insert_pg_node_avl(struct pg_query_alts* root, struct pg_query_alts**
 void
 pgexporter_copy_pg_query_alts(struct pg_query_alts** dst, struct pg_query_alts* src);
 
+/**
+ * @brief Check if two query alternative trees hold the same queries
+ * @param a The first tree
+ * @param b The second tree
+ * @return true if the trees are identical, otherwise false
+ */
+bool
+pgexporter_is_same_pg_query_alts(struct pg_query_alts* a, struct pg_query_alts* b);
+
 /**
  * @brief Free the Query Alternatives of a configuration
  * @param configuration The configuration
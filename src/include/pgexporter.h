@@ -52,8 +52,10 @@ extern "C" {
 
 #define MAIN_UDS                     ".s.pgexporter"
 #define TRANSFER_UDS                 ".s.pgexporter.tu"
+#define STREAM_UDS                   ".s.pgexporter.st"
 
 #define MAX_NUMBER_OF_COLUMNS        32
+#define MAX_NUMBER_OF_BUCKETS        32
 
 #define MAX_PROCESS_TITLE_LENGTH     256
 
@@ -78,7 +80,7 @@ extern "C" {
 #define NUMBER_OF_EXTENSIONS         64
 #define NUMBER_OF_ALERTS             64
 #define NUMBER_OF_DATABASES          64
-#define NUMBER_OF_METRIC_NAMES       1024
+#define NUMBER_OF_SHARDS             16
 #define MAX_METRIC_COLUMNS           2048
 
 #define STATE_FREE                   0
@@ -130,6 +132,7 @@ extern "C" {
 #define SERVER_QUERY_BOTH            0 /* Default */
 #define SERVER_QUERY_PRIMARY         1
 #define SERVER_QUERY_REPLICA         2
+#define SERVER_QUERY_CLUSTER         3
 
 enum alert_operator {
    ALERT_OPERATOR_GT, /* ">"  */
@@ -145,6 +148,12 @@ enum alert_type {
    ALERT_TYPE_CONNECTION /* No SQL, checks fd == -1 */
 };
 
+enum alert_state {
+   ALERT_STATE_INACTIVE, /* The condition does not hold */
+   ALERT_STATE_PENDING,  /* The condition holds, but not for long enough */
+   ALERT_STATE_FIRING    /* The condition has held for the whole 'for' duration */
+};
+
 #define SERVER_UNDERTERMINED_VERSION 0
 
 #define ENCRYPTION_NONE              0
@@ -272,6 +281,42 @@ extern void* bridge_cache_shmem;
  */
 extern void* bridge_json_cache_shmem;
 
+/**
+ * Shared memory used to contain the TLS
+ * session cache and ticket keys.
+ */
+extern void* tls_session_shmem;
+
+/**
+ * Shared memory used to contain the rendered
+ * metrics of each shard.
+ */
+extern void* shard_shmem;
+
+/**
+ * Shared memory used to contain the previous
+ * samples of the derived counters.
+ */
+extern void* derive_shmem;
+
+/**
+ * Shared memory used to contain the last
+ * known rows of the sliced metrics.
+ */
+extern void* slice_shmem;
+
+/**
+ * Shared memory used to contain the aggregates
+ * of the pg_stat_activity sampler.
+ */
+extern void* activity_shmem;
+
+/**
+ * Shared memory used to contain the categories
+ * selected by the console.
+ */
+extern void* console_shmem;
+
 /**
  * @struct version
  * Semantic version structure for extensions (major.minor.patch format)
@@ -295,6 +340,40 @@ struct extension_info
    struct version installed_version; /**< The installed version */
 } __attribute__((aligned(64)));
 
+/** @struct server_statistics
+ * Runtime statistics of a server, maintained by the scrape path so
+ * that they can be reported without triggering a scrape
+ */
+struct server_statistics
+{
+   atomic_ulong scrapes;              /**< The number of scrapes */
+   atomic_ulong failed_scrapes;       /**< The number of scrapes without a connection */
+   atomic_llong last_scrape;          /**< The time of the last scrape */
+   atomic_llong last_success;         /**< The time of the last scrape with a connection */
+   atomic_ulong last_scrape_duration; /**< The time spent on the server in the last scrape in microseconds */
+   atomic_ulong busy_time;            /**< The total time spent connecting to and querying the server in microseconds */
+   atomic_ulong queries;              /**< The number of queries */
+   atomic_ulong query_errors;         /**< The number of failed queries */
+   atomic_ulong bytes_received;       /**< The number of bytes received */
+   atomic_ulong connections;          /**< The number of connections established */
+   atomic_ulong connections_reused;   /**< The number of times an open connection was reused */
+   atomic_ulong connection_errors;    /**< The number of failed connection attempts */
+   atomic_llong discovery;            /**< The time the databases and extensions were discovered */
+};
+
+/** @struct disk_usage
+ * The usage of a directory of a server, maintained by the disk process
+ */
+struct disk_usage
+{
+   atomic_ullong used;   /**< The size of the files in bytes */
+   atomic_ullong files;  /**< The number of files */
+   atomic_ullong free;   /**< The free space of the file system in bytes */
+   atomic_ullong total;  /**< The size of the file system in bytes */
+   atomic_ulong scans;   /**< The number of directories scanned */
+   atomic_llong updated; /**< The time of the last update, 0 if none */
+};
+
 /** @struct server
  * Defines a server
  */
@@ -323,6 +402,16 @@ struct server
    struct extension_info extensions[NUMBER_OF_EXTENSIONS]; /**< The extensions */
    char extensions_config[MAX_EXTENSIONS_CONFIG_LENGTH];   /**< Server-specific extensions configuration */
    int fips_enabled;                                       /**< FIPS mode status */
+   int shard;                                              /**< The metrics shard (-1 = by name) */
+   char application_name[MISC_LENGTH];                     /**< The application_name of the session */
+   pgexporter_time_t statement_timeout;                    /**< The statement_timeout of the session */
+   pgexporter_time_t lock_timeout;                         /**< The lock_timeout of the session */
+   bool jit;                                               /**< Is JIT compilation left on for the session */
+   char work_mem[MISC_LENGTH];                             /**< The work_mem of the session */
+   char system_identifier[MISC_LENGTH];                    /**< The system identifier of the cluster, empty if unknown */
+   bool cluster_warned;                                    /**< Was a failure to detect the cluster logged */
+   struct server_statistics statistics;                    /**< The runtime statistics */
+   struct disk_usage disk[2];                              /**< The usage of the data and WAL directories */
 
 } __attribute__((aligned(64)));
 
@@ -362,9 +451,11 @@ struct prometheus_cache
  */
 struct column
 {
-   int type;                            /**< Metrics type 0--label 1--counter 2--gauge 3--histogram*/
-   char name[PROMETHEUS_LENGTH];        /**< Column name */
-   char description[PROMETHEUS_LENGTH]; /**< Description of column */
+   int type;                              /**< Metrics type 0--label 1--counter 2--gauge 3--histogram*/
+   char name[PROMETHEUS_LENGTH];          /**< Column name */
+   char description[PROMETHEUS_LENGTH];   /**< Description of column */
+   int n_buckets;                         /**< Number of bucket bounds, 0 if the query returns the buckets itself */
+   double buckets[MAX_NUMBER_OF_BUCKETS]; /**< Increasing upper bounds of the buckets the observations are counted into */
 } __attribute__((aligned(64)));
 
 /** @struct prometheus
@@ -374,12 +465,15 @@ struct prometheus
 {
    char tag[PROMETHEUS_LENGTH];          /**< The metric name */
    int sort_type;                        /**< Sorting type of multi queries 0--SORT_NAME 1--SORT_DATA0 */
-   int server_query_type;                /**< Query type 0--SERVER_QUERY_BOTH 1--SERVER_QUERY_PRIMARY 2--SERVER_QUERY_REPLICA */
+   int server_query_type;                /**< Query type 0--SERVER_QUERY_BOTH 1--SERVER_QUERY_PRIMARY 2--SERVER_QUERY_REPLICA 3--SERVER_QUERY_CLUSTER */
    bool exec_on_all_dbs;                 /**< Execute on all databases */
    bool optional;                        /**< If true, suppress warning on query failure */
+   int derive;                           /**< Derived gauges of the counters DERIVE_NONE, DERIVE_RATE or DERIVE_DELTA, optionally with DERIVE_ONLY */
+   int slices;                           /**< The number of slices queried in turn, 0 or 1 to query everything */
    char collector[MAX_COLLECTOR_LENGTH]; /**< Collector Tag for query */
    struct pg_query_alts* pg_root;        /**< Root of the Query Alternatives' AVL Tree for PostgreSQL core queries*/
    struct ext_query_alts* ext_root;      /**< Root of the Query Alternatives' AVL Tree for PostgreSQL extension queries*/
+   bool compiled;                        /**< Query alternatives are compiled into the binary and must not be freed */
 } __attribute__((aligned(64)));
 
 /** @struct extension_metrics
@@ -387,9 +481,11 @@ struct prometheus
  */
 struct extension_metrics
 {
-   char extension_name[PROMETHEUS_LENGTH];       /**< Extension name (e.g., "pg_stat_statements") */
-   int number_of_metrics;                        /**< Number of metrics for this extension */
-   struct prometheus metrics[NUMBER_OF_METRICS]; /**< The actual metrics for this extension */
+   char extension_name[PROMETHEUS_LENGTH]; /**< Extension name (e.g., "pg_stat_statements") */
+   int number_of_metrics;                  /**< Number of metrics for this extension */
+   int capacity;                           /**< Number of allocated metrics */
+   unsigned int generation;                /**< The load that allocated the metrics */
+   struct prometheus* metrics;             /**< The actual metrics for this extension, in shared memory */
 } __attribute__((aligned(64)));
 
 /** @struct endpoint
@@ -401,20 +497,36 @@ struct endpoint
    int port;               /**< The port */
 } __attribute__((aligned(64)));
 
+/** @struct alert_status
+ * The evaluation state of an alert on a server
+ */
+struct alert_status
+{
+   atomic_int state;     /**< The alert_state */
+   atomic_bool valid;    /**< Did the last evaluation produce a result */
+   atomic_llong value;   /**< The last value */
+   atomic_llong since;   /**< The time the current state was entered */
+   atomic_llong updated; /**< The time of the last evaluation */
+};
+
 /** @struct alert_definition
  * Defines an alert metric loaded from YAML
  */
 struct alert_definition
 {
-   char name[PROMETHEUS_LENGTH];                 /**< The alert name */
-   char description[PROMETHEUS_LENGTH];          /**< The HELP description */
-   char query[MAX_QUERY_LENGTH];                 /**< The SQL query (empty for connection alerts) */
-   enum alert_type alert_type;                   /**< ALERT_TYPE_QUERY or ALERT_TYPE_CONNECTION */
-   enum alert_operator operator;                 /**< Comparison operator */
-   int64_t threshold;                            /**< Threshold value */
-   bool servers_all;                             /**< Target all servers */
-   int number_of_servers;                        /**< Number of target servers */
-   char servers[NUMBER_OF_SERVERS][MISC_LENGTH]; /**< Target server names */
+   char name[PROMETHEUS_LENGTH];                  /**< The alert name */
+   char description[PROMETHEUS_LENGTH];           /**< The HELP description */
+   char query[MAX_QUERY_LENGTH];                  /**< The SQL query (empty for connection alerts) */
+   enum alert_type alert_type;                    /**< ALERT_TYPE_QUERY or ALERT_TYPE_CONNECTION */
+   enum alert_operator operator;                  /**< Comparison operator */
+   int64_t threshold;                             /**< Threshold value */
+   pgexporter_time_t for_duration;                /**< How long the condition must hold before firing */
+   bool hysteresis;                               /**< Is a clear threshold defined */
+   int64_t clear_threshold;                       /**< Threshold a firing alert is compared against */
+   bool servers_all;                              /**< Target all servers */
+   int number_of_servers;                         /**< Number of target servers */
+   char servers[NUMBER_OF_SERVERS][MISC_LENGTH];  /**< Target server names */
+   struct alert_status status[NUMBER_OF_SERVERS]; /**< The state on each server */
 } __attribute__((aligned(64)));
 
 /** @struct configuration
@@ -433,6 +545,8 @@ struct configuration
    pgexporter_time_t metrics_cache_max_age; /**< Cache duration for Prometheus response */
    size_t metrics_cache_max_size;           /**< Number of bytes max to cache the Prometheus response */
    pgexporter_time_t metrics_query_timeout; /**< Timeout for metric queries */
+   int metrics_shards;                      /**< The number of scraper shards (0 = disabled) */
+   int activity_sampling;                   /**< The pg_stat_activity samples per second (0 = disabled) */
    int management;                          /**< The management port */
    int console;                             /**< The console port */
 
@@ -461,8 +575,11 @@ struct configuration
    int bridge_history_backend;                 /**< The bridge history storage backend */
    char bridge_history_path[MAX_PATH];         /**< Path for the bridge history storage file */
 
-   bool cache;          /**< Cache connection */
-   bool alerts_enabled; /**< Is alerting enabled */
+   bool cache;                        /**< Cache connection */
+   bool alerts_enabled;               /**< Is alerting enabled */
+   pgexporter_time_t alerts_interval; /**< Interval between alert evaluations */
+   atomic_bool alerts_worker_running; /**< State of the alert evaluator */
+   atomic_int alerts_worker_pid;      /**< PID of the forked alert evaluator (0 if none) */
 
    int log_type;                       /**< The logging type */
    int log_level;                      /**< The logging level */
@@ -481,6 +598,7 @@ struct configuration
    char metrics_cert_file[MAX_PATH]; /**< Metrics TLS certificate path */
    char metrics_key_file[MAX_PATH];  /**< Metrics TLS key path */
    char metrics_ca_file[MAX_PATH];   /**< Metrics TLS CA certificate path */
+   bool metrics_ktls;                /**< Offload metrics TLS records to the kernel */
 
    pgexporter_time_t blocking_timeout;       /**< The blocking timeout */
    pgexporter_time_t authentication_timeout; /**< The authentication timeout */
@@ -506,9 +624,10 @@ struct configuration
    int number_of_excluded_collectors; /**< Number of total exclude collectors */
    int number_of_endpoints;           /**< The number of endpoints */
    int number_of_extensions;          /**< Number of loaded extensions */
-   int number_of_metric_names;        /**< Number of unique metric names */
+   atomic_bool extensions_detected;   /**< Was an extension without a loaded catalog detected */
 
-   char metrics_path[MAX_PATH]; /**< The metrics path */
+   char metrics_path[MAX_PATH];    /**< The metrics path */
+   char yaml_cache_path[MAX_PATH]; /**< The directory of the precompiled YAML metric cache */
 
    int number_of_alerts;                             /**< The number of alerts */
    struct alert_definition alerts[NUMBER_OF_ALERTS]; /**< The alert definitions */
@@ -524,14 +643,14 @@ struct configuration
    char allowed_collectors[NUMBER_OF_COLLECTORS][MAX_COLLECTOR_LENGTH];  /**< List of allowed collectors */
    char excluded_collectors[NUMBER_OF_COLLECTORS][MAX_COLLECTOR_LENGTH]; /**< List of excluded collectors */
 
-   char global_extensions[MAX_EXTENSIONS_CONFIG_LENGTH];         /**< Global extensions configuration */
-   char metric_names[NUMBER_OF_METRIC_NAMES][PROMETHEUS_LENGTH]; /**< List of all the metric names */
-   struct server servers[NUMBER_OF_SERVERS];                     /**< The servers */
-   struct user users[NUMBER_OF_USERS];                           /**< The users */
-   struct user admins[NUMBER_OF_ADMINS];                         /**< The admins */
-   struct prometheus prometheus[NUMBER_OF_METRICS];              /**< The Prometheus metrics */
-   struct endpoint endpoints[NUMBER_OF_ENDPOINTS];               /**< The Prometheus metrics */
-   struct extension_metrics extensions[NUMBER_OF_EXTENSIONS];    /**< Extension metrics by extension */
+   char global_extensions[MAX_EXTENSIONS_CONFIG_LENGTH];      /**< Global extensions configuration */
+   struct metric_names* metric_names;                         /**< The registry of all the metric names */
+   struct server servers[NUMBER_OF_SERVERS];                  /**< The servers */
+   struct user users[NUMBER_OF_USERS];                        /**< The users */
+   struct user admins[NUMBER_OF_ADMINS];                      /**< The admins */
+   struct prometheus prometheus[NUMBER_OF_METRICS];           /**< The Prometheus metrics */
+   struct endpoint endpoints[NUMBER_OF_ENDPOINTS];            /**< The Prometheus metrics */
+   struct extension_metrics extensions[NUMBER_OF_EXTENSIONS]; /**< Extension metrics by extension */
 } __attribute__((aligned(64)));
 
 #ifdef __cplusplus
@@ -38,6 +38,8 @@ extern "C" {
 #include <ev.h>
 #include <stdlib.h>
 
+struct prometheus_bridge;
+
 /**
  * ART-based metrics container for each category
  */
@@ -69,6 +71,38 @@ typedef struct prometheus_metrics_container
 int
 pgexporter_prometheus_scrape(prometheus_metrics_container_t** container);
 
+/**
+ * Scrape the servers of a shard and populate the container.
+ *
+ * The connections are kept open for the next scrape of the shard.
+ * On success the caller owns *container and must release it with pgexporter_prometheus_destroy_container().
+ *
+ * @param container The pointer to store the allocated and populated container
+ * @param global Include the metrics about pgexporter itself
+ * @return 0 on success, 1 on failure
+ */
+int
+pgexporter_prometheus_shard_scrape(prometheus_metrics_container_t** container, bool global);
+
+/**
+ * Fill a bridge with the current metrics of this pgexporter.
+ *
+ * The metrics are read from the fragments of the shards, or from the metrics
+ * cache when it is valid and not being rebuilt. Otherwise they are scraped in
+ * process. A long-lived process must not share the connections of the
+ * servers, so it reads the last scrape in the cache even once it has expired,
+ * and gets nothing when there is none.
+ *
+ * Each source holds the text exposition of the metrics, which is parsed into
+ * the bridge without going through a socket.
+ *
+ * @param bridge The bridge
+ * @param in_process Scrape in this process when nothing is cached
+ * @return 0 on success, 1 on failure
+ */
+int
+pgexporter_prometheus_snapshot(struct prometheus_bridge* bridge, bool in_process);
+
 /**
  * Destroy a metrics container
  *
@@ -126,6 +160,12 @@ pgexporter_prometheus(SSL* client_ssl, int fd);
 void
 pgexporter_prometheus_reset(void);
 
+/**
+ * Invalidate the metrics response cache
+ */
+void
+pgexporter_prometheus_invalidate_cache(void);
+
 /**
  * Add a logging count
  * @param logging The logging type
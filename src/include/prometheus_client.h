@@ -116,6 +116,17 @@ pgexporter_prometheus_client_destroy_bridge(struct prometheus_bridge* bridge);
 int
 pgexporter_prometheus_client_get(int endpoint, struct prometheus_bridge* bridge);
 
+/**
+ * Parse metrics in the Prometheus text format into the bridge.
+ * Lines before the first metric are ignored
+ * @param endpoint The endpoint label of the metrics as host:port
+ * @param data The metrics, terminated in place during the parse and restored
+ * @param bridge The ART containing all bridge metrics.
+ * @return 0 if success, otherwise 1
+ */
+int
+pgexporter_prometheus_client_parse(char* endpoint, char* data, struct prometheus_bridge* bridge);
+
 #ifdef __cplusplus
 }
 #endif
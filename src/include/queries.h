@@ -36,6 +36,7 @@ extern "C" {
 #include <pgexporter.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /** @struct tuple
  * Defines a tuple
@@ -91,6 +92,22 @@ struct query_alts_base
 int
 pgexporter_check_pg_monitor_role(int server);
 
+/**
+ * Restrict this process to a subset of the servers. Connections are only
+ * opened, used and closed for the servers in the mask
+ * @param mask The bit mask of the servers, UINT64_MAX for all servers
+ */
+void
+pgexporter_set_server_mask(uint64_t mask);
+
+/**
+ * Is a server handled by this process
+ * @param server The server
+ * @return True if the server is in the server mask, otherwise false
+ */
+bool
+pgexporter_server_owned(int server);
+
 /**
  * Open database connections
  */
@@ -103,6 +120,20 @@ pgexporter_open_connections(void);
 void
 pgexporter_close_connections(void);
 
+/**
+ * Mark the start of a scrape in the server statistics
+ * @param busy_time The busy time of each server at the start of the scrape
+ */
+void
+pgexporter_scrape_statistics_begin(uint64_t* busy_time);
+
+/**
+ * Record the end of a scrape in the server statistics
+ * @param busy_time The busy time of each server at the start of the scrape
+ */
+void
+pgexporter_scrape_statistics_end(uint64_t* busy_time);
+
 /**
  * Execute query
  * @param server The server
@@ -114,6 +145,20 @@ pgexporter_close_connections(void);
 int
 pgexporter_query_execute(int server, char* sql, char* tag, struct query** query);
 
+/**
+ * Execute query on a connection of its own, which is not counted in the
+ * query and server statistics of the scrapes
+ * @param server The server
+ * @param ssl The SSL structure of the connection
+ * @param socket The socket of the connection
+ * @param sql The SQL query
+ * @param tag The tag
+ * @param query The resulting query
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_query_execute_socket(int server, SSL* ssl, int socket, char* sql, char* tag, struct query** query);
+
 /**
  * Execute a command that doesn't return result sets
  * @param server The server
@@ -150,6 +195,15 @@ pgexporter_query_uptime(int server, struct query** query);
 int
 pgexporter_query_primary(int server, struct query** query);
 
+/**
+ * Query the system identifier of the cluster
+ * @param server The server
+ * @param query The resulting query
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_query_system_identifier(int server, struct query** query);
+
 /**
  * Query pg_database for size
  * @param server The server
@@ -36,6 +36,7 @@ extern "C" {
 #include <pgexporter.h>
 #include <deque.h>
 
+#include <stdatomic.h>
 #include <stdlib.h>
 
 #include <openssl/ssl.h>
@@ -44,6 +45,49 @@ extern "C" {
  * can force on us. Well above PostgreSQL's default of 4096. */
 #define SCRAM_MAX_ITERATIONS 100000
 
+#define TLS_TICKET_KEY_NAME_LENGTH 16
+#define TLS_TICKET_KEY_LENGTH      32
+#define TLS_TICKET_KEY_ROTATION_MS 3600000
+
+#define TLS_SESSION_CACHE_SIZE     256
+#define TLS_SESSION_ID_LENGTH      32
+#define TLS_SESSION_DATA_LENGTH    2048
+
+/** @struct tls_ticket_key
+ * A session ticket encryption key
+ */
+struct tls_ticket_key
+{
+   unsigned char name[TLS_TICKET_KEY_NAME_LENGTH]; /**< The key name sent in the ticket */
+   unsigned char aes_key[TLS_TICKET_KEY_LENGTH];   /**< The AES-256 key */
+   unsigned char hmac_key[TLS_TICKET_KEY_LENGTH];  /**< The HMAC-SHA256 key */
+};
+
+/** @struct tls_session
+ * A serialized TLS session
+ */
+struct tls_session
+{
+   unsigned int id_length;                      /**< The length of the session id */
+   unsigned char id[TLS_SESSION_ID_LENGTH];     /**< The session id */
+   unsigned int length;                         /**< The length of the session data */
+   unsigned char data[TLS_SESSION_DATA_LENGTH]; /**< The DER encoded session */
+};
+
+/** @struct tls_session_cache
+ * The TLS session state shared by the HTTPS listeners.
+ * Tickets are sealed with the current key and the previous key is kept
+ * so tickets issued before a rotation can still be resumed once
+ */
+struct tls_session_cache
+{
+   atomic_schar lock;                                   /**< The lock */
+   int current;                                         /**< The index of the current ticket key */
+   struct tls_ticket_key keys[2];                       /**< The current and the previous ticket key */
+   int next;                                            /**< The next session slot to replace */
+   struct tls_session sessions[TLS_SESSION_CACHE_SIZE]; /**< The server session cache */
+};
+
 /**
  * Authenticate a user
  * @param server The server
@@ -140,6 +184,48 @@ pgexporter_create_ssl_ctx(bool client, SSL_CTX** ctx);
 int
 pgexporter_create_ssl_server(SSL_CTX* ctx, char* key, char* cert, char* root, int socket, SSL** ssl);
 
+/**
+ * Create the shared memory for the TLS session cache and the ticket keys
+ * @param p_size The resulting size of the segment
+ * @param p_shmem The resulting segment
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_tls_session_init(size_t* p_size, void** p_shmem);
+
+/**
+ * Rotate the session ticket keys
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_tls_session_rotate(void);
+
+/**
+ * Enable session tickets and the shared session cache for a server SSL context
+ * @param ctx The SSL context
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_enable_tls_session_resumption(SSL_CTX* ctx);
+
+/**
+ * Request kernel TLS offload for the connections of a SSL context.
+ * OpenSSL falls back to user space encryption per connection when the
+ * kernel TLS module or the negotiated cipher isn't supported
+ * @param ctx The SSL context
+ * @return 0 upon success, 1 if OpenSSL was built without kernel TLS
+ */
+int
+pgexporter_enable_ktls(SSL_CTX* ctx);
+
+/**
+ * Is the send side of a connection offloaded to kernel TLS
+ * @param ssl The SSL structure
+ * @return True if offloaded, otherwise false
+ */
+bool
+pgexporter_is_ktls(SSL* ssl);
+
 #ifdef __cplusplus
 }
 #endif
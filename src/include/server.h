@@ -33,6 +33,9 @@
 extern "C" {
 #endif
 
+#include <deque.h>
+
+#include <stdbool.h>
 #include <stdlib.h>
 
 /**
@@ -43,6 +46,26 @@ extern "C" {
 int
 pgexporter_server_info(int srv);
 
+/**
+ * Get the run-time parameters that the sessions of a server
+ * are started with, so no round trip is needed to set them
+ * @param srv The server index
+ * @param parameters The resulting parameters
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_server_session(int srv, struct deque** parameters);
+
+/**
+ * Is a server the one that collects the cluster-wide metrics of its
+ * cluster. The connected servers sharing a system identifier form a
+ * cluster, which is led by its primary, otherwise by its first server
+ * @param srv The server index
+ * @return True if the server leads its cluster, or its cluster is unknown, otherwise false
+ */
+bool
+pgexporter_server_cluster_leader(int srv);
+
 #ifdef __cplusplus
 }
 #endif
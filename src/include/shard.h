@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_SHARD_H
+#define PGEXPORTER_SHARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+#include <prometheus_client.h>
+
+#include <openssl/ssl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The size of a fragment buffer of a shard
+ */
+#define SHARD_FRAGMENT_SIZE (4 * 1024 * 1024)
+
+/**
+ * The default interval between the scrapes of a shard in seconds
+ */
+#define SHARD_DEFAULT_INTERVAL 15
+
+/**
+ * The number of readers of a fragment buffer at the same time
+ */
+#define SHARD_READERS 64
+
+/**
+ * The time a publish waits for the readers of a buffer in milliseconds
+ */
+#define SHARD_PUBLISH_TIMEOUT 5000
+
+/** @struct shard_fragment
+ * The rendered metrics of a shard.
+ *
+ * A shard renders into the buffer that isn't active and then makes it the
+ * active one, so readers never wait for a scrape. Each buffer holds the
+ * metric families of the shard sorted by name, and every family is stored
+ * as its name, its #HELP / #TYPE lines and its samples.
+ *
+ * A reader holds a slot with its pid while it reads a buffer. The shard
+ * only takes a buffer over when all of its readers are gone, and frees the
+ * slots of readers that died; with a live reader the old metrics stay.
+ */
+struct shard_fragment
+{
+   atomic_int active;                     /**< The buffer being read, -1 until the first scrape */
+   atomic_int readers[2][SHARD_READERS];  /**< The pids of the readers of each buffer, 0 for a free slot */
+   size_t size[2];                        /**< The number of bytes used in each buffer */
+   atomic_llong updated;                  /**< The time of the last scrape */
+   atomic_int servers;                    /**< The number of servers of the shard */
+} __attribute__((aligned(64)));
+
+/**
+ * Create the shared memory of the shard fragments
+ * @param p_size The size of the shared memory
+ * @param p_shmem The shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_shard_init(size_t* p_size, void** p_shmem);
+
+/**
+ * Get the shard of a server. A server without an explicit shard
+ * is placed by a hash of its name
+ * @param server The server
+ * @return The shard
+ */
+int
+pgexporter_shard_of(int server);
+
+/**
+ * Get the servers of a shard. The mask has a bit for each of the
+ * NUMBER_OF_SERVERS (64) servers, the size of the server table
+ * @param shard The shard
+ * @return The bit mask of the servers
+ */
+uint64_t
+pgexporter_shard_servers(int shard);
+
+/**
+ * Run a shard. The shard scrapes its servers on its own schedule
+ * and publishes the metrics in its fragment. Never returns
+ * @param shard The shard
+ */
+void
+pgexporter_shard_run(int shard);
+
+/**
+ * Publish metrics in the Prometheus text format in the fragment of a shard.
+ * The metrics are grouped by family, and the readers of the previous
+ * metrics are waited for
+ * @param shard The shard
+ * @param text The metrics
+ * @return 0 upon success, 1 if the fragment is still read or on error
+ */
+int
+pgexporter_shard_publish(int shard, char* text);
+
+/**
+ * Merge the metrics of all shards into the Prometheus text format.
+ * The header of a family is written once, followed by the samples of
+ * every shard
+ * @param data The zero terminated metrics, NULL if no shard has published
+ * @param size The length of the metrics
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_shard_merge(char** data, size_t* size);
+
+/**
+ * Write the metrics of all shards as the body of a chunked /metrics
+ * response, including the response headers. The families of the fragments
+ * are merged by name and written straight out of the shared memory
+ * @param client_ssl The client SSL
+ * @param client_fd The client descriptor
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_shard_output(SSL* client_ssl, int client_fd);
+
+/**
+ * Fill a bridge with the metrics of all shards
+ * @param endpoint The endpoint label of the metrics as host:port
+ * @param bridge The bridge
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_shard_snapshot(char* endpoint, struct prometheus_bridge* bridge);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
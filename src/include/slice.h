@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef PGEXPORTER_SLICE_H
+#define PGEXPORTER_SLICE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+#include <queries.h>
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of slices of a metric
+ */
+#define SLICE_MAX 256
+
+/**
+ * The minimum number of sliced results that are kept. The table has an
+ * entry for each sliced metric of each server
+ */
+#define SLICE_NUMBER_OF_ENTRIES 32
+
+/**
+ * The size of the rows kept for a sliced result
+ */
+#define SLICE_ENTRY_SIZE (1024 * 1024)
+
+/** @struct slice_entry
+ * The rows of the last scrape of each slice of a query. A row is
+ * kept as its slice and server followed by the length, or -1 for NULL,
+ * and the bytes of each column
+ */
+struct slice_entry
+{
+   uint64_t key;                                         /**< The hash of the tag, server and database, 0 if the entry is free */
+   uint64_t used;                                        /**< The clock of the last merge */
+   int slices;                                           /**< The number of slices */
+   int cursor;                                           /**< The next slice to query */
+   int number_of_columns;                                /**< The number of columns of the rows */
+   char names[MAX_NUMBER_OF_COLUMNS][PROMETHEUS_LENGTH]; /**< The column names */
+   int type_oids[MAX_NUMBER_OF_COLUMNS];                 /**< The PostgreSQL type OIDs */
+   size_t size;                                          /**< The size of the rows */
+   char data[SLICE_ENTRY_SIZE];                          /**< The rows */
+};
+
+/** @struct slice_table
+ * The sliced results, shared by all scrapes. The least recently
+ * merged entry is replaced when they are all taken, which is logged
+ * as the slices of that result start over
+ */
+struct slice_table
+{
+   atomic_schar lock;            /**< The lock */
+   uint64_t clock;               /**< The number of merges */
+   int number_of_entries;        /**< The number of entries */
+   struct slice_entry entries[]; /**< The entries */
+};
+
+/**
+ * Create the shared memory of the sliced results. Nothing is created
+ * while no metric is sliced
+ * @param p_size The size of the shared memory
+ * @param p_shmem The shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_slice_init(size_t* p_size, void** p_shmem);
+
+/**
+ * Grow the shared memory of the sliced results when the metrics or the
+ * servers need more entries, or create it for the first sliced metric.
+ * The known rows are dropped, and processes forked before keep the
+ * previous table until they are restarted
+ * @param p_size The size of the shared memory
+ * @param p_shmem The shared memory
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_slice_resize(size_t* p_size, void** p_shmem);
+
+/**
+ * Validate the slices of a query
+ * @param slices The number of slices
+ * @param derive The derive flags of the metric
+ * @param query The query
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_slice_validate(int slices, int derive, char* query);
+
+/**
+ * Get the key of a sliced result
+ * @param tag The metric tag
+ * @param server The server name
+ * @param database The database name, or NULL
+ * @return The key
+ */
+uint64_t
+pgexporter_slice_key(char* tag, char* server, char* database);
+
+/**
+ * Get the slice to query next
+ * @param key The key
+ * @param slices The number of slices
+ * @return The slice
+ */
+int
+pgexporter_slice_next(uint64_t key, int slices);
+
+/**
+ * Replace the {slice} and {slices} placeholders of a query
+ * @param query The query
+ * @param slices The number of slices
+ * @param slice The slice
+ * @return The query, which must be freed
+ */
+char*
+pgexporter_slice_query(char* query, int slices, int slice);
+
+/**
+ * Keep the rows of a slice and add the last known rows of the
+ * other slices to the result, then move on to the next slice
+ * @param key The key
+ * @param slices The number of slices
+ * @param slice The slice that was queried
+ * @param query The result of the slice
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_slice_merge(uint64_t key, int slices, int slice, struct query* query);
+
+/**
+ * Move on from a slice that failed, and get the last known rows
+ * of all slices
+ * @param key The key
+ * @param slices The number of slices
+ * @param slice The slice that failed
+ * @param tag The metric tag
+ * @param query The known rows, NULL if there are none
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_slice_skip(uint64_t key, int slices, int slice, char* tag, struct query** query);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
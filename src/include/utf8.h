@@ -50,6 +50,24 @@ pgexporter_utf8_char_length(const unsigned char* buf, size_t len);
 bool
 pgexporter_is_ascii(const char* str, size_t len);
 
+/**
+ * Get the length of the ASCII prefix of a byte buffer.
+ * @param buf The byte buffer.
+ * @param len The length of the buffer in bytes.
+ * @return The number of bytes before the first non-ASCII byte.
+ */
+size_t
+pgexporter_ascii_length(const unsigned char* buf, size_t len);
+
+/**
+ * Replaces the bytes that aren't part of a valid UTF-8 sequence with '?'.
+ * @param buf The byte buffer.
+ * @param len The length of the buffer in bytes.
+ * @return The number of bytes replaced.
+ */
+size_t
+pgexporter_utf8_sanitize(unsigned char* buf, size_t len);
+
 /**
  * Validates if the entire byte buffer contains valid UTF-8.
  * @param buf The UTF-8 byte buffer.
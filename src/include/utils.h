@@ -695,6 +695,15 @@ pgexporter_starts_with(char* str, char* prefix);
 bool
 pgexporter_ends_with(char* str, char* suffix);
 
+/**
+ * Fold a string into a FNV-1a hash
+ * @param hash The hash of the preceding strings, or 0 to start a new hash
+ * @param str The string
+ * @return The hash
+ */
+uint64_t
+pgexporter_hash_string(uint64_t hash, const char* str);
+
 /**
  * Remove whitespace from a string
  * @param orig The original string
@@ -860,6 +869,27 @@ pgexporter_os_kernel_version(char** os, int* kernel_major, int* kernel_minor, in
 bool
 pgexporter_is_valid_metric_name(char* name);
 
+/**
+ * Parse the upper bounds of histogram buckets, separated by commas
+ * @param str The bounds, such as "1, 2, 5"
+ * @param buckets The resulting bounds
+ * @param n_buckets The resulting number of bounds
+ * @return 0 upon success, 1 if a bound isn't a finite number, the bounds aren't
+ *         increasing or there are more than MAX_NUMBER_OF_BUCKETS of them
+ */
+int
+pgexporter_parse_buckets(char* str, double* buckets, int* n_buckets);
+
+/**
+ * Find the first bucket whose upper bound holds a value
+ * @param buckets The increasing upper bounds
+ * @param n_buckets The number of bounds
+ * @param value The value
+ * @return The index of the bucket, or n_buckets for the +Inf bucket
+ */
+int
+pgexporter_bucket_index(double* buckets, int n_buckets, double value);
+
 /**
  * Check and set directory path using caller-provided buffer
  * @param directory_path Directory to search for path
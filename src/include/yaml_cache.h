@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PGEXPORTER_YAML_CACHE_H
+#define PGEXPORTER_YAML_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <pgexporter.h>
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#define YAML_CACHE_MAGIC   "PGEXYMLC"
+#define YAML_CACHE_VERSION 4
+#define YAML_CACHE_SUFFIX  ".cache"
+
+/**
+ * The YAML cache holds the post-semantics metric definitions of one
+ * YAML metric file, so an unchanged file can be restored without running
+ * the YAML parser. A cache file is tied to the pgexporter version and
+ * structure layout that wrote it, and is only used when the modification
+ * time or the SHA-256 hash of the YAML file matches.
+ */
+
+/** @struct yaml_cache
+ * Defines a mapped YAML cache file
+ */
+struct yaml_cache
+{
+   void* data;                        /**< The mapped cache file */
+   size_t size;                       /**< The size of the mapping */
+   bool is_extension;                 /**< Is the YAML file an extension file */
+   char extension_name[MISC_LENGTH];  /**< The extension name */
+   int number_of_metrics;             /**< The number of metrics */
+   int number_of_metric_names;        /**< The number of metric names */
+};
+
+/**
+ * Open the cache of a YAML file.
+ * The cache is only returned when it is valid for the current content of the file.
+ * @param config The configuration
+ * @param path The path of the YAML file
+ * @param cache The resulting cache
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_yaml_cache_open(struct configuration* config, char* path, struct yaml_cache** cache);
+
+/**
+ * Restore the metric definitions of a cache.
+ * Nothing is changed if the metric names conflict with the existing ones,
+ * and the destination metrics are cleared again when the restore fails.
+ * @param config The configuration
+ * @param cache The cache
+ * @param prometheus The destination metrics
+ * @param max The number of available destination metrics
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_yaml_cache_restore(struct configuration* config, struct yaml_cache* cache, struct prometheus* prometheus, int max);
+
+/**
+ * Close a cache
+ * @param cache The cache
+ */
+void
+pgexporter_yaml_cache_close(struct yaml_cache* cache);
+
+/**
+ * Store the metric definitions loaded from a YAML file in its cache.
+ * @param config The configuration
+ * @param path The path of the YAML file
+ * @param extension_name The extension name, or NULL for a metrics file
+ * @param prometheus The metrics loaded from the file
+ * @param number_of_metrics The number of metrics
+ * @param metric_names_start The index of the first metric name added by the file
+ * @return 0 upon success, otherwise 1
+ */
+int
+pgexporter_yaml_cache_store(struct configuration* config, char* path, char* extension_name,
+                            struct prometheus* prometheus, int number_of_metrics, int metric_names_start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -68,6 +68,25 @@ pgexporter_read_internal_yaml_metrics(struct configuration* config, bool start);
 int
 pgexporter_read_yaml_from_file_pointer(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, FILE* file);
 
+/**
+ * Is the metric catalog of an extension loaded
+ * @param config The configuration
+ * @param extension_name The name of the extension
+ * @return True if the catalog has metrics, otherwise false
+ */
+bool
+pgexporter_is_extension_yaml_loaded(struct configuration* config, char* extension_name);
+
+/**
+ * Is the metric catalog of an extension mapped in this process. A catalog
+ * is loaded by the main process, so the processes forked before the load
+ * don't have its shared memory
+ * @param ext The extension
+ * @return True if the catalog can be used, otherwise false
+ */
+bool
+pgexporter_is_extension_mapped(struct extension_metrics* ext);
+
 /**
  * Find and load a specific extension's YAML file
  * @param extensions_path The base extensions directory path
@@ -78,6 +97,19 @@ pgexporter_read_yaml_from_file_pointer(struct configuration* config, struct prom
 int
 pgexporter_load_single_extension_yaml(char* extensions_path, char* extension_name, struct configuration* config);
 
+/**
+ * Find and load the YAML files of a list of extensions. The files are parsed
+ * in parallel and loaded in the order of the list. Extensions whose catalog
+ * is already loaded are skipped
+ * @param extensions_path The base extensions directory path
+ * @param extension_names The names of the extensions
+ * @param number_of_extensions The number of extensions
+ * @param config The configuration to load into
+ * @return 0 on success, 1 if any of the files couldn't be loaded
+ */
+int
+pgexporter_load_extension_yaml_list(char* extensions_path, char** extension_names, int number_of_extensions, struct configuration* config);
+
 #ifdef __cplusplus
 }
 #endif
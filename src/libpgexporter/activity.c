@@ -0,0 +1,659 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <activity.h>
+#include <logging.h>
+#include <memory.h>
+#include <message.h>
+#include <network.h>
+#include <queries.h>
+#include <security.h>
+#include <shmem.h>
+#include <utils.h>
+
+/* system */
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ACTIVITY_STATEMENT_TIMEOUT 1000
+
+#define ACTIVITY_QUERY                                                        \
+   "SELECT pid, COALESCE(state, ''), COALESCE(wait_event_type, ''), "         \
+   "COALESCE(wait_event, ''), COALESCE(backend_type, '') "                    \
+   "FROM pg_stat_activity WHERE pid <> pg_backend_pid() ORDER BY pid;"
+
+/** @struct wait
+ * A session that is waiting
+ */
+struct wait
+{
+   int pid;       /**< The process */
+   int type;      /**< The wait event type */
+   int event;     /**< The wait event, -1 if there is no room for it */
+   int64_t start; /**< The time of the first sample that saw the wait */
+};
+
+const char* const pgexporter_activity_states[ACTIVITY_NUMBER_OF_STATES] = {
+   "active",
+   "idle",
+   "idle in transaction",
+   "idle in transaction (aborted)",
+   "fastpath function call",
+   "disabled",
+};
+
+const char* const pgexporter_activity_wait_types[ACTIVITY_NUMBER_OF_WAIT_TYPES] = {
+   "Activity",
+   "BufferPin",
+   "Client",
+   "Extension",
+   "InjectionPoint",
+   "IO",
+   "IPC",
+   "Lock",
+   "LWLock",
+   "Timeout",
+   "Other",
+};
+
+const uint64_t pgexporter_activity_session_bounds[ACTIVITY_NUMBER_OF_BUCKETS] = {
+   0, 1, 2, 4, 8, 16, 32, 64, 128, 256,
+};
+
+const uint64_t pgexporter_activity_wait_bounds[ACTIVITY_NUMBER_OF_BUCKETS] = {
+   100, 250, 500, 1000, 2500, 5000, 10000, 30000, 60000, 300000,
+};
+
+/* The waits of the previous sample of each server, sorted by pid */
+static struct wait* waits[NUMBER_OF_SERVERS];
+static int number_of_waits[NUMBER_OF_SERVERS];
+
+static int session_compare(const void* a, const void* b);
+static struct wait* find_wait(struct wait* list, int number, int pid);
+static int counter_index(struct activity_counter* counters, int number, char* type, char* name);
+static void observe(struct activity_histogram* histogram, const uint64_t* bounds, uint64_t value);
+static int state_index(char* state);
+static int wait_type_index(char* type);
+static int sample(int server, SSL* ssl, int socket, int64_t now);
+static int connect_server(int server, SSL** ssl, int* socket);
+static void disconnect_server(SSL** ssl, int* socket);
+static void forget(int server);
+static int64_t now_ms(void);
+
+bool
+pgexporter_activity_enabled(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->metrics <= 0 || config->activity_sampling <= 0 || activity_shmem == NULL)
+   {
+      return false;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (config->servers[i].type != SERVER_TYPE_PROMETHEUS)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+int
+pgexporter_activity_init(size_t* p_size, void** p_shmem)
+{
+   size_t size;
+   void* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   size = NUMBER_OF_SERVERS * sizeof(struct activity_server);
+
+   /* The mapping is zeroed, which is the initial state of the aggregates */
+   if (pgexporter_create_shared_memory(size, config->hugepage, &s))
+   {
+      return 1;
+   }
+
+   *p_size = size;
+   *p_shmem = s;
+
+   return 0;
+}
+
+struct activity_server*
+pgexporter_activity_server(int server)
+{
+   if (activity_shmem == NULL || server < 0 || server >= NUMBER_OF_SERVERS)
+   {
+      return NULL;
+   }
+
+   return (struct activity_server*)activity_shmem + server;
+}
+
+int
+pgexporter_activity_record(int server, struct activity_session* sessions, int number_of_sessions, int64_t now)
+{
+   int index;
+   int type;
+   int event;
+   int active = 0;
+   int number = 0;
+   struct wait* current = NULL;
+   struct wait* previous = NULL;
+   struct activity_server* aggregates = NULL;
+
+   aggregates = pgexporter_activity_server(server);
+   if (aggregates == NULL)
+   {
+      goto error;
+   }
+
+   if (number_of_sessions > 0)
+   {
+      qsort(sessions, number_of_sessions, sizeof(struct activity_session), session_compare);
+
+      current = (struct wait*)malloc(number_of_sessions * sizeof(struct wait));
+      if (current == NULL)
+      {
+         goto error;
+      }
+   }
+
+   for (int i = 0; i < number_of_sessions; i++)
+   {
+      index = state_index(sessions[i].state);
+      if (index != -1)
+      {
+         atomic_fetch_add(&aggregates->states[index], 1);
+
+         if (index == 0)
+         {
+            active++;
+         }
+      }
+
+      if (strlen(sessions[i].backend_type) > 0)
+      {
+         index = counter_index(&aggregates->backend_types[0], ACTIVITY_NUMBER_OF_BACKEND_TYPES, "", sessions[i].backend_type);
+         if (index != -1)
+         {
+            atomic_fetch_add(&aggregates->backend_types[index].samples, 1);
+         }
+      }
+
+      if (strlen(sessions[i].wait_event_type) == 0)
+      {
+         continue;
+      }
+
+      type = wait_type_index(sessions[i].wait_event_type);
+      event = counter_index(&aggregates->wait_events[0], ACTIVITY_NUMBER_OF_WAIT_EVENTS,
+                            sessions[i].wait_event_type, sessions[i].wait_event);
+      if (event != -1)
+      {
+         atomic_fetch_add(&aggregates->wait_events[event].samples, 1);
+      }
+
+      /* The same wait as in the previous sample goes on */
+      previous = find_wait(waits[server], number_of_waits[server], sessions[i].pid);
+
+      current[number].pid = sessions[i].pid;
+      current[number].type = type;
+      current[number].event = event;
+      if (previous != NULL && previous->type == type && previous->event == event)
+      {
+         current[number].start = previous->start;
+      }
+      else
+      {
+         current[number].start = now;
+      }
+      number++;
+   }
+
+   /* The waits that are gone ended since the previous sample */
+   for (int i = 0; i < number_of_waits[server]; i++)
+   {
+      previous = &waits[server][i];
+      struct wait* next = find_wait(current, number, previous->pid);
+
+      if (next == NULL || next->start != previous->start)
+      {
+         observe(&aggregates->waits[previous->type], &pgexporter_activity_wait_bounds[0],
+                 (uint64_t)(now > previous->start ? now - previous->start : 0));
+      }
+   }
+
+   free(waits[server]);
+   waits[server] = current;
+   number_of_waits[server] = number;
+
+   observe(&aggregates->active, &pgexporter_activity_session_bounds[0], (uint64_t)active);
+   atomic_fetch_add(&aggregates->samples, 1);
+
+   return 0;
+
+error:
+
+   free(current);
+
+   return 1;
+}
+
+void
+pgexporter_activity_clear(void)
+{
+   for (int server = 0; server < NUMBER_OF_SERVERS; server++)
+   {
+      forget(server);
+   }
+}
+
+void
+pgexporter_activity_run(void)
+{
+   int64_t start;
+   int64_t interval;
+   int64_t elapsed;
+   SSL* ssl[NUMBER_OF_SERVERS] = {0};
+   int sockets[NUMBER_OF_SERVERS];
+   int64_t retry[NUMBER_OF_SERVERS] = {0};
+   struct activity_server* aggregates = NULL;
+   pid_t parent = getppid();
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgexporter_start_logging();
+   pgexporter_memory_init();
+
+   /* The handlers of the main process don't apply here, and the
+    * connections are closed by the kernel when the sampler stops */
+   signal(SIGTERM, SIG_DFL);
+   signal(SIGINT, SIG_DFL);
+   signal(SIGHUP, SIG_IGN);
+
+   interval = 1000 / config->activity_sampling;
+
+   for (int server = 0; server < NUMBER_OF_SERVERS; server++)
+   {
+      sockets[server] = -1;
+   }
+
+   /* The servers may have moved since the last run */
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+
+      if (strcmp(aggregates->server, config->servers[server].name))
+      {
+         memset(aggregates, 0, sizeof(struct activity_server));
+         pgexporter_snprintf(aggregates->server, sizeof(aggregates->server), "%s", config->servers[server].name);
+      }
+   }
+
+   pgexporter_log_debug("Activity: sampling %d servers every %" PRId64 "ms", config->number_of_servers, interval);
+
+   /* Also stop when the main process went away without a shutdown */
+   while (config->keep_running && getppid() == parent)
+   {
+      start = now_ms();
+
+      for (int server = 0; server < config->number_of_servers; server++)
+      {
+         if (config->servers[server].type == SERVER_TYPE_PROMETHEUS)
+         {
+            continue;
+         }
+
+         if (sockets[server] == -1)
+         {
+            if (start < retry[server])
+            {
+               continue;
+            }
+
+            if (connect_server(server, &ssl[server], &sockets[server]))
+            {
+               retry[server] = start + ACTIVITY_RECONNECT_INTERVAL;
+               continue;
+            }
+         }
+
+         if (sample(server, ssl[server], sockets[server], start))
+         {
+            atomic_fetch_add(&pgexporter_activity_server(server)->errors, 1);
+
+            /* A wait can't be measured across a gap */
+            disconnect_server(&ssl[server], &sockets[server]);
+            forget(server);
+            retry[server] = start + ACTIVITY_RECONNECT_INTERVAL;
+         }
+      }
+
+      elapsed = now_ms() - start;
+      if (elapsed < interval)
+      {
+         SLEEP((interval - elapsed) * 1000000L);
+      }
+   }
+
+   for (int server = 0; server < NUMBER_OF_SERVERS; server++)
+   {
+      disconnect_server(&ssl[server], &sockets[server]);
+   }
+
+   pgexporter_activity_clear();
+
+   pgexporter_memory_destroy();
+   pgexporter_stop_logging();
+
+   exit(0);
+}
+
+static int
+session_compare(const void* a, const void* b)
+{
+   const struct activity_session* s1 = (const struct activity_session*)a;
+   const struct activity_session* s2 = (const struct activity_session*)b;
+
+   return (s1->pid > s2->pid) - (s1->pid < s2->pid);
+}
+
+static struct wait*
+find_wait(struct wait* list, int number, int pid)
+{
+   int low = 0;
+   int high = number - 1;
+   int middle;
+
+   while (low <= high)
+   {
+      middle = low + (high - low) / 2;
+
+      if (list[middle].pid == pid)
+      {
+         return &list[middle];
+      }
+      else if (list[middle].pid < pid)
+      {
+         low = middle + 1;
+      }
+      else
+      {
+         high = middle - 1;
+      }
+   }
+
+   return NULL;
+}
+
+static int
+counter_index(struct activity_counter* counters, int number, char* type, char* name)
+{
+   uint64_t hash = pgexporter_hash_string(0, name);
+   int index;
+
+   /* The sampler is the only writer, so a counter is claimed by filling
+    * in its names before it is marked as used */
+   for (int i = 0; i < number; i++)
+   {
+      index = (int)((hash + (uint64_t)i) % (uint64_t)number);
+
+      if (!atomic_load(&counters[index].used))
+      {
+         pgexporter_snprintf(counters[index].type, ACTIVITY_NAME_LENGTH, "%s", type);
+         pgexporter_snprintf(counters[index].name, ACTIVITY_NAME_LENGTH, "%s", name);
+         atomic_store(&counters[index].used, true);
+         return index;
+      }
+
+      if (!strncmp(counters[index].name, name, ACTIVITY_NAME_LENGTH - 1) &&
+          !strncmp(counters[index].type, type, ACTIVITY_NAME_LENGTH - 1))
+      {
+         return index;
+      }
+   }
+
+   return -1;
+}
+
+static void
+observe(struct activity_histogram* histogram, const uint64_t* bounds, uint64_t value)
+{
+   for (int i = 0; i < ACTIVITY_NUMBER_OF_BUCKETS; i++)
+   {
+      if (value <= bounds[i])
+      {
+         atomic_fetch_add(&histogram->buckets[i], 1);
+         break;
+      }
+   }
+
+   atomic_fetch_add(&histogram->sum, value);
+   atomic_fetch_add(&histogram->count, 1);
+}
+
+static int
+state_index(char* state)
+{
+   for (int i = 0; i < ACTIVITY_NUMBER_OF_STATES; i++)
+   {
+      if (!strcmp(state, pgexporter_activity_states[i]))
+      {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+static int
+wait_type_index(char* type)
+{
+   for (int i = 0; i < ACTIVITY_NUMBER_OF_WAIT_TYPES - 1; i++)
+   {
+      if (!strcmp(type, pgexporter_activity_wait_types[i]))
+      {
+         return i;
+      }
+   }
+
+   return ACTIVITY_NUMBER_OF_WAIT_TYPES - 1;
+}
+
+static int
+sample(int server, SSL* ssl, int socket, int64_t now)
+{
+   int number = 0;
+   int count = 0;
+   struct query* query = NULL;
+   struct activity_session* sessions = NULL;
+
+   if (pgexporter_query_execute_socket(server, ssl, socket, ACTIVITY_QUERY, "activity", &query))
+   {
+      goto error;
+   }
+
+   for (struct tuple* tuple = query->tuples; tuple != NULL; tuple = tuple->next)
+   {
+      count++;
+   }
+
+   if (count > 0)
+   {
+      sessions = (struct activity_session*)calloc(count, sizeof(struct activity_session));
+      if (sessions == NULL)
+      {
+         goto error;
+      }
+   }
+
+   for (struct tuple* tuple = query->tuples; tuple != NULL; tuple = tuple->next)
+   {
+      if (pgexporter_get_column(0, tuple) == NULL)
+      {
+         continue;
+      }
+
+      sessions[number].pid = atoi(pgexporter_get_column(0, tuple));
+      pgexporter_snprintf(sessions[number].state, ACTIVITY_NAME_LENGTH, "%s",
+                          pgexporter_get_column(1, tuple) != NULL ? pgexporter_get_column(1, tuple) : "");
+      pgexporter_snprintf(sessions[number].wait_event_type, ACTIVITY_NAME_LENGTH, "%s",
+                          pgexporter_get_column(2, tuple) != NULL ? pgexporter_get_column(2, tuple) : "");
+      pgexporter_snprintf(sessions[number].wait_event, ACTIVITY_NAME_LENGTH, "%s",
+                          pgexporter_get_column(3, tuple) != NULL ? pgexporter_get_column(3, tuple) : "");
+      pgexporter_snprintf(sessions[number].backend_type, ACTIVITY_NAME_LENGTH, "%s",
+                          pgexporter_get_column(4, tuple) != NULL ? pgexporter_get_column(4, tuple) : "");
+      number++;
+   }
+
+   if (pgexporter_activity_record(server, sessions, number, now))
+   {
+      goto error;
+   }
+
+   free(sessions);
+   pgexporter_free_query(query);
+
+   return 0;
+
+error:
+
+   free(sessions);
+   pgexporter_free_query(query);
+
+   return 1;
+}
+
+static int
+connect_server(int server, SSL** ssl, int* socket)
+{
+   int user = -1;
+   char sql[MISC_LENGTH];
+   struct query* query = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int usr = 0; user == -1 && usr < config->number_of_users; usr++)
+   {
+      if (!strcmp(&config->users[usr].username[0], &config->servers[server].username[0]))
+      {
+         user = usr;
+      }
+   }
+
+   if (user == -1)
+   {
+      pgexporter_log_debug("Activity: no user '%s' configured for server '%s'",
+                           &config->servers[server].username[0], &config->servers[server].name[0]);
+      goto error;
+   }
+
+   if (pgexporter_server_authenticate(server, "postgres",
+                                      &config->users[user].username[0], &config->users[user].password[0],
+                                      ssl, socket) != AUTH_SUCCESS)
+   {
+      pgexporter_log_debug("Activity: failed login for '%s' on server '%s'",
+                           &config->users[user].username[0], &config->servers[server].name[0]);
+      goto error;
+   }
+
+   /* A sample must not hold up the next one for long */
+   pgexporter_snprintf(&sql[0], sizeof(sql), "SELECT set_config('statement_timeout', '%d', false);", ACTIVITY_STATEMENT_TIMEOUT);
+   if (pgexporter_query_execute_socket(server, *ssl, *socket, &sql[0], "activity", &query))
+   {
+      goto error;
+   }
+   pgexporter_free_query(query);
+
+   pgexporter_log_debug("Activity: sampling server '%s'", &config->servers[server].name[0]);
+
+   return 0;
+
+error:
+
+   disconnect_server(ssl, socket);
+
+   return 1;
+}
+
+static void
+disconnect_server(SSL** ssl, int* socket)
+{
+   if (*socket == -1)
+   {
+      return;
+   }
+
+   pgexporter_write_terminate(*ssl, *socket);
+
+   if (*ssl != NULL)
+   {
+      pgexporter_close_ssl(*ssl);
+      *ssl = NULL;
+   }
+
+   pgexporter_disconnect(*socket);
+   *socket = -1;
+}
+
+static void
+forget(int server)
+{
+   free(waits[server]);
+   waits[server] = NULL;
+   number_of_waits[server] = 0;
+}
+
+static int64_t
+now_ms(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
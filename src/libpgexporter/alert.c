@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <alert.h>
+#include <connection.h>
+#include <logging.h>
+#include <queries.h>
+#include <utils.h>
+
+/* system */
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static bool alert_condition(struct alert_definition* alert, int state, int64_t value);
+static void alert_worker(void);
+
+bool
+pgexporter_alert_applies(struct alert_definition* alert, int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (alert->servers_all || alert->number_of_servers == 0)
+   {
+      return true;
+   }
+
+   for (int s = 0; s < alert->number_of_servers; s++)
+   {
+      if (!strcmp(alert->servers[s], config->servers[server].name))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+bool
+pgexporter_alert_compare(int64_t value, enum alert_operator op, int64_t threshold)
+{
+   switch (op)
+   {
+      case ALERT_OPERATOR_GT:
+         return value > threshold;
+      case ALERT_OPERATOR_LT:
+         return value < threshold;
+      case ALERT_OPERATOR_GE:
+         return value >= threshold;
+      case ALERT_OPERATOR_LE:
+         return value <= threshold;
+      case ALERT_OPERATOR_EQ:
+         return value == threshold;
+      case ALERT_OPERATOR_NE:
+         return value != threshold;
+      default:
+         return false;
+   }
+}
+
+int
+pgexporter_alert_transition(struct alert_definition* alert, int server, int64_t value, time_t now)
+{
+   int state;
+   int next;
+   struct alert_status* status = NULL;
+
+   status = &alert->status[server];
+
+   state = atomic_load(&status->state);
+
+   if (!alert_condition(alert, state, value))
+   {
+      next = ALERT_STATE_INACTIVE;
+   }
+   else if (state == ALERT_STATE_FIRING)
+   {
+      next = ALERT_STATE_FIRING;
+   }
+   else if (state == ALERT_STATE_PENDING &&
+            (int64_t)difftime(now, (time_t)atomic_load(&status->since)) * 1000 >= alert->for_duration.ms)
+   {
+      next = ALERT_STATE_FIRING;
+   }
+   else if (state == ALERT_STATE_INACTIVE && alert->for_duration.ms <= 0)
+   {
+      next = ALERT_STATE_FIRING;
+   }
+   else
+   {
+      next = ALERT_STATE_PENDING;
+   }
+
+   if (next != state)
+   {
+      atomic_store(&status->since, (long long)now);
+      atomic_store(&status->state, next);
+
+      if (next == ALERT_STATE_FIRING)
+      {
+         pgexporter_log_warn("Alert '%s' is firing on server '%s' (value %lld)",
+                             alert->name, ((struct configuration*)shmem)->servers[server].name, (long long)value);
+      }
+      else if (state == ALERT_STATE_FIRING)
+      {
+         pgexporter_log_info("Alert '%s' resolved on server '%s' (value %lld)",
+                             alert->name, ((struct configuration*)shmem)->servers[server].name, (long long)value);
+      }
+   }
+
+   atomic_store(&status->value, (long long)value);
+   atomic_store(&status->updated, (long long)now);
+   atomic_store(&status->valid, true);
+
+   return next;
+}
+
+void
+pgexporter_alert_evaluate(void)
+{
+   int ret;
+   time_t now;
+   int64_t value;
+   char* result = NULL;
+   struct query* query = NULL;
+   struct configuration* config;
+   int server_conn_valid[NUMBER_OF_SERVERS];
+
+   config = (struct configuration*)shmem;
+
+   memset(server_conn_valid, -1, sizeof(server_conn_valid));
+
+   for (int a = 0; a < config->number_of_alerts; a++)
+   {
+      struct alert_definition* alert = &config->alerts[a];
+
+      for (int server = 0; server < config->number_of_servers; server++)
+      {
+         if (!pgexporter_alert_applies(alert, server) || !pgexporter_server_owned(server))
+         {
+            continue;
+         }
+
+         /* Lazy connection validity check */
+         if (server_conn_valid[server] == -1)
+         {
+            server_conn_valid[server] = pgexporter_connection_isvalid(config->servers[server].ssl, config->servers[server].fd) ? 1 : 0;
+         }
+
+         now = time(NULL);
+
+         if (alert->alert_type == ALERT_TYPE_CONNECTION)
+         {
+            pgexporter_alert_transition(alert, server, server_conn_valid[server] == 1 ? 0 : 1, now);
+            continue;
+         }
+
+         /* Query alerts can't be evaluated on a server that is down */
+         if (server_conn_valid[server] != 1)
+         {
+            atomic_store(&alert->status[server].valid, false);
+            continue;
+         }
+
+         ret = pgexporter_query_execute(server, alert->query, alert->name, &query);
+
+         if (ret == 0 && query != NULL && query->tuples != NULL &&
+             (result = pgexporter_get_column(0, query->tuples)) != NULL)
+         {
+            value = strtoll(result, NULL, 10);
+            pgexporter_alert_transition(alert, server, value, now);
+         }
+         else
+         {
+            pgexporter_log_warn("Failed to query alert '%s' for server %s",
+                                alert->name, config->servers[server].name);
+            atomic_store(&alert->status[server].valid, false);
+         }
+
+         pgexporter_free_query(query);
+         query = NULL;
+         result = NULL;
+      }
+   }
+}
+
+void
+pgexporter_alert_tick_cb(void)
+{
+   struct configuration* config = (struct configuration*)shmem;
+   pid_t pid;
+   bool expected = false;
+
+   if (config == NULL || !config->alerts_enabled || config->number_of_alerts == 0)
+   {
+      return;
+   }
+
+   if (!atomic_compare_exchange_strong(&config->alerts_worker_running, &expected, true))
+   {
+      /* The previous evaluation is still running */
+      return;
+   }
+
+   pid = fork();
+   if (pid < 0)
+   {
+      pgexporter_log_error("alert: failed to fork evaluator");
+      atomic_store(&config->alerts_worker_running, false);
+      return;
+   }
+   else if (pid > 0)
+   {
+      /* Record worker pid so sigchld_cb can clear the running flag
+       * if the worker dies before resetting it itself. */
+      atomic_store(&config->alerts_worker_pid, (int)pid);
+      return;
+   }
+
+   alert_worker();
+}
+
+/**
+ * Is the condition of an alert met. A firing alert with a clear
+ * threshold is compared against that threshold
+ * @param alert The alert
+ * @param state The current state
+ * @param value The value
+ * @return True if the condition holds, otherwise false
+ */
+static bool
+alert_condition(struct alert_definition* alert, int state, int64_t value)
+{
+   if (alert->alert_type == ALERT_TYPE_CONNECTION)
+   {
+      return value != 0;
+   }
+
+   if (state == ALERT_STATE_FIRING && alert->hysteresis)
+   {
+      return pgexporter_alert_compare(value, alert->operator, alert->clear_threshold);
+   }
+
+   return pgexporter_alert_compare(value, alert->operator, alert->threshold);
+}
+
+/**
+ * Child-process worker that evaluates the alerts over its own
+ * connections. Called after fork(); exit(0)s.
+ */
+static void
+alert_worker(void)
+{
+   struct configuration* config = (struct configuration*)shmem;
+
+   pgexporter_open_connections();
+
+   pgexporter_alert_evaluate();
+
+   pgexporter_close_connections();
+
+   atomic_store(&config->alerts_worker_pid, 0);
+   atomic_store(&config->alerts_worker_running, false);
+   exit(0);
+}
@@ -40,6 +40,7 @@
 
 static enum alert_operator parse_alert_operator(const char* str);
 static enum alert_type parse_alert_type_string(const char* str);
+static pgexporter_time_t parse_alert_duration(const char* str);
 static int parse_alerts_yaml(FILE* file, struct configuration* config, bool merge);
 
 #define ALERT_OVERRIDE_DESCRIPTION 0x01
@@ -48,6 +49,8 @@ static int parse_alerts_yaml(FILE* file, struct configuration* config, bool merg
 #define ALERT_OVERRIDE_OPERATOR    0x08
 #define ALERT_OVERRIDE_THRESHOLD   0x10
 #define ALERT_OVERRIDE_SERVERS     0x20
+#define ALERT_OVERRIDE_FOR         0x40
+#define ALERT_OVERRIDE_CLEAR       0x80
 
 static enum alert_operator
 parse_alert_operator(const char* str)
@@ -97,6 +100,48 @@ parse_alert_type_string(const char* str)
    exit(1);
 }
 
+static pgexporter_time_t
+parse_alert_duration(const char* str)
+{
+   char* end = NULL;
+   long long value;
+   int64_t multiplier = 1000;
+
+   value = strtoll(str, &end, 10);
+
+   if (end == str || value < 0)
+   {
+      goto error;
+   }
+
+   if (!strcmp(end, "ms"))
+   {
+      multiplier = 1;
+   }
+   else if (!strcmp(end, "") || !strcmp(end, "s"))
+   {
+      multiplier = 1000;
+   }
+   else if (!strcmp(end, "m"))
+   {
+      multiplier = 60 * 1000;
+   }
+   else if (!strcmp(end, "h"))
+   {
+      multiplier = 3600 * 1000;
+   }
+   else
+   {
+      goto error;
+   }
+
+   return PGEXPORTER_TIME_MS(value * multiplier);
+
+error:
+   pgexporter_log_fatal("Invalid alert duration: '%s'", str);
+   exit(1);
+}
+
 static int
 parse_alerts_yaml(FILE* file, struct configuration* config, bool merge)
 {
@@ -199,6 +244,17 @@ parse_alerts_yaml(FILE* file, struct configuration* config, bool merge)
                   current_alert.threshold = strtoll(val, NULL, 10);
                   overrides |= ALERT_OVERRIDE_THRESHOLD;
                }
+               else if (!strcmp(current_key, "for"))
+               {
+                  current_alert.for_duration = parse_alert_duration(val);
+                  overrides |= ALERT_OVERRIDE_FOR;
+               }
+               else if (!strcmp(current_key, "clear_threshold"))
+               {
+                  current_alert.clear_threshold = strtoll(val, NULL, 10);
+                  current_alert.hysteresis = true;
+                  overrides |= ALERT_OVERRIDE_CLEAR;
+               }
                else if (!strcmp(current_key, "servers"))
                {
                   if (!strcmp(val, "all"))
@@ -284,6 +340,15 @@ parse_alerts_yaml(FILE* file, struct configuration* config, bool merge)
                            {
                               config->alerts[i].threshold = current_alert.threshold;
                            }
+                           if (overrides & ALERT_OVERRIDE_FOR)
+                           {
+                              config->alerts[i].for_duration = current_alert.for_duration;
+                           }
+                           if (overrides & ALERT_OVERRIDE_CLEAR)
+                           {
+                              config->alerts[i].hysteresis = current_alert.hysteresis;
+                              config->alerts[i].clear_threshold = current_alert.clear_threshold;
+                           }
                            if (overrides & ALERT_OVERRIDE_SERVERS)
                            {
                               config->alerts[i].servers_all = current_alert.servers_all;
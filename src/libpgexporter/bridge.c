@@ -86,23 +86,16 @@ static struct http_route bridge_json_routes[] = {
 void
 pgexporter_bridge(int client_fd)
 {
-   struct http_server_request* req = NULL;
-
    pgexporter_start_logging();
    pgexporter_memory_init();
 
-   if (pgexporter_http_server_parse(NULL, client_fd, &req) != MESSAGE_STATUS_OK)
+   if (pgexporter_http_server_serve(NULL, client_fd,
+                                    bridge_routes,
+                                    sizeof(bridge_routes) / sizeof(bridge_routes[0])) != MESSAGE_STATUS_OK)
    {
       pgexporter_http_respond_400(NULL, client_fd);
    }
-   else
-   {
-      pgexporter_http_server_dispatch(NULL, client_fd, req,
-                                      bridge_routes,
-                                      sizeof(bridge_routes) / sizeof(bridge_routes[0]));
-   }
 
-   pgexporter_http_server_request_destroy(req);
    pgexporter_disconnect(client_fd);
    pgexporter_memory_destroy();
    pgexporter_stop_logging();
@@ -113,23 +106,16 @@ pgexporter_bridge(int client_fd)
 void
 pgexporter_bridge_json(int client_fd)
 {
-   struct http_server_request* req = NULL;
-
    pgexporter_start_logging();
    pgexporter_memory_init();
 
-   if (pgexporter_http_server_parse(NULL, client_fd, &req) != MESSAGE_STATUS_OK)
+   if (pgexporter_http_server_serve(NULL, client_fd,
+                                    bridge_json_routes,
+                                    sizeof(bridge_json_routes) / sizeof(bridge_json_routes[0])) != MESSAGE_STATUS_OK)
    {
       pgexporter_http_respond_400(NULL, client_fd);
    }
-   else
-   {
-      pgexporter_http_server_dispatch(NULL, client_fd, req,
-                                      bridge_json_routes,
-                                      sizeof(bridge_json_routes) / sizeof(bridge_json_routes[0]));
-   }
 
-   pgexporter_http_server_request_destroy(req);
    pgexporter_disconnect(client_fd);
    pgexporter_memory_destroy();
    pgexporter_stop_logging();
@@ -28,14 +28,18 @@
 
 /* pgexporter */
 #include <pgexporter.h>
+#include <activity.h>
 #include <aes.h>
+#include <alert_configuration.h>
 #include <bridge.h>
 #include <configuration.h>
 #include <json.h>
 #include <ext_query_alts.h>
+#include <extension.h>
 #include <logging.h>
 #include <management.h>
 #include <memory.h>
+#include <metric_names.h>
 #include <network.h>
 #include <pg_query_alts.h>
 #include <prometheus.h>
@@ -87,7 +91,10 @@ static int as_bytes(char* str, long* bytes, long default_bytes);
 static int as_endpoints(char* str, struct configuration* config, bool reload);
 static bool check_restart_required(struct configuration* config, struct configuration* reload);
 static int transfer_configuration(struct configuration* config, struct configuration* reload);
-static void copy_server(struct server* dst, struct server* src);
+static bool transfer_servers(struct configuration* config, struct configuration* reload);
+static bool transfer_metrics(struct configuration* config, struct configuration* reload);
+static bool transfer_extensions(struct configuration* config, struct configuration* reload);
+static void copy_server(struct server* dst, struct server* src, struct server* runtime);
 static void copy_server_config(struct server* dst, struct server* src);
 static void copy_user(struct user* dst, struct user* src);
 static void copy_promethus(struct prometheus* dst, struct prometheus* src);
@@ -95,6 +102,11 @@ static void copy_endpoint(struct endpoint* dst, struct endpoint* src);
 static int restart_int(char* name, int e, int n);
 static int restart_string(char* name, char* e, char* n);
 static bool is_supported_backend(ev_backend_t backend);
+static bool is_same_server(struct server* s1, struct server* s2);
+static bool is_same_server_config(struct server* s1, struct server* s2);
+static bool is_same_connection(struct configuration* config, struct server* s1, struct configuration* reload, struct server* s2);
+static bool is_same_metric(struct prometheus* m1, struct prometheus* m2);
+static char* get_user_password(struct configuration* config, char* username);
 static void validate_event_backend(struct configuration* config);
 static const char* ev_backend_to_string(ev_backend_t backend);
 
@@ -127,8 +139,8 @@ pgexporter_init_configuration(void* shm)
    config->metrics_query_timeout = PGEXPORTER_TIME_DISABLED;
    config->cache = true;
    config->alerts_enabled = false;
-   config->number_of_metric_names = 0;
-   memset(config->metric_names, 0, sizeof(config->metric_names));
+   config->alerts_interval = PGEXPORTER_TIME_SEC(30);
+   config->metric_names = NULL;
 
    config->console = -1;
 
@@ -300,6 +312,7 @@ pgexporter_read_configuration(void* shm, char* filename)
                   srv.version = SERVER_UNDERTERMINED_VERSION;
                   srv.fips_enabled = SERVER_FIPS_UNKNOWN;
                   srv.tls_mode = SERVER_TLS_TRY;
+                  srv.shard = -1;
 
                   idx_server++;
                }
@@ -311,7 +324,7 @@ pgexporter_read_configuration(void* shm, char* filename)
          }
          else
          {
-            if (pgexporter_starts_with(line, "unix_socket_dir") || pgexporter_starts_with(line, "metrics_path") || pgexporter_starts_with(line, "alerts_path") || pgexporter_starts_with(line, "log_path") || pgexporter_starts_with(line, "tls_cert_file") || pgexporter_starts_with(line, "tls_key_file") || pgexporter_starts_with(line, "tls_ca_file") || pgexporter_starts_with(line, "metrics_cert_file") || pgexporter_starts_with(line, "metrics_key_file") || pgexporter_starts_with(line, "metrics_ca_file") || pgexporter_starts_with(line, "history_cert_file") || pgexporter_starts_with(line, "history_key_file") || pgexporter_starts_with(line, "history_ca_file"))
+            if (pgexporter_starts_with(line, "unix_socket_dir") || pgexporter_starts_with(line, "metrics_path") || pgexporter_starts_with(line, "yaml_cache_path") || pgexporter_starts_with(line, "alerts_path") || pgexporter_starts_with(line, "log_path") || pgexporter_starts_with(line, "tls_cert_file") || pgexporter_starts_with(line, "tls_key_file") || pgexporter_starts_with(line, "tls_ca_file") || pgexporter_starts_with(line, "metrics_cert_file") || pgexporter_starts_with(line, "metrics_key_file") || pgexporter_starts_with(line, "metrics_ca_file") || pgexporter_starts_with(line, "history_cert_file") || pgexporter_starts_with(line, "history_key_file") || pgexporter_starts_with(line, "history_ca_file"))
             {
                extract_syskey_value(line, &key, &value);
             }
@@ -371,6 +384,84 @@ pgexporter_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "shard"))
+               {
+                  if (strlen(section) > 0)
+                  {
+                     if (as_int(value, &srv.shard))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "application_name"))
+               {
+                  if (strlen(section) > 0)
+                  {
+                     pgexporter_snprintf(&srv.application_name[0], MISC_LENGTH, "%s", value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "statement_timeout"))
+               {
+                  if (strlen(section) > 0)
+                  {
+                     if (as_milliseconds(value, &srv.statement_timeout, PGEXPORTER_TIME_DISABLED))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "lock_timeout"))
+               {
+                  if (strlen(section) > 0)
+                  {
+                     if (as_milliseconds(value, &srv.lock_timeout, PGEXPORTER_TIME_DISABLED))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "jit"))
+               {
+                  if (strlen(section) > 0)
+                  {
+                     if (as_bool(value, &srv.jit))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "work_mem"))
+               {
+                  if (strlen(section) > 0)
+                  {
+                     pgexporter_snprintf(&srv.work_mem[0], MISC_LENGTH, "%s", value);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "user"))
                {
                   if (strlen(section) > 0)
@@ -471,6 +562,34 @@ pgexporter_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "metrics_shards"))
+               {
+                  if (!strcmp(section, "pgexporter"))
+                  {
+                     if (as_int(value, &config->metrics_shards))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
+               else if (!strcmp(key, "activity_sampling"))
+               {
+                  if (!strcmp(section, "pgexporter"))
+                  {
+                     if (as_int(value, &config->activity_sampling))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "bridge"))
                {
                   if (!strcmp(section, "pgexporter"))
@@ -809,6 +928,20 @@ pgexporter_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "alerts_interval"))
+               {
+                  if (!strcmp(section, "pgexporter"))
+                  {
+                     if (as_milliseconds(value, &config->alerts_interval, PGEXPORTER_TIME_SEC(30)))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "cache"))
                {
                   if (!strcmp(section, "pgexporter"))
@@ -1009,6 +1142,20 @@ pgexporter_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "metrics_ktls"))
+               {
+                  if (!strcmp(section, "pgexporter"))
+                  {
+                     if (as_bool(value, &config->metrics_ktls))
+                     {
+                        unknown = true;
+                     }
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "blocking_timeout"))
                {
                   if (!strcmp(section, "pgexporter"))
@@ -1321,6 +1468,22 @@ pgexporter_read_configuration(void* shm, char* filename)
                      unknown = true;
                   }
                }
+               else if (!strcmp(key, "yaml_cache_path"))
+               {
+                  if (!strcmp(section, "pgexporter"))
+                  {
+                     max = strlen(value);
+                     if (max > MAX_PATH - 1)
+                     {
+                        max = MAX_PATH - 1;
+                     }
+                     memcpy(config->yaml_cache_path, value, max);
+                  }
+                  else
+                  {
+                     unknown = true;
+                  }
+               }
                else if (!strcmp(key, "extensions"))
                {
                   if (!strcmp(section, "pgexporter"))
@@ -1679,6 +1842,41 @@ pgexporter_validate_configuration(void* shm)
       config->metrics_query_timeout = PGEXPORTER_TIME_MS(50);
    }
 
+   if (config->metrics_shards < 0 || config->metrics_shards > NUMBER_OF_SHARDS)
+   {
+      pgexporter_log_warn("metrics_shards=%d is out of range, using %d", config->metrics_shards,
+                          config->metrics_shards < 0 ? 0 : NUMBER_OF_SHARDS);
+      config->metrics_shards = config->metrics_shards < 0 ? 0 : NUMBER_OF_SHARDS;
+   }
+
+   if (config->metrics_shards > 0 && config->metrics <= 0)
+   {
+      pgexporter_log_warn("metrics_shards requires metrics, not sharding");
+      config->metrics_shards = 0;
+   }
+
+   if (config->activity_sampling < 0 || config->activity_sampling > ACTIVITY_MAX_SAMPLING)
+   {
+      pgexporter_log_warn("activity_sampling=%d is out of range, using %d", config->activity_sampling,
+                          config->activity_sampling < 0 ? 0 : ACTIVITY_MAX_SAMPLING);
+      config->activity_sampling = config->activity_sampling < 0 ? 0 : ACTIVITY_MAX_SAMPLING;
+   }
+
+   if (config->activity_sampling > 0 && config->metrics <= 0)
+   {
+      pgexporter_log_warn("activity_sampling requires metrics, not sampling");
+      config->activity_sampling = 0;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (config->metrics_shards > 0 && config->servers[i].shard >= config->metrics_shards)
+      {
+         pgexporter_log_warn("Server %s: shard %d doesn't exist, placing it by name", config->servers[i].name, config->servers[i].shard);
+         config->servers[i].shard = -1;
+      }
+   }
+
    validate_event_backend(config);
 
    return 0;
@@ -2204,6 +2402,17 @@ pgexporter_reload_configuration(bool* r)
       }
    }
 
+   /* Alerts enabled by the reload start with the definitions */
+   if (pgexporter_read_internal_yaml_alerts(reload))
+   {
+      goto error;
+   }
+
+   if (pgexporter_read_alerts_configuration((void*)reload))
+   {
+      goto error;
+   }
+
    if (pgexporter_validate_configuration(reload))
    {
       goto error;
@@ -2228,6 +2437,7 @@ pgexporter_reload_configuration(bool* r)
       pgexporter_free_pg_query_alts(reload);
    }
    pgexporter_free_extension_query_alts(reload);
+   pgexporter_metric_names_destroy(reload->metric_names);
 
    pgexporter_destroy_shared_memory((void*)reload, reload_size);
 
@@ -2250,6 +2460,10 @@ error:
       pgexporter_free_pg_query_alts(reload);
    }
    pgexporter_free_extension_query_alts(reload);
+   if (reload != NULL)
+   {
+      pgexporter_metric_names_destroy(reload->metric_names);
+   }
 
    pgexporter_destroy_shared_memory((void*)reload, reload_size);
 
@@ -2361,8 +2575,14 @@ get_config_value_str(char* buf, size_t size, struct configuration* cfg, char* ke
       pgexporter_snprintf(buf, size, "%lld", (long long)pgexporter_time_convert(cfg->metrics_cache_max_age, FORMAT_TIME_S));
    else if (!strcmp(key, "metrics_query_timeout"))
       pgexporter_snprintf(buf, size, "%lld", (long long)pgexporter_time_convert(cfg->metrics_query_timeout, FORMAT_TIME_MS));
+   else if (!strcmp(key, "metrics_shards"))
+      pgexporter_snprintf(buf, size, "%d", cfg->metrics_shards);
+   else if (!strcmp(key, "activity_sampling"))
+      pgexporter_snprintf(buf, size, "%d", cfg->activity_sampling);
    else if (!strcmp(key, "metrics_path"))
       pgexporter_snprintf(buf, size, "%s", cfg->metrics_path);
+   else if (!strcmp(key, "yaml_cache_path"))
+      pgexporter_snprintf(buf, size, "%s", cfg->yaml_cache_path);
    else if (!strcmp(key, "console"))
       pgexporter_snprintf(buf, size, "%d", cfg->console);
    else if (!strcmp(key, "management"))
@@ -2387,6 +2607,8 @@ get_config_value_str(char* buf, size_t size, struct configuration* cfg, char* ke
       pgexporter_snprintf(buf, size, "%s", cfg->alerts_enabled ? "true" : "false");
    else if (!strcmp(key, "alerts_path"))
       pgexporter_snprintf(buf, size, "%s", cfg->alerts_path);
+   else if (!strcmp(key, "alerts_interval"))
+      pgexporter_snprintf(buf, size, "%lld", (long long)pgexporter_time_convert(cfg->alerts_interval, FORMAT_TIME_S));
    else if (!strcmp(key, "history"))
       pgexporter_snprintf(buf, size, "%d", cfg->history);
    else if (!strcmp(key, "history_interval"))
@@ -2453,6 +2675,8 @@ get_config_value_str(char* buf, size_t size, struct configuration* cfg, char* ke
       pgexporter_snprintf(buf, size, "%s", cfg->metrics_cert_file);
    else if (!strcmp(key, "metrics_key_file"))
       pgexporter_snprintf(buf, size, "%s", cfg->metrics_key_file);
+   else if (!strcmp(key, "metrics_ktls"))
+      pgexporter_snprintf(buf, size, "%s", cfg->metrics_ktls ? "true" : "false");
    else if (!strcmp(key, "blocking_timeout"))
       pgexporter_snprintf(buf, size, "%lld", (long long)pgexporter_time_convert(cfg->blocking_timeout, FORMAT_TIME_S));
    else if (!strcmp(key, "authentication_timeout"))
@@ -2485,6 +2709,36 @@ get_config_value_str(char* buf, size_t size, struct configuration* cfg, char* ke
       if (server_index >= 0)
          pgexporter_snprintf(buf, size, "%s", cfg->servers[server_index].wal);
    }
+   else if (!strcmp(key, "shard"))
+   {
+      if (server_index >= 0)
+         pgexporter_snprintf(buf, size, "%d", cfg->servers[server_index].shard);
+   }
+   else if (!strcmp(key, "application_name"))
+   {
+      if (server_index >= 0)
+         pgexporter_snprintf(buf, size, "%s", cfg->servers[server_index].application_name);
+   }
+   else if (!strcmp(key, "statement_timeout"))
+   {
+      if (server_index >= 0)
+         pgexporter_snprintf(buf, size, "%lld", (long long)pgexporter_time_convert(cfg->servers[server_index].statement_timeout, FORMAT_TIME_MS));
+   }
+   else if (!strcmp(key, "lock_timeout"))
+   {
+      if (server_index >= 0)
+         pgexporter_snprintf(buf, size, "%lld", (long long)pgexporter_time_convert(cfg->servers[server_index].lock_timeout, FORMAT_TIME_MS));
+   }
+   else if (!strcmp(key, "jit"))
+   {
+      if (server_index >= 0)
+         pgexporter_snprintf(buf, size, "%s", cfg->servers[server_index].jit ? "true" : "false");
+   }
+   else if (!strcmp(key, "work_mem"))
+   {
+      if (server_index >= 0)
+         pgexporter_snprintf(buf, size, "%s", cfg->servers[server_index].work_mem);
+   }
 }
 
 /**
@@ -2509,6 +2763,8 @@ copy_configuration_values(struct configuration* dst, struct configuration* src)
    dst->metrics_cache_max_age = src->metrics_cache_max_age;
    dst->metrics_cache_max_size = src->metrics_cache_max_size;
    dst->metrics_query_timeout = src->metrics_query_timeout;
+   dst->metrics_shards = src->metrics_shards;
+   dst->activity_sampling = src->activity_sampling;
    dst->management = src->management;
    dst->console = src->console;
 
@@ -2531,6 +2787,7 @@ copy_configuration_values(struct configuration* dst, struct configuration* src)
 
    dst->cache = src->cache;
    dst->alerts_enabled = src->alerts_enabled;
+   dst->alerts_interval = src->alerts_interval;
 
    dst->log_type = src->log_type;
    dst->log_level = src->log_level;
@@ -2547,6 +2804,7 @@ copy_configuration_values(struct configuration* dst, struct configuration* src)
    memcpy(dst->metrics_cert_file, src->metrics_cert_file, MAX_PATH);
    memcpy(dst->metrics_key_file, src->metrics_key_file, MAX_PATH);
    memcpy(dst->metrics_ca_file, src->metrics_ca_file, MAX_PATH);
+   dst->metrics_ktls = src->metrics_ktls;
 
    dst->blocking_timeout = src->blocking_timeout;
    dst->authentication_timeout = src->authentication_timeout;
@@ -2614,6 +2872,7 @@ copy_configuration_values(struct configuration* dst, struct configuration* src)
    {
       memcpy(dst->metrics_path, src->metrics_path, MAX_PATH);
    }
+   memcpy(dst->yaml_cache_path, src->yaml_cache_path, MAX_PATH);
 }
 
 void
@@ -3223,6 +3482,14 @@ pgexporter_conf_set(SSL* ssl __attribute__((unused)), int client_fd, uint8_t com
          config->metrics_key_file[max] = '\0';
          pgexporter_json_put(response, key, (uintptr_t)config->metrics_key_file, ValueString);
       }
+      else if (!strcmp(key, "metrics_ktls"))
+      {
+         if (as_bool(config_value, &config->metrics_ktls))
+         {
+            invalid_value = true;
+         }
+         pgexporter_json_put(response, key, (uintptr_t)config->metrics_ktls, ValueBool);
+      }
       else if (!strcmp(key, "blocking_timeout"))
       {
          if (as_milliseconds(config_value, &config->blocking_timeout, PGEXPORTER_TIME_SEC(30)))
@@ -3559,6 +3826,7 @@ pgexporter_conf_set(SSL* ssl __attribute__((unused)), int client_fd, uint8_t com
    elapsed = NULL;
    if (temp_shmem != NULL)
    {
+      pgexporter_metric_names_destroy(temp_config->metric_names);
       pgexporter_destroy_shared_memory(temp_shmem, temp_size);
       temp_shmem = NULL;
       temp_config = NULL;
@@ -3569,6 +3837,7 @@ error:
    free(elapsed);
    if (temp_shmem != NULL)
    {
+      pgexporter_metric_names_destroy(temp_config->metric_names);
       pgexporter_destroy_shared_memory(temp_shmem, temp_size);
       temp_shmem = NULL;
       temp_config = NULL;
@@ -3588,9 +3857,12 @@ add_configuration_response(struct json* res)
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_UNIX_SOCKET_DIR, (uintptr_t)config->unix_socket_dir, ValueString);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS, (uintptr_t)config->metrics, ValueInt64);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_PATH, (uintptr_t)config->metrics_path, ValueString);
+   pgexporter_json_put(res, CONFIGURATION_ARGUMENT_YAML_CACHE_PATH, (uintptr_t)config->yaml_cache_path, ValueString);
    pgexporter_json_put_time_value(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_AGE, config->metrics_cache_max_age, FORMAT_TIME_S);
    pgexporter_json_put_size_value(res, CONFIGURATION_ARGUMENT_METRICS_CACHE_MAX_SIZE, config->metrics_cache_max_size);
    pgexporter_json_put_time_value(res, CONFIGURATION_ARGUMENT_METRICS_QUERY_TIMEOUT, config->metrics_query_timeout, FORMAT_TIME_MS);
+   pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_SHARDS, (uintptr_t)config->metrics_shards, ValueInt64);
+   pgexporter_json_put(res, CONFIGURATION_ARGUMENT_ACTIVITY_SAMPLING, (uintptr_t)config->activity_sampling, ValueInt64);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_BRIDGE, (uintptr_t)config->bridge, ValueInt64);
 
    if (config->number_of_endpoints > 0)
@@ -3629,6 +3901,7 @@ add_configuration_response(struct json* res)
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_BRIDGE_HISTORY_PATH, (uintptr_t)config->bridge_history_path, ValueString);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_MANAGEMENT, (uintptr_t)config->management, ValueInt64);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_ALERTS, (uintptr_t)config->alerts_enabled, ValueBool);
+   pgexporter_json_put_time_value(res, CONFIGURATION_ARGUMENT_ALERTS_INTERVAL, config->alerts_interval, FORMAT_TIME_S);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_CACHE, (uintptr_t)config->cache, ValueBool);
    pgexporter_json_put_enum_value(res, CONFIGURATION_ARGUMENT_LOG_TYPE, config->log_type, to_log_type);
    pgexporter_json_put_enum_value(res, CONFIGURATION_ARGUMENT_LOG_LEVEL, config->log_level, to_log_level);
@@ -3645,6 +3918,7 @@ add_configuration_response(struct json* res)
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CERT_FILE, (uintptr_t)config->metrics_cert_file, ValueString);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_CA_FILE, (uintptr_t)config->metrics_ca_file, ValueString);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_KEY_FILE, (uintptr_t)config->metrics_key_file, ValueString);
+   pgexporter_json_put(res, CONFIGURATION_ARGUMENT_METRICS_KTLS, (uintptr_t)config->metrics_ktls, ValueBool);
    pgexporter_json_put_enum_value(res, CONFIGURATION_ARGUMENT_EV_BACKEND, config->ev_backend, to_ev_backend);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_KEEP_ALIVE, (uintptr_t)config->keep_alive, ValueBool);
    pgexporter_json_put(res, CONFIGURATION_ARGUMENT_NODELAY, (uintptr_t)config->nodelay, ValueBool);
@@ -3692,6 +3966,12 @@ add_servers_configuration_response(struct json* res)
       pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_USER, (uintptr_t)config->servers[i].username, ValueString);
       pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_DATA_DIR, (uintptr_t)config->servers[i].data, ValueString);
       pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_WAL_DIR, (uintptr_t)config->servers[i].wal, ValueString);
+      pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_SHARD, (uintptr_t)config->servers[i].shard, ValueInt64);
+      pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_APPLICATION_NAME, (uintptr_t)config->servers[i].application_name, ValueString);
+      pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_STATEMENT_TIMEOUT, (uintptr_t)pgexporter_time_convert(config->servers[i].statement_timeout, FORMAT_TIME_MS), ValueInt64);
+      pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_LOCK_TIMEOUT, (uintptr_t)pgexporter_time_convert(config->servers[i].lock_timeout, FORMAT_TIME_MS), ValueInt64);
+      pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_JIT, (uintptr_t)config->servers[i].jit, ValueBool);
+      pgexporter_json_put(server_conf, CONFIGURATION_ARGUMENT_WORK_MEM, (uintptr_t)config->servers[i].work_mem, ValueString);
 
       // Add this server to the server section using server name as key
       pgexporter_json_put(server_section, config->servers[i].name, (uintptr_t)server_conf, ValueJSON);
@@ -4722,23 +5002,111 @@ is_same_server(struct server* s1, struct server* s2)
 }
 
 /**
- * Check if a server configuration change requires restart
+ * Check if two servers have the same configuration
  */
-static int
-restart_server(struct server* new_srv, struct server* current_srv)
+static bool
+is_same_server_config(struct server* s1, struct server* s2)
+{
+   return is_same_server(s1, s2) &&
+          !strcmp(s1->name, s2->name) &&
+          s1->type == s2->type &&
+          s1->tls_mode == s2->tls_mode &&
+          !strcmp(s1->username, s2->username) &&
+          !strcmp(s1->data, s2->data) &&
+          !strcmp(s1->wal, s2->wal) &&
+          s1->shard == s2->shard &&
+          !strcmp(s1->application_name, s2->application_name) &&
+          s1->statement_timeout.ms == s2->statement_timeout.ms &&
+          s1->lock_timeout.ms == s2->lock_timeout.ms &&
+          s1->jit == s2->jit &&
+          !strcmp(s1->work_mem, s2->work_mem) &&
+          !strcmp(s1->tls_cert_file, s2->tls_cert_file) &&
+          !strcmp(s1->tls_key_file, s2->tls_key_file) &&
+          !strcmp(s1->tls_ca_file, s2->tls_ca_file) &&
+          !strcmp(s1->extensions_config, s2->extensions_config);
+}
+
+/**
+ * Check if a connection to a server can be used with the new configuration
+ */
+static bool
+is_same_connection(struct configuration* config, struct server* s1, struct configuration* reload, struct server* s2)
 {
-   char restart_message[2 * MISC_LENGTH];
+   char* p1 = NULL;
+   char* p2 = NULL;
 
-   if (!is_same_server(new_srv, current_srv))
+   if (!is_same_server(s1, s2) ||
+       s1->tls_mode != s2->tls_mode ||
+       strcmp(s1->username, s2->username) ||
+       strcmp(s1->tls_cert_file, s2->tls_cert_file) ||
+       strcmp(s1->tls_key_file, s2->tls_key_file) ||
+       strcmp(s1->tls_ca_file, s2->tls_ca_file))
    {
-      pgexporter_snprintf(restart_message, sizeof(restart_message), "Server <%s>, parameter <host>", new_srv->name);
-      restart_string(restart_message, current_srv->host, new_srv->host);
-      pgexporter_snprintf(restart_message, sizeof(restart_message), "Server <%s>, parameter <port>", new_srv->name);
-      restart_int(restart_message, current_srv->port, new_srv->port);
-      return 1;
+      return false;
    }
 
-   return 0;
+   /* The session parameters are only sent in the startup message */
+   if (strcmp(s1->application_name, s2->application_name) ||
+       s1->statement_timeout.ms != s2->statement_timeout.ms ||
+       s1->lock_timeout.ms != s2->lock_timeout.ms ||
+       s1->jit != s2->jit ||
+       strcmp(s1->work_mem, s2->work_mem) ||
+       config->metrics_query_timeout.ms != reload->metrics_query_timeout.ms)
+   {
+      return false;
+   }
+
+   p1 = get_user_password(config, s1->username);
+   p2 = get_user_password(reload, s2->username);
+
+   if (p1 == NULL || p2 == NULL)
+   {
+      return p1 == p2;
+   }
+
+   return !strcmp(p1, p2);
+}
+
+/**
+ * Check if two metric definitions are the same
+ */
+static bool
+is_same_metric(struct prometheus* m1, struct prometheus* m2)
+{
+   if (strcmp(m1->tag, m2->tag) ||
+       strcmp(m1->collector, m2->collector) ||
+       m1->sort_type != m2->sort_type ||
+       m1->server_query_type != m2->server_query_type ||
+       m1->exec_on_all_dbs != m2->exec_on_all_dbs ||
+       m1->optional != m2->optional ||
+       m1->derive != m2->derive ||
+       m1->slices != m2->slices ||
+       m1->compiled != m2->compiled)
+   {
+      return false;
+   }
+
+   /* Extension definitions live in the extensions */
+   if (m1->ext_root != NULL || m2->ext_root != NULL)
+   {
+      return false;
+   }
+
+   return pgexporter_is_same_pg_query_alts(m1->pg_root, m2->pg_root);
+}
+
+static char*
+get_user_password(struct configuration* config, char* username)
+{
+   for (int i = 0; i < config->number_of_users; i++)
+   {
+      if (!strcmp(config->users[i].username, username))
+      {
+         return config->users[i].password;
+      }
+   }
+
+   return NULL;
 }
 
 /**
@@ -4817,28 +5185,17 @@ check_restart_required(struct configuration* config, struct configuration* reloa
    {
       restart = true;
    }
-
-   /* Check if number of servers decreased */
-   if (config->number_of_servers > reload->number_of_servers)
+   if (restart_int("metrics_shards", config->metrics_shards, reload->metrics_shards))
    {
-      if (restart_int("decreasing number of servers", config->number_of_servers, reload->number_of_servers))
-      {
-         restart = true;
-      }
+      restart = true;
    }
-
-   /* Check each server for host/port/TLS changes */
-   for (int i = 0; i < reload->number_of_servers; i++)
+   if (restart_int("activity_sampling", config->activity_sampling, reload->activity_sampling))
    {
-      if (i < config->number_of_servers)
-      {
-         if (restart_server(&reload->servers[i], &config->servers[i]))
-         {
-            restart = true;
-         }
-      }
+      restart = true;
    }
 
+   /* Servers are added, removed and changed by transfer_servers() */
+
    return restart;
 }
 
@@ -4847,6 +5204,8 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 {
    char* old_endpoints = NULL;
    char* new_endpoints = NULL;
+   struct metric_names* names = NULL;
+   bool invalidate = false;
 
 #ifdef HAVE_SYSTEMD
    sd_notify(0, "RELOADING=1");
@@ -4938,6 +5297,7 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 
    config->cache = reload->cache;
    config->alerts_enabled = reload->alerts_enabled;
+   config->alerts_interval = reload->alerts_interval;
    config->tls = reload->tls;
 
    /* Logging */
@@ -4967,6 +5327,7 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    memcpy(config->metrics_cert_file, reload->metrics_cert_file, MAX_PATH);
    memcpy(config->metrics_key_file, reload->metrics_key_file, MAX_PATH);
    memcpy(config->metrics_ca_file, reload->metrics_ca_file, MAX_PATH);
+   config->metrics_ktls = reload->metrics_ktls;
 
    /* Timeouts */
    config->blocking_timeout = reload->blocking_timeout;
@@ -4984,18 +5345,29 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    memcpy(config->unix_socket_dir, reload->unix_socket_dir, MISC_LENGTH);
 
    /* Collectors */
+   if (config->number_of_allowed_collectors != reload->number_of_allowed_collectors ||
+       config->number_of_excluded_collectors != reload->number_of_excluded_collectors ||
+       memcmp(config->allowed_collectors, reload->allowed_collectors, sizeof(config->allowed_collectors)) ||
+       memcmp(config->excluded_collectors, reload->excluded_collectors, sizeof(config->excluded_collectors)))
+   {
+      invalidate = true;
+   }
    memcpy(config->allowed_collectors, reload->allowed_collectors, sizeof(config->allowed_collectors));
    config->number_of_allowed_collectors = reload->number_of_allowed_collectors;
    memcpy(config->excluded_collectors, reload->excluded_collectors, sizeof(config->excluded_collectors));
    config->number_of_excluded_collectors = reload->number_of_excluded_collectors;
 
-   /* Servers */
-   for (int i = 0; i < reload->number_of_servers; i++)
+   /* Servers, before the users as connections depend on the old passwords */
+   if (transfer_servers(config, reload))
    {
-      copy_server(&config->servers[i], &reload->servers[i]);
+      invalidate = true;
+   }
+
+   /* Extensions, once the servers have their new extension lists */
+   if (transfer_extensions(config, reload))
+   {
+      invalidate = true;
    }
-   memset(&config->servers[reload->number_of_servers], 0, sizeof(struct server) * (NUMBER_OF_SERVERS - reload->number_of_servers));
-   config->number_of_servers = reload->number_of_servers;
 
    /* Users */
    memset(&config->users[0], 0, sizeof(struct user) * NUMBER_OF_USERS);
@@ -5015,19 +5387,32 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
 
    /* Prometheus */
    memcpy(config->metrics_path, reload->metrics_path, MAX_PATH);
-   for (int i = 0; i < reload->number_of_metrics; i++)
+   memcpy(config->yaml_cache_path, reload->yaml_cache_path, MAX_PATH);
+   if (transfer_metrics(config, reload))
    {
-      copy_promethus(&config->prometheus[i], &reload->prometheus[i]);
+      invalidate = true;
    }
-   config->number_of_metrics = reload->number_of_metrics;
 
-   /* Metric names list */
-   memcpy(config->metric_names, reload->metric_names, sizeof(config->metric_names));
-   config->number_of_metric_names = reload->number_of_metric_names;
+   /* Metric names, the old registry is released with the reloaded configuration */
+   names = config->metric_names;
+   config->metric_names = reload->metric_names;
+   reload->metric_names = names;
 
    /* Alerts */
    memcpy(config->alerts_path, reload->alerts_path, MAX_PATH);
    for (int i = 0; i < reload->number_of_alerts; i++)
+   {
+      /* An alert that stays keeps its state, wherever it moved in the file */
+      for (int j = 0; j < config->number_of_alerts; j++)
+      {
+         if (!strcmp(config->alerts[j].name, reload->alerts[i].name))
+         {
+            memcpy(&reload->alerts[i].status, &config->alerts[j].status, sizeof(reload->alerts[i].status));
+            break;
+         }
+      }
+   }
+   for (int i = 0; i < reload->number_of_alerts; i++)
    {
       memcpy(&config->alerts[i], &reload->alerts[i], sizeof(struct alert_definition));
    }
@@ -5040,6 +5425,12 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    }
    config->number_of_endpoints = reload->number_of_endpoints;
 
+   /* The cached response is only stale if the servers or the metrics changed */
+   if (invalidate)
+   {
+      pgexporter_prometheus_invalidate_cache();
+   }
+
 #ifdef HAVE_SYSTEMD
    sd_notify(0, "READY=1");
 #endif
@@ -5050,8 +5441,266 @@ transfer_configuration(struct configuration* config, struct configuration* reloa
    return 0;
 }
 
+static bool
+transfer_servers(struct configuration* config, struct configuration* reload)
+{
+   struct server* current = NULL;
+   bool used[NUMBER_OF_SERVERS];
+   int number_of_current;
+   int added = 0;
+   int removed = 0;
+   int changed = 0;
+   int moved = 0;
+   int j;
+
+   number_of_current = config->number_of_servers;
+   memset(used, 0, sizeof(used));
+
+   current = (struct server*)malloc(sizeof(struct server) * NUMBER_OF_SERVERS);
+   if (current == NULL)
+   {
+      /* Start over with all the servers */
+      pgexporter_log_warn("Reload: Unable to preserve the server state");
+      number_of_current = 0;
+   }
+   else
+   {
+      memcpy(current, config->servers, sizeof(struct server) * NUMBER_OF_SERVERS);
+   }
+
+   for (int i = 0; i < reload->number_of_servers; i++)
+   {
+      /* A server keeps its state as long as it has the same name, host and port */
+      j = -1;
+      for (int k = 0; j == -1 && k < number_of_current; k++)
+      {
+         if (!used[k] && !strcmp(current[k].name, reload->servers[i].name) &&
+             is_same_server(&current[k], &reload->servers[i]))
+         {
+            j = k;
+         }
+      }
+
+      if (j == -1)
+      {
+         copy_server(&config->servers[i], &reload->servers[i], NULL);
+         added++;
+         continue;
+      }
+
+      used[j] = true;
+
+      /* The connections of the shards belong to the shards, which start over after the reload */
+      if (!is_same_connection(config, &current[j], reload, &reload->servers[i]) && current[j].fd != -1 &&
+          config->metrics_shards == 0)
+      {
+         pgexporter_log_debug("Reload: Closing the connection to %s", current[j].name);
+
+         if (current[j].ssl != NULL)
+         {
+            pgexporter_close_ssl(current[j].ssl);
+            current[j].ssl = NULL;
+         }
+         pgexporter_disconnect(current[j].fd);
+         current[j].fd = -1;
+         current[j].state = SERVER_UNKNOWN;
+      }
+
+      if (!is_same_server_config(&current[j], &reload->servers[i]))
+      {
+         changed++;
+      }
+      else if (i != j)
+      {
+         moved++;
+      }
+
+      copy_server(&config->servers[i], &reload->servers[i], &current[j]);
+   }
+
+   for (int k = 0; k < number_of_current; k++)
+   {
+      if (!used[k])
+      {
+         if (current[k].fd != -1 && config->metrics_shards == 0)
+         {
+            if (current[k].ssl != NULL)
+            {
+               pgexporter_close_ssl(current[k].ssl);
+            }
+            pgexporter_disconnect(current[k].fd);
+         }
+         removed++;
+      }
+   }
+
+   memset(&config->servers[reload->number_of_servers], 0, sizeof(struct server) * (NUMBER_OF_SERVERS - reload->number_of_servers));
+   config->number_of_servers = reload->number_of_servers;
+
+   pgexporter_log_debug("Reload: Servers added %d, removed %d, changed %d, moved %d, unchanged %d",
+                        added, removed, changed, moved, reload->number_of_servers - added - changed - moved);
+
+   free(current);
+
+   return added > 0 || removed > 0 || changed > 0 || moved > 0;
+}
+
+static bool
+transfer_metrics(struct configuration* config, struct configuration* reload)
+{
+   struct prometheus* next = NULL;
+   bool used[NUMBER_OF_METRICS];
+   int added = 0;
+   int removed = 0;
+   int moved = 0;
+   int j;
+
+   memset(used, 0, sizeof(used));
+
+   next = (struct prometheus*)calloc(NUMBER_OF_METRICS, sizeof(struct prometheus));
+   if (next == NULL)
+   {
+      /* Copy all the definitions */
+      pgexporter_log_warn("Reload: Unable to preserve the metric definitions");
+      for (int i = 0; i < reload->number_of_metrics; i++)
+      {
+         copy_promethus(&config->prometheus[i], &reload->prometheus[i]);
+      }
+      for (int i = reload->number_of_metrics; i < config->number_of_metrics; i++)
+      {
+         if (!config->prometheus[i].compiled)
+         {
+            pgexporter_free_pg_node_avl(&config->prometheus[i].pg_root);
+         }
+         if (config->prometheus[i].ext_root != NULL)
+         {
+            pgexporter_free_extension_node_avl(&config->prometheus[i].ext_root);
+         }
+         memset(&config->prometheus[i], 0, sizeof(struct prometheus));
+      }
+      config->number_of_metrics = reload->number_of_metrics;
+
+      return true;
+   }
+
+   for (int i = 0; i < reload->number_of_metrics; i++)
+   {
+      /* Definitions rarely move, so look at the same index first */
+      j = -1;
+      if (i < config->number_of_metrics && !used[i] && is_same_metric(&config->prometheus[i], &reload->prometheus[i]))
+      {
+         j = i;
+      }
+      for (int k = 0; j == -1 && k < config->number_of_metrics; k++)
+      {
+         if (!used[k] && is_same_metric(&config->prometheus[k], &reload->prometheus[i]))
+         {
+            j = k;
+         }
+      }
+
+      if (j != -1)
+      {
+         /* Keep the running query alternatives */
+         memcpy(&next[i], &config->prometheus[j], sizeof(struct prometheus));
+         used[j] = true;
+
+         if (i != j)
+         {
+            moved++;
+         }
+      }
+      else
+      {
+         /* Take over the query alternatives of the new definition */
+         memcpy(&next[i], &reload->prometheus[i], sizeof(struct prometheus));
+         reload->prometheus[i].pg_root = NULL;
+         reload->prometheus[i].ext_root = NULL;
+         reload->prometheus[i].compiled = false;
+         added++;
+      }
+   }
+
+   for (int k = 0; k < config->number_of_metrics; k++)
+   {
+      if (!used[k])
+      {
+         if (!config->prometheus[k].compiled)
+         {
+            pgexporter_free_pg_node_avl(&config->prometheus[k].pg_root);
+         }
+         if (config->prometheus[k].ext_root != NULL)
+         {
+            pgexporter_free_extension_node_avl(&config->prometheus[k].ext_root);
+         }
+         removed++;
+      }
+   }
+
+   memcpy(config->prometheus, next, sizeof(struct prometheus) * NUMBER_OF_METRICS);
+   config->number_of_metrics = reload->number_of_metrics;
+
+   pgexporter_log_debug("Reload: Metrics added %d, removed %d, moved %d, unchanged %d",
+                        added, removed, moved, reload->number_of_metrics - added - moved);
+
+   free(next);
+
+   return added > 0 || removed > 0 || moved > 0;
+}
+
+static bool
+transfer_extensions(struct configuration* config, struct configuration* reload)
+{
+   struct extension_info* extension = NULL;
+   bool enabled;
+   int added = 0;
+   int removed = 0;
+
+   memcpy(config->global_extensions, reload->global_extensions, MAX_EXTENSIONS_CONFIG_LENGTH);
+
+   /* The servers keep the extensions detected on their connection, so only
+    * which of them are enabled follows the new lists. The catalogs of newly
+    * enabled extensions are loaded after the reload */
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      for (int i = 0; i < config->servers[server].number_of_extensions; i++)
+      {
+         extension = &config->servers[server].extensions[i];
+
+         /* An extension without a known version stays disabled */
+         if (extension->installed_version.major < 0)
+         {
+            continue;
+         }
+
+         enabled = pgexporter_extension_is_enabled(config, server, extension->name);
+
+         if (enabled != extension->enabled)
+         {
+            pgexporter_log_debug("Reload: Extension %s %s on %s", extension->name,
+                                 enabled ? "enabled" : "disabled", config->servers[server].name);
+
+            extension->enabled = enabled;
+
+            if (enabled)
+            {
+               added++;
+            }
+            else
+            {
+               removed++;
+            }
+         }
+      }
+   }
+
+   pgexporter_log_debug("Reload: Extensions enabled %d, disabled %d", added, removed);
+
+   return added > 0 || removed > 0;
+}
+
 static void
-copy_server(struct server* dst, struct server* src)
+copy_server(struct server* dst, struct server* src, struct server* runtime)
 {
    SSL* ssl = NULL;
    int fd = -1;
@@ -5064,24 +5713,32 @@ copy_server(struct server* dst, struct server* src)
    int fips_enabled = SERVER_FIPS_UNKNOWN;
    char databases[NUMBER_OF_EXTENSIONS][DB_NAME_LENGTH];
    struct extension_info extensions[NUMBER_OF_EXTENSIONS];
-   bool preserve_runtime = is_same_server(dst, src);
+   char system_identifier[MISC_LENGTH];
+   bool cluster_warned = false;
+   struct server_statistics statistics;
 
    memset(databases, 0, sizeof(databases));
+   memset(system_identifier, 0, sizeof(system_identifier));
    memset(extensions, 0, sizeof(extensions));
-
-   if (preserve_runtime)
-   {
-      ssl = dst->ssl;
-      fd = dst->fd;
-      is_new = dst->new;
-      state = dst->state;
-      version = dst->version;
-      minor_version = dst->minor_version;
-      number_of_databases = dst->number_of_databases;
-      number_of_extensions = dst->number_of_extensions;
-      fips_enabled = dst->fips_enabled;
-      memcpy(databases, dst->databases, sizeof(databases));
-      memcpy(extensions, dst->extensions, sizeof(extensions));
+   memset(&statistics, 0, sizeof(statistics));
+
+   /* The connection and what was discovered through it */
+   if (runtime != NULL)
+   {
+      ssl = runtime->ssl;
+      fd = runtime->fd;
+      is_new = runtime->new;
+      state = runtime->state;
+      version = runtime->version;
+      minor_version = runtime->minor_version;
+      number_of_databases = runtime->number_of_databases;
+      number_of_extensions = runtime->number_of_extensions;
+      fips_enabled = runtime->fips_enabled;
+      memcpy(databases, runtime->databases, sizeof(databases));
+      memcpy(extensions, runtime->extensions, sizeof(extensions));
+      memcpy(system_identifier, runtime->system_identifier, sizeof(system_identifier));
+      cluster_warned = runtime->cluster_warned;
+      memcpy(&statistics, &runtime->statistics, sizeof(statistics));
    }
 
    memset(dst, 0, sizeof(struct server));
@@ -5093,6 +5750,12 @@ copy_server(struct server* dst, struct server* src)
    memcpy(&dst->username[0], &src->username[0], MAX_USERNAME_LENGTH);
    memcpy(&dst->data[0], &src->data[0], MISC_LENGTH);
    memcpy(&dst->wal[0], &src->wal[0], MISC_LENGTH);
+   dst->shard = src->shard;
+   memcpy(&dst->application_name[0], &src->application_name[0], MISC_LENGTH);
+   dst->statement_timeout = src->statement_timeout;
+   dst->lock_timeout = src->lock_timeout;
+   dst->jit = src->jit;
+   memcpy(&dst->work_mem[0], &src->work_mem[0], MISC_LENGTH);
    memcpy(&dst->tls_cert_file[0], &src->tls_cert_file[0], MAX_PATH);
    memcpy(&dst->tls_key_file[0], &src->tls_key_file[0], MAX_PATH);
    memcpy(&dst->tls_ca_file[0], &src->tls_ca_file[0], MAX_PATH);
@@ -5108,6 +5771,9 @@ copy_server(struct server* dst, struct server* src)
    dst->fips_enabled = fips_enabled;
    memcpy(dst->databases, databases, sizeof(databases));
    memcpy(dst->extensions, extensions, sizeof(extensions));
+   memcpy(dst->system_identifier, system_identifier, sizeof(system_identifier));
+   dst->cluster_warned = cluster_warned;
+   memcpy(&dst->statistics, &statistics, sizeof(statistics));
 }
 
 static void
@@ -5122,6 +5788,12 @@ copy_server_config(struct server* dst, struct server* src)
    memcpy(&dst->username[0], &src->username[0], MAX_USERNAME_LENGTH);
    memcpy(&dst->data[0], &src->data[0], MISC_LENGTH);
    memcpy(&dst->wal[0], &src->wal[0], MISC_LENGTH);
+   dst->shard = src->shard;
+   memcpy(&dst->application_name[0], &src->application_name[0], MISC_LENGTH);
+   dst->statement_timeout = src->statement_timeout;
+   dst->lock_timeout = src->lock_timeout;
+   dst->jit = src->jit;
+   memcpy(&dst->work_mem[0], &src->work_mem[0], MISC_LENGTH);
    memcpy(&dst->tls_cert_file[0], &src->tls_cert_file[0], MAX_PATH);
    memcpy(&dst->tls_key_file[0], &src->tls_key_file[0], MAX_PATH);
    memcpy(&dst->tls_ca_file[0], &src->tls_ca_file[0], MAX_PATH);
@@ -5145,16 +5817,28 @@ copy_promethus(struct prometheus* dst, struct prometheus* src)
    memcpy(dst->collector, src->collector, MAX_COLLECTOR_LENGTH);
    dst->sort_type = src->sort_type;
    dst->server_query_type = src->server_query_type;
+   dst->exec_on_all_dbs = src->exec_on_all_dbs;
+   dst->optional = src->optional;
+   dst->derive = src->derive;
+   dst->slices = src->slices;
 
    // Always free dst's tree if it exists before copying
-   if (dst->pg_root != NULL)
+   if (dst->pg_root != NULL && !dst->compiled)
    {
       pgexporter_free_pg_node_avl(&dst->pg_root);
-      dst->pg_root = NULL;
    }
+   dst->pg_root = NULL;
 
-   // Copy src tree to dst
-   pgexporter_copy_pg_query_alts(&dst->pg_root, src->pg_root);
+   // Compiled trees are shared, otherwise copy src tree to dst
+   dst->compiled = src->compiled;
+   if (src->compiled)
+   {
+      dst->pg_root = src->pg_root;
+   }
+   else
+   {
+      pgexporter_copy_pg_query_alts(&dst->pg_root, src->pg_root);
+   }
 
    // Same for extension tree
    if (dst->ext_root != NULL)
@@ -55,6 +55,16 @@ static int write_ssl(SSL* ssl, void* buf, size_t size);
 
 int
 pgexporter_transfer_connection_write(int server)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return pgexporter_transfer_descriptor_write(TRANSFER_UDS, server, config->servers[server].fd);
+}
+
+int
+pgexporter_transfer_descriptor_write(char* uds, int32_t id, int descriptor)
 {
    int fd;
    struct cmsghdr* cmptr = NULL;
@@ -66,19 +76,19 @@ pgexporter_transfer_connection_write(int server)
 
    config = (struct configuration*)shmem;
 
-   if (pgexporter_connect_unix_socket(config->unix_socket_dir, TRANSFER_UDS, &fd))
+   if (pgexporter_connect_unix_socket(config->unix_socket_dir, uds, &fd))
    {
-      pgexporter_log_warn("pgexporter_management_transfer_connection: connect: %d", fd);
+      pgexporter_log_warn("pgexporter_transfer_descriptor_write: connect: %s", uds);
       errno = 0;
       goto error;
    }
 
    memset(&buf4[0], 0, sizeof(buf4));
-   pgexporter_write_int32(&buf4, server);
+   pgexporter_write_int32(&buf4, id);
 
    if (write_complete(NULL, fd, &buf4, sizeof(buf4)))
    {
-      pgexporter_log_warn("pgexporter_management_transfer_connection: write: %d %s", fd, strerror(errno));
+      pgexporter_log_warn("pgexporter_transfer_descriptor_write: write: %d %s", fd, strerror(errno));
       errno = 0;
       goto error;
    }
@@ -102,7 +112,7 @@ pgexporter_transfer_connection_write(int server)
    msg.msg_control = cmptr;
    msg.msg_controllen = CMSG_SPACE(sizeof(int));
    msg.msg_flags = 0;
-   *(int*)CMSG_DATA(cmptr) = config->servers[server].fd;
+   *(int*)CMSG_DATA(cmptr) = descriptor;
 
    if (sendmsg(fd, &msg, 0) != 2)
    {
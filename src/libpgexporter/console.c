@@ -28,16 +28,19 @@
 
 /* pgexporter */
 #include <pgexporter.h>
+#include <connection.h>
 #include <console.h>
 #include <http.h>
 #include <http_server.h>
 #include <logging.h>
 #include <memory.h>
 #include <network.h>
+#include <prometheus.h>
 #include <prometheus_client.h>
 #include <management.h>
 #include <message.h>
 #include <security.h>
+#include <shmem.h>
 #include <utils.h>
 
 /* system */
@@ -46,7 +49,13 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <errno.h>
 #include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 /**
  * @struct console_metric
@@ -55,6 +64,7 @@
 struct console_metric
 {
    char* name;                   /**< Full metric name */
+   uint64_t key;                 /**< Identity of the series, see metric_key() */
    char* type;                   /**< Metric type (gauge, counter, histogram, etc.) */
    char* help;                   /**< Description of the metric */
    double value;                 /**< The numeric value of the metric */
@@ -86,8 +96,16 @@ struct console_category
  */
 struct console_server
 {
-   char* name;  /**< Server name */
-   bool active; /**< Whether server is active */
+   char* name;                  /**< Server name */
+   bool active;                 /**< Whether server is active */
+   uint64_t scrape_duration;    /**< Time spent in the last scrape in milliseconds */
+   time_t last_success;         /**< Time of the last scrape with a connection */
+   uint64_t queries;            /**< Number of queries */
+   uint64_t query_errors;       /**< Number of failed queries */
+   uint64_t bytes_received;     /**< Number of bytes received */
+   uint64_t connections;        /**< Number of connections established */
+   uint64_t connections_reused; /**< Number of times a connection was reused */
+   time_t discovery;            /**< Time the databases and extensions were discovered */
 };
 
 /**
@@ -117,12 +135,6 @@ struct console_page
    char* metric_prefix;                 /**< Metric prefix to strip */
 };
 
-struct prefix_count
-{
-   char* prefix;
-   int count;
-};
-
 struct category_candidate
 {
    char* prefix;
@@ -136,21 +148,57 @@ struct category_candidate
 #define MAX_DEPTH                      4
 
 #define METRIC_LIST_INITIAL_CAP        64
-#define PREFIX_COUNT_INITIAL_CAP       32
 #define CATEGORY_CANDIDATE_INITIAL_CAP 16
-#define CATEGORY_SELECT_INITIAL_CAP    16
+#define CATEGORY_CACHE_SIZE            (64 * 1024)
+
+/**
+ * @struct category_cache
+ * The categories selected for a set of metric names. Each request is
+ * served by its own process, so they are kept in shared memory and
+ * reused while the set is unchanged
+ */
+struct category_cache
+{
+   atomic_schar lock;                  /**< The lock */
+   bool valid;                         /**< Are there selected categories */
+   uint64_t signature;                 /**< FNV-1a hash of the metric names */
+   int metric_count;                   /**< Number of metric names */
+   size_t length;                      /**< The length of the prefixes */
+   char prefixes[CATEGORY_CACHE_SIZE]; /**< The selected category prefixes, each terminated by a NUL */
+};
+
+
+/* Constants for the stream worker */
+#define STREAM_MAX_SUBSCRIBERS         64
+#define STREAM_INTERVAL_MS             5000
+#define STREAM_MAX_PENDING             (4 * 1024 * 1024)
+
+/**
+ * @struct stream_subscriber
+ * A viewer of /api/stream
+ */
+struct stream_subscriber
+{
+   int fd;                /**< The client socket */
+   char* pending;         /**< Output not accepted by the socket yet */
+   size_t pending_length; /**< The length of the pending output */
+};
 
 static int build_categories_from_bridge(struct prometheus_bridge* bridge, struct console_page* console);
-static int record_prefix_counts(const char* metric_name, struct prefix_count** counts, int* size, int* capacity);
-static int add_or_increment_prefix(struct prefix_count** counts, int* size, int* capacity, const char* prefix);
+static uint64_t hash_string(uint64_t hash, const char* name);
+static const char* strip_metric_prefix(struct console_page* console, const char* name);
+static int record_prefix_counts(char* metric_name, struct art* counts);
+static int increment_prefix(struct art* counts, char* prefix);
 static int count_prefix_depth(const char* prefix);
-static int build_category_candidates(struct prefix_count* counts, int size, struct category_candidate** candidates, int* candidate_count);
+static int build_category_candidates(struct art* counts, struct category_candidate** candidates, int* candidate_count);
 static int compare_candidates_by_score(const void* a, const void* b);
-static char** select_global_categories(struct category_candidate* candidates, int candidate_count, int* selected_count);
-static char* find_best_category(const char* metric_name, char** categories, int category_count);
+static int select_global_categories(struct category_candidate* candidates, int candidate_count, struct art** selected);
+static char* find_best_category(const char* metric_name, struct art* categories);
+static int category_cache_load(uint64_t signature, int metric_count, struct art** selected);
+static void category_cache_store(uint64_t signature, int metric_count, struct art* selected);
 static char* extract_category_prefix(char* metric_name);
 static char* fallback_category_from_last_underscore(char* metric_name);
-static struct console_category* find_or_create_category(struct console_page* console, char* category_name);
+static struct console_category* find_or_create_category(struct console_page* console, struct art* index, char* category_name);
 static int add_metric_to_category(struct console_category* category, struct console_metric* metric);
 static struct console_metric* create_metric_from_prometheus_attrs(struct prometheus_metric* prom_metric, const char* display_name, struct prometheus_attributes* attrs);
 static int extract_labels_from_prometheus_attrs(struct prometheus_attributes* attrs, struct console_metric* metric);
@@ -160,22 +208,35 @@ static char* generate_metrics_table(struct console_category* category);
 static char* generate_category_tabs(struct console_page* console);
 static int home_page(SSL* client_ssl, int client_fd);
 static int api_page(SSL* client_ssl, int client_fd);
-static int console_init(int endpoint, const char* brand_name, const char* metric_prefix, struct console_page** result);
-static int console_refresh_metrics(int endpoint, struct console_page* console);
+static int console_init(const char* brand_name, const char* metric_prefix, struct console_page** result);
+static int console_refresh_metrics(struct console_page* console);
 static int console_refresh_status(struct console_page* console);
 static int console_generate_html(struct console_page* console, char** html, size_t* html_size);
 static int console_generate_json(struct console_page* console, char** json, size_t* json_size);
 static int console_destroy(struct console_page* console);
+static int stream_page(SSL* client_ssl, int client_fd);
+static uint64_t metric_key(struct prometheus_metric* prom_metric, struct prometheus_attributes* attrs);
+static void format_metric_value(double value, char* buffer, size_t size);
+static void stream_tick(struct stream_subscriber* subscribers, int number_of_subscribers, struct art** values);
+static int stream_values(struct prometheus_bridge* bridge, struct art** values);
+static int stream_json(struct art* values, struct art* previous, char** json, size_t* length);
+static char* stream_event(char* json, size_t json_length, size_t* length);
+static int stream_add(struct stream_subscriber* subscribers, int* number_of_subscribers, int stream_fd, struct art* values);
+static int stream_send(struct stream_subscriber* subscriber, char* data, size_t length);
+static int stream_flush(struct stream_subscriber* subscriber);
+static void stream_remove(struct stream_subscriber* subscriber);
+static int64_t stream_now(void);
 
 static struct http_route console_routes[] = {
    {"/", home_page},
    {"/index.html", home_page},
    {"/api", api_page},
    {"/api/", api_page},
+   {"/api/stream", stream_page},
 };
 
 static int
-console_init(int endpoint, const char* brand_name, const char* metric_prefix, struct console_page** result)
+console_init(const char* brand_name, const char* metric_prefix, struct console_page** result)
 {
    struct console_page* console = NULL;
 
@@ -206,7 +267,7 @@ console_init(int endpoint, const char* brand_name, const char* metric_prefix, st
 
    memset(console->status, 0, sizeof(struct console_status));
 
-   if (console_refresh_metrics(endpoint, console))
+   if (console_refresh_metrics(console))
    {
       pgexporter_log_error("Failed to refresh metrics");
       goto error;
@@ -240,7 +301,7 @@ home_page(SSL* client_ssl, int client_fd)
    size_t html_size = 0;
    int status = MESSAGE_STATUS_OK;
 
-   if (console_init(0, "pgexporter", "pgexporter_", &console))
+   if (console_init("pgexporter", "pgexporter_", &console))
    {
       pgexporter_log_error("Failed to initialize console");
       status = MESSAGE_STATUS_ERROR;
@@ -278,7 +339,7 @@ api_page(SSL* client_ssl, int client_fd)
    size_t json_size = 0;
    int status = MESSAGE_STATUS_OK;
 
-   if (console_init(0, "pgexporter", "pgexporter_", &console))
+   if (console_init("pgexporter", "pgexporter_", &console))
    {
       pgexporter_log_error("Failed to initialize console for API");
       status = MESSAGE_STATUS_ERROR;
@@ -309,11 +370,24 @@ done:
 }
 
 static int
-console_refresh_metrics(int endpoint, struct console_page* console)
+stream_page(SSL* client_ssl, int client_fd)
+{
+   /* The stream is held open by the stream worker, not by this process */
+   if (client_ssl != NULL || pgexporter_transfer_descriptor_write(STREAM_UDS, 0, client_fd))
+   {
+      pgexporter_log_debug("Console stream not available");
+      return pgexporter_http_respond_404(client_ssl, client_fd);
+   }
+
+   pgexporter_http_server_close(client_fd);
+
+   return MESSAGE_STATUS_OK;
+}
+
+static int
+console_refresh_metrics(struct console_page* console)
 {
    struct prometheus_bridge* bridge = NULL;
-   struct configuration* config = NULL;
-   int effective_endpoint = endpoint;
 
    if (console == NULL)
    {
@@ -321,38 +395,16 @@ console_refresh_metrics(int endpoint, struct console_page* console)
       goto error;
    }
 
-   config = (struct configuration*)shmem;
-   if (config != NULL)
-   {
-      if (config->number_of_endpoints <= 0 || effective_endpoint >= config->number_of_endpoints || config->endpoints[effective_endpoint].port == 0)
-      {
-         if (config->metrics > 0)
-         {
-            effective_endpoint = 0;
-            config->number_of_endpoints = 1;
-            /* Use loopback if host is wildcard/empty */
-            const char* h = (strlen(config->host) == 0 || strcmp(config->host, "*") == 0 || strcmp(config->host, "0.0.0.0") == 0) ? "127.0.0.1" : config->host;
-            strncpy(config->endpoints[0].host, h, MISC_LENGTH - 1);
-            config->endpoints[0].host[MISC_LENGTH - 1] = '\0';
-            config->endpoints[0].port = config->metrics;
-         }
-         else
-         {
-            pgexporter_log_error("No Prometheus endpoint configured and metrics listener disabled");
-            goto error;
-         }
-      }
-   }
-
    if (pgexporter_prometheus_client_create_bridge(&bridge))
    {
       pgexporter_log_error("Failed to create Prometheus bridge");
       goto error;
    }
 
-   if (pgexporter_prometheus_client_get(effective_endpoint, bridge))
+   /* Read the metrics in process instead of scraping our own endpoint */
+   if (pgexporter_prometheus_snapshot(bridge, true))
    {
-      pgexporter_log_error("Failed to fetch metrics from endpoint %d", effective_endpoint);
+      pgexporter_log_error("Failed to get a metrics snapshot");
       goto error;
    }
 
@@ -497,6 +549,20 @@ console_refresh_status(struct console_page* console)
             {
                console->status->servers[server_idx].name = server_name ? strdup(server_name) : strdup("unknown");
                console->status->servers[server_idx].active = active;
+
+               if (server_idx < config->number_of_servers)
+               {
+                  struct server_statistics* statistics = &config->servers[server_idx].statistics;
+
+                  console->status->servers[server_idx].scrape_duration = atomic_load(&statistics->last_scrape_duration) / 1000;
+                  console->status->servers[server_idx].last_success = (time_t)atomic_load(&statistics->last_success);
+                  console->status->servers[server_idx].queries = atomic_load(&statistics->queries);
+                  console->status->servers[server_idx].query_errors = atomic_load(&statistics->query_errors);
+                  console->status->servers[server_idx].bytes_received = atomic_load(&statistics->bytes_received);
+                  console->status->servers[server_idx].connections = atomic_load(&statistics->connections);
+                  console->status->servers[server_idx].connections_reused = atomic_load(&statistics->connections_reused);
+                  console->status->servers[server_idx].discovery = (time_t)atomic_load(&statistics->discovery);
+               }
             }
 
             server_idx++;
@@ -733,6 +799,18 @@ console_generate_html(struct console_page* console, char** html, size_t* html_si
                                   "  updateRefreshButtonText();\n"
                                   "  updateRefreshMenuSelection();\n"
                                   "  scheduleAutoRefresh();\n"
+                                  "  if (window.EventSource) {\n"
+                                  "    const stream = new EventSource('/api/stream');\n"
+                                  "    stream.addEventListener('metrics', function(e){\n"
+                                  "      const values = JSON.parse(e.data);\n"
+                                  "      for (const key in values) {\n"
+                                  "        const cell = document.getElementById('v' + key);\n"
+                                  "        if (cell) {\n"
+                                  "          cell.textContent = values[key];\n"
+                                  "        }\n"
+                                  "      }\n"
+                                  "    });\n"
+                                  "  }\n"
                                   "})();\n"
                                   "</script>\n"
                                   "</body>\n</html>\n");
@@ -890,15 +968,13 @@ build_categories_from_bridge(struct prometheus_bridge* bridge, struct console_pa
    struct prometheus_metric** metrics = NULL;
    int metric_count = 0;
    int metric_capacity = 0;
+   uint64_t signature = 0;
 
-   struct prefix_count* prefix_counts = NULL;
-   int prefix_count_size = 0;
-   int prefix_count_capacity = 0;
-
+   struct art* prefix_counts = NULL;
    struct category_candidate* candidates = NULL;
    int candidate_count = 0;
-   char** selected_categories = NULL;
-   int selected_count = 0;
+   struct art* selected_categories = NULL;
+   struct art* category_index = NULL;
 
    int status = 0;
 
@@ -919,23 +995,16 @@ build_categories_from_bridge(struct prometheus_bridge* bridge, struct console_pa
       goto error;
    }
 
-   /* collect metrics and count shared prefixes */
+   /* collect metrics and fingerprint the set of names */
    while (pgexporter_art_iterator_next(iter))
    {
       struct prometheus_metric* prom_metric = (struct prometheus_metric*)iter->value->data;
-      const char* base_name = NULL;
 
       if (prom_metric == NULL || prom_metric->name == NULL)
       {
          continue;
       }
 
-      base_name = prom_metric->name;
-      if (strncmp(base_name, "pgexporter_", strlen("pgexporter_")) == 0)
-      {
-         base_name = base_name + strlen("pgexporter_");
-      }
-
       if (metric_count == metric_capacity)
       {
          metric_capacity = metric_capacity == 0 ? METRIC_LIST_INITIAL_CAP : metric_capacity * 2;
@@ -950,30 +1019,65 @@ build_categories_from_bridge(struct prometheus_bridge* bridge, struct console_pa
       }
 
       metrics[metric_count++] = prom_metric;
+      signature = hash_string(signature, prom_metric->name);
+   }
+
+   pgexporter_art_iterator_destroy(iter);
+   iter = NULL;
 
-      if (record_prefix_counts(base_name, &prefix_counts, &prefix_count_size, &prefix_count_capacity))
+   /* The categories only depend on the names, so reuse them while the set is unchanged */
+   if (category_cache_load(signature, metric_count, &selected_categories))
+   {
+      if (pgexporter_art_create(&prefix_counts))
       {
-         pgexporter_log_error("Failed to record prefix counts");
+         pgexporter_log_error("Failed to create prefix counts");
          status = 1;
          goto error;
       }
-   }
 
-   pgexporter_art_iterator_destroy(iter);
-   iter = NULL;
+      for (int i = 0; i < metric_count; i++)
+      {
+         char* base_name = strdup(strip_metric_prefix(console, metrics[i]->name));
 
-   /* Build and rank category candidates globally */
-   if (build_category_candidates(prefix_counts, prefix_count_size, &candidates, &candidate_count))
-   {
-      pgexporter_log_error("Failed to build category candidates");
-      status = 1;
-      goto error;
+         if (base_name == NULL || record_prefix_counts(base_name, prefix_counts))
+         {
+            pgexporter_log_error("Failed to record prefix counts");
+            free(base_name);
+            status = 1;
+            goto error;
+         }
+
+         free(base_name);
+      }
+
+      /* Build and rank category candidates globally */
+      if (build_category_candidates(prefix_counts, &candidates, &candidate_count))
+      {
+         pgexporter_log_error("Failed to build category candidates");
+         status = 1;
+         goto error;
+      }
+
+      if (select_global_categories(candidates, candidate_count, &selected_categories))
+      {
+         pgexporter_log_error("Failed to select categories");
+         status = 1;
+         goto error;
+      }
+
+      if (selected_categories->size == 0)
+      {
+         pgexporter_log_warn("No categories selected, using fallback");
+      }
+
+      category_cache_store(signature, metric_count, selected_categories);
    }
 
-   selected_categories = select_global_categories(candidates, candidate_count, &selected_count);
-   if (selected_categories == NULL)
+   if (pgexporter_art_create(&category_index))
    {
-      pgexporter_log_warn("No categories selected, using fallback");
+      pgexporter_log_error("Failed to create category index");
+      status = 1;
+      goto error;
    }
 
    /* assign metrics to selected categories */
@@ -986,19 +1090,10 @@ build_categories_from_bridge(struct prometheus_bridge* bridge, struct console_pa
       const char* base_name = NULL;
       struct deque_iterator* def_iter = NULL;
 
-      if (prom_metric == NULL || prom_metric->name == NULL)
-      {
-         continue;
-      }
-
-      base_name = prom_metric->name;
-      if (console->metric_prefix != NULL && strncmp(base_name, console->metric_prefix, strlen(console->metric_prefix)) == 0)
-      {
-         base_name = base_name + strlen(console->metric_prefix);
-      }
+      base_name = strip_metric_prefix(console, prom_metric->name);
 
       /* Find the best matching category from the globally selected set */
-      category_name = find_best_category(base_name, selected_categories, selected_count);
+      category_name = find_best_category(base_name, selected_categories);
       if (category_name == NULL)
       {
          category_name = extract_category_prefix((char*)base_name);
@@ -1020,7 +1115,7 @@ build_categories_from_bridge(struct prometheus_bridge* bridge, struct console_pa
          leaf_name = strdup(base_name);
       }
 
-      category = find_or_create_category(console, category_name);
+      category = find_or_create_category(console, category_index, category_name);
       free(category_name);
       category_name = NULL;
 
@@ -1087,14 +1182,8 @@ error:
       pgexporter_art_iterator_destroy(iter);
    }
 
-   if (prefix_counts != NULL)
-   {
-      for (int i = 0; i < prefix_count_size; i++)
-      {
-         free(prefix_counts[i].prefix);
-      }
-      free(prefix_counts);
-   }
+   pgexporter_art_destroy(prefix_counts);
+   pgexporter_art_destroy(category_index);
 
    if (metrics != NULL)
    {
@@ -1110,16 +1199,80 @@ error:
       free(candidates);
    }
 
-   if (selected_categories != NULL)
+   pgexporter_art_destroy(selected_categories);
+
+   return status;
+}
+
+/**
+ * Helper: Fold a string and a separator into a FNV-1a hash
+ */
+static uint64_t
+hash_string(uint64_t hash, const char* name)
+{
+   hash = pgexporter_hash_string(hash, name);
+
+   /* Separate the strings so that "ab" + "c" differs from "a" + "bc" */
+   return pgexporter_hash_string(hash, "\n");
+}
+
+/**
+ * Helper: Skip the console metric prefix of a metric name
+ */
+static const char*
+strip_metric_prefix(struct console_page* console, const char* name)
+{
+   if (console->metric_prefix != NULL && strncmp(name, console->metric_prefix, strlen(console->metric_prefix)) == 0)
+   {
+      return name + strlen(console->metric_prefix);
+   }
+
+   return name;
+}
+
+/**
+ * Helper: Identify a series by its metric name and labels
+ */
+static uint64_t
+metric_key(struct prometheus_metric* prom_metric, struct prometheus_attributes* attrs)
+{
+   struct deque_iterator* iter = NULL;
+   uint64_t key = hash_string(0, prom_metric->name);
+
+   if (attrs->attributes != NULL && pgexporter_deque_iterator_create(attrs->attributes, &iter) == 0)
    {
-      for (int i = 0; i < selected_count; i++)
+      while (pgexporter_deque_iterator_next(iter))
       {
-         free(selected_categories[i]);
+         struct prometheus_attribute* attr = (struct prometheus_attribute*)iter->value->data;
+
+         if (attr != NULL && attr->key != NULL && attr->value != NULL)
+         {
+            key = hash_string(key, attr->key);
+            key = hash_string(key, attr->value);
+         }
       }
-      free(selected_categories);
+      pgexporter_deque_iterator_destroy(iter);
    }
 
-   return status;
+   return key;
+}
+
+/**
+ * Helper: Format a metric value for display
+ */
+static void
+format_metric_value(double value, char* buffer, size_t size)
+{
+   long long int_value = (long long)value;
+
+   if ((double)int_value == value && int_value >= LLONG_MIN && int_value <= LLONG_MAX)
+   {
+      pgexporter_snprintf(buffer, size, "%lld", int_value);
+   }
+   else
+   {
+      pgexporter_snprintf(buffer, size, "%.2f", value);
+   }
 }
 
 /**
@@ -1170,15 +1323,16 @@ fallback_category_from_last_underscore(char* metric_name)
  * Helper: Find or create category
  */
 static struct console_category*
-find_or_create_category(struct console_page* console, char* category_name)
+find_or_create_category(struct console_page* console, struct art* index, char* category_name)
 {
+   enum value_type type = ValueNone;
+   int32_t position = 0;
+
    /* Try to find existing */
-   for (int i = 0; i < console->category_count; i++)
+   position = (int32_t)pgexporter_art_search_typed(index, category_name, &type);
+   if (type != ValueNone)
    {
-      if (strcmp(console->categories[i].name, category_name) == 0)
-      {
-         return &console->categories[i];
-      }
+      return &console->categories[position];
    }
 
    /* Create new category */
@@ -1201,6 +1355,14 @@ find_or_create_category(struct console_page* console, char* category_name)
       return NULL;
    }
 
+   if (pgexporter_art_insert(index, category_name, (uintptr_t)console->category_count, ValueInt32))
+   {
+      pgexporter_log_error("Failed to index category %s", category_name);
+      free(new_cat->name);
+      new_cat->name = NULL;
+      return NULL;
+   }
+
    console->category_count++;
 
    return new_cat;
@@ -1259,6 +1421,7 @@ create_metric_from_prometheus_attrs(struct prometheus_metric* prom_metric, const
    memset(metric, 0, sizeof(struct console_metric));
 
    metric->name = strdup(display_name != NULL ? display_name : prom_metric->name);
+   metric->key = metric_key(prom_metric, attrs);
    metric->type = strdup(prom_metric->type != NULL ? prom_metric->type : "gauge");
    metric->help = strdup(prom_metric->help != NULL ? prom_metric->help : "");
    metric->value = 0.0;
@@ -1362,97 +1525,61 @@ error:
 }
 
 /**
- * Helper: Add or increment a prefix in the counts array
+ * Helper: Add one to the count of a prefix
  */
 static int
-add_or_increment_prefix(struct prefix_count** counts, int* size, int* capacity, const char* prefix)
+increment_prefix(struct art* counts, char* prefix)
 {
-   int found = -1;
-
-   if (counts == NULL || size == NULL || capacity == NULL || prefix == NULL)
-   {
-      return 1;
-   }
-
-   /* Find existing prefix */
-   for (int j = 0; j < *size; j++)
-   {
-      if (strcmp((*counts)[j].prefix, prefix) == 0)
-      {
-         found = j;
-         break;
-      }
-   }
-
-   if (found == -1)
-   {
-      /* Prefix not found, add it */
-      if (*size == *capacity)
-      {
-         *capacity = (*capacity == 0) ? PREFIX_COUNT_INITIAL_CAP : (*capacity * 2);
-         struct prefix_count* resized = realloc(*counts, *capacity * sizeof(struct prefix_count));
-         if (resized == NULL)
-         {
-            return 1;
-         }
-         *counts = resized;
-      }
-
-      (*counts)[*size].prefix = strdup(prefix);
-      if ((*counts)[*size].prefix == NULL)
-      {
-         return 1;
-      }
-      (*counts)[*size].count = 1;
-      (*size)++;
-   }
-   else
-   {
-      (*counts)[found].count += 1;
-   }
+   int32_t count = (int32_t)pgexporter_art_search(counts, prefix);
 
-   return 0;
+   return pgexporter_art_insert(counts, prefix, (uintptr_t)(count + 1), ValueInt32);
 }
 
 /**
- * Helper: Increment shared prefix counts for a metric name
+ * Helper: Increment shared prefix counts for a metric name.
+ * Only prefixes that can become a category are counted, so each
+ * name costs at most MAX_DEPTH + 1 lookups
  */
 static int
-record_prefix_counts(const char* metric_name, struct prefix_count** counts, int* size, int* capacity)
+record_prefix_counts(char* metric_name, struct art* counts)
 {
-   size_t len = 0;
+   int depth = 0;
+   char* p = NULL;
 
-   if (metric_name == NULL || counts == NULL || size == NULL || capacity == NULL)
+   if (metric_name == NULL || counts == NULL)
    {
       return 1;
    }
 
-   len = strlen(metric_name);
-
-   /* Traverse the string and record prefixes at every underscore boundary */
-   for (size_t i = 0; i < len; i++)
+   /* Cut the name in place at every underscore boundary */
+   for (p = metric_name; *p != '\0' && depth <= MAX_DEPTH; p++)
    {
-      if (metric_name[i] == '_')
+      if (*p == '_')
       {
-         char* prefix = strndup(metric_name, i);
-         if (prefix == NULL)
+         if (depth > 0)
          {
-            return 1;
-         }
+            int ret;
 
-         if (add_or_increment_prefix(counts, size, capacity, prefix))
-         {
-            free(prefix);
-            return 1;
+            *p = '\0';
+            ret = increment_prefix(counts, metric_name);
+            *p = '_';
+
+            if (ret)
+            {
+               return 1;
+            }
          }
-         free(prefix);
+         depth++;
       }
    }
 
    /* Also record the full metric name as a prefix */
-   if (add_or_increment_prefix(counts, size, capacity, metric_name))
+   if (*p == '\0' && depth > 0 && depth <= MAX_DEPTH)
    {
-      return 1;
+      if (increment_prefix(counts, metric_name))
+      {
+         return 1;
+      }
    }
 
    return 0;
@@ -1485,8 +1612,9 @@ count_prefix_depth(const char* prefix)
  * Filters by MIN_GROUP_SIZE and MAX_DEPTH, calculates scores
  */
 static int
-build_category_candidates(struct prefix_count* counts, int size, struct category_candidate** candidates, int* candidate_count)
+build_category_candidates(struct art* counts, struct category_candidate** candidates, int* candidate_count)
 {
+   struct art_iterator* iter = NULL;
    struct category_candidate* cands = NULL;
    int count = 0;
    int capacity = 0;
@@ -1498,11 +1626,18 @@ build_category_candidates(struct prefix_count* counts, int size, struct category
       goto error;
    }
 
-   for (int i = 0; i < size; i++)
+   if (pgexporter_art_iterator_create(counts, &iter))
+   {
+      status = 1;
+      goto error;
+   }
+
+   while (pgexporter_art_iterator_next(iter))
    {
-      int depth = count_prefix_depth(counts[i].prefix);
+      int prefix_count = (int)(int32_t)iter->value->data;
+      int depth = count_prefix_depth(iter->key);
 
-      if (counts[i].count >= MIN_GROUP_SIZE && depth > 0 && depth <= MAX_DEPTH)
+      if (prefix_count >= MIN_GROUP_SIZE && depth > 0 && depth <= MAX_DEPTH)
       {
          if (count == capacity)
          {
@@ -1517,26 +1652,29 @@ build_category_candidates(struct prefix_count* counts, int size, struct category
             cands = resized;
          }
 
-         cands[count].prefix = strdup(counts[i].prefix);
+         cands[count].prefix = strdup(iter->key);
          if (cands[count].prefix == NULL)
          {
             pgexporter_log_error("Failed to allocate prefix string");
             status = 1;
             goto error;
          }
-         cands[count].count = counts[i].count;
+         cands[count].count = prefix_count;
          cands[count].depth = depth;
          /* higher count and moderate depth preferred */
-         cands[count].score = counts[i].count * (1.0 + depth * 0.2);
+         cands[count].score = prefix_count * (1.0 + depth * 0.2);
          count++;
       }
    }
 
+   pgexporter_art_iterator_destroy(iter);
+
    *candidates = cands;
    *candidate_count = count;
    return 0;
 
 error:
+   pgexporter_art_iterator_destroy(iter);
    if (cands != NULL)
    {
       for (int i = 0; i < count; i++)
@@ -1549,7 +1687,7 @@ error:
 }
 
 /**
- * Helper: Compare candidates by score (descending)
+ * Helper: Compare candidates by score (descending), then by prefix
  */
 static int
 compare_candidates_by_score(const void* a, const void* b)
@@ -1565,144 +1703,246 @@ compare_candidates_by_score(const void* a, const void* b)
    {
       return -1;
    }
-   return 0;
+   return strcmp(ca->prefix, cb->prefix);
 }
 
 /**
  * Helper: Select non-overlapping category prefixes globally
- * Sort by score descending, accept prefix only if not already covered by a longer accepted prefix
+ * Sort by score descending, accept prefix only if not already covered by a shorter accepted prefix
  */
-static char**
-select_global_categories(struct category_candidate* candidates, int candidate_count, int* selected_count)
+static int
+select_global_categories(struct category_candidate* candidates, int candidate_count, struct art** selected)
 {
-   char** selected = NULL;
-   int count = 0;
-   int capacity = 0;
+   struct art* s = NULL;
 
-   if (candidates == NULL || candidate_count == 0 || selected_count == NULL)
+   if (selected == NULL)
    {
-      *selected_count = 0;
-      return NULL;
+      goto error;
+   }
+
+   if (pgexporter_art_create(&s))
+   {
+      goto error;
    }
 
-   /* Sort candidates by score descending */
-   qsort(candidates, candidate_count, sizeof(struct category_candidate), compare_candidates_by_score);
+   if (candidates != NULL && candidate_count > 0)
+   {
+      /* Sort candidates by score descending */
+      qsort(candidates, candidate_count, sizeof(struct category_candidate), compare_candidates_by_score);
+   }
 
    for (int i = 0; i < candidate_count; i++)
    {
-      int is_covered = 0;
+      char* prefix = candidates[i].prefix;
+      bool is_covered = false;
 
-      /* Check if this candidate is already covered by a longer accepted prefix */
-      for (int j = 0; j < count; j++)
+      /* Check if an accepted category is a prefix of this candidate */
+      for (char* p = prefix; *p != '\0' && !is_covered; p++)
       {
-         size_t sel_len = strlen(selected[j]);
-         size_t cand_len = strlen(candidates[i].prefix);
-
-         if (cand_len > sel_len && strncmp(candidates[i].prefix, selected[j], sel_len) == 0 && candidates[i].prefix[sel_len] == '_')
+         if (*p == '_')
          {
-            is_covered = 1;
-            break;
+            *p = '\0';
+            is_covered = pgexporter_art_contains_key(s, prefix);
+            *p = '_';
          }
       }
 
       if (!is_covered)
       {
-         if (count == capacity)
+         if (pgexporter_art_insert(s, prefix, 1, ValueInt32))
          {
-            capacity = capacity == 0 ? CATEGORY_SELECT_INITIAL_CAP : capacity * 2;
-            char** resized = realloc(selected, capacity * sizeof(char*));
-            if (resized == NULL)
-            {
-               for (int k = 0; k < count; k++)
-               {
-                  free(selected[k]);
-               }
-               free(selected);
-               return NULL;
-            }
-            selected = resized;
+            goto error;
          }
-
-         selected[count] = strdup(candidates[i].prefix);
-         count++;
       }
    }
 
-   *selected_count = count;
-   return selected;
+   *selected = s;
+
+   return 0;
+
+error:
+   pgexporter_art_destroy(s);
+
+   return 1;
 }
 
 /**
  * Helper: Find the longest matching category for a metric name
  */
 static char*
-find_best_category(const char* metric_name, char** categories, int category_count)
+find_best_category(const char* metric_name, struct art* categories)
 {
+   char* name = NULL;
    char* best = NULL;
-   size_t best_len = 0;
+   int depth = 0;
 
-   if (metric_name == NULL || categories == NULL || category_count == 0)
+   if (metric_name == NULL || categories == NULL || categories->size == 0)
    {
       return NULL;
    }
 
-   for (int i = 0; i < category_count; i++)
+   name = strdup(metric_name);
+   if (name == NULL)
    {
-      size_t cat_len = strlen(categories[i]);
-      size_t name_len = strlen(metric_name);
+      return NULL;
+   }
 
-      /* Check if category is a prefix of metric_name followed by _ */
-      if (name_len > cat_len && strncmp(metric_name, categories[i], cat_len) == 0 && metric_name[cat_len] == '_')
+   /* Categories are at most MAX_DEPTH deep and must be followed by _ */
+   for (char* p = name; *p != '\0' && depth <= MAX_DEPTH; p++)
+   {
+      if (*p == '_')
       {
-         if (cat_len > best_len)
+         *p = '\0';
+         if (pgexporter_art_contains_key(categories, name))
          {
-            best_len = cat_len;
-            best = categories[i];
+            free(best);
+            best = strdup(name);
          }
+         *p = '_';
+         depth++;
       }
    }
 
-   return best != NULL ? strdup(best) : NULL;
+   free(name);
+
+   return best;
 }
 
 /**
- * Helper: Generate HTML table for metrics in a category
+ * Helper: Get the categories selected for a set of metric names
+ * @param signature The hash of the metric names
+ * @param metric_count The number of metric names
+ * @param selected The selected categories
+ * @return 0 upon success, 1 if they need to be selected
  */
-static char*
-generate_metrics_table(struct console_category* category)
+static int
+category_cache_load(uint64_t signature, int metric_count, struct art** selected)
 {
-   char* table_html = NULL;
-   char** label_keys = NULL;
-   int label_key_count = 0;
+   struct category_cache* cache = (struct category_cache*)console_shmem;
+   signed char is_free = STATE_FREE;
+   struct art* s = NULL;
+   int status = 1;
 
-   if (category == NULL || category->metric_count == 0)
+   *selected = NULL;
+
+   /* A cache that is being written isn't waited for */
+   if (cache == NULL || !atomic_compare_exchange_strong(&cache->lock, &is_free, STATE_IN_USE))
    {
-      return pgexporter_append(NULL, "<p>No metrics</p>\n");
+      return 1;
    }
 
-   if (collect_simple_label_columns(category, &label_keys, &label_key_count))
+   if (cache->valid && cache->signature == signature && cache->metric_count == metric_count &&
+       pgexporter_art_create(&s) == 0)
    {
-      pgexporter_log_warn("Failed to collect simple view label columns for category %s", category->name != NULL ? category->name : "unknown");
+      status = 0;
+
+      for (size_t offset = 0; status == 0 && offset < cache->length; offset += strlen(&cache->prefixes[offset]) + 1)
+      {
+         status = pgexporter_art_insert(s, &cache->prefixes[offset], 1, ValueInt32);
+      }
    }
 
-   table_html = pgexporter_append(table_html,
-                                  "<table class=\"metrics-table\">\n"
-                                  "<tr><th class=\"col-name\">Name</th><th class=\"col-type\">Type</th><th class=\"col-value\">Value</th><th class=\"col-labels\">Labels</th>");
+   atomic_store(&cache->lock, STATE_FREE);
 
-   for (int i = 0; i < label_key_count; i++)
+   if (status)
    {
-      table_html = pgexporter_format_and_append(table_html,
-                                                "<th class=\"col-simple-label\">%s</th>",
-                                                label_keys[i]);
+      pgexporter_art_destroy(s);
+      return 1;
    }
 
-   table_html = pgexporter_append(table_html, "</tr>\n");
+   *selected = s;
 
-   for (int m_idx = 0; m_idx < category->metric_count; m_idx++)
-   {
-      struct console_metric* metric = &category->metrics[m_idx];
-      char* labels_str = NULL;
-      bool first_label = true;
+   return 0;
+}
+
+/**
+ * Helper: Keep the categories selected for a set of metric names
+ * @param signature The hash of the metric names
+ * @param metric_count The number of metric names
+ * @param selected The selected categories
+ */
+static void
+category_cache_store(uint64_t signature, int metric_count, struct art* selected)
+{
+   struct category_cache* cache = (struct category_cache*)console_shmem;
+   struct art_iterator* iter = NULL;
+   signed char is_free = STATE_FREE;
+   size_t length = 0;
+
+   if (cache == NULL || !atomic_compare_exchange_strong(&cache->lock, &is_free, STATE_IN_USE))
+   {
+      return;
+   }
+
+   cache->valid = false;
+
+   if (pgexporter_art_iterator_create(selected, &iter) == 0)
+   {
+      cache->valid = true;
+
+      while (pgexporter_art_iterator_next(iter))
+      {
+         size_t size = strlen(iter->key) + 1;
+
+         /* Too many to keep, so they are selected again the next time */
+         if (length + size > sizeof(cache->prefixes))
+         {
+            cache->valid = false;
+            break;
+         }
+
+         memcpy(&cache->prefixes[length], iter->key, size);
+         length += size;
+      }
+
+      pgexporter_art_iterator_destroy(iter);
+   }
+
+   cache->signature = signature;
+   cache->metric_count = metric_count;
+   cache->length = length;
+
+   atomic_store(&cache->lock, STATE_FREE);
+}
+
+/**
+ * Helper: Generate HTML table for metrics in a category
+ */
+static char*
+generate_metrics_table(struct console_category* category)
+{
+   char* table_html = NULL;
+   char** label_keys = NULL;
+   int label_key_count = 0;
+
+   if (category == NULL || category->metric_count == 0)
+   {
+      return pgexporter_append(NULL, "<p>No metrics</p>\n");
+   }
+
+   if (collect_simple_label_columns(category, &label_keys, &label_key_count))
+   {
+      pgexporter_log_warn("Failed to collect simple view label columns for category %s", category->name != NULL ? category->name : "unknown");
+   }
+
+   table_html = pgexporter_append(table_html,
+                                  "<table class=\"metrics-table\">\n"
+                                  "<tr><th class=\"col-name\">Name</th><th class=\"col-type\">Type</th><th class=\"col-value\">Value</th><th class=\"col-labels\">Labels</th>");
+
+   for (int i = 0; i < label_key_count; i++)
+   {
+      table_html = pgexporter_format_and_append(table_html,
+                                                "<th class=\"col-simple-label\">%s</th>",
+                                                label_keys[i]);
+   }
+
+   table_html = pgexporter_append(table_html, "</tr>\n");
+
+   for (int m_idx = 0; m_idx < category->metric_count; m_idx++)
+   {
+      struct console_metric* metric = &category->metrics[m_idx];
+      char* labels_str = NULL;
+      bool first_label = true;
 
       if (metric->label_count > 0)
       {
@@ -1726,21 +1966,14 @@ generate_metrics_table(struct console_category* category)
       }
 
       char value_str[64];
-      long long int_value = (long long)metric->value;
-      if ((double)int_value == metric->value && int_value >= LLONG_MIN && int_value <= LLONG_MAX)
-      {
-         pgexporter_snprintf(value_str, sizeof(value_str), "%lld", int_value);
-      }
-      else
-      {
-         pgexporter_snprintf(value_str, sizeof(value_str), "%.2f", metric->value);
-      }
+      format_metric_value(metric->value, value_str, sizeof(value_str));
 
       table_html = pgexporter_format_and_append(table_html,
-                                                "<tr data-server=\"%s\"><td class=\"col-name\">%s</td><td class=\"col-type\">%s</td><td class=\"col-value\">%s</td><td class=\"col-labels\">%s</td>",
+                                                "<tr data-server=\"%s\"><td class=\"col-name\">%s</td><td class=\"col-type\">%s</td><td class=\"col-value\" id=\"v%016llx\">%s</td><td class=\"col-labels\">%s</td>",
                                                 metric->server != NULL ? metric->server : "all",
                                                 metric->name,
                                                 metric->type,
+                                                (unsigned long long)metric->key,
                                                 value_str,
                                                 labels_str != NULL ? labels_str : "");
 
@@ -1934,12 +2167,34 @@ generate_category_tabs(struct console_page* console)
 
    if (console->status && console->status->servers && console->status->num_servers > 0)
    {
+      time_t now = time(NULL);
+
       for (int s = 0; s < console->status->num_servers; s++)
       {
-         const char* name = console->status->servers[s].name ? console->status->servers[s].name : "server";
+         struct console_server* server = &console->status->servers[s];
+         const char* name = server->name ? server->name : "server";
+         uint64_t total = server->connections + server->connections_reused;
+         char* health = NULL;
+
+         health = pgexporter_format_and_append(health, "Last scrape: %llu ms | Queries: %llu | Errors: %llu | Received: %llu bytes | Reused connections: %llu%%",
+                                               (unsigned long long)server->scrape_duration,
+                                               (unsigned long long)server->queries,
+                                               (unsigned long long)server->query_errors,
+                                               (unsigned long long)server->bytes_received,
+                                               (unsigned long long)(total > 0 ? server->connections_reused * 100 / total : 0));
+         if (server->last_success > 0)
+         {
+            health = pgexporter_format_and_append(health, " | Last success: %.0f s ago", difftime(now, server->last_success));
+         }
+         if (server->discovery > 0)
+         {
+            health = pgexporter_format_and_append(health, " | Discovery: %.0f s ago", difftime(now, server->discovery));
+         }
+
          tabs_html = pgexporter_format_and_append(tabs_html,
-                                                  "<label class=\"dropdown-option\"><input type=\"checkbox\" class=\"server-item\" value=\"%s\" checked> %s</label>\n",
-                                                  name, name);
+                                                  "<label class=\"dropdown-option\" title=\"%s\"><input type=\"checkbox\" class=\"server-item\" value=\"%s\" checked> %s</label>\n",
+                                                  health, name, name);
+         free(health);
       }
    }
    else
@@ -2079,26 +2334,45 @@ generate_category_tabs(struct console_page* console)
    return tabs_html;
 }
 
+int
+pgexporter_console_init(size_t* p_size, void** p_shmem)
+{
+   struct category_cache* cache = NULL;
+   void* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   if (pgexporter_create_shared_memory(sizeof(struct category_cache), config->hugepage, &s))
+   {
+      return 1;
+   }
+
+   /* The mapping is zeroed, so nothing is cached */
+   cache = (struct category_cache*)s;
+   atomic_init(&cache->lock, STATE_FREE);
+
+   *p_size = sizeof(struct category_cache);
+   *p_shmem = s;
+
+   return 0;
+}
+
 void
 pgexporter_console(SSL* client_ssl, int client_fd)
 {
-   struct http_server_request* req = NULL;
-   int status = MESSAGE_STATUS_OK;
+   int status;
 
    pgexporter_start_logging();
    pgexporter_memory_init();
 
-   if (pgexporter_http_server_parse(client_ssl, client_fd, &req) != MESSAGE_STATUS_OK)
-   {
-      goto error;
-   }
-
-   status = pgexporter_http_server_dispatch(client_ssl, client_fd, req,
-                                            console_routes,
-                                            sizeof(console_routes) / sizeof(console_routes[0]));
+   status = pgexporter_http_server_serve(client_ssl, client_fd,
+                                         console_routes,
+                                         sizeof(console_routes) / sizeof(console_routes[0]));
 
-error:
-   pgexporter_http_server_request_destroy(req);
    pgexporter_close_ssl(client_ssl);
    pgexporter_disconnect(client_fd);
 
@@ -2112,3 +2386,582 @@ error:
 
    exit(1);
 }
+
+void
+pgexporter_console_stream(int stream_fd)
+{
+   struct configuration* config = (struct configuration*)shmem;
+   struct stream_subscriber subscribers[STREAM_MAX_SUBSCRIBERS];
+   struct pollfd fds[STREAM_MAX_SUBSCRIBERS + 1];
+   struct art* values = NULL;
+   int number_of_subscribers = 0;
+   int64_t next = 0;
+   pid_t parent = getppid();
+   char buffer[512];
+
+   pgexporter_start_logging();
+   pgexporter_memory_init();
+
+   /* The handlers of the main process don't apply here */
+   signal(SIGTERM, SIG_DFL);
+   signal(SIGINT, SIG_DFL);
+   signal(SIGHUP, SIG_IGN);
+
+   memset(&subscribers, 0, sizeof(subscribers));
+
+   /* Also stop when the main process went away without a shutdown */
+   while (config->keep_running && getppid() == parent)
+   {
+      int64_t now = stream_now();
+      int timeout = 1000;
+      int number_of_fds = 0;
+      int r;
+
+      if (number_of_subscribers > 0 && now >= next)
+      {
+         stream_tick(&subscribers[0], number_of_subscribers, &values);
+         next = now + STREAM_INTERVAL_MS;
+      }
+
+      /* Compact the subscribers that went away */
+      for (int i = 0; i < number_of_subscribers;)
+      {
+         if (subscribers[i].fd == -1)
+         {
+            subscribers[i] = subscribers[--number_of_subscribers];
+         }
+         else
+         {
+            i++;
+         }
+      }
+
+      if (number_of_subscribers == 0)
+      {
+         /* Nobody is watching, so the next viewer starts from a full snapshot */
+         pgexporter_art_destroy(values);
+         values = NULL;
+      }
+      else if (next - now < timeout)
+      {
+         timeout = next - now > 0 ? (int)(next - now) : 0;
+      }
+
+      fds[number_of_fds].fd = stream_fd;
+      fds[number_of_fds].events = POLLIN;
+      fds[number_of_fds].revents = 0;
+      number_of_fds++;
+
+      for (int i = 0; i < number_of_subscribers; i++)
+      {
+         fds[number_of_fds].fd = subscribers[i].fd;
+         fds[number_of_fds].events = POLLIN | (subscribers[i].pending_length > 0 ? POLLOUT : 0);
+         fds[number_of_fds].revents = 0;
+         number_of_fds++;
+      }
+
+      r = poll(&fds[0], number_of_fds, timeout);
+      if (r < 0)
+      {
+         if (errno == EINTR)
+         {
+            errno = 0;
+            continue;
+         }
+
+         pgexporter_log_error("Console stream: poll: %s", strerror(errno));
+         break;
+      }
+
+      for (int i = 0; i < number_of_subscribers; i++)
+      {
+         short revents = fds[i + 1].revents;
+
+         if (revents & (POLLERR | POLLHUP | POLLNVAL))
+         {
+            stream_remove(&subscribers[i]);
+            continue;
+         }
+
+         /* Viewers don't send anything, so a readable socket is a close */
+         if (revents & POLLIN)
+         {
+            ssize_t n = recv(subscribers[i].fd, buffer, sizeof(buffer), 0);
+
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+               stream_remove(&subscribers[i]);
+               continue;
+            }
+         }
+
+         if ((revents & POLLOUT) && stream_flush(&subscribers[i]))
+         {
+            stream_remove(&subscribers[i]);
+         }
+      }
+
+      if (fds[0].revents & POLLIN)
+      {
+         bool first = number_of_subscribers == 0;
+
+         if (stream_add(&subscribers[0], &number_of_subscribers, stream_fd, values) == 0 && first)
+         {
+            next = 0;
+         }
+      }
+   }
+
+   for (int i = 0; i < number_of_subscribers; i++)
+   {
+      stream_remove(&subscribers[i]);
+   }
+
+   pgexporter_art_destroy(values);
+   pgexporter_disconnect(stream_fd);
+
+   pgexporter_memory_destroy();
+   pgexporter_stop_logging();
+
+   exit(0);
+}
+
+/**
+ * Helper: Take a snapshot and push the changed values to the subscribers
+ */
+static void
+stream_tick(struct stream_subscriber* subscribers, int number_of_subscribers, struct art** values)
+{
+   struct prometheus_bridge* bridge = NULL;
+   struct art* current = NULL;
+   char* json = NULL;
+   size_t json_length = 0;
+   char* event = NULL;
+   size_t event_length = 0;
+
+   if (pgexporter_prometheus_client_create_bridge(&bridge) ||
+       pgexporter_prometheus_snapshot(bridge, false) ||
+       stream_values(bridge, &current))
+   {
+      pgexporter_log_debug("Console stream: no snapshot");
+      goto done;
+   }
+
+   if (stream_json(current, *values, &json, &json_length))
+   {
+      goto done;
+   }
+
+   pgexporter_art_destroy(*values);
+   *values = current;
+   current = NULL;
+
+done:
+   if (json != NULL)
+   {
+      event = stream_event(json, json_length, &event_length);
+   }
+   else
+   {
+      /* A comment keeps proxies from timing out and finds closed viewers */
+      event = strdup(": keep-alive\n\n");
+      event_length = event != NULL ? strlen(event) : 0;
+   }
+
+   for (int i = 0; event != NULL && i < number_of_subscribers; i++)
+   {
+      if (subscribers[i].fd != -1 && stream_send(&subscribers[i], event, event_length))
+      {
+         stream_remove(&subscribers[i]);
+      }
+   }
+
+   free(event);
+   free(json);
+   pgexporter_art_destroy(current);
+   pgexporter_prometheus_client_destroy_bridge(bridge);
+}
+
+/**
+ * Helper: Collect the displayed value of every series of a bridge
+ */
+static int
+stream_values(struct prometheus_bridge* bridge, struct art** values)
+{
+   struct art* v = NULL;
+   struct art_iterator* iter = NULL;
+   struct deque_iterator* def_iter = NULL;
+
+   if (pgexporter_art_create(&v) || pgexporter_art_iterator_create(bridge->metrics, &iter))
+   {
+      goto error;
+   }
+
+   while (pgexporter_art_iterator_next(iter))
+   {
+      struct prometheus_metric* prom_metric = (struct prometheus_metric*)iter->value->data;
+
+      if (prom_metric == NULL || prom_metric->name == NULL || prom_metric->definitions == NULL)
+      {
+         continue;
+      }
+
+      if (pgexporter_deque_iterator_create(prom_metric->definitions, &def_iter))
+      {
+         goto error;
+      }
+
+      while (pgexporter_deque_iterator_next(def_iter))
+      {
+         struct prometheus_attributes* attrs = (struct prometheus_attributes*)def_iter->value->data;
+         struct prometheus_value* value = NULL;
+         char key[17];
+         char value_str[64];
+
+         if (attrs == NULL || attrs->values == NULL || pgexporter_deque_size(attrs->values) == 0)
+         {
+            continue;
+         }
+
+         value = (struct prometheus_value*)pgexporter_deque_peek_last(attrs->values, NULL);
+         if (value == NULL || value->value == NULL)
+         {
+            continue;
+         }
+
+         pgexporter_snprintf(key, sizeof(key), "%016llx", (unsigned long long)metric_key(prom_metric, attrs));
+         format_metric_value(atof(value->value), value_str, sizeof(value_str));
+
+         if (pgexporter_art_insert(v, key, (uintptr_t)value_str, ValueString))
+         {
+            goto error;
+         }
+      }
+
+      pgexporter_deque_iterator_destroy(def_iter);
+      def_iter = NULL;
+   }
+
+   pgexporter_art_iterator_destroy(iter);
+
+   *values = v;
+
+   return 0;
+
+error:
+   pgexporter_deque_iterator_destroy(def_iter);
+   pgexporter_art_iterator_destroy(iter);
+   pgexporter_art_destroy(v);
+
+   return 1;
+}
+
+/**
+ * Helper: Render the values that differ from the previous ones as a JSON object
+ * @param values The values
+ * @param previous The previous values, or NULL for all values
+ * @param json The JSON object, or NULL when nothing changed
+ * @param length The length of the JSON object
+ * @return 0 upon success, otherwise 1
+ */
+static int
+stream_json(struct art* values, struct art* previous, char** json, size_t* length)
+{
+   struct art_iterator* iter = NULL;
+   char* data = NULL;
+   size_t size = 0;
+   size_t used = 0;
+
+   *json = NULL;
+   *length = 0;
+
+   if (pgexporter_art_iterator_create(values, &iter))
+   {
+      goto error;
+   }
+
+   while (pgexporter_art_iterator_next(iter))
+   {
+      char* value = (char*)iter->value->data;
+      char* old = previous != NULL ? (char*)pgexporter_art_search(previous, iter->key) : NULL;
+      size_t needed;
+
+      if (old != NULL && strcmp(old, value) == 0)
+      {
+         continue;
+      }
+
+      /* ,"key":"value" and the closing brace */
+      needed = used + strlen(iter->key) + strlen(value) + 8;
+      if (needed > size)
+      {
+         size_t new_size = size == 0 ? 4096 : size;
+         char* resized = NULL;
+
+         while (new_size < needed)
+         {
+            new_size *= 2;
+         }
+
+         resized = realloc(data, new_size);
+         if (resized == NULL)
+         {
+            goto error;
+         }
+
+         data = resized;
+         size = new_size;
+      }
+
+      used += pgexporter_snprintf(data + used, size - used, "%c\"%s\":\"%s\"", used == 0 ? '{' : ',', iter->key, value);
+   }
+
+   pgexporter_art_iterator_destroy(iter);
+
+   if (used > 0)
+   {
+      data[used++] = '}';
+      data[used] = '\0';
+
+      *json = data;
+      *length = used;
+   }
+
+   return 0;
+
+error:
+   pgexporter_art_iterator_destroy(iter);
+   free(data);
+
+   return 1;
+}
+
+/**
+ * Helper: Wrap a JSON object in a server-sent event
+ */
+static char*
+stream_event(char* json, size_t json_length, size_t* length)
+{
+   static const char prefix[] = "event: metrics\ndata: ";
+   char* event = NULL;
+
+   event = malloc(sizeof(prefix) - 1 + json_length + 3);
+   if (event == NULL)
+   {
+      return NULL;
+   }
+
+   memcpy(event, prefix, sizeof(prefix) - 1);
+   memcpy(event + sizeof(prefix) - 1, json, json_length);
+   memcpy(event + sizeof(prefix) - 1 + json_length, "\n\n", 3);
+
+   *length = sizeof(prefix) - 1 + json_length + 2;
+
+   return event;
+}
+
+/**
+ * Helper: Take over a viewer handed over by the console
+ */
+static int
+stream_add(struct stream_subscriber* subscribers, int* number_of_subscribers, int stream_fd, struct art* values)
+{
+   struct stream_subscriber* subscriber = NULL;
+   int client_fd = -1;
+   int fd = -1;
+   int32_t id = 0;
+   char header[256];
+   char* json = NULL;
+   size_t json_length = 0;
+   char* event = NULL;
+   size_t event_length = 0;
+
+   client_fd = accept(stream_fd, NULL, NULL);
+   if (client_fd == -1)
+   {
+      errno = 0;
+      return 1;
+   }
+
+   if (pgexporter_transfer_connection_read(client_fd, &id, &fd))
+   {
+      pgexporter_disconnect(client_fd);
+      return 1;
+   }
+
+   pgexporter_disconnect(client_fd);
+
+   if (*number_of_subscribers == STREAM_MAX_SUBSCRIBERS)
+   {
+      pgexporter_log_warn("Console stream: too many viewers (%d)", STREAM_MAX_SUBSCRIBERS);
+      pgexporter_disconnect(fd);
+      return 1;
+   }
+
+   pgexporter_socket_nonblocking(fd, true);
+
+   subscriber = &subscribers[*number_of_subscribers];
+   memset(subscriber, 0, sizeof(struct stream_subscriber));
+   subscriber->fd = fd;
+
+   pgexporter_snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: text/event-stream\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Connection: keep-alive\r\n"
+                       "\r\n"
+                       "retry: %d\n\n",
+                       STREAM_INTERVAL_MS);
+
+   if (stream_send(subscriber, header, strlen(header)))
+   {
+      goto error;
+   }
+
+   /* Catch up with the current values, the next events only carry changes */
+   if (values != NULL)
+   {
+      if (stream_json(values, NULL, &json, &json_length))
+      {
+         goto error;
+      }
+
+      if (json != NULL)
+      {
+         event = stream_event(json, json_length, &event_length);
+         if (event == NULL || stream_send(subscriber, event, event_length))
+         {
+            goto error;
+         }
+      }
+   }
+
+   (*number_of_subscribers)++;
+
+   free(event);
+   free(json);
+
+   return 0;
+
+error:
+   stream_remove(subscriber);
+
+   free(event);
+   free(json);
+
+   return 1;
+}
+
+/**
+ * Helper: Send to a subscriber without blocking. What the socket doesn't
+ * accept is kept, and a viewer too far behind is given up on
+ */
+static int
+stream_send(struct stream_subscriber* subscriber, char* data, size_t length)
+{
+   if (subscriber->pending_length == 0)
+   {
+      ssize_t n = send(subscriber->fd, data, length, MSG_NOSIGNAL);
+
+      if (n < 0)
+      {
+         if (errno != EAGAIN && errno != EWOULDBLOCK)
+         {
+            errno = 0;
+            return 1;
+         }
+
+         errno = 0;
+         n = 0;
+      }
+
+      data += n;
+      length -= n;
+   }
+
+   if (length > 0)
+   {
+      char* resized = NULL;
+
+      if (subscriber->pending_length + length > STREAM_MAX_PENDING)
+      {
+         pgexporter_log_debug("Console stream: viewer too slow");
+         return 1;
+      }
+
+      resized = realloc(subscriber->pending, subscriber->pending_length + length);
+      if (resized == NULL)
+      {
+         return 1;
+      }
+
+      memcpy(resized + subscriber->pending_length, data, length);
+      subscriber->pending = resized;
+      subscriber->pending_length += length;
+   }
+
+   return 0;
+}
+
+/**
+ * Helper: Send the pending output of a subscriber
+ */
+static int
+stream_flush(struct stream_subscriber* subscriber)
+{
+   ssize_t n;
+
+   if (subscriber->pending_length == 0)
+   {
+      return 0;
+   }
+
+   n = send(subscriber->fd, subscriber->pending, subscriber->pending_length, MSG_NOSIGNAL);
+   if (n < 0)
+   {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+         errno = 0;
+         return 0;
+      }
+
+      errno = 0;
+      return 1;
+   }
+
+   memmove(subscriber->pending, subscriber->pending + n, subscriber->pending_length - n);
+   subscriber->pending_length -= n;
+
+   return 0;
+}
+
+/**
+ * Helper: Close a subscriber, it is compacted away by the worker
+ */
+static void
+stream_remove(struct stream_subscriber* subscriber)
+{
+   if (subscriber->fd != -1)
+   {
+      pgexporter_disconnect(subscriber->fd);
+   }
+
+   free(subscriber->pending);
+
+   subscriber->fd = -1;
+   subscriber->pending = NULL;
+   subscriber->pending_length = 0;
+}
+
+/**
+ * Helper: The monotonic clock in milliseconds
+ */
+static int64_t
+stream_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <derive.h>
+#include <shmem.h>
+#include <utils.h>
+
+/* system */
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void derive_lock(struct derive_table* table);
+static void derive_unlock(struct derive_table* table);
+
+int
+pgexporter_derive_init(size_t* p_size, void** p_shmem)
+{
+   size_t size;
+   struct derive_table* table = NULL;
+   void* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   size = sizeof(struct derive_table);
+
+   if (pgexporter_create_shared_memory(size, config->hugepage, &s))
+   {
+      return 1;
+   }
+
+   /* The mapping is zeroed, so every slot starts out free */
+   table = (struct derive_table*)s;
+   atomic_init(&table->lock, STATE_FREE);
+
+   *p_size = size;
+   *p_shmem = s;
+
+   return 0;
+}
+
+int
+pgexporter_derive_parse(char* str, int* derive)
+{
+   *derive = DERIVE_NONE;
+
+   if (str == NULL || !strcmp(str, "") || !strcmp(str, "none"))
+   {
+      return 0;
+   }
+   else if (!strcmp(str, "rate"))
+   {
+      *derive = DERIVE_RATE;
+   }
+   else if (!strcmp(str, "delta"))
+   {
+      *derive = DERIVE_DELTA;
+   }
+   else if (!strcmp(str, "rate_only"))
+   {
+      *derive = DERIVE_RATE | DERIVE_ONLY;
+   }
+   else if (!strcmp(str, "delta_only"))
+   {
+      *derive = DERIVE_DELTA | DERIVE_ONLY;
+   }
+   else
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+char*
+pgexporter_derive_suffix(int derive)
+{
+   if (derive & DERIVE_RATE)
+   {
+      return "rate";
+   }
+
+   return "delta";
+}
+
+bool
+pgexporter_derive_is_reset(char* name)
+{
+   return !strcmp(name, "stats_reset") || !strcmp(name, "stats_reset_seconds");
+}
+
+uint64_t
+pgexporter_derive_hash(uint64_t hash, char* str)
+{
+   hash = pgexporter_hash_string(hash, str);
+
+   /* Separate the strings, so "ab" + "c" differs from "a" + "bc" */
+   return pgexporter_hash_string(hash, "\xff");
+}
+
+int64_t
+pgexporter_derive_now(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+bool
+pgexporter_derive_sample(uint64_t key, int derive, int64_t now, double value, int64_t reset, double* result)
+{
+   struct derive_table* table = (struct derive_table*)derive_shmem;
+   struct derive_series* series = NULL;
+   struct derive_series* victim = NULL;
+   struct derive_series* slot = NULL;
+   int64_t elapsed;
+   double delta;
+   bool restarted;
+   bool derived = false;
+
+   *result = 0.0;
+
+   if (table == NULL)
+   {
+      return false;
+   }
+
+   /* 0 marks a free slot */
+   if (key == 0)
+   {
+      key = 1;
+   }
+
+   derive_lock(table);
+
+   for (int i = 0; i < DERIVE_PROBE; i++)
+   {
+      slot = &table->series[(key + i) & (DERIVE_NUMBER_OF_SERIES - 1)];
+
+      if (slot->key == key)
+      {
+         series = slot;
+         break;
+      }
+
+      if (slot->key == 0)
+      {
+         /* Series are replaced but never removed, so the key isn't further along */
+         victim = slot;
+         break;
+      }
+
+      if (victim == NULL || slot->time < victim->time)
+      {
+         victim = slot;
+      }
+   }
+
+   if (series == NULL)
+   {
+      victim->key = key;
+      victim->time = now;
+      victim->reset = reset;
+      victim->value = value;
+      goto done;
+   }
+
+   elapsed = now - series->time;
+   if (elapsed <= 0)
+   {
+      goto done;
+   }
+
+   restarted = value < series->value ||
+               (reset != 0 && series->reset != 0 && llabs(reset - series->reset) > DERIVE_RESET_TOLERANCE);
+
+   /* Like Prometheus, a restarted counter counts from zero */
+   delta = restarted ? value : value - series->value;
+
+   if (derive & DERIVE_RATE)
+   {
+      *result = delta * 1000.0 / (double)elapsed;
+   }
+   else
+   {
+      *result = delta;
+   }
+
+   series->time = now;
+   series->value = value;
+   if (reset != 0)
+   {
+      series->reset = reset;
+   }
+
+   derived = true;
+
+done:
+
+   derive_unlock(table);
+
+   return derived;
+}
+
+static void
+derive_lock(struct derive_table* table)
+{
+   signed char lock_free;
+
+   while (true)
+   {
+      lock_free = STATE_FREE;
+      if (atomic_compare_exchange_strong(&table->lock, &lock_free, STATE_IN_USE))
+      {
+         return;
+      }
+
+      SLEEP(1000L);
+   }
+}
+
+static void
+derive_unlock(struct derive_table* table)
+{
+   atomic_store(&table->lock, STATE_FREE);
+}
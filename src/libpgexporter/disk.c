@@ -0,0 +1,1568 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <disk.h>
+#include <logging.h>
+#include <memory.h>
+#include <utils.h>
+
+/* system */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <time.h>
+#include <unistd.h>
+#if HAVE_LINUX
+#include <sys/inotify.h>
+#endif
+
+#define DISK_NUMBER_OF_WORKERS 8
+#define DISK_MAX_DEPTH         128
+
+#define NODE_TOP  -1
+#define NODE_FREE -2
+
+#if HAVE_LINUX
+#define DISK_EVENTS (IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
+
+/** @struct disk_file
+ * A file of a cached directory
+ */
+struct disk_file
+{
+   uint64_t hash;  /**< The hash of the name, 0 for a free slot */
+   uint64_t bytes; /**< The size of the file at the last stat */
+   bool changed;   /**< Modified since the last stat */
+   char* name;     /**< The name */
+};
+
+/** @struct disk_node
+ * A directory of a cached tree
+ */
+struct disk_node
+{
+   int parent;                   /**< The parent, NODE_TOP for the top directory and NODE_FREE for an unused node */
+   int children;                 /**< The number of subdirectories */
+   int wd;                       /**< The watch descriptor, -1 if not watched */
+   bool dirty;                   /**< Scan the directory on the next refresh */
+   bool modified;                /**< Stat the changed files on the next refresh */
+   bool seen;                    /**< Seen by the scan of the parent */
+   dev_t dev;                    /**< The device */
+   ino_t ino;                    /**< The inode */
+   struct timespec mtime;        /**< The modification time at the last scan */
+   uint64_t bytes;               /**< The size of the files of the directory */
+   uint64_t files;               /**< The number of files of the directory */
+   struct disk_file* file_table; /**< The files by the hash of their name, NULL if not known */
+   int file_capacity;            /**< The capacity of the files, a power of 2 */
+   int file_entries;             /**< The number of files in the table */
+   char name[NAME_MAX + 1];      /**< The name, empty for the top directory */
+};
+
+/** @struct disk_root
+ * A cached tree
+ */
+struct disk_root
+{
+   int server;              /**< The server, -1 if unused */
+   int kind;                /**< The kind of directory */
+   bool pgdata;             /**< Is it a data directory */
+   bool tablespace;         /**< Is it a tablespace of a data directory */
+   bool full;               /**< Scan the whole tree on the next refresh */
+   bool tablespaces;        /**< The tablespaces of the data directory may have changed */
+   bool reindex;            /**< The watches of the tree changed */
+   bool keep;               /**< Still a tablespace of its data directory */
+   unsigned long scans;     /**< The number of directories scanned since the last publish */
+   char path[MAX_PATH];     /**< The path of the top directory */
+   struct disk_node* nodes; /**< The directories */
+   int number_of_nodes;     /**< The number of nodes */
+   int capacity;            /**< The capacity of the nodes */
+};
+
+/** @struct disk_watch
+ * The directory of a watch descriptor
+ */
+struct disk_watch
+{
+   int wd;   /**< The watch descriptor */
+   int root; /**< The root */
+   int node; /**< The node */
+};
+
+struct disk
+{
+   int fd;                     /**< The inotify descriptor, -1 if not available */
+   struct disk_root* roots;    /**< The trees */
+   int number_of_roots;        /**< The number of trees */
+   struct disk_watch* watches; /**< The watches sorted by descriptor */
+   int number_of_watches;      /**< The number of watches */
+   bool reindex;               /**< Rebuild the watches */
+   time_t last_poll;           /**< The time of the last scan of the directories that aren't watched */
+   time_t last_full;           /**< The time of the last full scan */
+};
+
+/** @struct disk_pool
+ * The trees to refresh
+ */
+struct disk_pool
+{
+   struct disk* disk; /**< The cache */
+   atomic_int next;   /**< The next tree */
+};
+
+static int add_root(struct disk* disk, int server, int kind, char* path, bool pgdata, bool tablespace);
+static void release_root(struct disk_root* root);
+static void sync_tablespaces(struct disk* disk, int index);
+static int add_node(struct disk_root* root, int parent, char* name);
+static int find_child(struct disk_root* root, int parent, char* name);
+static void remove_children(struct disk_root* root, int node);
+static void remove_node(struct disk_root* root, int node);
+static int node_path(struct disk_root* root, int node, char* path, size_t size);
+static void clear_files(struct disk_node* node);
+static int add_file(struct disk_node* node, char* name, uint64_t bytes);
+static struct disk_file* find_file(struct disk_node* node, char* name);
+static uint64_t file_hash(char* name);
+static void restat_files(struct disk* disk, struct disk_root* root, int node);
+static void add_watch(struct disk* disk, struct disk_root* root, int node, char* path);
+static void scan_directory(struct disk* disk, struct disk_root* root, int node, int fd, char* path, size_t length, bool full);
+static void rescan(struct disk* disk, struct disk_root* root, int node, bool full);
+static void refresh_root(struct disk* disk, struct disk_root* root);
+static void refresh_roots(struct disk* disk);
+static void* refresh_worker(void* arg);
+static void read_events(struct disk* disk, int timeout);
+static void mark_watch(struct disk* disk, int wd, uint32_t mask, char* name);
+static void poll_unwatched(struct disk* disk, bool all);
+static void index_watches(struct disk* disk);
+static int compare_watches(const void* a, const void* b);
+static uint64_t allocated(struct stat* st);
+static void publish(struct disk* disk);
+
+bool
+pgexporter_disk_enabled(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->metrics <= 0)
+   {
+      return false;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      if (config->servers[i].type != SERVER_TYPE_PROMETHEUS &&
+          (strlen(config->servers[i].data) > 0 || strlen(config->servers[i].wal) > 0))
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+int
+pgexporter_disk_create(struct disk** disk)
+{
+   struct disk* d = NULL;
+
+   *disk = NULL;
+
+   d = (struct disk*)calloc(1, sizeof(struct disk));
+   if (d == NULL)
+   {
+      goto error;
+   }
+
+   d->fd = -1;
+   d->last_poll = time(NULL);
+   d->last_full = d->last_poll;
+
+#if HAVE_LINUX
+   d->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if (d->fd == -1)
+   {
+      pgexporter_log_warn("Disk: inotify not available (%s), polling the directories", strerror(errno));
+   }
+#endif
+
+   *disk = d;
+
+   return 0;
+
+error:
+
+   return 1;
+}
+
+int
+pgexporter_disk_add(struct disk* disk, int server, int kind, char* path, bool pgdata)
+{
+   int index;
+
+   index = add_root(disk, server, kind, path, pgdata, false);
+   if (index == -1)
+   {
+      return 1;
+   }
+
+   /* The tablespaces are trees of their own, so they are scanned in parallel */
+   if (pgdata)
+   {
+      sync_tablespaces(disk, index);
+   }
+
+   return 0;
+}
+
+int
+pgexporter_disk_refresh(struct disk* disk, int timeout)
+{
+   time_t now;
+   unsigned long before = 0;
+   unsigned long after = 0;
+
+   read_events(disk, timeout);
+
+   now = time(NULL);
+
+   /* A safety net for the changes that weren't signaled */
+   if (now - disk->last_full >= DISK_FULL_SCAN_INTERVAL)
+   {
+      for (int i = 0; i < disk->number_of_roots; i++)
+      {
+         disk->roots[i].full = true;
+      }
+      disk->last_full = now;
+   }
+
+   if (now - disk->last_poll >= DISK_POLL_INTERVAL)
+   {
+      poll_unwatched(disk, true);
+      disk->last_poll = now;
+   }
+   else
+   {
+      poll_unwatched(disk, false);
+   }
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      before += disk->roots[i].scans;
+   }
+
+   refresh_roots(disk);
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      after += disk->roots[i].scans;
+
+      if (disk->roots[i].reindex)
+      {
+         disk->roots[i].reindex = false;
+         disk->reindex = true;
+      }
+   }
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      if (disk->roots[i].server != -1 && disk->roots[i].pgdata && disk->roots[i].tablespaces)
+      {
+         sync_tablespaces(disk, i);
+      }
+   }
+
+   if (disk->reindex)
+   {
+      index_watches(disk);
+   }
+
+   return (int)(after - before);
+}
+
+int
+pgexporter_disk_usage(struct disk* disk, int server, int kind, uint64_t* bytes, uint64_t* files)
+{
+   bool found = false;
+   struct disk_root* root = NULL;
+
+   *bytes = 0;
+   *files = 0;
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      root = &disk->roots[i];
+
+      if (root->server != server || root->kind != kind)
+      {
+         continue;
+      }
+
+      found = true;
+
+      for (int j = 0; j < root->number_of_nodes; j++)
+      {
+         if (root->nodes[j].parent != NODE_FREE)
+         {
+            *bytes += root->nodes[j].bytes;
+            *files += root->nodes[j].files;
+         }
+      }
+   }
+
+   return found ? 0 : 1;
+}
+
+void
+pgexporter_disk_destroy(struct disk* disk)
+{
+   if (disk == NULL)
+   {
+      return;
+   }
+
+   if (disk->fd != -1)
+   {
+      close(disk->fd);
+   }
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      release_root(&disk->roots[i]);
+   }
+
+   free(disk->roots);
+   free(disk->watches);
+   free(disk);
+}
+
+void
+pgexporter_disk_run(void)
+{
+   char path[MAX_PATH];
+   pid_t parent = getppid();
+   struct disk* disk = NULL;
+   struct server* srv = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgexporter_start_logging();
+   pgexporter_memory_init();
+
+   signal(SIGTERM, SIG_DFL);
+   signal(SIGINT, SIG_DFL);
+   signal(SIGHUP, SIG_IGN);
+
+   /* The servers may have moved since the last run */
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      for (int k = DISK_DATA; k <= DISK_WAL; k++)
+      {
+         atomic_store(&config->servers[i].disk[k].updated, 0);
+         atomic_store(&config->servers[i].disk[k].scans, 0);
+      }
+   }
+
+   if (pgexporter_disk_create(&disk))
+   {
+      pgexporter_log_error("Disk: out of memory");
+      goto error;
+   }
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      srv = &config->servers[i];
+
+      if (srv->type == SERVER_TYPE_PROMETHEUS)
+      {
+         continue;
+      }
+
+      if (strlen(srv->data) > 0)
+      {
+         pgexporter_disk_add(disk, i, DISK_DATA, srv->data, true);
+      }
+
+      if (strlen(srv->wal) > 0)
+      {
+         pgexporter_disk_add(disk, i, DISK_WAL, srv->wal, false);
+      }
+      else if (strlen(srv->data) > 0)
+      {
+         pgexporter_snprintf(&path[0], sizeof(path), "%s/pg_wal", srv->data);
+         pgexporter_disk_add(disk, i, DISK_WAL, &path[0], false);
+      }
+   }
+
+   /* Also stop when the main process went away without a shutdown */
+   while (config->keep_running && getppid() == parent)
+   {
+      pgexporter_disk_refresh(disk, DISK_REFRESH_INTERVAL);
+      publish(disk);
+   }
+
+   pgexporter_disk_destroy(disk);
+
+   pgexporter_memory_destroy();
+   pgexporter_stop_logging();
+
+   exit(0);
+
+error:
+
+   pgexporter_disk_destroy(disk);
+
+   pgexporter_memory_destroy();
+   pgexporter_stop_logging();
+
+   exit(1);
+}
+
+static int
+add_root(struct disk* disk, int server, int kind, char* path, bool pgdata, bool tablespace)
+{
+   int index = -1;
+   struct disk_root* roots = NULL;
+   struct disk_root* root = NULL;
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      if (disk->roots[i].server == -1)
+      {
+         index = i;
+         break;
+      }
+   }
+
+   if (index == -1)
+   {
+      roots = (struct disk_root*)realloc(disk->roots, (disk->number_of_roots + 1) * sizeof(struct disk_root));
+      if (roots == NULL)
+      {
+         return -1;
+      }
+
+      disk->roots = roots;
+      index = disk->number_of_roots++;
+   }
+
+   root = &disk->roots[index];
+   memset(root, 0, sizeof(struct disk_root));
+
+   root->server = server;
+   root->kind = kind;
+   root->pgdata = pgdata;
+   root->tablespace = tablespace;
+   root->full = true;
+   pgexporter_snprintf(&root->path[0], sizeof(root->path), "%s", path);
+
+   if (add_node(root, NODE_TOP, "") == -1)
+   {
+      root->server = -1;
+      return -1;
+   }
+
+   pgexporter_log_debug("Disk: %s", path);
+
+   return index;
+}
+
+static void
+release_root(struct disk_root* root)
+{
+   for (int i = 0; i < root->number_of_nodes; i++)
+   {
+      clear_files(&root->nodes[i]);
+   }
+
+   free(root->nodes);
+   memset(root, 0, sizeof(struct disk_root));
+   root->server = -1;
+}
+
+static void
+sync_tablespaces(struct disk* disk, int index)
+{
+   int fd = -1;
+   int server;
+   int kind;
+   bool found;
+   char link[MAX_PATH];
+   char* resolved = NULL;
+   DIR* dir = NULL;
+   struct dirent* entry = NULL;
+
+   disk->roots[index].tablespaces = false;
+
+   server = disk->roots[index].server;
+   kind = disk->roots[index].kind;
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      if (disk->roots[i].server == server && disk->roots[i].tablespace)
+      {
+         disk->roots[i].keep = false;
+      }
+   }
+
+   pgexporter_snprintf(&link[0], sizeof(link), "%s/pg_tblspc", disk->roots[index].path);
+
+   fd = open(&link[0], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (fd != -1)
+   {
+      dir = fdopendir(fd);
+      if (dir == NULL)
+      {
+         close(fd);
+      }
+   }
+
+   while (dir != NULL && (entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_name[0] == '.')
+      {
+         continue;
+      }
+
+      pgexporter_snprintf(&link[0], sizeof(link), "%s/pg_tblspc/%s", disk->roots[index].path, entry->d_name);
+
+      resolved = realpath(&link[0], NULL);
+      if (resolved == NULL)
+      {
+         continue;
+      }
+
+      found = false;
+      for (int i = 0; i < disk->number_of_roots; i++)
+      {
+         if (disk->roots[i].server == server && disk->roots[i].tablespace && !strcmp(disk->roots[i].path, resolved))
+         {
+            disk->roots[i].keep = true;
+            found = true;
+         }
+      }
+
+      if (!found)
+      {
+         int added = add_root(disk, server, kind, resolved, false, true);
+
+         if (added != -1)
+         {
+            disk->roots[added].keep = true;
+         }
+      }
+
+      free(resolved);
+      resolved = NULL;
+   }
+
+   if (dir != NULL)
+   {
+      closedir(dir);
+   }
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      if (disk->roots[i].server == server && disk->roots[i].tablespace && !disk->roots[i].keep)
+      {
+         pgexporter_log_debug("Disk: %s is gone", disk->roots[i].path);
+         release_root(&disk->roots[i]);
+         disk->reindex = true;
+      }
+   }
+}
+
+static int
+add_node(struct disk_root* root, int parent, char* name)
+{
+   int index = -1;
+   struct disk_node* nodes = NULL;
+   struct disk_node* node = NULL;
+
+   for (int i = 0; i < root->number_of_nodes; i++)
+   {
+      if (root->nodes[i].parent == NODE_FREE)
+      {
+         index = i;
+         break;
+      }
+   }
+
+   if (index == -1)
+   {
+      if (root->number_of_nodes == root->capacity)
+      {
+         int capacity = root->capacity == 0 ? 16 : root->capacity * 2;
+
+         nodes = (struct disk_node*)realloc(root->nodes, capacity * sizeof(struct disk_node));
+         if (nodes == NULL)
+         {
+            return -1;
+         }
+
+         root->nodes = nodes;
+         root->capacity = capacity;
+      }
+
+      index = root->number_of_nodes++;
+   }
+
+   node = &root->nodes[index];
+   memset(node, 0, sizeof(struct disk_node));
+
+   node->parent = parent;
+   node->wd = -1;
+   pgexporter_snprintf(&node->name[0], sizeof(node->name), "%s", name);
+
+   if (parent >= 0)
+   {
+      root->nodes[parent].children++;
+   }
+
+   return index;
+}
+
+static int
+find_child(struct disk_root* root, int parent, char* name)
+{
+   if (root->nodes[parent].children == 0)
+   {
+      return -1;
+   }
+
+   for (int i = 0; i < root->number_of_nodes; i++)
+   {
+      if (root->nodes[i].parent == parent && !strcmp(root->nodes[i].name, name))
+      {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+static void
+remove_children(struct disk_root* root, int node)
+{
+   for (int i = 0; root->nodes[node].children > 0 && i < root->number_of_nodes; i++)
+   {
+      if (root->nodes[i].parent == node)
+      {
+         remove_node(root, i);
+      }
+   }
+}
+
+static void
+remove_node(struct disk_root* root, int node)
+{
+   remove_children(root, node);
+
+   if (root->nodes[node].parent >= 0)
+   {
+      root->nodes[root->nodes[node].parent].children--;
+   }
+
+   /* A watch of a removed directory is dropped by the kernel, and the others
+    * are dropped when they report an event */
+   if (root->nodes[node].wd != -1)
+   {
+      root->reindex = true;
+   }
+
+   clear_files(&root->nodes[node]);
+
+   root->nodes[node].parent = NODE_FREE;
+   root->nodes[node].wd = -1;
+}
+
+static int
+node_path(struct disk_root* root, int node, char* path, size_t size)
+{
+   int chain[DISK_MAX_DEPTH];
+   int depth = 0;
+   size_t length;
+
+   while (node >= 0 && root->nodes[node].parent != NODE_TOP)
+   {
+      if (depth == DISK_MAX_DEPTH)
+      {
+         return 1;
+      }
+
+      chain[depth++] = node;
+      node = root->nodes[node].parent;
+   }
+
+   length = (size_t)pgexporter_snprintf(path, size, "%s", root->path);
+
+   for (int i = depth - 1; i >= 0; i--)
+   {
+      length += (size_t)pgexporter_snprintf(path + length, size - length, "/%s", root->nodes[chain[i]].name);
+      if (length >= size - 1)
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+static void
+clear_files(struct disk_node* node)
+{
+   for (int i = 0; i < node->file_capacity; i++)
+   {
+      free(node->file_table[i].name);
+   }
+
+   free(node->file_table);
+
+   node->file_table = NULL;
+   node->file_capacity = 0;
+   node->file_entries = 0;
+   node->modified = false;
+}
+
+/**
+ * Add a file to the files of a directory
+ * @param node The directory
+ * @param name The name of the file
+ * @param bytes The size of the file
+ * @return 0 upon success, otherwise 1
+ */
+static int
+add_file(struct disk_node* node, char* name, uint64_t bytes)
+{
+   int capacity;
+   uint64_t hash;
+   struct disk_file* table = NULL;
+   struct disk_file* file = NULL;
+
+   /* Keep the load factor at or below 1/2 */
+   if (2 * (node->file_entries + 1) > node->file_capacity)
+   {
+      capacity = node->file_capacity == 0 ? 16 : node->file_capacity * 2;
+
+      table = (struct disk_file*)calloc(capacity, sizeof(struct disk_file));
+      if (table == NULL)
+      {
+         return 1;
+      }
+
+      for (int i = 0; i < node->file_capacity; i++)
+      {
+         if (node->file_table[i].hash != 0)
+         {
+            int slot = (int)(node->file_table[i].hash & (uint64_t)(capacity - 1));
+
+            while (table[slot].hash != 0)
+            {
+               slot = (slot + 1) & (capacity - 1);
+            }
+            table[slot] = node->file_table[i];
+         }
+      }
+
+      free(node->file_table);
+      node->file_table = table;
+      node->file_capacity = capacity;
+   }
+
+   hash = file_hash(name);
+
+   for (int slot = (int)(hash & (uint64_t)(node->file_capacity - 1));; slot = (slot + 1) & (node->file_capacity - 1))
+   {
+      file = &node->file_table[slot];
+
+      if (file->hash == 0)
+      {
+         file->name = strdup(name);
+         if (file->name == NULL)
+         {
+            return 1;
+         }
+
+         file->hash = hash;
+         file->bytes = bytes;
+         file->changed = false;
+         node->file_entries++;
+
+         return 0;
+      }
+   }
+}
+
+static struct disk_file*
+find_file(struct disk_node* node, char* name)
+{
+   uint64_t hash;
+   struct disk_file* file = NULL;
+
+   if (node->file_entries == 0)
+   {
+      return NULL;
+   }
+
+   hash = file_hash(name);
+
+   for (int slot = (int)(hash & (uint64_t)(node->file_capacity - 1));; slot = (slot + 1) & (node->file_capacity - 1))
+   {
+      file = &node->file_table[slot];
+
+      if (file->hash == 0)
+      {
+         return NULL;
+      }
+
+      if (file->hash == hash && !strcmp(file->name, name))
+      {
+         return file;
+      }
+   }
+}
+
+static uint64_t
+file_hash(char* name)
+{
+   uint64_t hash = pgexporter_hash_string(0, name);
+
+   /* 0 marks a free slot */
+   return hash != 0 ? hash : 1;
+}
+
+/**
+ * Stat the files of a directory that were modified since the last
+ * refresh. The directory is scanned if one of them is gone
+ * @param disk The cache
+ * @param root The tree
+ * @param node The directory
+ */
+static void
+restat_files(struct disk* disk, struct disk_root* root, int node)
+{
+   char path[MAX_PATH];
+   size_t length;
+   uint64_t bytes;
+   struct stat st;
+   struct disk_node* n = &root->nodes[node];
+   struct disk_file* file = NULL;
+
+   n->modified = false;
+
+   if (node_path(root, node, &path[0], sizeof(path)))
+   {
+      return;
+   }
+
+   length = strlen(&path[0]);
+
+   for (int i = 0; i < n->file_capacity && !n->dirty; i++)
+   {
+      file = &n->file_table[i];
+
+      if (file->hash == 0 || !file->changed)
+      {
+         continue;
+      }
+
+      file->changed = false;
+
+      if (length + 1 + strlen(file->name) >= sizeof(path))
+      {
+         continue;
+      }
+
+      pgexporter_snprintf(&path[length], sizeof(path) - length, "/%s", file->name);
+
+      if (lstat(&path[0], &st) || !S_ISREG(st.st_mode))
+      {
+         n->dirty = true;
+         continue;
+      }
+
+      bytes = allocated(&st);
+      n->bytes = n->bytes - file->bytes + bytes;
+      file->bytes = bytes;
+   }
+
+   if (n->dirty)
+   {
+      rescan(disk, root, node, false);
+   }
+}
+
+static void
+add_watch(struct disk* disk, struct disk_root* root, int node, char* path)
+{
+#if HAVE_LINUX
+   int wd;
+
+   if (disk->fd == -1)
+   {
+      return;
+   }
+
+   wd = inotify_add_watch(disk->fd, path, DISK_EVENTS);
+   if (wd == -1)
+   {
+      pgexporter_log_debug("Disk: %s isn't watched (%s), polling it", path, strerror(errno));
+      errno = 0;
+      return;
+   }
+
+   root->nodes[node].wd = wd;
+   root->reindex = true;
+#else
+   (void)disk;
+   (void)root;
+   (void)node;
+   (void)path;
+#endif
+}
+
+static void
+scan_directory(struct disk* disk, struct disk_root* root, int node, int fd, char* path, size_t length, bool full)
+{
+   int child;
+   int child_fd;
+   bool top;
+   bool fresh;
+   uint64_t bytes = 0;
+   uint64_t files = 0;
+   size_t child_length;
+   DIR* dir = NULL;
+   struct dirent* entry = NULL;
+   struct stat st;
+
+   if (fstat(fd, &st))
+   {
+      close(fd);
+      return;
+   }
+
+   /* Another directory took the place of the cached one */
+   if (root->nodes[node].dev != st.st_dev || root->nodes[node].ino != st.st_ino)
+   {
+      remove_children(root, node);
+      root->nodes[node].dev = st.st_dev;
+      root->nodes[node].ino = st.st_ino;
+      root->nodes[node].wd = -1;
+   }
+
+   root->nodes[node].mtime = st.st_mtim;
+   root->nodes[node].dirty = false;
+
+   /* The files are stat'ed again, so the table starts over */
+   clear_files(&root->nodes[node]);
+
+   /* Watch before reading, so that no change is missed */
+   if (root->nodes[node].wd == -1)
+   {
+      add_watch(disk, root, node, path);
+   }
+
+   dir = fdopendir(fd);
+   if (dir == NULL)
+   {
+      close(fd);
+      return;
+   }
+
+   top = root->nodes[node].parent == NODE_TOP;
+
+   for (int i = 0; root->nodes[node].children > 0 && i < root->number_of_nodes; i++)
+   {
+      if (root->nodes[i].parent == node)
+      {
+         root->nodes[i].seen = false;
+      }
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
+      {
+         continue;
+      }
+
+      /* The WAL is reported on its own */
+      if (top && root->pgdata && !strcmp(entry->d_name, "pg_wal"))
+      {
+         continue;
+      }
+
+      if (entry->d_type != DT_DIR && entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+      {
+         continue;
+      }
+
+      if (entry->d_type != DT_DIR)
+      {
+         if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW))
+         {
+            continue;
+         }
+
+         if (S_ISREG(st.st_mode))
+         {
+            bytes += allocated(&st);
+            files++;
+
+            /* Without an entry a modification scans the directory */
+            add_file(&root->nodes[node], entry->d_name, allocated(&st));
+            continue;
+         }
+
+         if (!S_ISDIR(st.st_mode))
+         {
+            continue;
+         }
+      }
+
+      child_length = length + 1 + strlen(entry->d_name);
+      if (child_length >= MAX_PATH)
+      {
+         continue;
+      }
+
+      child = find_child(root, node, entry->d_name);
+      fresh = child == -1;
+
+      if (fresh)
+      {
+         child = add_node(root, node, entry->d_name);
+         if (child == -1)
+         {
+            continue;
+         }
+      }
+
+      root->nodes[child].seen = true;
+
+      /* The subdirectories that are known have their own signals */
+      if (!fresh && !full)
+      {
+         continue;
+      }
+
+      child_fd = openat(dirfd(dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      if (child_fd == -1)
+      {
+         if (errno == ENOENT || errno == ENOTDIR)
+         {
+            remove_node(root, child);
+         }
+         errno = 0;
+         continue;
+      }
+
+      path[length] = '/';
+      memcpy(path + length + 1, entry->d_name, child_length - length);
+      scan_directory(disk, root, child, child_fd, path, child_length, true);
+      path[length] = '\0';
+   }
+
+   closedir(dir);
+
+   for (int i = 0; root->nodes[node].children > 0 && i < root->number_of_nodes; i++)
+   {
+      if (root->nodes[i].parent == node && !root->nodes[i].seen)
+      {
+         remove_node(root, i);
+      }
+   }
+
+   root->nodes[node].bytes = bytes;
+   root->nodes[node].files = files;
+   root->scans++;
+
+   if (root->pgdata && root->nodes[node].parent == 0 && !strcmp(root->nodes[node].name, "pg_tblspc"))
+   {
+      root->tablespaces = true;
+   }
+}
+
+static void
+rescan(struct disk* disk, struct disk_root* root, int node, bool full)
+{
+   int fd;
+   int flags = O_RDONLY | O_DIRECTORY | O_CLOEXEC;
+   char path[MAX_PATH];
+
+   root->nodes[node].dirty = false;
+
+   if (node_path(root, node, &path[0], sizeof(path)))
+   {
+      return;
+   }
+
+   /* The top directory may be a link, like a tablespace or pg_wal */
+   if (root->nodes[node].parent != NODE_TOP)
+   {
+      flags |= O_NOFOLLOW;
+   }
+
+   fd = open(&path[0], flags);
+   if (fd == -1)
+   {
+      if (root->nodes[node].parent == NODE_TOP)
+      {
+         remove_children(root, node);
+         root->nodes[node].dev = 0;
+         root->nodes[node].ino = 0;
+         root->nodes[node].bytes = 0;
+         root->nodes[node].files = 0;
+      }
+      else if (errno == ENOENT || errno == ENOTDIR || errno == ELOOP)
+      {
+         root->nodes[root->nodes[node].parent].dirty = true;
+         remove_node(root, node);
+      }
+
+      errno = 0;
+      return;
+   }
+
+   scan_directory(disk, root, node, fd, &path[0], strlen(&path[0]), full);
+}
+
+static void
+refresh_root(struct disk* disk, struct disk_root* root)
+{
+   if (root->server == -1)
+   {
+      return;
+   }
+
+   if (root->full)
+   {
+      root->full = false;
+      rescan(disk, root, 0, true);
+      return;
+   }
+
+   for (int i = 0; i < root->number_of_nodes; i++)
+   {
+      if (root->nodes[i].parent == NODE_FREE)
+      {
+         continue;
+      }
+
+      if (root->nodes[i].dirty)
+      {
+         rescan(disk, root, i, false);
+      }
+      else if (root->nodes[i].modified)
+      {
+         restat_files(disk, root, i);
+      }
+   }
+}
+
+static void
+refresh_roots(struct disk* disk)
+{
+   pthread_t workers[DISK_NUMBER_OF_WORKERS];
+   int n_workers = 0;
+   int n_roots = 0;
+   int max_workers;
+   long cpus;
+   struct disk_pool pool;
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      if (disk->roots[i].server != -1 && disk->roots[i].full)
+      {
+         n_roots++;
+      }
+   }
+
+   pool.disk = disk;
+   atomic_init(&pool.next, 0);
+
+   cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   max_workers = MIN(n_roots, MIN(cpus > 0 ? (int)cpus : 1, DISK_NUMBER_OF_WORKERS));
+
+   /* Only the full scans are worth the threads. The calling thread is one of the workers */
+   for (int i = 1; i < max_workers; i++)
+   {
+      if (pthread_create(&workers[n_workers], NULL, refresh_worker, &pool))
+      {
+         break;
+      }
+      n_workers++;
+   }
+
+   refresh_worker(&pool);
+
+   for (int i = 0; i < n_workers; i++)
+   {
+      pthread_join(workers[i], NULL);
+   }
+}
+
+static void*
+refresh_worker(void* arg)
+{
+   struct disk_pool* pool = (struct disk_pool*)arg;
+   int i;
+
+   while ((i = atomic_fetch_add(&pool->next, 1)) < pool->disk->number_of_roots)
+   {
+      refresh_root(pool->disk, &pool->disk->roots[i]);
+   }
+
+   return NULL;
+}
+
+static void
+read_events(struct disk* disk, int timeout)
+{
+#if HAVE_LINUX
+   char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+   ssize_t length;
+   struct pollfd pfd;
+   const struct inotify_event* event = NULL;
+
+   if (disk->fd == -1)
+   {
+      poll(NULL, 0, timeout);
+      return;
+   }
+
+   pfd.fd = disk->fd;
+   pfd.events = POLLIN;
+   pfd.revents = 0;
+
+   if (poll(&pfd, 1, timeout) <= 0)
+   {
+      errno = 0;
+      return;
+   }
+
+   while ((length = read(disk->fd, &buffer[0], sizeof(buffer))) > 0)
+   {
+      for (char* p = &buffer[0]; p < &buffer[0] + length; p += sizeof(struct inotify_event) + event->len)
+      {
+         event = (const struct inotify_event*)p;
+
+         if (event->mask & IN_Q_OVERFLOW)
+         {
+            pgexporter_log_debug("Disk: too many changes, scanning everything");
+
+            for (int i = 0; i < disk->number_of_roots; i++)
+            {
+               disk->roots[i].full = true;
+            }
+            continue;
+         }
+
+         mark_watch(disk, event->wd, event->mask, event->len > 0 ? (char*)event->name : NULL);
+      }
+   }
+
+   errno = 0;
+#else
+   (void)disk;
+   poll(NULL, 0, timeout);
+#endif
+}
+
+static void
+mark_watch(struct disk* disk, int wd, uint32_t mask, char* name)
+{
+#if HAVE_LINUX
+   int lo = 0;
+   int hi = disk->number_of_watches;
+   bool found = false;
+   struct disk_root* root = NULL;
+   struct disk_node* node = NULL;
+   struct disk_file* file = NULL;
+
+   while (lo < hi)
+   {
+      int mid = lo + (hi - lo) / 2;
+
+      if (disk->watches[mid].wd < wd)
+      {
+         lo = mid + 1;
+      }
+      else
+      {
+         hi = mid;
+      }
+   }
+
+   /* The same directory may be in more than one tree */
+   for (int i = lo; i < disk->number_of_watches && disk->watches[i].wd == wd; i++)
+   {
+      root = &disk->roots[disk->watches[i].root];
+
+      if (root->server == -1 || disk->watches[i].node >= root->number_of_nodes)
+      {
+         continue;
+      }
+
+      node = &root->nodes[disk->watches[i].node];
+
+      if (node->parent == NODE_FREE || node->wd != wd)
+      {
+         continue;
+      }
+
+      found = true;
+
+      if (mask & IN_IGNORED)
+      {
+         node->wd = -1;
+         disk->reindex = true;
+      }
+
+      if ((mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) && node->parent >= 0)
+      {
+         root->nodes[node->parent].dirty = true;
+      }
+
+      /* A file that changes its size only needs a stat, the entries of the
+       * directory only change with a create, delete or move */
+      if ((mask & IN_MODIFY) && !(mask & IN_ISDIR) && name != NULL && !node->dirty)
+      {
+         file = find_file(node, name);
+         if (file != NULL)
+         {
+            file->changed = true;
+            node->modified = true;
+            continue;
+         }
+      }
+
+      node->dirty = true;
+   }
+
+   if (!found && !(mask & IN_IGNORED))
+   {
+      inotify_rm_watch(disk->fd, wd);
+   }
+#else
+   (void)disk;
+   (void)wd;
+   (void)mask;
+   (void)name;
+#endif
+}
+
+static void
+poll_unwatched(struct disk* disk, bool all)
+{
+   char path[MAX_PATH];
+   struct stat st;
+   struct disk_root* root = NULL;
+   struct disk_node* node = NULL;
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      root = &disk->roots[i];
+
+      if (root->server == -1 || root->full)
+      {
+         continue;
+      }
+
+      for (int j = 0; j < root->number_of_nodes; j++)
+      {
+         node = &root->nodes[j];
+
+         if (node->parent == NODE_FREE || node->wd != -1 || node->dirty)
+         {
+            continue;
+         }
+
+         /* A new or removed entry changes the directory, a file that grows doesn't */
+         if (all)
+         {
+            node->dirty = true;
+         }
+         else if (node_path(root, j, &path[0], sizeof(path)) == 0)
+         {
+            if (stat(&path[0], &st) || st.st_mtim.tv_sec != node->mtime.tv_sec || st.st_mtim.tv_nsec != node->mtime.tv_nsec)
+            {
+               node->dirty = true;
+            }
+         }
+      }
+   }
+}
+
+static void
+index_watches(struct disk* disk)
+{
+   int count = 0;
+   struct disk_watch* watches = NULL;
+
+   disk->reindex = false;
+
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      for (int j = 0; disk->roots[i].server != -1 && j < disk->roots[i].number_of_nodes; j++)
+      {
+         if (disk->roots[i].nodes[j].parent != NODE_FREE && disk->roots[i].nodes[j].wd != -1)
+         {
+            count++;
+         }
+      }
+   }
+
+   free(disk->watches);
+   disk->watches = NULL;
+   disk->number_of_watches = 0;
+
+   if (count == 0)
+   {
+      return;
+   }
+
+   watches = (struct disk_watch*)malloc(count * sizeof(struct disk_watch));
+   if (watches == NULL)
+   {
+      return;
+   }
+
+   count = 0;
+   for (int i = 0; i < disk->number_of_roots; i++)
+   {
+      for (int j = 0; disk->roots[i].server != -1 && j < disk->roots[i].number_of_nodes; j++)
+      {
+         if (disk->roots[i].nodes[j].parent != NODE_FREE && disk->roots[i].nodes[j].wd != -1)
+         {
+            watches[count].wd = disk->roots[i].nodes[j].wd;
+            watches[count].root = i;
+            watches[count].node = j;
+            count++;
+         }
+      }
+   }
+
+   qsort(watches, count, sizeof(struct disk_watch), compare_watches);
+
+   disk->watches = watches;
+   disk->number_of_watches = count;
+}
+
+static int
+compare_watches(const void* a, const void* b)
+{
+   const struct disk_watch* wa = (const struct disk_watch*)a;
+   const struct disk_watch* wb = (const struct disk_watch*)b;
+
+   return (wa->wd > wb->wd) - (wa->wd < wb->wd);
+}
+
+static uint64_t
+allocated(struct stat* st)
+{
+   uint64_t blocks;
+
+   /* Same as pgexporter_directory_size() */
+   if (st->st_blksize <= 0)
+   {
+      return (uint64_t)st->st_size;
+   }
+
+   blocks = (uint64_t)st->st_size / (uint64_t)st->st_blksize;
+   if ((uint64_t)st->st_size % (uint64_t)st->st_blksize != 0)
+   {
+      blocks++;
+   }
+
+   return blocks * (uint64_t)st->st_blksize;
+}
+
+static void
+publish(struct disk* disk)
+{
+   time_t now;
+   uint64_t bytes;
+   uint64_t files;
+   unsigned long scans;
+   struct statvfs sv;
+   struct disk_usage* usage = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   now = time(NULL);
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      for (int k = DISK_DATA; k <= DISK_WAL; k++)
+      {
+         if (pgexporter_disk_usage(disk, i, k, &bytes, &files))
+         {
+            continue;
+         }
+
+         usage = &config->servers[i].disk[k];
+         scans = 0;
+
+         for (int j = 0; j < disk->number_of_roots; j++)
+         {
+            if (disk->roots[j].server != i || disk->roots[j].kind != k)
+            {
+               continue;
+            }
+
+            scans += disk->roots[j].scans;
+            disk->roots[j].scans = 0;
+
+            if (!disk->roots[j].tablespace && statvfs(disk->roots[j].path, &sv) == 0)
+            {
+               atomic_store(&usage->free, (uint64_t)sv.f_bavail * (uint64_t)sv.f_frsize);
+               atomic_store(&usage->total, (uint64_t)sv.f_blocks * (uint64_t)sv.f_frsize);
+            }
+         }
+
+         atomic_store(&usage->used, bytes);
+         atomic_store(&usage->files, files);
+         atomic_fetch_add(&usage->scans, scans);
+         atomic_store(&usage->updated, (long long)now);
+      }
+   }
+}
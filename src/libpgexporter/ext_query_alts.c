@@ -234,6 +234,14 @@ pgexporter_free_extension_query_alts(struct configuration* config)
             pgexporter_free_extension_node_avl(&config->extensions[i].metrics[j].ext_root);
          }
       }
+
+      if (config->extensions[i].metrics != NULL)
+      {
+         pgexporter_destroy_shared_memory(config->extensions[i].metrics, config->extensions[i].capacity * sizeof(struct prometheus));
+      }
+      config->extensions[i].metrics = NULL;
+      config->extensions[i].capacity = 0;
+      config->extensions[i].number_of_metrics = 0;
    }
 }
 
@@ -299,6 +299,10 @@ error:
 int
 pgexporter_load_extension_yamls(struct configuration* config)
 {
+   char* names[NUMBER_OF_EXTENSIONS];
+   int number_of_names = 0;
+   bool found;
+
    if (!config)
    {
       pgexporter_log_debug("Invalid configuration for extension YAML loading");
@@ -309,9 +313,10 @@ pgexporter_load_extension_yamls(struct configuration* config)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd == -1)
+      /* The extensions are detected when a connection is made, also by the scrape processes */
+      if (config->servers[server].number_of_extensions == 0)
       {
-         pgexporter_log_debug("Server %s is not connected, skipping extension YAML loading",
+         pgexporter_log_debug("Server %s has no detected extensions, skipping extension YAML loading",
                               config->servers[server].name);
          continue;
       }
@@ -324,15 +329,19 @@ pgexporter_load_extension_yamls(struct configuration* config)
       {
          if (config->servers[server].extensions[i].enabled)
          {
-            pgexporter_log_debug("Attempting to load YAML for extension: %s",
-                                 config->servers[server].extensions[i].name);
+            /* Each extension YAML is loaded once, whatever the number of servers */
+            found = false;
+            for (int j = 0; !found && j < number_of_names; j++)
+            {
+               found = !strcmp(names[j], config->servers[server].extensions[i].name);
+            }
 
-            if (pgexporter_load_single_extension_yaml(config->extensions_path,
-                                                      config->servers[server].extensions[i].name,
-                                                      config))
+            if (!found && number_of_names < NUMBER_OF_EXTENSIONS)
             {
-               pgexporter_log_debug("Failed to load YAML for extension: %s",
+               pgexporter_log_debug("Attempting to load YAML for extension: %s",
                                     config->servers[server].extensions[i].name);
+
+               names[number_of_names++] = config->servers[server].extensions[i].name;
             }
          }
          else
@@ -343,6 +352,12 @@ pgexporter_load_extension_yamls(struct configuration* config)
       }
    }
 
+   if (number_of_names > 0 &&
+       pgexporter_load_extension_yaml_list(config->extensions_path, names, number_of_names, config))
+   {
+      pgexporter_log_debug("Failed to load the YAML of some extensions");
+   }
+
    return 0;
 
 error:
@@ -403,7 +403,8 @@ pgexporter_history_tick_cb(void)
    int tick_time = 0;
    bool expected = false;
 
-   if (config == NULL || config->history == 0)
+   /* The shards store the snapshots of their own servers */
+   if (config == NULL || config->history == 0 || config->metrics_shards > 0)
    {
       return;
    }
@@ -506,68 +507,14 @@ pgexporter_history_retention_tick_cb(void)
    history_retention_worker();
 }
 
-static bool
-history_query_param(const char* query, const char* name, char* out, size_t out_size)
-{
-   size_t name_len = strlen(name);
-   const char* p = query;
-
-   if (p == NULL)
-   {
-      return false;
-   }
-
-   while (*p != '\0')
-   {
-      const char* eq = strchr(p, '=');
-      const char* amp = strchr(p, '&');
-      size_t key_len;
-
-      if (eq == NULL || (amp != NULL && amp < eq))
-      {
-         if (amp == NULL)
-         {
-            break;
-         }
-         p = amp + 1;
-         continue;
-      }
-
-      key_len = (size_t)(eq - p);
-
-      if (key_len == name_len && strncmp(p, name, name_len) == 0)
-      {
-         const char* val_start = eq + 1;
-         size_t val_len = amp != NULL ? (size_t)(amp - val_start) : strlen(val_start);
-
-         if (val_len >= out_size)
-         {
-            val_len = out_size - 1;
-         }
-
-         memcpy(out, val_start, val_len);
-         out[val_len] = '\0';
-         return true;
-      }
-
-      if (amp == NULL)
-      {
-         break;
-      }
-
-      p = amp + 1;
-   }
-
-   return false;
-}
-
 void
 pgexporter_history_http(SSL* ssl, int fd)
 {
+   struct http_server_parser* parser = NULL;
    struct http_server_request* req = NULL;
+   struct http_server_slice metric_name;
+   struct http_server_slice value;
    struct configuration* config;
-   char* path = NULL;
-   char* query = NULL;
    char metric[PROMETHEUS_LENGTH];
    char value_buf[64];
    time_t ts;
@@ -604,7 +551,7 @@ pgexporter_history_http(SSL* ssl, int fd)
       {
          /*
           * Plain HTTP on a TLS port — redirect to HTTPS. Read the raw message
-          * here (not via pgexporter_http_server_parse) because we need the path
+          * here (not via the request parser) because we need the path
           * for the redirect URL and the process exits immediately after.
           */
          struct message* redirect_msg = NULL;
@@ -648,46 +595,43 @@ pgexporter_history_http(SSL* ssl, int fd)
       /* MESSAGE_STATUS_OK: TLS handshake done, proceed to parse */
    }
 
-   if (pgexporter_http_server_parse(ssl, fd, &req) != MESSAGE_STATUS_OK)
+   if (pgexporter_http_server_parser_create(ssl, fd, &parser) ||
+       pgexporter_http_server_parser_next(parser, &req) != MESSAGE_STATUS_OK ||
+       !pgexporter_http_server_slice_equals(&req->method, "GET"))
    {
       goto error;
    }
 
-   path = req->path;
-   query = strchr(path, '?');
-   if (query != NULL)
+   if (req->path.length <= strlen("/history/") || strncmp(req->path.data, "/history/", strlen("/history/")) != 0)
    {
-      *query = '\0';
-      query++;
+      pgexporter_http_respond_404(ssl, fd);
+      goto done;
    }
 
-   if (strncmp(path, "/history/", strlen("/history/")) != 0 || strlen(path) <= strlen("/history/"))
+   metric_name.data = req->path.data + strlen("/history/");
+   metric_name.length = req->path.length - strlen("/history/");
+
+   if (pgexporter_http_server_slice_copy(&metric_name, metric, sizeof(metric)))
    {
-      pgexporter_http_respond_404(ssl, fd);
+      pgexporter_http_respond_400(ssl, fd);
       goto done;
    }
 
-   memset(metric, 0, sizeof(metric));
+   ts = time(NULL);
+   duration = -3600;
+
+   if (pgexporter_http_server_query_param(req, "timestamp", &value))
    {
-      const char* metric_name = path + strlen("/history/");
-      size_t metric_len = strlen(metric_name);
+      char* endptr = NULL;
+      long long parsed = 0;
 
-      if (metric_len == 0 || metric_len >= sizeof(metric))
+      if (pgexporter_http_server_slice_copy(&value, value_buf, sizeof(value_buf)))
       {
          pgexporter_http_respond_400(ssl, fd);
          goto done;
       }
 
-      memcpy(metric, metric_name, metric_len);
-   }
-
-   ts = time(NULL);
-   duration = -3600;
-
-   if (history_query_param(query, "timestamp", value_buf, sizeof(value_buf)))
-   {
-      char* endptr = NULL;
-      long long parsed = strtoll(value_buf, &endptr, 10);
+      parsed = strtoll(value_buf, &endptr, 10);
 
       if (endptr == value_buf || *endptr != '\0')
       {
@@ -698,10 +642,16 @@ pgexporter_history_http(SSL* ssl, int fd)
       ts = (time_t)parsed;
    }
 
-   if (history_query_param(query, "duration", value_buf, sizeof(value_buf)))
+   if (pgexporter_http_server_query_param(req, "duration", &value))
    {
       char* endptr = NULL;
 
+      if (pgexporter_http_server_slice_copy(&value, value_buf, sizeof(value_buf)))
+      {
+         pgexporter_http_respond_400(ssl, fd);
+         goto done;
+      }
+
       duration = strtoll(value_buf, &endptr, 10);
 
       if (endptr == value_buf || *endptr != '\0')
@@ -763,7 +713,7 @@ done:
    free(json_str);
    pgexporter_json_destroy(root);
    pgexporter_history_records_free(records, count);
-   pgexporter_http_server_request_destroy(req);
+   pgexporter_http_server_parser_destroy(parser);
    pgexporter_close_ssl(ssl);
    pgexporter_disconnect(fd);
    pgexporter_memory_destroy();
@@ -772,7 +722,7 @@ done:
 
 error:
    pgexporter_http_respond_400(ssl, fd);
-   pgexporter_http_server_request_destroy(req);
+   pgexporter_http_server_parser_destroy(parser);
    pgexporter_close_ssl(ssl);
    pgexporter_disconnect(fd);
    pgexporter_memory_destroy();
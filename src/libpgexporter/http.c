@@ -37,14 +37,45 @@
 /* system */
 #include <errno.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <zlib.h>
 #include <openssl/err.h>
 
+#define HTTP_BODY_BUFFER_SIZE 16384
+
+/** @struct http_body
+ * The state of reading a response body
+ */
+struct http_body
+{
+   SSL* ssl;                           /**< The SSL connection */
+   int socket;                         /**< The socket descriptor */
+   struct http_response* response;     /**< The response */
+   char buffer[HTTP_BODY_BUFFER_SIZE]; /**< The receive buffer */
+   size_t start;                       /**< The first unread byte in the buffer */
+   size_t end;                         /**< The end of the data in the buffer */
+   size_t capacity;                    /**< The capacity of the buffered payload */
+   bool inflate;                       /**< Is the body decompressed */
+   bool stream_end;                    /**< Has the end of the compressed stream been seen */
+   z_stream stream;                    /**< The decompression stream */
+};
+
 static int http_parse_header(char** header, struct http_response* http_response);
 static int http_read_response_body(SSL* ssl, int socket, struct http_response* http_response);
 static int http_read_response_header(SSL* ssl, int socket, char** header_text, struct http_response* http_response);
 static int http_build_request(struct http* connection, struct http_request* request, char** full_request, size_t* full_request_size);
 static char* http_method_to_string(int method);
+static ssize_t http_read_bytes(SSL* ssl, int socket, char* buffer, size_t size);
+static int http_body_create(SSL* ssl, int socket, struct http_response* http_response, struct http_body* body);
+static int http_body_destroy(struct http_body* body, int status);
+static ssize_t http_body_fill(struct http_body* body);
+static int http_body_line(struct http_body* body, char* line, size_t size);
+static int http_body_deliver(struct http_body* body, char* data, size_t size);
+static int http_body_sink(struct http_body* body, char* data, size_t size);
+static int http_read_chunked_body(struct http_body* body);
+static int http_read_content_length_body(struct http_body* body, size_t content_length);
+static int http_read_EOF_body(struct http_body* body);
 
 int
 pgexporter_http_create(char* hostname, int port, bool secure, struct http** result)
@@ -396,6 +427,12 @@ pgexporter_http_invoke(struct http* connection, struct http_request* request, st
       response_owned = true;
    }
 
+   /* Ask for a compressed body when it is decompressed on the fly */
+   if (http_response->decompress && pgexporter_http_request_get_header(request, "Accept-Encoding") == NULL)
+   {
+      pgexporter_http_request_add_header(request, "Accept-Encoding", "gzip, deflate");
+   }
+
    if (http_build_request(connection, request, &full_request, &full_request_size))
    {
       pgexporter_log_error("Failed to build HTTP request");
@@ -495,6 +532,81 @@ error:
    return PGEXPORTER_HTTP_STATUS_ERROR;
 }
 
+size_t
+pgexporter_http_line_sink_write(void* buffer, size_t size, void* userdata)
+{
+   struct http_line_sink* sink = (struct http_line_sink*)userdata;
+   char* data = (char*)buffer;
+   size_t total = size;
+   char* eol = NULL;
+   int ret;
+   size_t length;
+   size_t capacity;
+   char* l = NULL;
+
+   while (size > 0)
+   {
+      eol = memchr(data, '\n', size);
+      length = eol != NULL ? (size_t)(eol - data) : size;
+
+      /* Lines are assembled in a buffer sized to the longest line */
+      if (sink->line_size + length + 1 > sink->line_capacity)
+      {
+         capacity = MAX(sink->line_capacity * 2, sink->line_size + length + 1);
+         capacity = MAX(capacity, (size_t)256);
+
+         l = (char*)realloc(sink->line, capacity);
+         if (l == NULL)
+         {
+            return 0;
+         }
+
+         sink->line = l;
+         sink->line_capacity = capacity;
+      }
+
+      memcpy(sink->line + sink->line_size, data, length);
+      sink->line_size += length;
+      sink->line[sink->line_size] = '\0';
+
+      if (eol == NULL)
+      {
+         break;
+      }
+
+      ret = sink->line_cb(sink->line, sink->userdata);
+      sink->line_size = 0;
+
+      if (ret)
+      {
+         return 0;
+      }
+
+      data = eol + 1;
+      size -= length + 1;
+   }
+
+   return total;
+}
+
+int
+pgexporter_http_line_sink_finish(struct http_line_sink* sink)
+{
+   int ret = PGEXPORTER_HTTP_STATUS_OK;
+
+   if (sink->line_size > 0 && sink->line_cb(sink->line, sink->userdata))
+   {
+      ret = PGEXPORTER_HTTP_STATUS_ERROR;
+   }
+
+   free(sink->line);
+   sink->line = NULL;
+   sink->line_size = 0;
+   sink->line_capacity = 0;
+
+   return ret;
+}
+
 int
 pgexporter_http_request_destroy(struct http_request* request)
 {
@@ -587,338 +699,484 @@ http_read_response_header(SSL* ssl, int socket,
                           char** header_text,
                           struct http_response* http_response)
 {
-   char buffer[8192];
+   char* text = NULL;
+   char* t = NULL;
    ssize_t bytes_read;
    size_t total = 0;
-   char* end = NULL;
+   size_t capacity = 0;
+   size_t header_len = 0;
+   size_t extra;
 
    *header_text = NULL;
 
-   // read to the buffer
-   while (!end)
+   /* The body may follow the header in the same read, so the text is not assumed to be a string */
+   while (header_len == 0)
    {
-      bytes_read = http_read_bytes(ssl, socket, buffer, sizeof(buffer) - 1);
-      if (bytes_read < 0)
+      if (total + 8192 + 1 > capacity)
+      {
+         capacity = MAX(capacity * 2, total + 8192 + 1);
+
+         t = (char*)realloc(text, capacity);
+         if (t == NULL)
+         {
+            goto error;
+         }
+         text = t;
+      }
+
+      bytes_read = http_read_bytes(ssl, socket, text + total, 8192);
+      if (bytes_read <= 0)
       {
-         free(*header_text);
          goto error;
       }
 
-      buffer[bytes_read] = '\0';
-      *header_text = pgexporter_append(*header_text, buffer);
+      /* Resume the search where the terminator could start */
+      for (size_t i = total >= 3 ? total - 3 : 0; i + 4 <= total + bytes_read; i++)
+      {
+         if (!memcmp(text + i, "\r\n\r\n", 4))
+         {
+            // add 4 bytes for the \r\n\r\n CLRF
+            header_len = i + 4;
+            break;
+         }
+      }
+
       total += bytes_read;
 
-      if (total > MAX_HEADER_SIZE)
+      /* The limit is on the header, the body may follow in the same read */
+      if (header_len == 0 && total > MAX_HEADER_SIZE)
       {
-         free(*header_text);
          goto error;
       }
-
-      end = strstr(*header_text, "\r\n\r\n");
    }
 
    // store the rest as body/data of the http request
-   // add 4 bytes for the \r\n\r\n CLRF
-   size_t header_len = (end - *header_text) + 4;
-   size_t extra = total - header_len;
+   extra = total - header_len;
 
    if (extra > 0)
    {
       http_response->payload.data = malloc(extra + 1);
       if (!http_response->payload.data)
       {
-         free(*header_text);
          goto error;
       }
 
-      memcpy(http_response->payload.data, *header_text + header_len, extra);
+      memcpy(http_response->payload.data, text + header_len, extra);
       ((char*)http_response->payload.data)[extra] = '\0';
       http_response->payload.data_size = extra;
    }
 
+   *header_text = text;
    (*header_text)[header_len] = '\0';
    return MESSAGE_STATUS_OK;
 error:
+   free(text);
    return MESSAGE_STATUS_ERROR;
 }
 
 static int
-http_read_chunked_body(SSL* ssl, int socket, struct http_response* http_response)
+http_body_create(SSL* ssl, int socket, struct http_response* http_response, struct http_body* body)
 {
-   char buffer[8192];
-   ssize_t bytes_read;
-   char* prefetched = (char*)http_response->payload.data;
-   size_t prefetched_size = http_response->payload.data_size;
-   size_t prefetched_pos = 0;
+   char* encoding = NULL;
+
+   memset(body, 0, sizeof(struct http_body));
+
+   body->ssl = ssl;
+   body->socket = socket;
+   body->response = http_response;
+
+   /* Body bytes read together with the header are decoded first */
+   if (http_response->payload.data_size > sizeof(body->buffer))
+   {
+      goto error;
+   }
 
-   // body bytes may already be buffered while reading headers; chunk decode
-   // from those bytes first, then continue reading from the socket.
+   if (http_response->payload.data_size > 0)
+   {
+      memcpy(body->buffer, http_response->payload.data, http_response->payload.data_size);
+      body->end = http_response->payload.data_size;
+   }
+
+   free(http_response->payload.data);
    http_response->payload.data = NULL;
    http_response->payload.data_size = 0;
 
-   while (1)
+   encoding = (char*)pgexporter_deque_get(http_response->payload.headers, "Content-Encoding");
+
+   if (http_response->decompress && encoding != NULL && strcasecmp(encoding, "identity"))
    {
-      // read chunk size line
-      char chunk_size_line[32] = {0};
-      int line_pos = 0;
+      int window_bits;
 
-      while (line_pos < (int)sizeof(chunk_size_line) - 1)
+      if (!strcasecmp(encoding, "gzip") || !strcasecmp(encoding, "x-gzip"))
       {
-         char c;
-         // check the prefetched bytes for ordering them
-         if (prefetched_pos < prefetched_size)
-         {
-            c = prefetched[prefetched_pos++];
-            bytes_read = 1;
-         }
-         else
-         {
-            bytes_read = http_read_bytes(ssl, socket, &c, 1);
-         }
-         if (bytes_read <= 0)
-            goto error;
+         window_bits = MAX_WBITS + 16;
+      }
+      else if (!strcasecmp(encoding, "deflate"))
+      {
+         window_bits = MAX_WBITS;
+      }
+      else
+      {
+         pgexporter_log_error("Unsupported HTTP Content-Encoding: %s", encoding);
+         goto error;
+      }
 
-         if (c == '\n')
-            break;
-         if (c != '\r')
-            chunk_size_line[line_pos++] = c;
+      if (inflateInit2(&body->stream, window_bits) != Z_OK)
+      {
+         pgexporter_log_error("Failed to initialize HTTP body decompression");
+         goto error;
       }
 
-      size_t chunk_size = strtoul(chunk_size_line, NULL, 16);
+      body->inflate = true;
+   }
 
-      // last chunk
-      // we read 2 bytes here cause the \r\n
-      if (chunk_size == 0)
+   return 0;
+
+error:
+
+   return 1;
+}
+
+static int
+http_body_destroy(struct http_body* body, int status)
+{
+   if (body->inflate)
+   {
+      /* A truncated compressed stream is an error */
+      if (status == MESSAGE_STATUS_OK && !body->stream_end)
       {
-         char trailing[2];
-         // check if prefetched bytes are available
-         if (prefetched_pos < prefetched_size)
-         {
-            size_t remaining_prefetched = prefetched_size - prefetched_pos;
-            if (remaining_prefetched >= 2)
-            {
-               memcpy(trailing, prefetched + prefetched_pos, 2);
-               prefetched_pos += 2;
-               bytes_read = 2;
-            }
-            else
-            {
-               bytes_read = http_read_bytes(ssl, socket, trailing, 2);
-            }
-         }
-         else
-         {
-            bytes_read = http_read_bytes(ssl, socket, trailing, 2);
-         }
-         if (bytes_read != 2)
-            goto error;
-         break;
+         pgexporter_log_error("Truncated compressed HTTP body");
+         status = MESSAGE_STATUS_ERROR;
       }
 
-      // read chucnk data
-      size_t chunk_read = 0;
-      while (chunk_read < chunk_size)
+      inflateEnd(&body->stream);
+      body->inflate = false;
+   }
+
+   return status;
+}
+
+static ssize_t
+http_body_fill(struct http_body* body)
+{
+   ssize_t bytes_read;
+
+   if (body->start > 0)
+   {
+      memmove(body->buffer, body->buffer + body->start, body->end - body->start);
+      body->end -= body->start;
+      body->start = 0;
+   }
+
+   if (body->end == sizeof(body->buffer))
+   {
+      return -1;
+   }
+
+   bytes_read = http_read_bytes(body->ssl, body->socket, body->buffer + body->end, sizeof(body->buffer) - body->end);
+   if (bytes_read > 0)
+   {
+      body->end += bytes_read;
+   }
+
+   return bytes_read;
+}
+
+static int
+http_body_line(struct http_body* body, char* line, size_t size)
+{
+   char* eol = NULL;
+   size_t length;
+
+   while ((eol = memchr(body->buffer + body->start, '\n', body->end - body->start)) == NULL)
+   {
+      if (http_body_fill(body) <= 0)
       {
-         size_t to_read = chunk_size - chunk_read;
-         if (to_read > sizeof(buffer) - 1)
-            to_read = sizeof(buffer) - 1;
+         return 1;
+      }
+   }
 
-         // check if the prefetched bytes are available
-         if (prefetched_pos < prefetched_size)
-         {
-            size_t remaining_prefetched = prefetched_size - prefetched_pos;
-            size_t from_prefetched = to_read < remaining_prefetched ? to_read : remaining_prefetched;
-            memcpy(buffer, prefetched + prefetched_pos, from_prefetched);
-            prefetched_pos += from_prefetched;
-            bytes_read = (ssize_t)from_prefetched;
-         }
-         else
-         {
-            bytes_read = http_read_bytes(ssl, socket, buffer, to_read);
-         }
-         if (bytes_read <= 0)
-            goto error;
+   length = eol - (body->buffer + body->start);
+   if (length > 0 && eol[-1] == '\r')
+   {
+      length--;
+   }
 
-         if (http_response->write_cb != NULL)
+   if (length >= size)
+   {
+      return 1;
+   }
+
+   memcpy(line, body->buffer + body->start, length);
+   line[length] = '\0';
+   body->start = (eol - body->buffer) + 1;
+
+   return 0;
+}
+
+static int
+http_body_deliver(struct http_body* body, char* data, size_t size)
+{
+   struct http_response* response = body->response;
+   size_t capacity;
+   char* d = NULL;
+
+   if (size == 0)
+   {
+      return 0;
+   }
+
+   if (response->write_cb != NULL)
+   {
+      return response->write_cb(data, size, response->write_userdata) != size;
+   }
+
+   /* Grow geometrically, the payload stays zero terminated */
+   if (response->payload.data_size + size + 1 > body->capacity)
+   {
+      capacity = MAX(body->capacity * 2, response->payload.data_size + size + 1);
+      capacity = MAX(capacity, (size_t)HTTP_BODY_BUFFER_SIZE);
+
+      d = (char*)realloc(response->payload.data, capacity);
+      if (d == NULL)
+      {
+         return 1;
+      }
+
+      response->payload.data = d;
+      body->capacity = capacity;
+   }
+
+   memcpy((char*)response->payload.data + response->payload.data_size, data, size);
+   response->payload.data_size += size;
+   ((char*)response->payload.data)[response->payload.data_size] = '\0';
+
+   return 0;
+}
+
+static int
+http_body_sink(struct http_body* body, char* data, size_t size)
+{
+   char out[HTTP_BODY_BUFFER_SIZE];
+   int ret;
+
+   if (!body->inflate)
+   {
+      return http_body_deliver(body, data, size);
+   }
+
+   if (body->stream_end)
+   {
+      return size > 0;
+   }
+
+   body->stream.next_in = (Bytef*)data;
+   body->stream.avail_in = (uInt)size;
+
+   do
+   {
+      body->stream.next_out = (Bytef*)out;
+      body->stream.avail_out = sizeof(out);
+
+      ret = inflate(&body->stream, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+      {
+         pgexporter_log_error("Failed to decompress HTTP body (%d)", ret);
+         return 1;
+      }
+
+      if (http_body_deliver(body, out, sizeof(out) - body->stream.avail_out))
+      {
+         return 1;
+      }
+
+      if (ret == Z_STREAM_END)
+      {
+         body->stream_end = true;
+         return body->stream.avail_in > 0;
+      }
+   }
+   while (body->stream.avail_in > 0 || body->stream.avail_out == 0);
+
+   return 0;
+}
+
+static int
+http_read_chunked_body(struct http_body* body)
+{
+   char line[32];
+   size_t chunk_size;
+   size_t n;
+   char* endptr = NULL;
+
+   while (1)
+   {
+      if (http_body_line(body, line, sizeof(line)))
+      {
+         goto error;
+      }
+
+      /* Chunk extensions are ignored */
+      chunk_size = strtoul(line, &endptr, 16);
+      if (endptr == line)
+      {
+         goto error;
+      }
+
+      if (chunk_size == 0)
+      {
+         /* Skip the trailer section up to the empty line */
+         do
          {
-            if (http_response->write_cb(buffer, bytes_read, http_response->write_userdata) != (size_t)bytes_read)
+            if (http_body_line(body, line, sizeof(line)))
+            {
                goto error;
+            }
          }
-         else
-         {
-            buffer[bytes_read] = '\0';
-            http_response->payload.data = pgexporter_append(http_response->payload.data, buffer);
-            http_response->payload.data_size += bytes_read;
-         }
-         chunk_read += bytes_read;
+         while (line[0] != '\0');
+
+         break;
       }
-      // the chunk size must match
-      // notice it does not include the \r\n
-      if (chunk_read != chunk_size)
-         goto error;
 
-      // read the trailing CLF or \r\n
-      char trailing[2];
-      if (prefetched_pos < prefetched_size)
+      while (chunk_size > 0)
       {
-         size_t remaining_prefetched = prefetched_size - prefetched_pos;
-         if (remaining_prefetched >= 2)
+         if (body->start == body->end && http_body_fill(body) <= 0)
          {
-            memcpy(trailing, prefetched + prefetched_pos, 2);
-            prefetched_pos += 2;
-            bytes_read = 2;
+            goto error;
          }
-         else
+
+         n = MIN(chunk_size, body->end - body->start);
+
+         if (http_body_sink(body, body->buffer + body->start, n))
          {
-            bytes_read = http_read_bytes(ssl, socket, trailing, 2);
+            goto error;
          }
+
+         body->start += n;
+         chunk_size -= n;
       }
-      else
-      {
-         bytes_read = http_read_bytes(ssl, socket, trailing, 2);
-      }
-      if (bytes_read != 2)
-         goto error;
 
-      if (trailing[0] != '\r' || trailing[1] != '\n')
+      if (http_body_line(body, line, sizeof(line)) || line[0] != '\0')
+      {
          goto error;
+      }
    }
 
-   free(prefetched);
    return MESSAGE_STATUS_OK;
+
 error:
-   free(prefetched);
+
    return MESSAGE_STATUS_ERROR;
 }
 
 static int
-http_read_content_length_body(SSL* ssl, int socket, struct http_response* http_response, size_t content_length)
+http_read_content_length_body(struct http_body* body, size_t content_length)
 {
-   char buffer[8192];
-   ssize_t bytes_read;
-   char* prefetched = (char*)http_response->payload.data;
-   size_t prefetched_size = http_response->payload.data_size;
-   size_t remaining;
+   size_t remaining = content_length;
+   size_t n;
 
-   if (prefetched_size > content_length)
+   if (body->end - body->start > content_length)
    {
       goto error;
    }
 
-   if (http_response->write_cb != NULL && prefetched_size > 0)
+   while (remaining > 0)
    {
-      if (http_response->write_cb(prefetched, prefetched_size, http_response->write_userdata) != prefetched_size)
+      if (body->start == body->end && http_body_fill(body) <= 0)
       {
-         free(prefetched);
-         http_response->payload.data = NULL;
-         http_response->payload.data_size = 0;
          goto error;
       }
-      free(prefetched);
-      http_response->payload.data = NULL;
-      http_response->payload.data_size = 0;
-   }
-
-   remaining = content_length - prefetched_size;
 
-   while (remaining > 0)
-   {
-      size_t to_read = remaining > sizeof(buffer) - 1 ? sizeof(buffer) - 1 : remaining;
+      n = MIN(remaining, body->end - body->start);
 
-      bytes_read = http_read_bytes(ssl, socket, buffer, to_read);
-      if (bytes_read <= 0)
-         goto error;
-
-      if (http_response->write_cb != NULL)
+      if (http_body_sink(body, body->buffer + body->start, n))
       {
-         if (http_response->write_cb(buffer, bytes_read, http_response->write_userdata) != (size_t)bytes_read)
-            goto error;
-      }
-      else
-      {
-         buffer[bytes_read] = '\0';
-         http_response->payload.data = pgexporter_append(http_response->payload.data, buffer);
-         http_response->payload.data_size += bytes_read;
+         goto error;
       }
-      remaining -= bytes_read;
+
+      body->start += n;
+      remaining -= n;
    }
 
    return MESSAGE_STATUS_OK;
+
 error:
+
    return MESSAGE_STATUS_ERROR;
 }
+
 static int
-http_read_EOF_body(SSL* ssl, int socket, struct http_response* http_response)
+http_read_EOF_body(struct http_body* body)
 {
-   char buffer[8192];
    ssize_t bytes_read;
 
-   if (http_response->write_cb != NULL && http_response->payload.data_size > 0)
+   while (1)
    {
-      if (http_response->write_cb(http_response->payload.data, http_response->payload.data_size, http_response->write_userdata) != http_response->payload.data_size)
+      if (body->start < body->end)
       {
-         free(http_response->payload.data);
-         http_response->payload.data = NULL;
-         http_response->payload.data_size = 0;
-         goto error;
-      }
-      free(http_response->payload.data);
-      http_response->payload.data = NULL;
-      http_response->payload.data_size = 0;
-   }
+         if (http_body_sink(body, body->buffer + body->start, body->end - body->start))
+         {
+            goto error;
+         }
 
-   while (1)
-   {
-      size_t to_read = sizeof(buffer) - 1;
+         body->start = body->end;
+      }
 
-      bytes_read = http_read_bytes(ssl, socket, buffer, to_read);
+      bytes_read = http_body_fill(body);
       if (bytes_read < 0)
-         goto error;
-      if (bytes_read == 0)
-         break;
-
-      if (http_response->write_cb != NULL)
       {
-         if (http_response->write_cb(buffer, bytes_read, http_response->write_userdata) != (size_t)bytes_read)
-            goto error;
+         goto error;
       }
-      else
+      if (bytes_read == 0)
       {
-         buffer[bytes_read] = '\0';
-         http_response->payload.data = pgexporter_append(http_response->payload.data, buffer);
-         http_response->payload.data_size += bytes_read;
+         break;
       }
    }
 
    return MESSAGE_STATUS_OK;
+
 error:
+
    return MESSAGE_STATUS_ERROR;
 }
 
 static int
 http_read_response_body(SSL* ssl, int socket, struct http_response* http_response)
 {
+   struct http_body body;
+   char* transfer_encoding = NULL;
+   char* cl_str = NULL;
+   int status;
+
    if (!http_response)
+   {
       return MESSAGE_STATUS_ERROR;
+   }
 
-   char* transfer_encoding = (char*)pgexporter_deque_get(http_response->payload.headers, "Transfer-Encoding");
-   char* cl_str = (char*)pgexporter_deque_get(http_response->payload.headers, "Content-Length");
+   if (http_body_create(ssl, socket, http_response, &body))
+   {
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   transfer_encoding = (char*)pgexporter_deque_get(http_response->payload.headers, "Transfer-Encoding");
+   cl_str = (char*)pgexporter_deque_get(http_response->payload.headers, "Content-Length");
 
-   // handle chunked transfer_encoding
    if (transfer_encoding && strstr(transfer_encoding, "chunked"))
    {
-      return http_read_chunked_body(ssl, socket, http_response);
+      status = http_read_chunked_body(&body);
    }
-
-   // handle content length
-   if (cl_str)
+   else if (cl_str)
    {
-      size_t content_length = strtoul(cl_str, NULL, 10);
-      return http_read_content_length_body(ssl, socket, http_response, content_length);
+      status = http_read_content_length_body(&body, strtoul(cl_str, NULL, 10));
+   }
+   else
+   {
+      status = http_read_EOF_body(&body);
    }
 
-   return http_read_EOF_body(ssl, socket, http_response);
+   return http_body_destroy(&body, status);
 }
+
 static int
 http_parse_header(char** header_text, struct http_response* http_response)
 {
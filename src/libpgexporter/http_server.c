@@ -31,15 +31,33 @@
 #include <http_server.h>
 #include <logging.h>
 #include <message.h>
+#include <security.h>
 #include <shmem.h>
 #include <utils.h>
 
 /* system */
+#include <errno.h>
+#include <openssl/err.h>
+#include <poll.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/socket.h>
 #include <time.h>
+#include <unistd.h>
+
+static bool next_line(char* p, char* end, char** eol, char** line_end);
+static bool find_headers_end(char* data, size_t length, size_t* scanned);
+static struct http_server_slice trim(char* start, char* end);
+static bool slice_equals_ignore_case(struct http_server_slice* slice, const char* str);
+static bool has_token(struct http_server_slice* value, const char* token);
+static int parser_read(struct http_server_parser* parser, int64_t timeout);
+static const char* connection_header(int fd);
+
+/* The connections served by the process */
+static struct http_server_parser* connections = NULL;
 
 static void
 fill_date(char* buf, size_t len)
@@ -69,6 +87,12 @@ pgexporter_http_server_ssl_accept(SSL* ssl, int fd)
          pgexporter_log_error("http_server: SSL_accept failed");
          return MESSAGE_STATUS_ERROR;
       }
+
+      if (((struct configuration*)shmem)->metrics_ktls)
+      {
+         pgexporter_log_debug("http_server: %s TLS on %d", pgexporter_is_ktls(ssl) ? "Kernel" : "User space", fd);
+      }
+
       return MESSAGE_STATUS_OK;
    }
 
@@ -76,91 +100,477 @@ pgexporter_http_server_ssl_accept(SSL* ssl, int fd)
 }
 
 int
-pgexporter_http_server_parse(SSL* ssl, int fd, struct http_server_request** req)
+pgexporter_http_server_parse(char* data, size_t length, struct http_server_request* req, size_t* consumed)
 {
-   struct message* msg = NULL;
-   struct configuration* config;
-   struct http_server_request* r = NULL;
-   char* from = NULL;
-   int index;
-   int status;
-
-   *req = NULL;
+   char* p = data;
+   char* end = data + length;
+   char* eol = NULL;
+   char* line_end = NULL;
+   char* sp = NULL;
+   char* colon = NULL;
+   struct http_server_slice value;
+   bool has_content_length = false;
+   size_t content_length = 0;
+
+   memset(req, 0, sizeof(struct http_server_request));
+   *consumed = 0;
+
+   /* Empty lines before the request line are ignored */
+   while (p < end && (*p == '\r' || *p == '\n'))
+   {
+      p++;
+   }
 
-   config = (struct configuration*)shmem;
+   if (next_line(p, end, &eol, &line_end))
+   {
+      return MESSAGE_STATUS_ZERO;
+   }
 
-   status = pgexporter_read_timeout_message(ssl, fd,
-                                            (int)pgexporter_time_convert(config->authentication_timeout, FORMAT_TIME_S),
-                                            &msg);
-   if (status != MESSAGE_STATUS_OK)
+   /* Request line: method SP target SP version */
+   sp = memchr(p, ' ', line_end - p);
+   if (sp == NULL || sp == p)
    {
-      pgexporter_log_debug("http_server: failed to read request");
       return MESSAGE_STATUS_ERROR;
    }
 
-   if (msg == NULL || msg->data == NULL || msg->length < 3 ||
-       strncmp((char*)msg->data, "GET", 3) != 0)
+   req->method.data = p;
+   req->method.length = sp - p;
+
+   for (size_t i = 0; i < req->method.length; i++)
+   {
+      if (p[i] < 'A' || p[i] > 'Z')
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+   }
+
+   p = sp + 1;
+   sp = memchr(p, ' ', line_end - p);
+   if (sp == NULL || sp == p || *p != '/')
    {
-      pgexporter_log_debug("http_server: not a GET request");
       return MESSAGE_STATUS_ERROR;
    }
 
-   index = 4;
-   from = (char*)msg->data + index;
+   req->target.data = p;
+   req->target.length = sp - p;
+   req->path = req->target;
 
-   while (index < (int)msg->length && pgexporter_read_byte(msg->data + index) != ' ')
+   for (char* c = p; c < sp; c++)
    {
-      index++;
+      if (*c == '?')
+      {
+         req->path.length = c - p;
+         req->query.data = c + 1;
+         req->query.length = sp - (c + 1);
+         break;
+      }
    }
 
-   if (index >= (int)msg->length)
+   p = sp + 1;
+   if (line_end - p != 8 || strncmp(p, "HTTP/1.", 7) || (p[7] != '0' && p[7] != '1'))
    {
-      pgexporter_log_debug("http_server: malformed request line");
       return MESSAGE_STATUS_ERROR;
    }
 
-   pgexporter_write_byte(msg->data + index, '\0');
+   req->minor_version = p[7] - '0';
 
-   r = malloc(sizeof(struct http_server_request));
-   if (r == NULL)
+   /* Headers */
+   p = eol + 1;
+   while (true)
+   {
+      if (next_line(p, end, &eol, &line_end))
+      {
+         return MESSAGE_STATUS_ZERO;
+      }
+
+      if (line_end == p)
+      {
+         p = eol + 1;
+         break;
+      }
+
+      /* Obsolete line folding isn't supported */
+      if (*p == ' ' || *p == '\t')
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      colon = memchr(p, ':', line_end - p);
+      if (colon == NULL || colon == p || memchr(p, ' ', colon - p) != NULL || memchr(p, '\t', colon - p) != NULL)
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      if (req->number_of_headers >= HTTP_SERVER_MAX_HEADERS)
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      req->headers[req->number_of_headers].name.data = p;
+      req->headers[req->number_of_headers].name.length = colon - p;
+      req->headers[req->number_of_headers].value = trim(colon + 1, line_end);
+      req->number_of_headers++;
+
+      p = eol + 1;
+   }
+
+   /* Request bodies are only framed by Content-Length */
+   if (pgexporter_http_server_header(req, "Transfer-Encoding", &value))
    {
       return MESSAGE_STATUS_ERROR;
    }
 
-   memset(r, 0, sizeof(struct http_server_request));
-   strncpy(r->path, from, sizeof(r->path) - 1);
+   for (int i = 0; i < req->number_of_headers; i++)
+   {
+      size_t n = 0;
+
+      if (!slice_equals_ignore_case(&req->headers[i].name, "Content-Length"))
+      {
+         continue;
+      }
+
+      if (req->headers[i].value.length == 0)
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      for (size_t j = 0; j < req->headers[i].value.length; j++)
+      {
+         char c = req->headers[i].value.data[j];
+
+         if (c < '0' || c > '9' || n > (SIZE_MAX - 9) / 10)
+         {
+            return MESSAGE_STATUS_ERROR;
+         }
+
+         n = n * 10 + (c - '0');
+      }
+
+      if (has_content_length && n != content_length)
+      {
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      has_content_length = true;
+      content_length = n;
+   }
+
+   if ((size_t)(end - p) < content_length)
+   {
+      return MESSAGE_STATUS_ZERO;
+   }
+
+   if (content_length > 0)
+   {
+      req->body.data = p;
+      req->body.length = content_length;
+   }
+
+   req->keep_alive = req->minor_version == 1;
+   if (pgexporter_http_server_header(req, "Connection", &value))
+   {
+      if (has_token(&value, "close"))
+      {
+         req->keep_alive = false;
+      }
+      else if (has_token(&value, "keep-alive"))
+      {
+         req->keep_alive = true;
+      }
+   }
+
+   *consumed = (p + content_length) - data;
 
-   *req = r;
    return MESSAGE_STATUS_OK;
 }
 
+int
+pgexporter_http_server_parser_create(SSL* ssl, int fd, struct http_server_parser** parser)
+{
+   struct http_server_parser* p = NULL;
+
+   *parser = NULL;
+
+   p = (struct http_server_parser*)calloc(1, sizeof(struct http_server_parser));
+   if (p == NULL)
+   {
+      goto error;
+   }
+
+   p->buffer = (char*)malloc(DEFAULT_BUFFER_SIZE);
+   if (p->buffer == NULL)
+   {
+      goto error;
+   }
+
+   p->ssl = ssl;
+   p->fd = fd;
+   p->size = DEFAULT_BUFFER_SIZE;
+
+   *parser = p;
+
+   return 0;
+
+error:
+
+   free(p);
+
+   return 1;
+}
+
+int
+pgexporter_http_server_parser_next(struct http_server_parser* parser, struct http_server_request** req)
+{
+   struct configuration* config;
+   int64_t timeout;
+   time_t start_time;
+   size_t consumed = 0;
+   int status;
+
+   *req = NULL;
+
+   config = (struct configuration*)shmem;
+
+   /* An idle keep-alive connection only waits a short while for its next request */
+   if (parser->number_of_requests > 0 && parser->offset == parser->length)
+   {
+      timeout = HTTP_SERVER_KEEP_ALIVE_TIMEOUT;
+   }
+   else
+   {
+      timeout = pgexporter_time_convert(config->authentication_timeout, FORMAT_TIME_MS);
+   }
+   start_time = time(NULL);
+
+   while (true)
+   {
+      /* Empty lines between requests are ignored */
+      while (parser->offset < parser->length &&
+             (parser->buffer[parser->offset] == '\r' || parser->buffer[parser->offset] == '\n'))
+      {
+         parser->offset++;
+      }
+
+      if (find_headers_end(parser->buffer + parser->offset, parser->length - parser->offset, &parser->scanned))
+      {
+         status = pgexporter_http_server_parse(parser->buffer + parser->offset, parser->length - parser->offset,
+                                               &parser->request, &consumed);
+
+         if (status == MESSAGE_STATUS_ERROR)
+         {
+            pgexporter_log_debug("http_server: malformed request");
+            return MESSAGE_STATUS_ERROR;
+         }
+
+         if (status == MESSAGE_STATUS_OK)
+         {
+            /* The request stays valid in the buffer until the next call */
+            parser->offset += consumed;
+            parser->scanned = 0;
+            parser->number_of_requests++;
+
+            if (parser->number_of_requests >= HTTP_SERVER_MAX_REQUESTS)
+            {
+               parser->request.keep_alive = false;
+            }
+
+            *req = &parser->request;
+
+            return MESSAGE_STATUS_OK;
+         }
+      }
+
+      /* Keep the partial request at the start of the buffer */
+      if (parser->offset > 0)
+      {
+         memmove(parser->buffer, parser->buffer + parser->offset, parser->length - parser->offset);
+         parser->length -= parser->offset;
+         parser->offset = 0;
+      }
+
+      if (parser->length == parser->size)
+      {
+         pgexporter_log_debug("http_server: request exceeds %zu bytes", parser->size);
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      status = parser_read(parser, timeout > 0 ? MAX(timeout - (int64_t)difftime(time(NULL), start_time) * 1000, 0) : -1);
+
+      if (status != MESSAGE_STATUS_OK)
+      {
+         /* A connection closed in the middle of a request is an error */
+         return parser->length > 0 ? MESSAGE_STATUS_ERROR : status;
+      }
+   }
+}
+
 void
-pgexporter_http_server_request_destroy(struct http_server_request* req)
+pgexporter_http_server_parser_destroy(struct http_server_parser* parser)
+{
+   if (parser != NULL)
+   {
+      free(parser->buffer);
+      free(parser);
+   }
+}
+
+bool
+pgexporter_http_server_header(struct http_server_request* req, const char* name, struct http_server_slice* value)
 {
-   free(req);
+   for (int i = 0; i < req->number_of_headers; i++)
+   {
+      if (slice_equals_ignore_case(&req->headers[i].name, name))
+      {
+         *value = req->headers[i].value;
+         return true;
+      }
+   }
+
+   return false;
+}
+
+bool
+pgexporter_http_server_query_param(struct http_server_request* req, const char* name, struct http_server_slice* value)
+{
+   size_t name_length = strlen(name);
+   char* p = req->query.data;
+   char* end = req->query.data + req->query.length;
+   char* amp = NULL;
+   char* eq = NULL;
+
+   if (p == NULL)
+   {
+      return false;
+   }
+
+   while (p < end)
+   {
+      amp = memchr(p, '&', end - p);
+      if (amp == NULL)
+      {
+         amp = end;
+      }
+
+      eq = memchr(p, '=', amp - p);
+
+      if (eq != NULL && (size_t)(eq - p) == name_length && !strncmp(p, name, name_length))
+      {
+         value->data = eq + 1;
+         value->length = amp - (eq + 1);
+         return true;
+      }
+
+      p = amp + 1;
+   }
+
+   return false;
+}
+
+bool
+pgexporter_http_server_slice_equals(struct http_server_slice* slice, const char* str)
+{
+   size_t length = strlen(str);
+
+   return slice->length == length && (length == 0 || !memcmp(slice->data, str, length));
+}
+
+int
+pgexporter_http_server_slice_copy(struct http_server_slice* slice, char* out, size_t size)
+{
+   if (slice->length >= size)
+   {
+      return 1;
+   }
+
+   if (slice->length > 0)
+   {
+      memcpy(out, slice->data, slice->length);
+   }
+   out[slice->length] = '\0';
+
+   return 0;
 }
 
 int
 pgexporter_http_server_dispatch(SSL* ssl, int fd, struct http_server_request* req,
                                 struct http_route* routes, int n_routes)
 {
-   if (req == NULL)
+   if (req == NULL || !pgexporter_http_server_slice_equals(&req->method, "GET"))
    {
       return pgexporter_http_respond_400(ssl, fd);
    }
 
    for (int i = 0; i < n_routes; i++)
    {
-      if (strcmp(req->path, routes[i].path) == 0)
+      if (pgexporter_http_server_slice_equals(&req->path, routes[i].path))
       {
          return routes[i].handler(ssl, fd);
       }
    }
 
-   pgexporter_log_debug("http_server: no route for path '%s'", req->path);
+   pgexporter_log_debug("http_server: no route for path '%.*s'", (int)req->path.length, req->path.data);
    return pgexporter_http_respond_404(ssl, fd);
 }
 
+int
+pgexporter_http_server_serve(SSL* ssl, int fd, struct http_route* routes, int n_routes)
+{
+   struct http_server_parser* parser = NULL;
+   struct http_server_request* req = NULL;
+   int status;
+
+   if (pgexporter_http_server_parser_create(ssl, fd, &parser))
+   {
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   parser->next = connections;
+   connections = parser;
+
+   while ((status = pgexporter_http_server_parser_next(parser, &req)) == MESSAGE_STATUS_OK)
+   {
+      parser->keep_alive = req->keep_alive;
+
+      pgexporter_http_server_dispatch(ssl, fd, req, routes, n_routes);
+
+      if (!parser->keep_alive)
+      {
+         break;
+      }
+   }
+
+   /* The connection ends normally when the client has nothing more to send */
+   if (status == MESSAGE_STATUS_ZERO && parser->number_of_requests > 0)
+   {
+      status = MESSAGE_STATUS_OK;
+   }
+
+   for (struct http_server_parser** p = &connections; *p != NULL; p = &(*p)->next)
+   {
+      if (*p == parser)
+      {
+         *p = parser->next;
+         break;
+      }
+   }
+
+   pgexporter_http_server_parser_destroy(parser);
+
+   return status;
+}
+
+void
+pgexporter_http_server_close(int fd)
+{
+   for (struct http_server_parser* p = connections; p != NULL; p = p->next)
+   {
+      if (p->fd == fd)
+      {
+         p->keep_alive = false;
+      }
+   }
+}
+
 int
 pgexporter_http_respond_ok(SSL* ssl, int fd, const char* content_type,
                            const void* body, size_t len)
@@ -176,9 +586,9 @@ pgexporter_http_respond_ok(SSL* ssl, int fd, const char* content_type,
                                     "HTTP/1.1 200 OK\r\n"
                                     "Content-Type: %s\r\n"
                                     "Content-Length: %zu\r\n"
-                                    "Connection: close\r\n"
+                                    "%s"
                                     "\r\n",
-                                    content_type, len);
+                                    content_type, len, connection_header(fd));
 
    msg.data = header;
    msg.length = header_len;
@@ -210,7 +620,7 @@ pgexporter_http_respond_400(SSL* ssl, int fd)
 
    data = pgexporter_append(data, "HTTP/1.1 400 Bad Request\r\n");
    data = pgexporter_append(data, "Content-Length: 0\r\n");
-   data = pgexporter_append(data, "Connection: close\r\n");
+   data = pgexporter_append(data, (char*)connection_header(fd));
    data = pgexporter_append(data, "\r\n");
 
    msg.kind = 0;
@@ -234,13 +644,14 @@ pgexporter_http_respond_404(SSL* ssl, int fd)
    memset(&msg, 0, sizeof(struct message));
    fill_date(time_buf, sizeof(time_buf));
 
-   data = pgexporter_vappend(data, 6,
+   data = pgexporter_vappend(data, 7,
                              "HTTP/1.1 404 Not Found\r\n",
                              "Date: ",
                              time_buf,
                              "\r\n",
                              "Content-Length: 0\r\n",
-                             "Connection: close\r\n\r\n");
+                             connection_header(fd),
+                             "\r\n");
 
    msg.kind = 0;
    msg.length = strlen(data);
@@ -263,13 +674,14 @@ pgexporter_http_respond_500(SSL* ssl, int fd)
    memset(&msg, 0, sizeof(struct message));
    fill_date(time_buf, sizeof(time_buf));
 
-   data = pgexporter_vappend(data, 6,
+   data = pgexporter_vappend(data, 7,
                              "HTTP/1.1 500 Internal Server Error\r\n",
                              "Date: ",
                              time_buf,
                              "\r\n",
                              "Content-Length: 0\r\n",
-                             "Connection: close\r\n\r\n");
+                             connection_header(fd),
+                             "\r\n");
 
    msg.kind = 0;
    msg.length = strlen(data);
@@ -300,7 +712,7 @@ pgexporter_http_respond_redirect(SSL* ssl, int fd, const char* location)
    data = pgexporter_append(data, time_buf);
    data = pgexporter_append(data, "\r\n");
    data = pgexporter_append(data, "Content-Length: 0\r\n");
-   data = pgexporter_append(data, "Connection: close\r\n");
+   data = pgexporter_append(data, (char*)connection_header(fd));
    data = pgexporter_append(data, "\r\n");
 
    msg.kind = 0;
@@ -324,14 +736,16 @@ pgexporter_http_respond_chunked_start(SSL* ssl, int fd, const char* content_type
    memset(&msg, 0, sizeof(struct message));
    fill_date(time_buf, sizeof(time_buf));
 
-   data = pgexporter_vappend(data, 7,
+   data = pgexporter_vappend(data, 9,
                              "HTTP/1.1 200 OK\r\n",
                              "Content-Type: ",
                              content_type,
                              "\r\n",
                              "Date: ",
                              time_buf,
-                             "\r\nTransfer-Encoding: chunked\r\n\r\n");
+                             "\r\nTransfer-Encoding: chunked\r\n",
+                             connection_header(fd),
+                             "\r\n");
 
    msg.kind = 0;
    msg.length = strlen(data);
@@ -382,6 +796,117 @@ pgexporter_http_respond_chunked_write(SSL* ssl, int fd, const char* data)
    return status;
 }
 
+int
+pgexporter_http_respond_chunked_writev(SSL* ssl, int fd, struct iovec* iov, int count)
+{
+   char size[20];
+   size_t total = 0;
+   int n = 0;
+   ssize_t written;
+   struct pollfd pfd;
+   struct message msg;
+   struct iovec vec[HTTP_SERVER_CHUNK_PIECES + 2];
+   struct iovec* v = NULL;
+
+   if (iov == NULL || count <= 0 || count > HTTP_SERVER_CHUNK_PIECES)
+   {
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   for (int i = 0; i < count; i++)
+   {
+      total += iov[i].iov_len;
+   }
+
+   if (total == 0)
+   {
+      return MESSAGE_STATUS_OK;
+   }
+
+   pgexporter_snprintf(size, sizeof(size), "%zX\r\n", total);
+
+   vec[n].iov_base = size;
+   vec[n].iov_len = strlen(size);
+   n++;
+   for (int i = 0; i < count; i++)
+   {
+      vec[n++] = iov[i];
+   }
+   vec[n].iov_base = "\r\n";
+   vec[n].iov_len = 2;
+   n++;
+
+   if (ssl != NULL)
+   {
+      memset(&msg, 0, sizeof(struct message));
+
+      for (int i = 0; i < n; i++)
+      {
+         if (vec[i].iov_len == 0)
+         {
+            continue;
+         }
+
+         msg.kind = 0;
+         msg.length = vec[i].iov_len;
+         msg.data = vec[i].iov_base;
+
+         if (pgexporter_write_message(ssl, fd, &msg) != MESSAGE_STATUS_OK)
+         {
+            return MESSAGE_STATUS_ERROR;
+         }
+      }
+
+      return MESSAGE_STATUS_OK;
+   }
+
+   v = &vec[0];
+
+   while (n > 0)
+   {
+      written = writev(fd, v, n);
+
+      if (written == -1)
+      {
+         if (errno == EINTR)
+         {
+            continue;
+         }
+
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+         {
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            pfd.revents = 0;
+
+            /* Give up on a client that doesn't read */
+            if (poll(&pfd, 1, HTTP_SERVER_WRITE_TIMEOUT) > 0)
+            {
+               continue;
+            }
+         }
+
+         return MESSAGE_STATUS_ERROR;
+      }
+
+      /* Skip what was written, a piece may be written partially */
+      while (n > 0 && (size_t)written >= v->iov_len)
+      {
+         written -= v->iov_len;
+         v++;
+         n--;
+      }
+
+      if (n > 0)
+      {
+         v->iov_base = (char*)v->iov_base + written;
+         v->iov_len -= written;
+      }
+   }
+
+   return MESSAGE_STATUS_OK;
+}
+
 int
 pgexporter_http_respond_chunked_end(SSL* ssl, int fd)
 {
@@ -394,3 +919,206 @@ pgexporter_http_respond_chunked_end(SSL* ssl, int fd)
 
    return pgexporter_write_message(ssl, fd, &msg);
 }
+
+static bool
+next_line(char* p, char* end, char** eol, char** line_end)
+{
+   *eol = memchr(p, '\n', end - p);
+   if (*eol == NULL)
+   {
+      return true;
+   }
+
+   *line_end = *eol;
+   if (*line_end > p && *(*line_end - 1) == '\r')
+   {
+      (*line_end)--;
+   }
+
+   return false;
+}
+
+static bool
+find_headers_end(char* data, size_t length, size_t* scanned)
+{
+   char* p = data + *scanned;
+   char* end = data + length;
+   char* eol = NULL;
+
+   /* Resume after the last complete line, the headers end with an empty line */
+   while (p < end && (eol = memchr(p, '\n', end - p)) != NULL)
+   {
+      if (eol + 1 < end && eol[1] == '\n')
+      {
+         return true;
+      }
+
+      if (eol + 2 < end && eol[1] == '\r' && eol[2] == '\n')
+      {
+         return true;
+      }
+
+      if (eol + 2 >= end)
+      {
+         break;
+      }
+
+      p = eol + 1;
+   }
+
+   *scanned = p - data;
+
+   return false;
+}
+
+static struct http_server_slice
+trim(char* start, char* end)
+{
+   struct http_server_slice slice;
+
+   while (start < end && (*start == ' ' || *start == '\t'))
+   {
+      start++;
+   }
+
+   while (end > start && (*(end - 1) == ' ' || *(end - 1) == '\t'))
+   {
+      end--;
+   }
+
+   slice.data = start;
+   slice.length = end - start;
+
+   return slice;
+}
+
+static bool
+slice_equals_ignore_case(struct http_server_slice* slice, const char* str)
+{
+   size_t length = strlen(str);
+
+   return slice->length == length && !strncasecmp(slice->data, str, length);
+}
+
+static bool
+has_token(struct http_server_slice* value, const char* token)
+{
+   char* p = value->data;
+   char* end = value->data + value->length;
+   char* comma = NULL;
+   struct http_server_slice item;
+
+   while (p < end)
+   {
+      comma = memchr(p, ',', end - p);
+      if (comma == NULL)
+      {
+         comma = end;
+      }
+
+      item = trim(p, comma);
+      if (slice_equals_ignore_case(&item, token))
+      {
+         return true;
+      }
+
+      p = comma + 1;
+   }
+
+   return false;
+}
+
+static int
+parser_read(struct http_server_parser* parser, int64_t timeout)
+{
+   struct pollfd pfd;
+   ssize_t numbytes;
+   int err;
+   int r;
+
+   while (true)
+   {
+      if (parser->ssl == NULL || SSL_pending(parser->ssl) == 0)
+      {
+         if (timeout == 0)
+         {
+            return MESSAGE_STATUS_ZERO;
+         }
+
+         pfd.fd = parser->fd;
+         pfd.events = POLLIN;
+         pfd.revents = 0;
+
+         r = poll(&pfd, 1, (int)timeout);
+         if (r == 0)
+         {
+            pgexporter_log_debug("http_server: read timeout");
+            return MESSAGE_STATUS_ZERO;
+         }
+         else if (r < 0)
+         {
+            if (errno == EINTR)
+            {
+               errno = 0;
+               continue;
+            }
+
+            return MESSAGE_STATUS_ERROR;
+         }
+      }
+
+      if (parser->ssl != NULL)
+      {
+         numbytes = SSL_read(parser->ssl, parser->buffer + parser->length, parser->size - parser->length);
+         if (numbytes > 0)
+         {
+            break;
+         }
+
+         err = SSL_get_error(parser->ssl, numbytes);
+         ERR_clear_error();
+
+         if (err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE)
+         {
+            continue;
+         }
+
+         return err == SSL_ERROR_ZERO_RETURN ? MESSAGE_STATUS_ZERO : MESSAGE_STATUS_ERROR;
+      }
+
+      numbytes = read(parser->fd, parser->buffer + parser->length, parser->size - parser->length);
+      if (numbytes > 0)
+      {
+         break;
+      }
+      else if (numbytes == 0)
+      {
+         return MESSAGE_STATUS_ZERO;
+      }
+      else if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+         errno = 0;
+         continue;
+      }
+
+      return MESSAGE_STATUS_ERROR;
+   }
+
+   parser->length += numbytes;
+
+   return MESSAGE_STATUS_OK;
+}
+
+static const char*
+connection_header(int fd)
+{
+   for (struct http_server_parser* p = connections; p != NULL; p = p->next)
+   {
+      if (p->fd == fd)
+      {
+         return p->keep_alive ? "Connection: keep-alive\r\n" : "Connection: close\r\n";
+      }
+   }
+
+   return "Connection: close\r\n";
+}
@@ -29,16 +29,21 @@
 /* pgexporter */
 #include <pgexporter.h>
 #include <art.h>
+#include <derive.h>
 #include <internal.h>
 #include <logging.h>
+#include <metric_names.h>
 #include <pg_query_alts.h>
 #include <shmem.h>
+#include <slice.h>
 #include <utils.h>
 #include <value.h>
 #include <json_configuration.h>
 
 /* system */
+#include <inttypes.h>
 #include <json.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* JSON Parsing */
@@ -51,6 +56,7 @@ typedef struct json_column
    char* name;
    char* description;
    char* type;
+   char* buckets;
 } __attribute__((aligned(64))) json_column_t;
 
 // Query's Value's Structure
@@ -74,6 +80,8 @@ typedef struct json_metric
    char* server;
    bool exec_on_all_dbs;
    bool optional;
+   char* derive;
+   int slices;
 } __attribute__((aligned(64))) json_metric_t;
 
 // Config's Structure
@@ -91,6 +99,7 @@ static int parse_metrics(struct json* metrics_array, json_config_t* config);
 static int parse_queries(struct json* queries_array, json_metric_t* metric);
 
 // Parses the value of `columns` array in JSON
+static int parse_buckets(struct json* column, char** buckets);
 static int parse_columns(struct json* columns_array, json_query_t* query);
 
 // Free allocated memory for JSON columns
@@ -186,7 +195,6 @@ pgexporter_read_json_metrics_configuration(void* shmem)
 static int
 pgexporter_validate_json_metrics(struct configuration* config, json_config_t* json_config)
 {
-   struct art* existing_metrics_art = NULL;
    struct art* temp_art = NULL;
    struct art* metric_columns_art = NULL;
    struct art* processed_columns = NULL;
@@ -194,21 +202,6 @@ pgexporter_validate_json_metrics(struct configuration* config, json_config_t* js
    char final_metric_name[PROMETHEUS_LENGTH];
    int i, j, k;
 
-   if (pgexporter_art_create(&existing_metrics_art))
-   {
-      pgexporter_log_error("Failed to create temporary ART");
-      goto error;
-   }
-
-   for (int idx = 0; idx < config->number_of_metric_names; idx++)
-   {
-      if (pgexporter_art_insert(existing_metrics_art, config->metric_names[idx], 1, ValueInt32))
-      {
-         pgexporter_log_error("Failed to insert metric name into temporary ART");
-         goto error;
-      }
-   }
-
    if (pgexporter_art_create(&temp_art))
    {
       pgexporter_log_error("Failed to create temporary ART");
@@ -326,7 +319,7 @@ pgexporter_validate_json_metrics(struct configuration* config, json_config_t* js
             }
 
             /* Check for duplicates against global ART */
-            if (pgexporter_art_contains_key(existing_metrics_art, final_metric_name))
+            if (pgexporter_metric_names_contains(config->metric_names, final_metric_name))
             {
                pgexporter_log_error("Duplicate metric name with previously loaded files: pgexporter_%s", final_metric_name);
                goto error;
@@ -354,12 +347,10 @@ pgexporter_validate_json_metrics(struct configuration* config, json_config_t* js
       metric_columns_art = NULL;
    }
 
-   pgexporter_art_destroy(existing_metrics_art);
    pgexporter_art_destroy(temp_art);
    return 0;
 
 error:
-   pgexporter_art_destroy(existing_metrics_art);
    pgexporter_art_destroy(processed_columns);
    pgexporter_art_destroy(metric_columns_art);
    pgexporter_art_destroy(temp_art);
@@ -420,6 +411,61 @@ pgexporter_read_json(struct configuration* config, struct prometheus* prometheus
    return ret;
 }
 
+static int
+parse_buckets(struct json* column, char** buckets)
+{
+   struct json_iterator* iter = NULL;
+   enum value_type type;
+   uintptr_t value;
+   char bound[64];
+
+   value = pgexporter_json_get_typed(column, "buckets", &type);
+
+   /* Either a string such as "1, 2, 5" or an array such as [1, 2, 5] */
+   if (type == ValueString)
+   {
+      *buckets = strdup((char*)value);
+      return 0;
+   }
+
+   if (type != ValueJSON || pgexporter_json_iterator_create((struct json*)value, &iter))
+   {
+      pgexporter_log_error("Unexpected buckets");
+      return 1;
+   }
+
+   *buckets = strdup("");
+
+   while (pgexporter_json_iterator_next(iter))
+   {
+      switch (iter->value->type)
+      {
+         case ValueInt64:
+            pgexporter_snprintf(bound, sizeof(bound), "%" PRId64, (int64_t)iter->value->data);
+            break;
+         case ValueDouble:
+            pgexporter_snprintf(bound, sizeof(bound), "%.17g", pgexporter_value_to_double(iter->value->data));
+            break;
+         case ValueString:
+            pgexporter_snprintf(bound, sizeof(bound), "%s", (char*)iter->value->data);
+            break;
+         default:
+            pgexporter_log_error("Unexpected bucket bound");
+            pgexporter_json_iterator_destroy(iter);
+            return 1;
+      }
+
+      if (strlen(*buckets) > 0)
+      {
+         *buckets = pgexporter_append_char(*buckets, ',');
+      }
+      *buckets = pgexporter_append(*buckets, bound);
+   }
+
+   pgexporter_json_iterator_destroy(iter);
+   return 0;
+}
+
 static int
 parse_columns(struct json* columns_array, json_query_t* query)
 {
@@ -468,6 +514,15 @@ parse_columns(struct json* columns_array, json_query_t* query)
          current_column->name = strdup(""); // empty default
       }
 
+      if (pgexporter_json_contains_key(column, "buckets"))
+      {
+         if (parse_buckets(column, &current_column->buckets))
+         {
+            pgexporter_json_iterator_destroy(iter);
+            return 1;
+         }
+      }
+
       // Check if this is a histogram type
       if (strcmp(current_column->type, "histogram") == 0)
       {
@@ -621,6 +676,31 @@ parse_metrics(struct json* metrics_array, json_config_t* config)
          current_metric->optional = false; // default
       }
 
+      if (pgexporter_json_contains_key(metric, "derive"))
+      {
+         current_metric->derive = strdup((char*)pgexporter_json_get(metric, "derive"));
+      }
+
+      if (pgexporter_json_contains_key(metric, "slices"))
+      {
+         enum value_type type;
+         uintptr_t slices = pgexporter_json_get_typed(metric, "slices", &type);
+
+         if (type == ValueInt64)
+         {
+            current_metric->slices = (int)(int64_t)slices;
+         }
+         else if (type == ValueString)
+         {
+            current_metric->slices = atoi((char*)slices);
+         }
+         else
+         {
+            pgexporter_log_error("Unexpected slices for metric %d", metric_idx);
+            return 1;
+         }
+      }
+
       if (pgexporter_json_contains_key(metric, "queries"))
       {
          struct json* queries = (struct json*)pgexporter_json_get(metric, "queries");
@@ -713,6 +793,10 @@ free_json_columns(json_column_t** columns, size_t n_columns)
       {
          free((*columns)[i].type);
       }
+      if ((*columns)[i].buckets)
+      {
+         free((*columns)[i].buckets);
+      }
    }
 
    free(*columns);
@@ -759,6 +843,10 @@ free_json_metrics(json_metric_t** metrics, size_t n_metrics)
       {
          free((*metrics)[i].server);
       }
+      if ((*metrics)[i].derive)
+      {
+         free((*metrics)[i].derive);
+      }
       if ((*metrics)[i].queries)
       {
          free_json_queries(&(*metrics)[i].queries, (*metrics)[i].n_queries);
@@ -840,12 +928,24 @@ semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t*
       {
          prom->server_query_type = SERVER_QUERY_REPLICA;
       }
+      else if (!strcmp(json_config->metrics[i].server, "cluster"))
+      {
+         prom->server_query_type = SERVER_QUERY_CLUSTER;
+      }
       else
       {
          pgexporter_log_error("pgexporter: unexpected server %s", json_config->metrics[i].server);
          return 1;
       }
 
+      if (pgexporter_derive_parse(json_config->metrics[i].derive, &prom->derive))
+      {
+         pgexporter_log_error("pgexporter: unexpected derive %s", json_config->metrics[i].derive);
+         return 1;
+      }
+
+      prom->slices = json_config->metrics[i].slices;
+
       // Execute on all databases
       prom->exec_on_all_dbs = json_config->metrics[i].exec_on_all_dbs;
       prom->optional = json_config->metrics[i].optional;
@@ -856,6 +956,12 @@ semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t*
          struct pg_query_alts* new_query = NULL;
          void* new_query_shmem = NULL;
 
+         if (pgexporter_slice_validate(prom->slices, prom->derive, json_config->metrics[i].queries[j].query))
+         {
+            pgexporter_log_error("pgexporter: unexpected slices %d for %s", prom->slices, prom->tag);
+            return 1;
+         }
+
          pgexporter_create_shared_memory(sizeof(struct pg_query_alts), HUGEPAGE_OFF, &new_query_shmem);
          new_query = (struct pg_query_alts*)new_query_shmem;
 
@@ -902,6 +1008,19 @@ semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t*
                pgexporter_log_error("pgexporter: unexpected type %s", json_config->metrics[i].queries[j].columns[k].type);
                return 1;
             }
+
+            // Buckets
+            if (json_config->metrics[i].queries[j].columns[k].buckets)
+            {
+               if (new_query->node.columns[k].type != HISTOGRAM_TYPE ||
+                   pgexporter_parse_buckets(json_config->metrics[i].queries[j].columns[k].buckets,
+                                            new_query->node.columns[k].buckets,
+                                            &new_query->node.columns[k].n_buckets))
+               {
+                  pgexporter_log_error("pgexporter: unexpected buckets %s", json_config->metrics[i].queries[j].columns[k].buckets);
+                  return 1;
+               }
+            }
          }
 
          if (json_config->metrics[i].queries[j].version == 0)
@@ -961,17 +1080,10 @@ semantics_json(struct prometheus* prometheus, int prometheus_idx, json_config_t*
             }
 
             struct configuration* config = (struct configuration*)shmem;
-            if (config->number_of_metric_names < NUMBER_OF_METRIC_NAMES)
+            if (pgexporter_metric_names_add(&config->metric_names, final_metric_name))
             {
-               pgexporter_snprintf(config->metric_names[config->number_of_metric_names],
-                                   PROMETHEUS_LENGTH,
-                                   "%s",
-                                   final_metric_name);
-               config->number_of_metric_names++;
-            }
-            else
-            {
-               pgexporter_log_warn("Maximum metric names reached (%d), skipping: %s", NUMBER_OF_METRIC_NAMES, final_metric_name);
+               pgexporter_log_error("Failed to register metric name: %s", final_metric_name);
+               return 1;
             }
          }
       }
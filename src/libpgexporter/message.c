@@ -36,12 +36,13 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <poll.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <shmem.h>
-#include <sys/time.h>
 
 static int read_message(int socket, bool block, int timeout, struct message** msg);
 static int write_message(int socket, struct message* msg);
@@ -52,6 +53,9 @@ static int write_message_from_buffer(struct io_watcher* watcher, struct message*
 static int ssl_read_message(SSL* ssl, int timeout, struct message** msg);
 static int ssl_write_message(SSL* ssl, struct message* msg);
 
+static int64_t deadline_ms(int timeout);
+static int wait_socket(int socket, short events, int64_t deadline);
+
 int
 pgexporter_read_block_message(SSL* ssl, int socket, struct message** msg)
 {
@@ -66,6 +70,7 @@ pgexporter_read_block_message(SSL* ssl, int socket, struct message** msg)
 static int
 read_append(SSL* ssl, int socket, struct message* m, size_t needed)
 {
+   int status;
    ssize_t numbytes;
 
    while ((size_t)m->length < needed)
@@ -83,6 +88,11 @@ read_append(SSL* ssl, int socket, struct message* m, size_t needed)
             {
                case SSL_ERROR_WANT_READ:
                case SSL_ERROR_WANT_WRITE:
+                  status = wait_socket(SSL_get_fd(ssl), err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT, -1);
+                  if (status != MESSAGE_STATUS_OK)
+                  {
+                     return status;
+                  }
                   continue;
                case SSL_ERROR_ZERO_RETURN:
                   return MESSAGE_STATUS_ZERO;
@@ -104,6 +114,11 @@ read_append(SSL* ssl, int socket, struct message* m, size_t needed)
             if (errno == EAGAIN || errno == EWOULDBLOCK)
             {
                errno = 0;
+               status = wait_socket(socket, POLLIN, -1);
+               if (status != MESSAGE_STATUS_OK)
+               {
+                  return status;
+               }
                continue;
             }
 
@@ -667,16 +682,30 @@ pgexporter_create_ssl_message(struct message** msg)
 }
 
 int
-pgexporter_create_startup_message(char* username, char* database, struct message** msg)
+pgexporter_create_startup_message(char* username, char* database, struct deque* parameters, struct message** msg)
 {
    struct message* m = NULL;
+   struct deque_iterator* iter = NULL;
+   char* value = NULL;
    size_t size;
-   size_t us;
-   size_t ds;
+   size_t offset;
 
-   us = strlen(username);
-   ds = strlen(database);
-   size = 4 + 4 + 4 + 1 + us + 1 + 8 + 1 + ds + 1 + 17 + 11 + 1;
+   size = 4 + 4 + 4 + 1 + strlen(username) + 1 + 8 + 1 + strlen(database) + 1 + 1;
+
+   if (parameters != NULL)
+   {
+      pgexporter_deque_iterator_create(parameters, &iter);
+      while (pgexporter_deque_iterator_next(iter))
+      {
+         size += strlen(iter->tag) + 1 + strlen((char*)iter->value->data) + 1;
+      }
+      pgexporter_deque_iterator_destroy(iter);
+      iter = NULL;
+   }
+   else
+   {
+      size += 17 + 11;
+   }
 
    m = (struct message*)malloc(sizeof(struct message));
    m->data = malloc(size);
@@ -688,12 +717,37 @@ pgexporter_create_startup_message(char* username, char* database, struct message
 
    pgexporter_write_int32(m->data, size);
    pgexporter_write_int32(m->data + 4, 196608);
-   pgexporter_write_string(m->data + 8, "user");
-   pgexporter_write_string(m->data + 13, username);
-   pgexporter_write_string(m->data + 13 + us + 1, "database");
-   pgexporter_write_string(m->data + 13 + us + 1 + 9, database);
-   pgexporter_write_string(m->data + 13 + us + 1 + 9 + ds + 1, "application_name");
-   pgexporter_write_string(m->data + 13 + us + 1 + 9 + ds + 1 + 17, "pgexporter");
+
+   offset = 8;
+   pgexporter_write_string(m->data + offset, "user");
+   offset += 5;
+   pgexporter_write_string(m->data + offset, username);
+   offset += strlen(username) + 1;
+   pgexporter_write_string(m->data + offset, "database");
+   offset += 9;
+   pgexporter_write_string(m->data + offset, database);
+   offset += strlen(database) + 1;
+
+   if (parameters != NULL)
+   {
+      pgexporter_deque_iterator_create(parameters, &iter);
+      while (pgexporter_deque_iterator_next(iter))
+      {
+         value = (char*)iter->value->data;
+
+         pgexporter_write_string(m->data + offset, iter->tag);
+         offset += strlen(iter->tag) + 1;
+         pgexporter_write_string(m->data + offset, value);
+         offset += strlen(value) + 1;
+      }
+      pgexporter_deque_iterator_destroy(iter);
+   }
+   else
+   {
+      pgexporter_write_string(m->data + offset, "application_name");
+      offset += 17;
+      pgexporter_write_string(m->data + offset, "pgexporter");
+   }
 
    *msg = m;
 
@@ -703,20 +757,25 @@ pgexporter_create_startup_message(char* username, char* database, struct message
 static int
 read_message(int socket, bool block, int timeout, struct message** msg)
 {
-   bool keep_read = false;
+   int status;
+   int64_t deadline;
    ssize_t numbytes;
-   struct timeval tv;
    struct message* m = NULL;
 
-   if (unlikely(timeout > 0))
-   {
-      tv.tv_sec = timeout;
-      tv.tv_usec = 0;
-      setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-   }
+   deadline = deadline_ms(timeout);
 
-   do
+   while (true)
    {
+      /* A blocking descriptor would otherwise ignore the deadline */
+      if (unlikely(deadline >= 0))
+      {
+         status = wait_socket(socket, POLLIN, deadline);
+         if (status != MESSAGE_STATUS_OK)
+         {
+            return status;
+         }
+      }
+
       m = pgexporter_memory_message();
 
       numbytes = read(socket, m->data, DEFAULT_BUFFER_SIZE);
@@ -727,72 +786,47 @@ read_message(int socket, bool block, int timeout, struct message** msg)
          m->length = numbytes;
          *msg = m;
 
-         if (unlikely(timeout > 0))
-         {
-            tv.tv_sec = 0;
-            tv.tv_usec = 0;
-            setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-         }
-
          return MESSAGE_STATUS_OK;
       }
-      else if (numbytes == 0)
-      {
-         pgexporter_memory_free();
 
-         if ((errno == EAGAIN || errno == EWOULDBLOCK) && block)
-         {
-            keep_read = true;
-            errno = 0;
-         }
-         else
-         {
-            if (unlikely(timeout > 0))
-            {
-               tv.tv_sec = 0;
-               tv.tv_usec = 0;
-               setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-            }
+      pgexporter_memory_free();
 
-            return MESSAGE_STATUS_ZERO;
-         }
+      if (numbytes == 0)
+      {
+         return MESSAGE_STATUS_ZERO;
       }
-      else
+
+      if ((errno == EAGAIN || errno == EWOULDBLOCK) && block)
       {
-         pgexporter_memory_free();
+         errno = 0;
 
-         if ((errno == EAGAIN || errno == EWOULDBLOCK) && block)
-         {
-            keep_read = true;
-            errno = 0;
-         }
-         else
+         if (deadline < 0)
          {
-            keep_read = false;
+            status = wait_socket(socket, POLLIN, -1);
+            if (status != MESSAGE_STATUS_OK)
+            {
+               return status;
+            }
          }
+
+         continue;
       }
-   }
-   while (keep_read);
 
-   if (unlikely(timeout > 0))
-   {
-      tv.tv_sec = 0;
-      tv.tv_usec = 0;
-      setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+      if (errno == EINTR)
+      {
+         errno = 0;
+         continue;
+      }
 
-      pgexporter_memory_free();
+      return MESSAGE_STATUS_ERROR;
    }
-
-   return MESSAGE_STATUS_ERROR;
 }
 
 static int
 write_message(int socket, struct message* msg)
 {
-   bool keep_write = false;
    ssize_t numbytes;
    int offset;
-   ssize_t totalbytes;
    ssize_t remaining;
    ssize_t write_size;
 
@@ -800,81 +834,71 @@ write_message(int socket, struct message* msg)
    assert(msg != NULL);
 #endif
 
-   numbytes = 0;
    offset = 0;
-   totalbytes = 0;
    remaining = msg->length;
 
-   do
+   while (remaining > 0)
    {
-      keep_write = false;
-
       write_size = MIN(remaining, DEFAULT_BUFFER_SIZE);
 
       numbytes = write(socket, msg->data + offset, write_size);
 
-      if (numbytes >= 0)
-      {
-         totalbytes += numbytes;
-      }
-
-      if (likely(totalbytes == msg->length))
-      {
-         return MESSAGE_STATUS_OK;
-      }
-      else if (numbytes != -1)
+      if (likely(numbytes >= 0))
       {
          offset += numbytes;
          remaining -= numbytes;
+      }
+      else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+         errno = 0;
 
-         if (totalbytes == msg->length)
+         if (wait_socket(socket, POLLOUT, -1) != MESSAGE_STATUS_OK)
          {
-            return MESSAGE_STATUS_OK;
+            return MESSAGE_STATUS_ERROR;
          }
-
-         keep_write = true;
+      }
+      else if (errno == EINTR)
+      {
          errno = 0;
       }
       else
       {
          pgexporter_log_debug("Error %d - %zd/%zd (%zd) - %d/%s",
                               socket,
-                              numbytes, totalbytes, msg->length,
+                              numbytes, (ssize_t)offset, msg->length,
                               errno, strerror(errno));
-
-         switch (errno)
-         {
-            case EAGAIN:
-               keep_write = true;
-               break;
-            default:
-               keep_write = false;
-               break;
-         }
          errno = 0;
+
+         return MESSAGE_STATUS_ERROR;
       }
    }
-   while (keep_write);
 
-   return MESSAGE_STATUS_ERROR;
+   return MESSAGE_STATUS_OK;
 }
 
 static int
 ssl_read_message(SSL* ssl, int timeout, struct message** msg)
 {
-   bool keep_read = false;
+   int status;
+   int64_t deadline;
    ssize_t numbytes;
-   time_t start_time;
    struct message* m = NULL;
    unsigned long err;
 
-   if (unlikely(timeout > 0))
-   {
-      start_time = time(NULL);
-   }
+   deadline = deadline_ms(timeout);
 
-   do
+   while (true)
    {
+      /* Records already decrypted by OpenSSL are not visible to poll() */
+      if (unlikely(deadline >= 0) && SSL_pending(ssl) == 0)
+      {
+         status = wait_socket(SSL_get_fd(ssl), POLLIN, deadline);
+         if (status != MESSAGE_STATUS_OK)
+         {
+            return status;
+         }
+      }
+
       m = pgexporter_memory_message();
 
       numbytes = SSL_read(ssl, m->data, DEFAULT_BUFFER_SIZE);
@@ -887,66 +911,59 @@ ssl_read_message(SSL* ssl, int timeout, struct message** msg)
 
          return MESSAGE_STATUS_OK;
       }
-      else
-      {
-         pgexporter_memory_free();
 
-         err = SSL_get_error(ssl, numbytes);
-         switch (err)
-         {
-            case SSL_ERROR_ZERO_RETURN:
-               if (timeout > 0)
-               {
-                  if (difftime(time(NULL), start_time) >= timeout)
-                  {
-                     return MESSAGE_STATUS_ZERO;
-                  }
+      pgexporter_memory_free();
 
-                  /* Sleep for 100ms */
-                  SLEEP(100000000L);
+      err = SSL_get_error(ssl, numbytes);
+      switch (err)
+      {
+         case SSL_ERROR_ZERO_RETURN:
+            ERR_clear_error();
+            return MESSAGE_STATUS_ZERO;
+         case SSL_ERROR_WANT_READ:
+         case SSL_ERROR_WANT_WRITE:
+            ERR_clear_error();
+            if (deadline < 0 || err == SSL_ERROR_WANT_WRITE)
+            {
+               status = wait_socket(SSL_get_fd(ssl), err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT, deadline);
+               if (status != MESSAGE_STATUS_OK)
+               {
+                  return status;
                }
-               __attribute__((fallthrough));
-            case SSL_ERROR_WANT_READ:
-            case SSL_ERROR_WANT_WRITE:
-            case SSL_ERROR_WANT_CONNECT:
-            case SSL_ERROR_WANT_ACCEPT:
-            case SSL_ERROR_WANT_X509_LOOKUP:
+            }
+            break;
+         case SSL_ERROR_WANT_CONNECT:
+         case SSL_ERROR_WANT_ACCEPT:
+         case SSL_ERROR_WANT_X509_LOOKUP:
 #ifndef HAVE_OPENBSD
-            case SSL_ERROR_WANT_ASYNC:
-            case SSL_ERROR_WANT_ASYNC_JOB:
-            case SSL_ERROR_WANT_CLIENT_HELLO_CB:
+         case SSL_ERROR_WANT_ASYNC:
+         case SSL_ERROR_WANT_ASYNC_JOB:
+         case SSL_ERROR_WANT_CLIENT_HELLO_CB:
 #endif
-               keep_read = true;
-               break;
-            case SSL_ERROR_SYSCALL:
-               err = ERR_get_error();
-               pgexporter_log_error("SSL_ERROR_SYSCALL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
-               pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
-               errno = 0;
-               keep_read = false;
-               break;
-            case SSL_ERROR_SSL:
-               err = ERR_get_error();
-               pgexporter_log_error("SSL_ERROR_SSL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
-               pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
-               keep_read = false;
-               break;
-         }
-         ERR_clear_error();
+            ERR_clear_error();
+            break;
+         case SSL_ERROR_SYSCALL:
+            err = ERR_get_error();
+            pgexporter_log_error("SSL_ERROR_SYSCALL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
+            pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
+            errno = 0;
+            ERR_clear_error();
+            return MESSAGE_STATUS_ERROR;
+         default:
+            err = ERR_get_error();
+            pgexporter_log_error("SSL_ERROR_SSL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
+            pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
+            ERR_clear_error();
+            return MESSAGE_STATUS_ERROR;
       }
    }
-   while (keep_read);
-
-   return MESSAGE_STATUS_ERROR;
 }
 
 static int
 ssl_write_message(SSL* ssl, struct message* msg)
 {
-   bool keep_write = false;
    ssize_t numbytes;
    int offset;
-   ssize_t totalbytes;
    ssize_t remaining;
    int err;
 
@@ -954,80 +971,147 @@ ssl_write_message(SSL* ssl, struct message* msg)
    assert(msg != NULL);
 #endif
 
-   numbytes = 0;
    offset = 0;
-   totalbytes = 0;
    remaining = msg->length;
 
-   do
+   while (remaining > 0)
    {
       numbytes = SSL_write(ssl, msg->data + offset, remaining);
 
-      if (likely(numbytes == msg->length))
-      {
-         return MESSAGE_STATUS_OK;
-      }
-      else if (numbytes > 0)
+      if (likely(numbytes > 0))
       {
          offset += numbytes;
-         totalbytes += numbytes;
          remaining -= numbytes;
 
-         if (totalbytes == msg->length)
+         if (remaining > 0)
          {
-            return MESSAGE_STATUS_OK;
+            pgexporter_log_debug("SSL/Write %d - %zd/%d vs %zd", SSL_get_fd(ssl), numbytes, offset, msg->length);
          }
 
-         pgexporter_log_debug("SSL/Write %d - %zd/%zd vs %zd", SSL_get_fd(ssl), numbytes, totalbytes, msg->length);
-         keep_write = true;
-         errno = 0;
+         continue;
       }
-      else
-      {
-         err = SSL_get_error(ssl, numbytes);
 
-         switch (err)
-         {
-            case SSL_ERROR_ZERO_RETURN:
-            case SSL_ERROR_WANT_READ:
-            case SSL_ERROR_WANT_WRITE:
-            case SSL_ERROR_WANT_CONNECT:
-            case SSL_ERROR_WANT_ACCEPT:
-            case SSL_ERROR_WANT_X509_LOOKUP:
+      err = SSL_get_error(ssl, numbytes);
+
+      switch (err)
+      {
+         case SSL_ERROR_WANT_READ:
+         case SSL_ERROR_WANT_WRITE:
+            ERR_clear_error();
+            if (wait_socket(SSL_get_fd(ssl), err == SSL_ERROR_WANT_READ ? POLLIN : POLLOUT, -1) != MESSAGE_STATUS_OK)
+            {
+               return MESSAGE_STATUS_ERROR;
+            }
+            break;
+         case SSL_ERROR_WANT_CONNECT:
+         case SSL_ERROR_WANT_ACCEPT:
+         case SSL_ERROR_WANT_X509_LOOKUP:
 #ifndef HAVE_OPENBSD
-            case SSL_ERROR_WANT_ASYNC:
-            case SSL_ERROR_WANT_ASYNC_JOB:
-            case SSL_ERROR_WANT_CLIENT_HELLO_CB:
+         case SSL_ERROR_WANT_ASYNC:
+         case SSL_ERROR_WANT_ASYNC_JOB:
+         case SSL_ERROR_WANT_CLIENT_HELLO_CB:
 #endif
-               errno = 0;
-               keep_write = true;
-               break;
-            case SSL_ERROR_SYSCALL:
-               err = ERR_get_error();
-               pgexporter_log_error("SSL_ERROR_SYSCALL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
-               pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
-               errno = 0;
-               keep_write = false;
-               break;
-            case SSL_ERROR_SSL:
-               err = ERR_get_error();
-               pgexporter_log_error("SSL_ERROR_SSL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
-               pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
-               errno = 0;
-               keep_write = false;
-               break;
+            ERR_clear_error();
+            errno = 0;
+            break;
+         case SSL_ERROR_SYSCALL:
+            err = ERR_get_error();
+            pgexporter_log_error("SSL_ERROR_SYSCALL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
+            pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
+            errno = 0;
+            ERR_clear_error();
+            return MESSAGE_STATUS_ERROR;
+         default:
+            err = ERR_get_error();
+            pgexporter_log_error("SSL_ERROR_SSL: %s (%d)", strerror(errno), SSL_get_fd(ssl));
+            pgexporter_log_error("Reason: %s", ERR_reason_error_string(err));
+            errno = 0;
+            ERR_clear_error();
+            return MESSAGE_STATUS_ERROR;
+      }
+   }
+
+   return MESSAGE_STATUS_OK;
+}
+
+static int64_t
+deadline_ms(int timeout)
+{
+   struct timespec ts;
+
+   if (timeout <= 0)
+   {
+      return -1;
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + (int64_t)timeout * 1000;
+}
+
+/**
+ * Wait until a socket is ready or the deadline passes
+ * @param socket The socket
+ * @param events The poll events
+ * @param deadline The monotonic deadline in milliseconds, or -1 for no deadline
+ * @return MESSAGE_STATUS_OK when ready, MESSAGE_STATUS_ZERO on timeout, otherwise MESSAGE_STATUS_ERROR
+ */
+static int
+wait_socket(int socket, short events, int64_t deadline)
+{
+   int r;
+   int wait;
+   int64_t remaining;
+   struct pollfd pfd;
+   struct timespec ts;
+
+   while (true)
+   {
+      wait = -1;
+
+      if (deadline >= 0)
+      {
+         clock_gettime(CLOCK_MONOTONIC, &ts);
+         remaining = deadline - ((int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+
+         if (remaining <= 0)
+         {
+            return MESSAGE_STATUS_ZERO;
          }
-         ERR_clear_error();
 
-         if (!keep_write)
+         wait = (int)MIN(remaining, (int64_t)INT32_MAX);
+      }
+
+      pfd.fd = socket;
+      pfd.events = events;
+      pfd.revents = 0;
+
+      r = poll(&pfd, 1, wait);
+
+      if (r > 0)
+      {
+         if (pfd.revents & POLLNVAL)
          {
             return MESSAGE_STATUS_ERROR;
          }
+
+         /* POLLHUP and POLLERR are reported by the following read or write */
+         return MESSAGE_STATUS_OK;
       }
-   }
-   while (keep_write);
+      else if (r < 0)
+      {
+         if (errno == EINTR)
+         {
+            errno = 0;
+            continue;
+         }
+
+         pgexporter_log_debug("poll error: fd=%d errno=%d", socket, errno);
+         errno = 0;
 
-   return MESSAGE_STATUS_ERROR;
+         return MESSAGE_STATUS_ERROR;
+      }
+   }
 }
 
 /**
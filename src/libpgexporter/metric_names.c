@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <logging.h>
+#include <metric_names.h>
+#include <shmem.h>
+#include <utils.h>
+
+/* system */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Slot value of an empty slot, otherwise the insertion index + 1 */
+#define EMPTY_SLOT 0
+
+static uint32_t* get_slots(struct metric_names* names);
+static uint32_t* get_order(struct metric_names* names);
+static char* get_strings(struct metric_names* names);
+static uint32_t hash_name(char* name);
+static uint32_t* find_slot(struct metric_names* names, char* name, uint32_t hash);
+static int grow(struct metric_names** names, uint32_t capacity, size_t strings_size);
+
+int
+pgexporter_metric_names_create(uint32_t capacity, size_t strings_size, struct metric_names** names)
+{
+   struct metric_names* n = NULL;
+   uint32_t slots = METRIC_NAMES_INITIAL_CAPACITY;
+   size_t size;
+
+   *names = NULL;
+
+   while (slots < capacity)
+   {
+      slots <<= 1;
+   }
+
+   strings_size = MAX(strings_size, (size_t)METRIC_NAMES_INITIAL_STRINGS);
+
+   size = sizeof(struct metric_names) + 2 * (size_t)slots * sizeof(uint32_t) + strings_size;
+
+   if (pgexporter_create_shared_memory(size, HUGEPAGE_OFF, (void**)&n))
+   {
+      pgexporter_log_error("Unable to allocate the metric name registry (%zu bytes)", size);
+      return 1;
+   }
+
+   /* The segment is zero filled, so all slots are empty */
+   n->size = size;
+   n->capacity = slots;
+   n->number_of_names = 0;
+   n->strings_size = strings_size;
+   n->strings_used = 0;
+
+   *names = n;
+
+   return 0;
+}
+
+int
+pgexporter_metric_names_add(struct metric_names** names, char* name)
+{
+   struct metric_names* n = NULL;
+   uint32_t hash;
+   uint32_t* slot = NULL;
+   size_t length;
+
+   if (names == NULL || name == NULL)
+   {
+      return 1;
+   }
+
+   if (*names == NULL && pgexporter_metric_names_create(0, 0, names))
+   {
+      return 1;
+   }
+
+   hash = hash_name(name);
+
+   if (*find_slot(*names, name, hash) != EMPTY_SLOT)
+   {
+      return 0;
+   }
+
+   length = strlen(name) + 1;
+   n = *names;
+
+   /* Keep the load factor at or below 1/2 */
+   if (2 * ((size_t)n->number_of_names + 1) > n->capacity || n->strings_used + length > n->strings_size)
+   {
+      if (grow(names,
+               2 * ((size_t)n->number_of_names + 1) > n->capacity ? n->capacity << 1 : n->capacity,
+               MAX(n->strings_size << 1, n->strings_used + length)))
+      {
+         return 1;
+      }
+      n = *names;
+   }
+
+   memcpy(get_strings(n) + n->strings_used, name, length);
+   get_order(n)[n->number_of_names] = (uint32_t)n->strings_used;
+   n->strings_used += length;
+
+   slot = find_slot(n, name, hash);
+   *slot = ++n->number_of_names;
+
+   return 0;
+}
+
+bool
+pgexporter_metric_names_contains(struct metric_names* names, char* name)
+{
+   if (names == NULL || name == NULL)
+   {
+      return false;
+   }
+
+   return *find_slot(names, name, hash_name(name)) != EMPTY_SLOT;
+}
+
+int
+pgexporter_metric_names_count(struct metric_names* names)
+{
+   return names != NULL ? (int)names->number_of_names : 0;
+}
+
+char*
+pgexporter_metric_names_get(struct metric_names* names, int index)
+{
+   if (names == NULL || index < 0 || (uint32_t)index >= names->number_of_names)
+   {
+      return NULL;
+   }
+
+   return get_strings(names) + get_order(names)[index];
+}
+
+void
+pgexporter_metric_names_destroy(struct metric_names* names)
+{
+   if (names != NULL)
+   {
+      pgexporter_destroy_shared_memory(names, names->size);
+   }
+}
+
+static uint32_t*
+get_slots(struct metric_names* names)
+{
+   return (uint32_t*)(names + 1);
+}
+
+static uint32_t*
+get_order(struct metric_names* names)
+{
+   return get_slots(names) + names->capacity;
+}
+
+static char*
+get_strings(struct metric_names* names)
+{
+   return (char*)(get_order(names) + names->capacity);
+}
+
+static uint32_t
+hash_name(char* name)
+{
+   uint64_t hash = pgexporter_hash_string(0, name);
+
+   return (uint32_t)(hash ^ (hash >> 32));
+}
+
+static uint32_t*
+find_slot(struct metric_names* names, char* name, uint32_t hash)
+{
+   uint32_t* slots = get_slots(names);
+   uint32_t* order = get_order(names);
+   char* strings = get_strings(names);
+   uint32_t mask = names->capacity - 1;
+   uint32_t i = hash & mask;
+
+   /* Linear probing, the load factor guarantees an empty slot */
+   while (slots[i] != EMPTY_SLOT && strcmp(strings + order[slots[i] - 1], name))
+   {
+      i = (i + 1) & mask;
+   }
+
+   return &slots[i];
+}
+
+static int
+grow(struct metric_names** names, uint32_t capacity, size_t strings_size)
+{
+   struct metric_names* old = *names;
+   struct metric_names* n = NULL;
+   char* name = NULL;
+
+   if (pgexporter_metric_names_create(capacity, strings_size, &n))
+   {
+      return 1;
+   }
+
+   for (uint32_t i = 0; i < old->number_of_names; i++)
+   {
+      name = get_strings(old) + get_order(old)[i];
+
+      memcpy(get_strings(n) + n->strings_used, name, strlen(name) + 1);
+      get_order(n)[i] = (uint32_t)n->strings_used;
+      n->strings_used += strlen(name) + 1;
+
+      *find_slot(n, name, hash_name(name)) = i + 1;
+      n->number_of_names = i + 1;
+   }
+
+   pgexporter_log_debug("Metric name registry grown to %u slots", n->capacity);
+
+   pgexporter_metric_names_destroy(old);
+   *names = n;
+
+   return 0;
+}
@@ -70,6 +70,43 @@ pgexporter_copy_pg_query_alts(struct pg_query_alts** dst, struct pg_query_alts*
    pgexporter_copy_pg_query_alts(&(*dst)->right, src->right);
 }
 
+bool
+pgexporter_is_same_pg_query_alts(struct pg_query_alts* a, struct pg_query_alts* b)
+{
+   if (a == b)
+   {
+      return true;
+   }
+
+   if (!a || !b)
+   {
+      return false;
+   }
+
+   if (a->pg_version != b->pg_version ||
+       a->node.n_columns != b->node.n_columns ||
+       a->node.is_histogram != b->node.is_histogram ||
+       strcmp(a->node.query, b->node.query))
+   {
+      return false;
+   }
+
+   for (int i = 0; i < a->node.n_columns && i < MAX_NUMBER_OF_COLUMNS; i++)
+   {
+      if (a->node.columns[i].type != b->node.columns[i].type ||
+          strcmp(a->node.columns[i].name, b->node.columns[i].name) ||
+          strcmp(a->node.columns[i].description, b->node.columns[i].description) ||
+          a->node.columns[i].n_buckets != b->node.columns[i].n_buckets ||
+          memcmp(a->node.columns[i].buckets, b->node.columns[i].buckets, a->node.columns[i].n_buckets * sizeof(double)))
+      {
+         return false;
+      }
+   }
+
+   return pgexporter_is_same_pg_query_alts(a->left, b->left) &&
+          pgexporter_is_same_pg_query_alts(a->right, b->right);
+}
+
 static int
 height(struct pg_query_alts* A)
 {
@@ -219,6 +256,14 @@ pgexporter_free_pg_query_alts(struct configuration* config)
 {
    for (int i = 0; i < config->number_of_metrics; i++)
    {
+      if (config->prometheus[i].compiled)
+      {
+         /* Lives in the binary */
+         config->prometheus[i].pg_root = NULL;
+         config->prometheus[i].compiled = false;
+         continue;
+      }
+
       pgexporter_free_pg_node_avl(&config->prometheus[i].pg_root);
    }
 }
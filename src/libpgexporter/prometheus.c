@@ -29,7 +29,11 @@
 /* pgexporter */
 #include <openssl/crypto.h>
 #include <pgexporter.h>
+#include <activity.h>
+#include <alert.h>
 #include <art.h>
+#include <derive.h>
+#include <disk.h>
 #include <extension.h>
 #include <fips.h>
 #include <history.h>
@@ -40,16 +44,24 @@
 #include <message.h>
 #include <network.h>
 #include <prometheus.h>
+#include <prometheus_client.h>
 #include <queries.h>
 #include <pg_query_alts.h>
 #include <ext_query_alts.h>
 #include <security.h>
+#include <server.h>
+#include <shard.h>
 #include <shmem.h>
+#include <slice.h>
 #include <cache.h>
 #include <utils.h>
+#include <utf8.h>
+#include <yaml_configuration.h>
 
 /* system */
 #include <errno.h>
+#include <inttypes.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,6 +69,7 @@
 #include <sys/types.h>
 
 #define CHUNK_SIZE                       32768
+#define ENDPOINT_STREAM_FLUSH_SIZE       16384
 #define DEFAULT_BLOCKING_TIMEOUT_SECONDS 30
 
 #define MAX_ARR_LENGTH                   256
@@ -66,6 +79,17 @@
 #define INPUT_DATA                       1
 #define INPUT_WAL                        2
 
+/**
+ * The state of relaying a Prometheus endpoint to the client
+ */
+struct endpoint_stream
+{
+   SSL* ssl;        /**< The client SSL */
+   int fd;          /**< The client descriptor */
+   char* data;      /**< The pending data */
+   bool first_line; /**< Is the next line the first of the endpoint */
+};
+
 /**
  * This is a linked list of queries with the data received from the server
  * as well as the query sent to the server and other meta data.
@@ -77,10 +101,25 @@ typedef struct query_list
    struct pg_query_alts* query_alt;
    char tag[PROMETHEUS_LENGTH];
    int sort_type;
+   int derive;
    bool error;
    char database[DB_NAME_LENGTH];
 } query_list_t;
 
+/**
+ * The observations of one series of a histogram that the exporter buckets itself.
+ *
+ * The series is identified by the server and the label values of its first
+ * observation, which also provides the labels when it is written.
+ **/
+typedef struct observation_series
+{
+   struct tuple* tuple;
+   uint64_t buckets[MAX_NUMBER_OF_BUCKETS + 1];
+   uint64_t count;
+   double sum;
+} observation_series_t;
+
 /**
  * This is one of the nodes of a linked list of a column entry.
  *
@@ -132,6 +171,7 @@ static int add_metric_to_art(struct art* art_tree, char* key, char* value,
                              char* help, char* type, int sort_type);
 static void output_art_metrics(SSL* client_ssl, int client_fd, struct art* art_tree);
 static void output_all_metrics(SSL* client_ssl, int client_fd, prometheus_metrics_container_t* container);
+static int snapshot_art_metrics(char* endpoint, struct art* art_tree, struct prometheus_bridge* bridge);
 
 static int home_page(SSL* client_ssl, int client_fd);
 static int metrics_page(SSL* client_ssl, int client_fd);
@@ -143,6 +183,10 @@ static bool collector_pass(const char* collector);
 static void add_column_to_store(column_store_t* store, int n_store, char* data, int sort_type, struct tuple* current);
 
 static void query_statistics_information(prometheus_metrics_container_t* container);
+static void server_statistics_information(prometheus_metrics_container_t* container);
+static void disk_information(prometheus_metrics_container_t* container);
+static void activity_information(prometheus_metrics_container_t* container);
+static char* activity_histogram(char* data, char* name, char* labels, struct activity_histogram* histogram, const uint64_t* bounds, double scale);
 static void general_information(prometheus_metrics_container_t* container);
 static void core_information(prometheus_metrics_container_t* container);
 static void extension_list_information(prometheus_metrics_container_t* container);
@@ -151,18 +195,26 @@ static void version_information(prometheus_metrics_container_t* container);
 static void uptime_information(prometheus_metrics_container_t* container);
 static void primary_information(prometheus_metrics_container_t* container);
 static void settings_information(prometheus_metrics_container_t* container);
-static void fips_information(prometheus_metrics_container_t* container);
+static void fips_information(prometheus_metrics_container_t* container, bool global);
 static void custom_metrics(prometheus_metrics_container_t* container); // Handles custom metrics provided in YAML format, both internal and external
 static void extension_metrics(prometheus_metrics_container_t* container);
 static void alert_information(prometheus_metrics_container_t* container);
 static void prometheus_endpoints_information(SSL* client_ssl, int client_fd);
+static int scrape(prometheus_metrics_container_t** container, bool global, bool keep_connections);
+static int endpoint_line(char* line, void* userdata);
+static void endpoint_flush(struct endpoint_stream* stream);
 static void append_help_info(char** data, char* tag, char* name, char* description);
 static void append_type_info(char** data, char* tag, char* name, int typeId);
 
+static int slice_query(int server, struct prometheus* prom, char* database, char* qs, int columns, char** names, struct query** query);
+
 static void handle_histogram(column_store_t* store, int* n_store, query_list_t* temp);
 static void handle_default_histogram(column_store_t* store, int* n_store, query_list_t* temp);
+static void handle_observations(column_store_t* store, int* n_store, query_list_t* temp, int h_idx);
+static void append_observation_labels(char** data, query_list_t* temp, struct tuple* tuple, int h_idx);
 static void handle_gauge_counter(column_store_t* store, int* n_store, query_list_t* temp);
 static void handle_default_gauge_counter(column_store_t* store, int* n_store, query_list_t* temp);
+static void handle_derived(column_store_t* store, int* n_store, query_list_t* temp, int column);
 
 static int parse_list(char* list_str, char** strs, int* n_strs);
 
@@ -188,7 +240,6 @@ static struct http_route prometheus_routes[] = {
 void
 pgexporter_prometheus(SSL* client_ssl, int client_fd)
 {
-   struct http_server_request* req = NULL;
    struct configuration* config;
 
    pgexporter_start_logging();
@@ -210,7 +261,7 @@ pgexporter_prometheus(SSL* client_ssl, int client_fd)
       {
          /*
           * Plain HTTP on a TLS port — redirect to HTTPS. Read the raw message
-          * here (not via pgexporter_http_server_parse) because we need the path
+          * here (not via pgexporter_http_server_serve) because we need the path
           * for the redirect URL and the process exits immediately after.
           */
          struct message* redirect_msg = NULL;
@@ -254,16 +305,13 @@ pgexporter_prometheus(SSL* client_ssl, int client_fd)
       /* MESSAGE_STATUS_OK: TLS handshake done, proceed to parse */
    }
 
-   if (pgexporter_http_server_parse(client_ssl, client_fd, &req) != MESSAGE_STATUS_OK)
+   if (pgexporter_http_server_serve(client_ssl, client_fd,
+                                    prometheus_routes,
+                                    sizeof(prometheus_routes) / sizeof(prometheus_routes[0])) != MESSAGE_STATUS_OK)
    {
       goto error;
    }
 
-   pgexporter_http_server_dispatch(client_ssl, client_fd, req,
-                                   prometheus_routes,
-                                   sizeof(prometheus_routes) / sizeof(prometheus_routes[0]));
-
-   pgexporter_http_server_request_destroy(req);
    pgexporter_close_ssl(client_ssl);
    pgexporter_disconnect(client_fd);
    pgexporter_memory_destroy();
@@ -275,7 +323,6 @@ pgexporter_prometheus(SSL* client_ssl, int client_fd)
 error:
 
    pgexporter_http_respond_400(client_ssl, client_fd);
-   pgexporter_http_server_request_destroy(req);
    pgexporter_close_ssl(client_ssl);
    pgexporter_disconnect(client_fd);
    pgexporter_memory_destroy();
@@ -315,6 +362,34 @@ retry_cache_locking:
    }
 }
 
+void
+pgexporter_prometheus_invalidate_cache(void)
+{
+   signed char cache_is_free;
+   struct prometheus_cache* cache;
+
+   cache = (struct prometheus_cache*)prometheus_cache_shmem;
+
+   if (cache == NULL)
+   {
+      return;
+   }
+
+retry_cache_locking:
+   cache_is_free = STATE_FREE;
+   if (atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   {
+      metrics_cache_invalidate();
+
+      atomic_store(&cache->lock, STATE_FREE);
+   }
+   else
+   {
+      /* Sleep for 1ms */
+      SLEEP_AND_GOTO(1000000L, retry_cache_locking);
+   }
+}
+
 void
 pgexporter_prometheus_logging(int type)
 {
@@ -385,6 +460,16 @@ home_page(SSL* client_ssl, int client_fd)
                              "  <li>pgexporter_query_errors_total</li>\n",
                              "  <li>pgexporter_query_timeouts_total</li>\n");
 
+   data = pgexporter_vappend(data, 8,
+                             "  <li>pgexporter_server_scrapes_total</li>\n",
+                             "  <li>pgexporter_server_last_scrape_duration_seconds</li>\n",
+                             "  <li>pgexporter_server_last_success_timestamp_seconds</li>\n",
+                             "  <li>pgexporter_server_queries_total</li>\n",
+                             "  <li>pgexporter_server_query_errors_total</li>\n",
+                             "  <li>pgexporter_server_bytes_received_total</li>\n",
+                             "  <li>pgexporter_server_connection_reuse_ratio</li>\n",
+                             "  <li>pgexporter_server_discovery_age_seconds</li>\n");
+
    data = pgexporter_vappend(data, 7,
                              "  <li>pgexporter_alert_postgresql_down</li>\n",
                              "  <li>pgexporter_alert_connections_high</li>\n",
@@ -394,6 +479,8 @@ home_page(SSL* client_ssl, int client_fd)
                              "  <li>pgexporter_alert_xid_wraparound</li>\n",
                              "  <li>pgexporter_alert_multixact_wraparound</li>\n");
 
+   data = pgexporter_append(data, "  <li>pgexporter_alert_state</li>\n");
+
    pgexporter_http_respond_chunked_write(client_ssl, client_fd, data);
    free(data);
    data = NULL;
@@ -465,6 +552,19 @@ metrics_page(SSL* client_ssl, int client_fd)
 
    memset(&msg, 0, sizeof(struct message));
 
+   /* The shards scrape the servers, so only their fragments are written */
+   if (config->metrics_shards > 0)
+   {
+      if (pgexporter_shard_output(client_ssl, client_fd))
+      {
+         return 1;
+      }
+
+      prometheus_endpoints_information(client_ssl, client_fd);
+
+      return pgexporter_http_respond_chunked_end(client_ssl, client_fd) != MESSAGE_STATUS_OK;
+   }
+
    start_time = time(NULL);
 
 retry_cache_locking:
@@ -775,6 +875,395 @@ query_statistics_information(prometheus_metrics_container_t* container)
    data = NULL;
 }
 
+static void
+server_statistics_information(prometheus_metrics_container_t* container)
+{
+   char* data = NULL;
+   time_t now;
+   double value;
+   uint64_t reused;
+   uint64_t connections;
+   struct server_statistics* statistics = NULL;
+   struct configuration* config;
+   static const char* names[] = {
+      "pgexporter_server_scrapes_total",
+      "pgexporter_server_last_scrape_duration_seconds",
+      "pgexporter_server_last_success_timestamp_seconds",
+      "pgexporter_server_queries_total",
+      "pgexporter_server_query_errors_total",
+      "pgexporter_server_bytes_received_total",
+      "pgexporter_server_connection_reuse_ratio",
+      "pgexporter_server_discovery_age_seconds",
+   };
+   static const char* helps[] = {
+      "The number of scrapes of the server",
+      "The time spent on the server in the last scrape",
+      "The time of the last scrape with a connection to the server",
+      "The number of metric queries executed on the server",
+      "The number of metric queries that failed on the server",
+      "The number of bytes received from the server",
+      "The share of connection requests served by an open connection to the server",
+      "The time since the databases and extensions of the server were discovered",
+   };
+   static const char* types[] = {
+      "counter", "gauge", "gauge", "counter", "counter", "counter", "gauge", "gauge",
+   };
+
+   config = (struct configuration*)shmem;
+
+   now = time(NULL);
+
+   for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+   {
+      data = pgexporter_format_and_append(data, "#HELP %s %s\n#TYPE %s %s\n", names[i], helps[i], names[i], types[i]);
+
+      for (int server = 0; server < config->number_of_servers; server++)
+      {
+         if (config->servers[server].type == SERVER_TYPE_PROMETHEUS || !pgexporter_server_owned(server))
+         {
+            continue;
+         }
+
+         statistics = &config->servers[server].statistics;
+
+         switch (i)
+         {
+            case 0:
+               value = (double)atomic_load(&statistics->scrapes);
+               break;
+            case 1:
+               value = (double)atomic_load(&statistics->last_scrape_duration) / 1000000.0;
+               break;
+            case 2:
+               value = (double)atomic_load(&statistics->last_success);
+               break;
+            case 3:
+               value = (double)atomic_load(&statistics->queries);
+               break;
+            case 4:
+               value = (double)atomic_load(&statistics->query_errors);
+               break;
+            case 5:
+               value = (double)atomic_load(&statistics->bytes_received);
+               break;
+            case 6:
+               reused = atomic_load(&statistics->connections_reused);
+               connections = atomic_load(&statistics->connections) + reused;
+               value = connections > 0 ? (double)reused / (double)connections : 0.0;
+               break;
+            default:
+               if (atomic_load(&statistics->discovery) == 0)
+               {
+                  continue;
+               }
+               value = difftime(now, (time_t)atomic_load(&statistics->discovery));
+               break;
+         }
+
+         data = pgexporter_format_and_append(data, "%s{server=\"%s\"} %.15g\n",
+                                             names[i], &config->servers[server].name[0], value);
+      }
+
+      add_metric_to_art(container->server_metrics, (char*)names[i], data, NULL, NULL, 0);
+      free(data);
+      data = NULL;
+   }
+}
+
+static void
+disk_information(prometheus_metrics_container_t* container)
+{
+   char* data = NULL;
+   bool found = false;
+   double value;
+   struct disk_usage* usage = NULL;
+   struct configuration* config;
+   static const char* names[] = {
+      "pgexporter_disk_used_bytes",
+      "pgexporter_disk_files",
+      "pgexporter_disk_free_bytes",
+      "pgexporter_disk_total_bytes",
+      "pgexporter_disk_scans_total",
+   };
+   static const char* helps[] = {
+      "The size of the files of the directory",
+      "The number of files of the directory",
+      "The free space of the file system of the directory",
+      "The size of the file system of the directory",
+      "The number of subdirectories scanned to keep the usage current",
+   };
+   static const char* types[] = {
+      "gauge", "gauge", "gauge", "gauge", "counter",
+   };
+   static const char* directories[] = {
+      "data", "wal",
+   };
+
+   config = (struct configuration*)shmem;
+
+   if (!collector_pass("disk"))
+   {
+      return;
+   }
+
+   /* The usage is maintained by the disk process */
+   for (int server = 0; !found && server < config->number_of_servers; server++)
+   {
+      found = pgexporter_server_owned(server) &&
+              (atomic_load(&config->servers[server].disk[DISK_DATA].updated) != 0 ||
+               atomic_load(&config->servers[server].disk[DISK_WAL].updated) != 0);
+   }
+
+   if (!found)
+   {
+      return;
+   }
+
+   for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+   {
+      data = pgexporter_format_and_append(data, "#HELP %s %s\n#TYPE %s %s\n", names[i], helps[i], names[i], types[i]);
+
+      for (int server = 0; server < config->number_of_servers; server++)
+      {
+         if (!pgexporter_server_owned(server))
+         {
+            continue;
+         }
+
+         for (int k = DISK_DATA; k <= DISK_WAL; k++)
+         {
+            usage = &config->servers[server].disk[k];
+
+            if (atomic_load(&usage->updated) == 0)
+            {
+               continue;
+            }
+
+            switch (i)
+            {
+               case 0:
+                  value = (double)atomic_load(&usage->used);
+                  break;
+               case 1:
+                  value = (double)atomic_load(&usage->files);
+                  break;
+               case 2:
+                  value = (double)atomic_load(&usage->free);
+                  break;
+               case 3:
+                  value = (double)atomic_load(&usage->total);
+                  break;
+               default:
+                  value = (double)atomic_load(&usage->scans);
+                  break;
+            }
+
+            data = pgexporter_format_and_append(data, "%s{server=\"%s\",directory=\"%s\"} %.15g\n",
+                                                names[i], &config->servers[server].name[0], directories[k], value);
+         }
+      }
+
+      add_metric_to_art(container->server_metrics, (char*)names[i], data, NULL, NULL, 0);
+      free(data);
+      data = NULL;
+   }
+}
+
+static void
+activity_information(prometheus_metrics_container_t* container)
+{
+   char* data = NULL;
+   char labels[MISC_LENGTH * 2];
+   bool found = false;
+   struct activity_server* aggregates = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!collector_pass("activity") || !pgexporter_activity_enabled())
+   {
+      return;
+   }
+
+   /* The aggregates are maintained by the sampler */
+   for (int server = 0; !found && server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      found = pgexporter_server_owned(server) && atomic_load(&aggregates->samples) > 0;
+   }
+
+   if (!found)
+   {
+      return;
+   }
+
+   data = pgexporter_append(data, "#HELP pgexporter_activity_samples_total The number of samples of pg_stat_activity\n"
+                                  "#TYPE pgexporter_activity_samples_total counter\n");
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      if (pgexporter_server_owned(server) && atomic_load(&aggregates->samples) > 0)
+      {
+         data = pgexporter_format_and_append(data, "pgexporter_activity_samples_total{server=\"%s\"} %llu\n",
+                                             &config->servers[server].name[0], atomic_load(&aggregates->samples));
+      }
+   }
+   add_metric_to_art(container->server_metrics, "pgexporter_activity_samples_total", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+
+   data = pgexporter_append(data, "#HELP pgexporter_activity_errors_total The number of failed samples of pg_stat_activity\n"
+                                  "#TYPE pgexporter_activity_errors_total counter\n");
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      if (pgexporter_server_owned(server) && atomic_load(&aggregates->samples) > 0)
+      {
+         data = pgexporter_format_and_append(data, "pgexporter_activity_errors_total{server=\"%s\"} %llu\n",
+                                             &config->servers[server].name[0], atomic_load(&aggregates->errors));
+      }
+   }
+   add_metric_to_art(container->server_metrics, "pgexporter_activity_errors_total", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+
+   data = pgexporter_append(data, "#HELP pgexporter_activity_state_samples_total The sessions in a state summed over the samples\n"
+                                  "#TYPE pgexporter_activity_state_samples_total counter\n");
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      if (!pgexporter_server_owned(server) || atomic_load(&aggregates->samples) == 0)
+      {
+         continue;
+      }
+
+      for (int i = 0; i < ACTIVITY_NUMBER_OF_STATES; i++)
+      {
+         data = pgexporter_format_and_append(data, "pgexporter_activity_state_samples_total{server=\"%s\",state=\"%s\"} %llu\n",
+                                             &config->servers[server].name[0], pgexporter_activity_states[i],
+                                             atomic_load(&aggregates->states[i]));
+      }
+   }
+   add_metric_to_art(container->server_metrics, "pgexporter_activity_state_samples_total", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+
+   data = pgexporter_append(data, "#HELP pgexporter_activity_backend_type_samples_total The sessions of a backend type summed over the samples\n"
+                                  "#TYPE pgexporter_activity_backend_type_samples_total counter\n");
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      if (!pgexporter_server_owned(server) || atomic_load(&aggregates->samples) == 0)
+      {
+         continue;
+      }
+
+      for (int i = 0; i < ACTIVITY_NUMBER_OF_BACKEND_TYPES; i++)
+      {
+         if (atomic_load(&aggregates->backend_types[i].used))
+         {
+            data = pgexporter_format_and_append(data, "pgexporter_activity_backend_type_samples_total{server=\"%s\",backend_type=\"%s\"} %llu\n",
+                                                &config->servers[server].name[0], aggregates->backend_types[i].name,
+                                                atomic_load(&aggregates->backend_types[i].samples));
+         }
+      }
+   }
+   add_metric_to_art(container->server_metrics, "pgexporter_activity_backend_type_samples_total", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+
+   data = pgexporter_append(data, "#HELP pgexporter_activity_wait_event_samples_total The sessions waiting on an event summed over the samples\n"
+                                  "#TYPE pgexporter_activity_wait_event_samples_total counter\n");
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      if (!pgexporter_server_owned(server) || atomic_load(&aggregates->samples) == 0)
+      {
+         continue;
+      }
+
+      for (int i = 0; i < ACTIVITY_NUMBER_OF_WAIT_EVENTS; i++)
+      {
+         if (atomic_load(&aggregates->wait_events[i].used))
+         {
+            data = pgexporter_format_and_append(data, "pgexporter_activity_wait_event_samples_total{server=\"%s\",wait_event_type=\"%s\",wait_event=\"%s\"} %llu\n",
+                                                &config->servers[server].name[0], aggregates->wait_events[i].type,
+                                                aggregates->wait_events[i].name, atomic_load(&aggregates->wait_events[i].samples));
+         }
+      }
+   }
+   add_metric_to_art(container->server_metrics, "pgexporter_activity_wait_event_samples_total", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+
+   data = pgexporter_append(data, "#HELP pgexporter_activity_active_sessions The active sessions of each sample\n"
+                                  "#TYPE pgexporter_activity_active_sessions histogram\n");
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      if (pgexporter_server_owned(server) && atomic_load(&aggregates->samples) > 0)
+      {
+         pgexporter_snprintf(&labels[0], sizeof(labels), "server=\"%s\"", &config->servers[server].name[0]);
+         data = activity_histogram(data, "pgexporter_activity_active_sessions", &labels[0],
+                                   &aggregates->active, &pgexporter_activity_session_bounds[0], 1.0);
+      }
+   }
+   add_metric_to_art(container->server_metrics, "pgexporter_activity_active_sessions", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+
+   data = pgexporter_append(data, "#HELP pgexporter_activity_wait_duration_seconds The duration of the waits, to the resolution of the sampling\n"
+                                  "#TYPE pgexporter_activity_wait_duration_seconds histogram\n");
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      aggregates = pgexporter_activity_server(server);
+      if (!pgexporter_server_owned(server) || atomic_load(&aggregates->samples) == 0)
+      {
+         continue;
+      }
+
+      for (int i = 0; i < ACTIVITY_NUMBER_OF_WAIT_TYPES; i++)
+      {
+         if (atomic_load(&aggregates->waits[i].count) == 0)
+         {
+            continue;
+         }
+
+         pgexporter_snprintf(&labels[0], sizeof(labels), "server=\"%s\",wait_event_type=\"%s\"",
+                             &config->servers[server].name[0], pgexporter_activity_wait_types[i]);
+         data = activity_histogram(data, "pgexporter_activity_wait_duration_seconds", &labels[0],
+                                   &aggregates->waits[i], &pgexporter_activity_wait_bounds[0], 0.001);
+      }
+   }
+   add_metric_to_art(container->server_metrics, "pgexporter_activity_wait_duration_seconds", data, NULL, NULL, 0);
+   free(data);
+   data = NULL;
+}
+
+static char*
+activity_histogram(char* data, char* name, char* labels, struct activity_histogram* histogram, const uint64_t* bounds, double scale)
+{
+   uint64_t cumulative = 0;
+   uint64_t count;
+
+   /* Read the count first, so the buckets never exceed it */
+   count = atomic_load(&histogram->count);
+
+   for (int i = 0; i < ACTIVITY_NUMBER_OF_BUCKETS; i++)
+   {
+      cumulative += atomic_load(&histogram->buckets[i]);
+      data = pgexporter_format_and_append(data, "%s_bucket{%s,le=\"%g\"} %llu\n",
+                                          name, labels, (double)bounds[i] * scale,
+                                          (unsigned long long)MIN(cumulative, count));
+   }
+
+   data = pgexporter_format_and_append(data, "%s_bucket{%s,le=\"+Inf\"} %llu\n", name, labels, (unsigned long long)count);
+   data = pgexporter_format_and_append(data, "%s_sum{%s} %.15g\n", name, labels, (double)atomic_load(&histogram->sum) * scale);
+   data = pgexporter_format_and_append(data, "%s_count{%s} %llu\n", name, labels, (unsigned long long)count);
+
+   return data;
+}
+
 static void
 server_information(prometheus_metrics_container_t* container)
 {
@@ -789,6 +1278,11 @@ server_information(prometheus_metrics_container_t* container)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
+      if (!pgexporter_server_owned(server))
+      {
+         continue;
+      }
+
       data = pgexporter_vappend(data, 3,
                                 "pgexporter_postgresql_active{server=\"",
                                 &config->servers[server].name[0],
@@ -829,7 +1323,7 @@ version_information(prometheus_metrics_container_t* container)
 
    for (server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->servers[server].fd != -1 && pgexporter_server_owned(server))
       {
          ret = pgexporter_query_version(server, &query);
          if (ret == 0)
@@ -903,7 +1397,7 @@ uptime_information(prometheus_metrics_container_t* container)
 
    for (server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->servers[server].fd != -1 && pgexporter_server_owned(server))
       {
          ret = pgexporter_query_uptime(server, &query);
          if (ret == 0)
@@ -971,7 +1465,7 @@ primary_information(prometheus_metrics_container_t* container)
 
    for (server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->servers[server].fd != -1 && pgexporter_server_owned(server))
       {
          ret = pgexporter_query_primary(server, &query);
          if (ret == 0)
@@ -1031,7 +1525,7 @@ primary_information(prometheus_metrics_container_t* container)
 }
 
 static void
-fips_information(prometheus_metrics_container_t* container)
+fips_information(prometheus_metrics_container_t* container, bool global)
 {
    int ret;
    int server;
@@ -1042,22 +1536,25 @@ fips_information(prometheus_metrics_container_t* container)
 
    config = (struct configuration*)shmem;
 
-   openssl_fips = pgexporter_fips_pgexporter();
+   if (global)
+   {
+      openssl_fips = pgexporter_fips_pgexporter();
 
-   data = pgexporter_vappend(data, 2,
-                             "#HELP pgexporter_fips Is pgexporter running with FIPS-compliant OpenSSL\n",
-                             "#TYPE pgexporter_fips gauge\n");
+      data = pgexporter_vappend(data, 2,
+                                "#HELP pgexporter_fips Is pgexporter running with FIPS-compliant OpenSSL\n",
+                                "#TYPE pgexporter_fips gauge\n");
 
-   data = pgexporter_vappend(data, 2,
-                             "pgexporter_fips ",
-                             openssl_fips ? "1" : "0");
-   data = pgexporter_append(data, "\n");
+      data = pgexporter_vappend(data, 2,
+                                "pgexporter_fips ",
+                                openssl_fips ? "1" : "0");
+      data = pgexporter_append(data, "\n");
 
-   if (data != NULL)
-   {
-      add_metric_to_art(container->fips_metrics, "pgexporter_fips", data, NULL, NULL, 0);
-      free(data);
-      data = NULL;
+      if (data != NULL)
+      {
+         add_metric_to_art(container->fips_metrics, "pgexporter_fips", data, NULL, NULL, 0);
+         free(data);
+         data = NULL;
+      }
    }
 
    data = pgexporter_vappend(data, 2,
@@ -1066,7 +1563,7 @@ fips_information(prometheus_metrics_container_t* container)
 
    for (server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->servers[server].fd != -1 && pgexporter_server_owned(server))
       {
          ret = pgexporter_fips_server(server, &pg_fips);
          if (ret != 0)
@@ -1135,7 +1632,7 @@ extension_list_information(prometheus_metrics_container_t* container)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->servers[server].fd != -1 && pgexporter_server_owned(server))
       {
          for (int i = 0; i < config->servers[server].number_of_extensions; i++)
          {
@@ -1201,7 +1698,7 @@ settings_information(prometheus_metrics_container_t* container)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->servers[server].fd != -1 && pgexporter_server_owned(server))
       {
          ret = pgexporter_query_settings(server, &query);
          if (ret == 0)
@@ -1289,37 +1786,17 @@ data:
    pgexporter_free_query(all);
 }
 
-static bool
-evaluate_alert(int64_t value, enum alert_operator op, int64_t threshold)
-{
-   switch (op)
-   {
-      case ALERT_OPERATOR_GT:
-         return value > threshold;
-      case ALERT_OPERATOR_LT:
-         return value < threshold;
-      case ALERT_OPERATOR_GE:
-         return value >= threshold;
-      case ALERT_OPERATOR_LE:
-         return value <= threshold;
-      case ALERT_OPERATOR_EQ:
-         return value == threshold;
-      case ALERT_OPERATOR_NE:
-         return value != threshold;
-      default:
-         return false;
-   }
-}
-
 static void
 alert_information(prometheus_metrics_container_t* container)
 {
-   int ret;
-   int server;
+   int state;
    char* data = NULL;
-   struct query* query = NULL;
+   char* states = NULL;
+   char* type_str = NULL;
+   struct alert_status* status = NULL;
    struct configuration* config;
    char metric_name[PROMETHEUS_LENGTH];
+   char state_value[16];
 
    config = (struct configuration*)shmem;
 
@@ -1328,9 +1805,11 @@ alert_information(prometheus_metrics_container_t* container)
       return;
    }
 
-   int server_conn_valid[NUMBER_OF_SERVERS];
-   memset(server_conn_valid, -1, sizeof(server_conn_valid));
+   states = pgexporter_vappend(states, 2,
+                               "#HELP pgexporter_alert_state The state of the alert (0 = inactive, 1 = pending, 2 = firing)\n",
+                               "#TYPE pgexporter_alert_state gauge\n");
 
+   /* The evaluator keeps the state, so this never runs alert SQL */
    for (int a = 0; a < config->number_of_alerts; a++)
    {
       struct alert_definition* alert = &config->alerts[a];
@@ -1342,85 +1821,39 @@ alert_information(prometheus_metrics_container_t* container)
       data = pgexporter_vappend(data, 3,
                                 "#TYPE ", metric_name, " gauge\n");
 
-      for (server = 0; server < config->number_of_servers; server++)
-      {
-         int firing = 0;
+      type_str = (alert->alert_type == ALERT_TYPE_CONNECTION) ? "connection" : "query";
 
-         /* Server name filter */
-         if (!alert->servers_all && alert->number_of_servers > 0)
+      for (int server = 0; server < config->number_of_servers; server++)
+      {
+         if (!pgexporter_alert_applies(alert, server) || !pgexporter_server_owned(server))
          {
-            bool match = false;
-            for (int s = 0; s < alert->number_of_servers; s++)
-            {
-               if (!strcmp(alert->servers[s], config->servers[server].name))
-               {
-                  match = true;
-                  break;
-               }
-            }
-            if (!match)
-            {
-               continue;
-            }
+            continue;
          }
 
-         /* Lazy connection validity check */
-         if (server_conn_valid[server] == -1)
-         {
-            server_conn_valid[server] = pgexporter_connection_isvalid(config->servers[server].ssl, config->servers[server].fd) ? 1 : 0;
-         }
-         bool conn_valid = (server_conn_valid[server] == 1);
+         status = &alert->status[server];
 
-         if (alert->alert_type == ALERT_TYPE_CONNECTION)
+         if (!atomic_load(&status->valid))
          {
-            firing = conn_valid ? 0 : 1;
+            continue;
          }
-         else if (alert->alert_type == ALERT_TYPE_QUERY)
-         {
-            if (!conn_valid)
-            {
-               /* Server is down, skip query-based alerts */
-               firing = -1;
-            }
-            else
-            {
-               query = NULL;
-               ret = pgexporter_query_execute(server, alert->query, alert->name, &query);
 
-               if (ret == 0 && query != NULL && query->tuples != NULL)
-               {
-                  char* result_str = pgexporter_get_column(0, query->tuples);
-                  if (result_str != NULL)
-                  {
-                     int64_t value = strtoll(result_str, NULL, 10);
-                     firing = evaluate_alert(value, alert->operator, alert->threshold) ? 1 : 0;
-                  }
-               }
-               else
-               {
-                  pgexporter_log_warn("Failed to query alert '%s' for server %s",
-                                      alert->name, config->servers[server].name);
-                  firing = -1;
-               }
+         state = atomic_load(&status->state);
 
-               pgexporter_free_query(query);
-               query = NULL;
-            }
-         }
+         data = pgexporter_vappend(data, 3,
+                                   metric_name, "{server=\"",
+                                   &config->servers[server].name[0]);
+         data = pgexporter_vappend(data, 5,
+                                   "\",alert=\"", alert->name,
+                                   "\",type=\"", type_str,
+                                   "\"} ");
+         data = pgexporter_append(data, state == ALERT_STATE_FIRING ? "1" : "0");
+         data = pgexporter_append(data, "\n");
 
-         if (firing >= 0)
-         {
-            char* type_str = (alert->alert_type == ALERT_TYPE_CONNECTION) ? "connection" : "query";
-            data = pgexporter_vappend(data, 3,
-                                      metric_name, "{server=\"",
-                                      &config->servers[server].name[0]);
-            data = pgexporter_vappend(data, 5,
-                                      "\",alert=\"", alert->name,
-                                      "\",type=\"", type_str,
-                                      "\"} ");
-            data = pgexporter_append(data, firing ? "1" : "0");
-            data = pgexporter_append(data, "\n");
-         }
+         pgexporter_snprintf(state_value, sizeof(state_value), "%d", state);
+         states = pgexporter_vappend(states, 7,
+                                     "pgexporter_alert_state{server=\"", &config->servers[server].name[0],
+                                     "\",alert=\"", alert->name,
+                                     "\"} ", state_value, "\n");
       }
 
       data = pgexporter_append(data, "\n");
@@ -1432,6 +1865,9 @@ alert_information(prometheus_metrics_container_t* container)
          data = NULL;
       }
    }
+
+   add_metric_to_art(container->alert_metrics, "pgexporter_alert_state", states, NULL, NULL, 0);
+   free(states);
 }
 
 static void
@@ -1447,7 +1883,7 @@ extension_metrics(prometheus_metrics_container_t* container)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd == -1)
+      if (config->servers[server].fd == -1 || !pgexporter_server_owned(server))
       {
          continue;
       }
@@ -1471,7 +1907,8 @@ extension_metrics(prometheus_metrics_container_t* container)
             }
          }
 
-         if (!ext_metrics)
+         /* A catalog loaded after this process was forked is used by the next one */
+         if (!ext_metrics || !pgexporter_is_extension_mapped(ext_metrics))
          {
             continue;
          }
@@ -1486,7 +1923,8 @@ extension_metrics(prometheus_metrics_container_t* container)
             }
 
             if ((prom->server_query_type == SERVER_QUERY_PRIMARY && config->servers[server].state != SERVER_PRIMARY) ||
-                (prom->server_query_type == SERVER_QUERY_REPLICA && config->servers[server].state != SERVER_REPLICA))
+                (prom->server_query_type == SERVER_QUERY_REPLICA && config->servers[server].state != SERVER_REPLICA) ||
+                (prom->server_query_type == SERVER_QUERY_CLUSTER && !pgexporter_server_cluster_leader(server)))
             {
                continue;
             }
@@ -1525,15 +1963,16 @@ extension_metrics(prometheus_metrics_container_t* container)
             }
             memcpy(ext_temp->tag, prom->tag, PROMETHEUS_LENGTH);
             ext_temp->query_alt = (struct pg_query_alts*)query_alt;
+            ext_temp->derive = prom->derive;
 
             if (query_alt->node.is_histogram)
             {
-               ext_temp->error = pgexporter_custom_query(server, query_alt->node.query, prom->tag, -1, NULL, &ext_temp->query);
+               ext_temp->error = slice_query(server, prom, NULL, query_alt->node.query, -1, NULL, &ext_temp->query);
                ext_temp->sort_type = prom->sort_type;
             }
             else
             {
-               ext_temp->error = pgexporter_custom_query(server, query_alt->node.query, prom->tag, query_alt->node.n_columns, names, &ext_temp->query);
+               ext_temp->error = slice_query(server, prom, NULL, query_alt->node.query, query_alt->node.n_columns, names, &ext_temp->query);
                ext_temp->sort_type = prom->sort_type;
             }
 
@@ -1660,14 +2099,15 @@ custom_metrics(prometheus_metrics_container_t* container)
 
          for (int db_idx = prom->exec_on_all_dbs ? 0 : n_db - 1; db_idx < n_db; db_idx++)
          {
-            if (config->servers[server].fd == -1)
+            if (config->servers[server].fd == -1 || !pgexporter_server_owned(server))
             {
                /* Skip */
                continue;
             }
 
             if ((prom->server_query_type == SERVER_QUERY_PRIMARY && config->servers[server].state != SERVER_PRIMARY) ||
-                (prom->server_query_type == SERVER_QUERY_REPLICA && config->servers[server].state != SERVER_REPLICA))
+                (prom->server_query_type == SERVER_QUERY_REPLICA && config->servers[server].state != SERVER_REPLICA) ||
+                (prom->server_query_type == SERVER_QUERY_CLUSTER && !pgexporter_server_cluster_leader(server)))
             {
                /* Skip */
                continue;
@@ -1710,6 +2150,7 @@ custom_metrics(prometheus_metrics_container_t* container)
             }
             memcpy(temp->tag, prom->tag, PROMETHEUS_LENGTH);
             temp->query_alt = query_alt;
+            temp->derive = prom->derive;
 
             char* database = config->servers[server].databases[db_idx];
 
@@ -1733,12 +2174,12 @@ custom_metrics(prometheus_metrics_container_t* container)
             // Gather all the queries in a linked list, with each query's result (linked list of tuples in it) as a node.
             if (query_alt->node.is_histogram)
             {
-               temp->error = pgexporter_custom_query(server, query_alt->node.query, prom->tag, -1, NULL, &temp->query);
+               temp->error = slice_query(server, prom, database, query_alt->node.query, -1, NULL, &temp->query);
                temp->sort_type = prom->sort_type;
             }
             else
             {
-               temp->error = pgexporter_custom_query(server, query_alt->node.query, prom->tag, query_alt->node.n_columns, names, &temp->query);
+               temp->error = slice_query(server, prom, database, query_alt->node.query, query_alt->node.n_columns, names, &temp->query);
                temp->sort_type = prom->sort_type;
             }
 
@@ -1755,6 +2196,8 @@ custom_metrics(prometheus_metrics_container_t* container)
             }
 
             pgexporter_snprintf(temp->database, DB_NAME_LENGTH, "%s", database);
+            /* Only the label, the connection keeps the name as is */
+            pgexporter_utf8_sanitize((unsigned char*)temp->database, strlen(temp->database));
 
             free(names);
             names = NULL;
@@ -1838,6 +2281,46 @@ custom_metrics(prometheus_metrics_container_t* container)
    q_list = NULL;
 }
 
+static int
+slice_query(int server, struct prometheus* prom, char* database, char* qs, int columns, char** names, struct query** query)
+{
+   struct configuration* config = NULL;
+   uint64_t key;
+   int slice;
+   char* sliced = NULL;
+   int ret;
+
+   config = (struct configuration*)shmem;
+
+   if (prom->slices <= 1)
+   {
+      return pgexporter_custom_query(server, qs, prom->tag, columns, names, query);
+   }
+
+   /* Query one slice, and serve the last known rows of the others */
+   key = pgexporter_slice_key(prom->tag, config->servers[server].name, database);
+   slice = pgexporter_slice_next(key, prom->slices);
+   sliced = pgexporter_slice_query(qs, prom->slices, slice);
+
+   pgexporter_log_debug("Querying slice %d of %d for tag %s", slice + 1, prom->slices, prom->tag);
+
+   ret = pgexporter_custom_query(server, sliced, prom->tag, columns, names, query);
+   if (ret == 0)
+   {
+      pgexporter_slice_merge(key, prom->slices, slice, *query);
+   }
+   else if (pgexporter_slice_skip(key, prom->slices, slice, prom->tag, query) == 0 && *query != NULL)
+   {
+      /* The other slices are still known */
+      pgexporter_log_warn("Failed to query slice %d of %d for tag %s on server %s", slice + 1, prom->slices, prom->tag, config->servers[server].name);
+      ret = 0;
+   }
+
+   free(sliced);
+
+   return ret;
+}
+
 static int
 parse_list(char* list_str, char** strs, int* n_strs)
 {
@@ -1993,6 +2476,13 @@ handle_histogram(column_store_t* store, int* n_store, query_list_t* temp)
       return;
    }
 
+   /* One observation per row, bucketed here */
+   if (h_idx < temp->query_alt->node.n_columns && temp->query_alt->node.columns[h_idx].n_buckets > 0)
+   {
+      handle_observations(store, n_store, temp, h_idx);
+      return;
+   }
+
    char* names[4] = {0};
 
    /* generate column names X_sum, X_count, X, X_bucket*/
@@ -2263,15 +2753,243 @@ append:
 
       data = NULL;
 
-      // Inserted help and type info above, and then go to append label to insert the rest of the information as usual.
-      // (*n_store)++ ensures this time it fulfills the condition for the if-statement.
-      goto append;
+      // Inserted help and type info above, and then go to append label to insert the rest of the information as usual.
+      // (*n_store)++ ensures this time it fulfills the condition for the if-statement.
+      goto append;
+   }
+
+   free(names[0]);
+   free(names[1]);
+   free(names[2]);
+   free(names[3]);
+}
+
+static void
+handle_observations(column_store_t* store, int* n_store, query_list_t* temp, int h_idx)
+{
+   char* data = NULL;
+   char* key = NULL;
+   char* value = NULL;
+   char* end = NULL;
+   char bound[64];
+   char number[64];
+   struct column* column = NULL;
+   struct configuration* config;
+   struct art* index = NULL;
+   observation_series_t* series = NULL;
+   int n_series = 0;
+   int capacity = 0;
+   int idx = 0;
+   int s;
+   double observation;
+   uint64_t cumulative;
+
+   config = (struct configuration*)shmem;
+   column = &temp->query_alt->node.columns[h_idx];
+
+   for (; idx < *n_store; idx++)
+   {
+      if (store[idx].type == HISTOGRAM_TYPE &&
+          store[idx].sort_type == temp->sort_type &&
+          !strcmp(store[idx].tag, temp->tag) &&
+          !strcmp(store[idx].name, column->name))
+      {
+         break;
+      }
+   }
+
+   if (idx >= *n_store)
+   {
+      if (idx >= MAX_METRIC_COLUMNS)
+      {
+         pgexporter_log_warn("Maximum metric columns (%d) exceeded, skipping", MAX_METRIC_COLUMNS);
+         return;
+      }
+
+      (*n_store)++;
+
+      store[idx].type = HISTOGRAM_TYPE;
+      store[idx].sort_type = temp->sort_type;
+      memcpy(store[idx].tag, temp->tag, PROMETHEUS_LENGTH);
+      memcpy(store[idx].name, column->name, PROMETHEUS_LENGTH);
+
+      append_help_info(&data, store[idx].tag, "", column->description);
+      append_type_info(&data, store[idx].tag, "", column->type);
+
+      add_column_to_store(store, idx, data, SORT_NAME, NULL);
+      data = NULL;
+   }
+
+   if (pgexporter_art_create(&index))
+   {
+      goto error;
+   }
+
+   /* Count each observation into the series of its server and labels */
+   for (struct tuple* current = temp->query->tuples; current != NULL; current = current->next)
+   {
+      value = pgexporter_get_column(h_idx, current);
+
+      if (value == NULL || strlen(value) == 0)
+      {
+         continue;
+      }
+
+      errno = 0;
+      observation = strtod(value, &end);
+
+      if (end == value || errno != 0 || isnan(observation))
+      {
+         continue;
+      }
+
+      key = pgexporter_append_int(NULL, current->server);
+      for (int j = 0; j < h_idx; j++)
+      {
+         key = pgexporter_append_char(key, '\x1f');
+         if (pgexporter_get_column(j, current) != NULL)
+         {
+            key = pgexporter_append(key, pgexporter_get_column(j, current));
+         }
+      }
+
+      s = (int)pgexporter_art_search(index, key) - 1;
+
+      if (s < 0)
+      {
+         if (n_series == capacity)
+         {
+            observation_series_t* grown = NULL;
+
+            capacity = capacity == 0 ? 16 : capacity * 2;
+            grown = realloc(series, capacity * sizeof(observation_series_t));
+            if (grown == NULL)
+            {
+               goto error;
+            }
+            series = grown;
+         }
+
+         s = n_series++;
+         memset(&series[s], 0, sizeof(observation_series_t));
+         series[s].tuple = current;
+
+         if (pgexporter_art_insert(index, key, (uintptr_t)(s + 1), ValueInt32))
+         {
+            goto error;
+         }
+      }
+
+      free(key);
+      key = NULL;
+
+      series[s].buckets[pgexporter_bucket_index(column->buckets, column->n_buckets, observation)]++;
+      series[s].count++;
+      series[s].sum += observation;
+   }
+
+   for (s = 0; s < n_series; s++)
+   {
+      struct tuple* tuple = series[s].tuple;
+
+      cumulative = 0;
+
+      for (int b = 0; b <= column->n_buckets; b++)
+      {
+         cumulative += series[s].buckets[b];
+
+         if (b < column->n_buckets)
+         {
+            pgexporter_snprintf(bound, sizeof(bound), "%.15g", column->buckets[b]);
+         }
+         else
+         {
+            pgexporter_snprintf(bound, sizeof(bound), "+Inf");
+         }
+         pgexporter_snprintf(number, sizeof(number), "%" PRIu64, cumulative);
+
+         data = pgexporter_vappend(data, 7,
+                                   "pgexporter_",
+                                   temp->tag,
+                                   "_bucket{le=\"",
+                                   bound,
+                                   "\", server=\"",
+                                   &config->servers[tuple->server].name[0],
+                                   "\"");
+         append_observation_labels(&data, temp, tuple, h_idx);
+         data = pgexporter_vappend(data, 3, "} ", number, "\n");
+      }
+
+      pgexporter_snprintf(number, sizeof(number), "%.15g", series[s].sum);
+      data = pgexporter_vappend(data, 5,
+                                "pgexporter_",
+                                temp->tag,
+                                "_sum{server=\"",
+                                &config->servers[tuple->server].name[0],
+                                "\"");
+      append_observation_labels(&data, temp, tuple, h_idx);
+      data = pgexporter_vappend(data, 3, "} ", number, "\n");
+
+      pgexporter_snprintf(number, sizeof(number), "%" PRIu64, series[s].count);
+      data = pgexporter_vappend(data, 5,
+                                "pgexporter_",
+                                temp->tag,
+                                "_count{server=\"",
+                                &config->servers[tuple->server].name[0],
+                                "\"");
+      append_observation_labels(&data, temp, tuple, h_idx);
+      data = pgexporter_vappend(data, 3, "} ", number, "\n");
+
+      add_column_to_store(store, idx, data, temp->sort_type, tuple);
+      data = NULL;
+   }
+
+   pgexporter_art_destroy(index);
+   free(series);
+
+   return;
+
+error:
+   pgexporter_log_error("Failed to bucket the observations of %s", temp->tag);
+
+   free(key);
+   free(data);
+   pgexporter_art_destroy(index);
+   free(series);
+}
+
+static void
+append_observation_labels(char** data, query_list_t* temp, struct tuple* tuple, int h_idx)
+{
+   char* safe_key = NULL;
+   bool db_key_present = false;
+
+   for (int j = 0; j < h_idx; j++)
+   {
+      if (!db_key_present && !strcmp("database", temp->query_alt->node.columns[j].name))
+      {
+         db_key_present = true;
+      }
+
+      safe_key = safe_prometheus_attribute(pgexporter_get_column(j, tuple),
+                                           temp->query->type_oids[j]);
+      *data = pgexporter_vappend(*data, 5,
+                                 ", ",
+                                 temp->query_alt->node.columns[j].name,
+                                 "=\"",
+                                 safe_key,
+                                 "\"");
+      safe_prometheus_key_free(safe_key);
    }
 
-   free(names[0]);
-   free(names[1]);
-   free(names[2]);
-   free(names[3]);
+   // Database
+   if (!db_key_present)
+   {
+      *data = pgexporter_vappend(*data, 3,
+                                 ", database=\"",
+                                 temp->database,
+                                 "\"");
+   }
 }
 
 static void
@@ -2290,6 +3008,13 @@ handle_default_gauge_counter(column_store_t* store, int* n_store, query_list_t*
          continue;
       }
 
+      if ((temp->derive & DERIVE_ONLY) && temp->query_alt->node.columns[i].type == COUNTER_TYPE &&
+          !pgexporter_derive_is_reset(temp->query_alt->node.columns[i].name))
+      {
+         /* Replaced by the derived gauge, which needs a sample */
+         continue;
+      }
+
       int idx = 0;
       for (; idx < (*n_store); idx++)
       {
@@ -2584,6 +3309,17 @@ handle_gauge_counter(column_store_t* store, int* n_store, query_list_t* temp)
          continue;
       }
 
+      if (temp->derive != DERIVE_NONE && temp->query_alt->node.columns[i].type == COUNTER_TYPE &&
+          !pgexporter_derive_is_reset(temp->query_alt->node.columns[i].name))
+      {
+         handle_derived(store, n_store, temp, i);
+
+         if (temp->derive & DERIVE_ONLY)
+         {
+            continue;
+         }
+      }
+
       int idx = 0;
       for (; idx < (*n_store); idx++)
       {
@@ -2716,6 +3452,178 @@ append:
    }
 }
 
+static void
+handle_derived(column_store_t* store, int* n_store, query_list_t* temp, int column)
+{
+   char name[PROMETHEUS_LENGTH];
+   char number[MISC_LENGTH];
+   char* description = NULL;
+   char* labels = NULL;
+   char* data = NULL;
+   char* safe_key = NULL;
+   char* val = NULL;
+   char* end = NULL;
+   int reset_column = -1;
+   int idx = 0;
+   bool db_key_present = false;
+   uint64_t key;
+   int64_t now;
+   int64_t reset;
+   double value;
+   double derived;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgexporter_snprintf(name, sizeof(name), "%s%s%s",
+                       temp->query_alt->node.columns[column].name,
+                       strlen(temp->query_alt->node.columns[column].name) > 0 ? "_" : "",
+                       pgexporter_derive_suffix(temp->derive));
+
+   for (; idx < (*n_store); idx++)
+   {
+      if (!strcmp(store[idx].tag, temp->tag) && !strcmp(store[idx].name, name) && store[idx].type == GAUGE_TYPE)
+      {
+         break;
+      }
+   }
+
+   if (idx >= (*n_store))
+   {
+      if (idx >= MAX_METRIC_COLUMNS)
+      {
+         pgexporter_log_warn("Maximum metric columns (%d) exceeded, skipping", MAX_METRIC_COLUMNS);
+         return;
+      }
+
+      (*n_store)++;
+
+      memcpy(store[idx].name, name, PROMETHEUS_LENGTH);
+      store[idx].type = GAUGE_TYPE;
+      memcpy(store[idx].tag, temp->tag, MIN(PROMETHEUS_LENGTH - 1, strlen(temp->tag)));
+      store[idx].tag[MIN(PROMETHEUS_LENGTH - 1, strlen(temp->tag))] = '\0';
+
+      if (strcmp("", temp->query_alt->node.columns[column].description))
+      {
+         description = pgexporter_vappend(description, 2,
+                                          temp->query_alt->node.columns[column].description,
+                                          (temp->derive & DERIVE_RATE) ? " per second" : " since the previous scrape");
+      }
+
+      append_help_info(&data, store[idx].tag, store[idx].name, description);
+      append_type_info(&data, store[idx].tag, store[idx].name, GAUGE_TYPE);
+
+      add_column_to_store(store, idx, data, SORT_NAME, NULL);
+
+      free(description);
+      description = NULL;
+   }
+
+   /* A reset of the statistics restarts the counters of the query */
+   for (int j = 0; j < temp->query_alt->node.n_columns; j++)
+   {
+      if (temp->query_alt->node.columns[j].type != LABEL_TYPE &&
+          pgexporter_derive_is_reset(temp->query_alt->node.columns[j].name))
+      {
+         reset_column = j;
+         break;
+      }
+   }
+
+   now = pgexporter_derive_now();
+
+   for (struct tuple* tuple = temp->query->tuples; tuple != NULL; tuple = tuple->next)
+   {
+      val = pgexporter_get_column(column, tuple);
+      if (val == NULL)
+      {
+         continue;
+      }
+
+      value = strtod(val, &end);
+      if (end == val)
+      {
+         continue;
+      }
+
+      reset = 0;
+      if (reset_column != -1 && pgexporter_get_column(reset_column, tuple) != NULL)
+      {
+         reset = strtoll(pgexporter_get_column(reset_column, tuple), NULL, 10);
+
+         if (reset != 0 && !strcmp(temp->query_alt->node.columns[reset_column].name, "stats_reset_seconds"))
+         {
+            /* The age of the statistics, so the reset is at now - age */
+            reset = now / 1000 - reset;
+         }
+      }
+
+      labels = NULL;
+      labels = pgexporter_vappend(labels, 3,
+                                  "{server=\"",
+                                  config->servers[temp->query->tuples->server].name,
+                                  "\"");
+
+      for (int j = 0; j < temp->query_alt->node.n_columns; j++)
+      {
+         if (temp->query_alt->node.columns[j].type != LABEL_TYPE)
+         {
+            continue;
+         }
+
+         if (!strcmp("database", temp->query_alt->node.columns[j].name))
+         {
+            db_key_present = true;
+         }
+
+         safe_key = safe_prometheus_attribute(pgexporter_get_column(j, tuple),
+                                              temp->query->type_oids[j]);
+         labels = pgexporter_vappend(labels, 5,
+                                     ", ",
+                                     temp->query_alt->node.columns[j].name,
+                                     "=\"",
+                                     safe_key,
+                                     "\"");
+         safe_prometheus_key_free(safe_key);
+      }
+
+      if (!db_key_present)
+      {
+         labels = pgexporter_vappend(labels, 3,
+                                     ", database=\"",
+                                     temp->database,
+                                     "\"");
+      }
+
+      labels = pgexporter_append(labels, "}");
+
+      key = pgexporter_derive_hash(0, store[idx].tag);
+      key = pgexporter_derive_hash(key, store[idx].name);
+      key = pgexporter_derive_hash(key, labels);
+
+      if (pgexporter_derive_sample(key, temp->derive, now, value, reset, &derived))
+      {
+         pgexporter_snprintf(number, sizeof(number), "%.12g", derived);
+
+         data = NULL;
+         data = pgexporter_vappend(data, 7,
+                                   "pgexporter_",
+                                   store[idx].tag,
+                                   "_",
+                                   store[idx].name,
+                                   labels,
+                                   " ",
+                                   number);
+         data = pgexporter_append(data, "\n");
+
+         add_column_to_store(store, idx, data, temp->sort_type, tuple);
+      }
+
+      free(labels);
+      labels = NULL;
+   }
+}
+
 static void
 append_help_info(char** data, char* tag, char* name, char* description)
 {
@@ -2839,7 +3747,7 @@ safe_prometheus_key_additional_length(char* key)
 
    while (key[i] != '\0')
    {
-      if (key[i] == '"' || key[i] == '\\')
+      if (key[i] == '"' || key[i] == '\\' || key[i] == '\n')
       {
          count++;
       }
@@ -2855,6 +3763,7 @@ safe_prometheus_key(char* key)
 {
    size_t i = 0;
    size_t j = 0;
+   size_t length;
    char* escaped = NULL;
 
    if (key == NULL || strlen(key) == 0)
@@ -2862,12 +3771,14 @@ safe_prometheus_key(char* key)
       return "";
    }
 
-   escaped = (char*)malloc(strlen(key) + safe_prometheus_key_additional_length(key) + 1);
+   length = strlen(key);
+
+   escaped = (char*)malloc(length + safe_prometheus_key_additional_length(key) + 1);
    while (key[i] != '\0')
    {
       if (key[i] == '.')
       {
-         if (i == strlen(key) - 1)
+         if (i == length - 1)
          {
             escaped[j] = '\0';
          }
@@ -2876,6 +3787,11 @@ safe_prometheus_key(char* key)
             escaped[j] = '_';
          }
       }
+      else if (key[i] == '\n')
+      {
+         escaped[j++] = '\\';
+         escaped[j] = 'n';
+      }
       else
       {
          if (key[i] == '"' || key[i] == '\\')
@@ -2890,6 +3806,14 @@ safe_prometheus_key(char* key)
       j++;
    }
    escaped[j] = '\0';
+
+   /* Prometheus rejects the whole scrape for a label value that isn't UTF-8,
+    * like a name from a database in another encoding */
+   if (pgexporter_utf8_sanitize((unsigned char*)escaped, j) > 0)
+   {
+      pgexporter_log_trace("Replaced invalid UTF-8 in label value: %s", escaped);
+   }
+
    return escaped;
 }
 
@@ -3091,14 +4015,24 @@ metrics_cache_finalize(void)
 static void
 prometheus_endpoints_information(SSL* client_ssl, int client_fd)
 {
-   char* data = NULL;
    struct http* connection = NULL;
    struct http_request* request = NULL;
    struct http_response* response = NULL;
+   struct http_line_sink sink;
+   struct endpoint_stream stream;
    struct configuration* config;
 
    config = (struct configuration*)shmem;
 
+   memset(&sink, 0, sizeof(struct http_line_sink));
+   memset(&stream, 0, sizeof(struct endpoint_stream));
+
+   stream.ssl = client_ssl;
+   stream.fd = client_fd;
+
+   sink.line_cb = &endpoint_line;
+   sink.userdata = &stream;
+
    for (int i = 0; i < config->number_of_servers; i++)
    {
       if (config->servers[i].type != SERVER_TYPE_PROMETHEUS)
@@ -3124,50 +4058,29 @@ prometheus_endpoints_information(SSL* client_ssl, int client_fd)
          goto next;
       }
 
+      response = (struct http_response*)calloc(1, sizeof(struct http_response));
+      if (response == NULL)
+      {
+         goto next;
+      }
+
+      /* Relay the body as it arrives */
+      stream.first_line = true;
+      response->write_cb = &pgexporter_http_line_sink_write;
+      response->write_userdata = &sink;
+      response->decompress = true;
+
       if (pgexporter_http_invoke(connection, request, &response))
       {
          pgexporter_log_warn("Failed to get metrics from Prometheus endpoint %s (%s:%d/metrics)",
                              config->servers[i].name,
                              config->servers[i].host,
                              config->servers[i].port);
-         goto next;
       }
 
-      if (response->payload.data != NULL && response->payload.data_size > 0)
-      {
-         char* line = NULL;
-         char* body_copy = NULL;
-         char* saveptr = NULL;
-         bool first_line = true;
-
-         body_copy = strdup((char*)response->payload.data);
-         if (body_copy == NULL)
-         {
-            goto next;
-         }
-
-         line = strtok_r(body_copy, "\n", &saveptr);
-         while (line != NULL)
-         {
-            if (!first_line && strncmp(line, "#HELP", 5) == 0)
-            {
-               data = pgexporter_append(data, "\n");
-            }
-
-            data = pgexporter_append(data, line);
-            data = pgexporter_append(data, "\n");
-
-            first_line = false;
-            line = strtok_r(NULL, "\n", &saveptr);
-         }
-
-         free(body_copy);
+      pgexporter_http_line_sink_finish(&sink);
 
-         pgexporter_http_respond_chunked_write(client_ssl, client_fd, data);
-         metrics_cache_append(data);
-         free(data);
-         data = NULL;
-      }
+      endpoint_flush(&stream);
 
 next:
       if (response != NULL)
@@ -3190,6 +4103,45 @@ next:
    }
 }
 
+static int
+endpoint_line(char* line, void* userdata)
+{
+   struct endpoint_stream* stream = (struct endpoint_stream*)userdata;
+
+   if (line[0] == '\0')
+   {
+      return 0;
+   }
+
+   if (!stream->first_line && strncmp(line, "#HELP", 5) == 0)
+   {
+      stream->data = pgexporter_append(stream->data, "\n");
+   }
+
+   stream->data = pgexporter_append(stream->data, line);
+   stream->data = pgexporter_append(stream->data, "\n");
+   stream->first_line = false;
+
+   if (strlen(stream->data) >= ENDPOINT_STREAM_FLUSH_SIZE)
+   {
+      endpoint_flush(stream);
+   }
+
+   return 0;
+}
+
+static void
+endpoint_flush(struct endpoint_stream* stream)
+{
+   if (stream->data != NULL)
+   {
+      pgexporter_http_respond_chunked_write(stream->ssl, stream->fd, stream->data);
+      metrics_cache_append(stream->data);
+      free(stream->data);
+      stream->data = NULL;
+   }
+}
+
 /**
  * Destroy callback for prometheus_metric_value_t
  * Called automatically when ART is destroyed
@@ -3375,6 +4327,97 @@ pgexporter_prometheus_iterator_value(struct art_iterator* iter, char** value)
 int
 pgexporter_prometheus_scrape(prometheus_metrics_container_t** container)
 {
+   return scrape(container, true, false);
+}
+
+int
+pgexporter_prometheus_shard_scrape(prometheus_metrics_container_t** container, bool global)
+{
+   return scrape(container, global, true);
+}
+
+int
+pgexporter_prometheus_snapshot(struct prometheus_bridge* bridge, bool in_process)
+{
+   struct prometheus_cache* cache = (struct prometheus_cache*)prometheus_cache_shmem;
+   prometheus_metrics_container_t* container = NULL;
+   struct configuration* config = (struct configuration*)shmem;
+   signed char cache_is_free = STATE_FREE;
+   char endpoint[MISC_LENGTH + 16];
+   int status = 1;
+
+   pgexporter_snprintf(endpoint, sizeof(endpoint), "%s:%d",
+                       (strlen(config->host) == 0 || !strcmp(config->host, "*") || !strcmp(config->host, "0.0.0.0")) ? "127.0.0.1" : config->host,
+                       config->metrics);
+
+   if (config->metrics_shards > 0)
+   {
+      return pgexporter_shard_snapshot(endpoint, bridge);
+   }
+
+   /* A cache that is being rebuilt isn't waited for */
+   if (cache != NULL && atomic_compare_exchange_strong(&cache->lock, &cache_is_free, STATE_IN_USE))
+   {
+      /* A long-lived process serves the last scrape even once it has expired */
+      if (is_metrics_cache_configured() && (is_metrics_cache_valid() || (!in_process && strlen(cache->data) > 0)))
+      {
+         pgexporter_log_debug("Snapshot out of cache (%d bytes valid until %lld)", strlen(cache->data), cache->valid_until);
+         status = pgexporter_prometheus_client_parse(endpoint, cache->data, bridge);
+      }
+
+      atomic_store(&cache->lock, STATE_FREE);
+
+      if (status == 0)
+      {
+         return 0;
+      }
+   }
+
+   /* A long-lived process leaves the connections to the metrics processes,
+    * and waits for their next scrape */
+   if (!in_process)
+   {
+      return 1;
+   }
+
+   if (pgexporter_prometheus_scrape(&container))
+   {
+      pgexporter_log_error("Failed to create metrics container");
+      return 1;
+   }
+
+   status = snapshot_art_metrics(endpoint, container->general_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->server_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->version_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->uptime_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->primary_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->fips_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->core_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->extension_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->extension_list_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->settings_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->custom_metrics, bridge) ||
+            snapshot_art_metrics(endpoint, container->alert_metrics, bridge);
+
+   pgexporter_prometheus_destroy_container(container);
+
+   return status;
+}
+
+/**
+ * Scrape the servers of this process into a new container
+ * @param container The pointer to store the container
+ * @param global Include the metrics about pgexporter itself
+ * @param keep_connections Keep the connections open for the next scrape
+ * @return 0 on success, 1 on failure
+ */
+static int
+scrape(prometheus_metrics_container_t** container, bool global, bool keep_connections)
+{
+   uint64_t busy_time[NUMBER_OF_SERVERS];
+
+   pgexporter_scrape_statistics_begin(&busy_time[0]);
+
    pgexporter_open_connections();
 
    if (create_metrics_container(container))
@@ -3383,25 +4426,78 @@ pgexporter_prometheus_scrape(prometheus_metrics_container_t** container)
       return 1;
    }
 
-   general_information(*container);
+   if (global)
+   {
+      general_information(*container);
+   }
    version_information(*container);
    uptime_information(*container);
    primary_information(*container);
-   fips_information(*container);
+   fips_information(*container, global);
    server_information(*container);
-   core_information(*container);
+   if (global)
+   {
+      core_information(*container);
+   }
    extension_list_information(*container);
    settings_information(*container);
    custom_metrics(*container);
    extension_metrics(*container);
-   query_statistics_information(*container);
+   if (global)
+   {
+      query_statistics_information(*container);
+   }
    alert_information(*container);
 
-   pgexporter_close_connections();
+   pgexporter_scrape_statistics_end(&busy_time[0]);
+   server_statistics_information(*container);
+   disk_information(*container);
+   activity_information(*container);
+
+   if (!keep_connections)
+   {
+      pgexporter_close_connections();
+   }
 
    return 0;
 }
 
+/**
+ * Parse the metrics of an ART into a bridge. The collectors only produce
+ * the text exposition of a metric family, so the chunks are parsed in place
+ * where they were rendered, without joining them into a response
+ */
+static int
+snapshot_art_metrics(char* endpoint, struct art* art_tree, struct prometheus_bridge* bridge)
+{
+   struct art_iterator* iter = NULL;
+   int status = 0;
+
+   if (art_tree == NULL)
+   {
+      return 0;
+   }
+
+   if (pgexporter_art_iterator_create(art_tree, &iter))
+   {
+      return 1;
+   }
+
+   while (status == 0 && pgexporter_art_iterator_next(iter))
+   {
+      prometheus_metric_value_t* m = (prometheus_metric_value_t*)iter->value->data;
+
+      if (m != NULL && m->value != NULL)
+      {
+         status = pgexporter_prometheus_client_parse(endpoint, m->value, bridge);
+      }
+   }
+
+   pgexporter_art_iterator_destroy(iter);
+
+   return status;
+}
+
 /**
  * Output all metrics from an ART in sorted order
  */
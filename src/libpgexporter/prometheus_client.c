@@ -45,7 +45,20 @@
 #include <string.h>
 #include <time.h>
 
-static int parse_body_to_bridge(int endpoint, time_t timestamp, char* body, struct prometheus_bridge* bridge);
+/** @struct bridge_parser
+ * The state of parsing a metrics body into a bridge, line by line
+ */
+struct bridge_parser
+{
+   char* endpoint;                   /**< The endpoint as host:port */
+   time_t timestamp;                 /**< The timestamp of the scrape */
+   struct prometheus_bridge* bridge; /**< The bridge */
+   struct prometheus_metric* metric; /**< The current metric */
+   int number_of_lines;              /**< The number of lines parsed */
+   bool failed;                      /**< Did a line fail to parse */
+};
+
+static int parse_line_to_bridge(char* line, void* userdata);
 static int metric_find_create(struct prometheus_bridge* bridge, char* name, struct prometheus_metric** metric);
 static int metric_set_name(struct prometheus_metric* metric, char* name);
 static int metric_set_help(struct prometheus_metric* metric, char* help);
@@ -54,7 +67,7 @@ static bool attributes_contains(struct deque* attributes, struct prometheus_attr
 static int attributes_find_create(struct deque* definitions, struct deque* input, struct prometheus_attributes** attributes, bool* new);
 static int add_attribute(struct deque* attributes, char* key, char* value);
 static int add_value(struct deque* values, time_t timestamp, char* value);
-static int add_line(struct prometheus_metric* metric, char* line, int endpoint, time_t timestamp);
+static int add_line(struct prometheus_metric* metric, char* line, char* endpoint, time_t timestamp);
 
 static void prometheus_metric_destroy_cb(uintptr_t data);
 static char* deque_string_cb(uintptr_t data, int32_t format, char* tag, int indent);
@@ -118,10 +131,18 @@ pgexporter_prometheus_client_get(int endpoint, struct prometheus_bridge* bridge)
    struct http* connection = NULL;
    struct http_request* request = NULL;
    struct http_response* response = NULL;
+   struct bridge_parser parser;
+   struct http_line_sink sink;
+   char e[MISC_LENGTH + 16];
    struct configuration* config = NULL;
 
    config = (struct configuration*)shmem;
 
+   memset(&parser, 0, sizeof(struct bridge_parser));
+   memset(&sink, 0, sizeof(struct http_line_sink));
+
+   pgexporter_snprintf(e, sizeof(e), "%s:%d", config->endpoints[endpoint].host, config->endpoints[endpoint].port);
+
    pgexporter_log_debug("Endpoint http://%s:%d/metrics", config->endpoints[endpoint].host, config->endpoints[endpoint].port);
 
    if (pgexporter_http_create(config->endpoints[endpoint].host, config->endpoints[endpoint].port, false, &connection))
@@ -139,22 +160,46 @@ pgexporter_prometheus_client_get(int endpoint, struct prometheus_bridge* bridge)
       goto error;
    }
 
-   if (pgexporter_http_invoke(connection, request, &response))
+   response = (struct http_response*)calloc(1, sizeof(struct http_response));
+   if (response == NULL)
    {
-      pgexporter_log_error("Failed to execute HTTP/GET interaction with http://%s:%d/metrics",
-                           config->endpoints[endpoint].host,
-                           config->endpoints[endpoint].port);
       goto error;
    }
 
    timestamp = time(NULL);
-   if (response->payload.data == NULL)
+
+   /* The body is parsed as it arrives */
+   parser.endpoint = e;
+   parser.timestamp = timestamp;
+   parser.bridge = bridge;
+
+   sink.line_cb = &parse_line_to_bridge;
+   sink.userdata = &parser;
+
+   response->write_cb = &pgexporter_http_line_sink_write;
+   response->write_userdata = &sink;
+   response->decompress = true;
+
+   if (pgexporter_http_invoke(connection, request, &response) ||
+       pgexporter_http_line_sink_finish(&sink))
    {
-      pgexporter_log_error("No response data from endpoint %d", endpoint);
+      if (parser.failed)
+      {
+         pgexporter_art_destroy(bridge->metrics);
+         bridge->metrics = NULL;
+      }
+      else
+      {
+         pgexporter_log_error("Failed to execute HTTP/GET interaction with http://%s:%d/metrics",
+                              config->endpoints[endpoint].host,
+                              config->endpoints[endpoint].port);
+      }
       goto error;
    }
-   if (parse_body_to_bridge(endpoint, timestamp, (char*)response->payload.data, bridge))
+
+   if (parser.number_of_lines == 0)
    {
+      pgexporter_log_error("No response data from endpoint %d", endpoint);
       goto error;
    }
 
@@ -166,6 +211,8 @@ pgexporter_prometheus_client_get(int endpoint, struct prometheus_bridge* bridge)
 
 error:
 
+   pgexporter_http_line_sink_finish(&sink);
+
    if (response != NULL)
    {
       pgexporter_http_response_destroy(response);
@@ -184,6 +231,45 @@ error:
    return 1;
 }
 
+int
+pgexporter_prometheus_client_parse(char* endpoint, char* data, struct prometheus_bridge* bridge)
+{
+   struct bridge_parser parser;
+   char* line = data;
+   char* eol = NULL;
+   int ret = 0;
+
+   memset(&parser, 0, sizeof(struct bridge_parser));
+
+   parser.endpoint = endpoint;
+   parser.timestamp = time(NULL);
+   parser.bridge = bridge;
+
+   while (ret == 0 && line != NULL && *line != '\0')
+   {
+      /* Lines are terminated in place and restored */
+      eol = strchr(line, '\n');
+      if (eol != NULL)
+      {
+         *eol = '\0';
+      }
+
+      ret = parse_line_to_bridge(line, &parser);
+
+      if (eol != NULL)
+      {
+         *eol = '\n';
+         line = eol + 1;
+      }
+      else
+      {
+         line = NULL;
+      }
+   }
+
+   return ret;
+}
+
 static void
 prometheus_metric_destroy_cb(uintptr_t data)
 {
@@ -708,21 +794,17 @@ error:
 }
 
 static int
-add_line(struct prometheus_metric* metric, char* line, int endpoint, time_t timestamp)
+add_line(struct prometheus_metric* metric, char* line, char* endpoint, time_t timestamp)
 {
-   char* e = NULL;
    bool new = false;
    char* line_value = NULL;
    struct deque* line_attrs = NULL;
    struct prometheus_attributes* attributes = NULL;
-   struct configuration* config = NULL;
    char* p = NULL;
    char* labels_end = NULL;
    char* value_start = NULL;
    char* value_end = NULL;
 
-   config = (struct configuration*)shmem;
-
    if (line == NULL)
    {
       goto error;
@@ -733,11 +815,7 @@ add_line(struct prometheus_metric* metric, char* line, int endpoint, time_t time
       goto error;
    }
 
-   e = pgexporter_append(e, config->endpoints[endpoint].host);
-   e = pgexporter_append_char(e, ':');
-   e = pgexporter_append_int(e, config->endpoints[endpoint].port);
-
-   if (add_attribute(line_attrs, "endpoint", e))
+   if (add_attribute(line_attrs, "endpoint", endpoint))
    {
       goto error;
    }
@@ -957,7 +1035,6 @@ add_line(struct prometheus_metric* metric, char* line, int endpoint, time_t time
       pgexporter_deque_destroy(line_attrs);
    }
 
-   free(e);
    free(line_value);
 
    return 0;
@@ -966,71 +1043,53 @@ error:
 
    pgexporter_deque_destroy(line_attrs);
 
-   free(e);
    free(line_value);
 
    return 1;
 }
 
 static int
-parse_body_to_bridge(int endpoint, time_t timestamp, char* body, struct prometheus_bridge* bridge)
+parse_line_to_bridge(char* line, void* userdata)
 {
-   char* line = NULL;
-   char* saveptr = NULL;
+   struct bridge_parser* parser = (struct bridge_parser*)userdata;
    char name[MISC_LENGTH] = {0};
    char help[MAX_PATH] = {0};
    char type[MISC_LENGTH] = {0};
-   struct value_config vc = {.destroy_data = &prometheus_metric_destroy_cb,
-                             .to_string = &prometheus_metric_string_cb};
-   struct prometheus_metric* metric = NULL;
 
-   line = strtok_r(body, "\n", &saveptr); /* We ideally should not care if body is modified. */
+   /* Empty lines, also Windows ones, separate metrics */
+   if (!strcmp(line, "") || !strcmp(line, "\r"))
+   {
+      return 0;
+   }
+
+   parser->number_of_lines++;
 
-   while (line != NULL)
+   if (line[0] == '#')
    {
-      if ((!strcmp(line, "") || !strcmp(line, "\r")) &&
-          metric != NULL && metric->definitions->size > 0) /* Basically empty strings, empty lines, or empty Windows lines. */
+      if (!strncmp(&line[1], "HELP", 4))
       {
-         /* Previous metric is over. */
-         pgexporter_art_insert_with_config(bridge->metrics, (char*)metric->name, (uintptr_t)metric, &vc);
+         sscanf(line + 6, "%127s %1021[^\n]", name, help);
 
-         metric = NULL;
-         continue;
+         metric_find_create(parser->bridge, name, &parser->metric);
+
+         metric_set_name(parser->metric, name);
+         metric_set_help(parser->metric, help);
       }
-      else if (line[0] == '#')
+      else if (!strncmp(&line[1], "TYPE", 4))
       {
-         if (!strncmp(&line[1], "HELP", 4))
-         {
-            sscanf(line + 6, "%127s %1021[^\n]", name, help);
-
-            metric_find_create(bridge, name, &metric);
-
-            metric_set_name(metric, name);
-            metric_set_help(metric, help);
-         }
-         else if (!strncmp(&line[1], "TYPE", 4))
-         {
-            sscanf(line + 6, "%127s %127[^\n]", name, type);
-            metric_set_type(metric, type);
-         }
-         else
-         {
-            goto error;
-         }
+         sscanf(line + 6, "%127s %127[^\n]", name, type);
+         metric_set_type(parser->metric, type);
       }
       else
       {
-         add_line(metric, line, endpoint, timestamp);
+         parser->failed = true;
+         return 1;
       }
-
-      line = strtok_r(NULL, "\n", &saveptr);
+   }
+   else if (parser->metric != NULL)
+   {
+      add_line(parser->metric, line, parser->endpoint, parser->timestamp);
    }
 
    return 0;
-
-error:
-   pgexporter_art_destroy(bridge->metrics);
-   bridge->metrics = NULL;
-
-   return 1;
 }
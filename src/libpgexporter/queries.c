@@ -39,13 +39,16 @@
 #include <server.h>
 #include <string.h>
 #include <utils.h>
+#include <yaml_configuration.h>
 
 /* system */
 #include <stdlib.h>
+#include <time.h>
 
 #define SQLSTATE_QUERY_CANCELED "57014"
 
 static int query_execute(int server, char* qs, char* tag, int columns, char* names[], struct query** query);
+static int query_execute_socket(int server, SSL* ssl, int socket, char* qs, char* tag, int columns, char* names[], bool statistics, struct query** query);
 static bool is_query_timeout_error(struct message* error_msg);
 static void* data_append(void* orig, size_t orig_size, void* n, size_t n_size);
 static int create_D_tuple(int server, int number_of_columns, struct message* msg, struct tuple** tuple);
@@ -55,8 +58,12 @@ static int get_column_type_oid(struct message* msg, int index);
 static int process_server_parameters(int server, struct deque* server_parameters);
 static int pgexporter_detect_databases(int server);
 static int pgexporter_detect_extensions(int server);
+static int pgexporter_detect_cluster(int server);
 static int pgexporter_connect_db(int server, char* database);
-static void pgexporter_apply_metrics_timeout(int server);
+static void query_statistics(int server, uint64_t start, size_t bytes, bool error);
+static uint64_t now_usec(void);
+
+static uint64_t server_mask = UINT64_MAX;
 
 int
 pgexporter_check_pg_monitor_role(int server)
@@ -115,11 +122,24 @@ pgexporter_check_pg_monitor_role(int server)
    return ret;
 }
 
+void
+pgexporter_set_server_mask(uint64_t mask)
+{
+   server_mask = mask;
+}
+
+bool
+pgexporter_server_owned(int server)
+{
+   return server >= 0 && server < NUMBER_OF_SERVERS && (server_mask & ((uint64_t)1 << server)) != 0;
+}
+
 void
 pgexporter_open_connections(void)
 {
    int ret;
    int user;
+   uint64_t start;
    struct configuration* config;
    struct deque* server_parameters;
 
@@ -127,7 +147,7 @@ pgexporter_open_connections(void)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].type == SERVER_TYPE_PROMETHEUS)
+      if (config->servers[server].type == SERVER_TYPE_PROMETHEUS || !pgexporter_server_owned(server))
       {
          continue;
       }
@@ -144,6 +164,10 @@ pgexporter_open_connections(void)
             }
             config->servers[server].fd = -1;
          }
+         else
+         {
+            atomic_fetch_add(&config->servers[server].statistics.connections_reused, 1);
+         }
       }
 
       if (config->servers[server].fd == -1)
@@ -166,6 +190,8 @@ pgexporter_open_connections(void)
 
          config->servers[server].new = false;
 
+         start = now_usec();
+
          ret = pgexporter_server_authenticate(server, "postgres",
                                               &config->users[user].username[0], &config->users[user].password[0],
                                               &config->servers[server].ssl,
@@ -199,13 +225,19 @@ pgexporter_open_connections(void)
 
             pgexporter_detect_databases(server);
             pgexporter_detect_extensions(server);
+            pgexporter_detect_cluster(server);
 
-            pgexporter_apply_metrics_timeout(server);
+            atomic_fetch_add(&config->servers[server].statistics.connections, 1);
+            atomic_store(&config->servers[server].statistics.discovery, (long long)time(NULL));
          }
          else
          {
             pgexporter_log_error("Failed login for '%s' on server '%s'", &config->users[user].username, &config->servers[server].name);
+
+            atomic_fetch_add(&config->servers[server].statistics.connection_errors, 1);
          }
+
+         atomic_fetch_add(&config->servers[server].statistics.busy_time, now_usec() - start);
       }
    }
 }
@@ -219,7 +251,7 @@ pgexporter_close_connections(void)
 
    for (int server = 0; server < config->number_of_servers; server++)
    {
-      if (config->servers[server].fd != -1)
+      if (config->servers[server].fd != -1 && pgexporter_server_owned(server))
       {
          pgexporter_write_terminate(config->servers[server].ssl, config->servers[server].fd);
 
@@ -237,12 +269,66 @@ pgexporter_close_connections(void)
    }
 }
 
+void
+pgexporter_scrape_statistics_begin(uint64_t* busy_time)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      busy_time[server] = atomic_load(&config->servers[server].statistics.busy_time);
+   }
+}
+
+void
+pgexporter_scrape_statistics_end(uint64_t* busy_time)
+{
+   time_t now;
+   struct server_statistics* statistics = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   now = time(NULL);
+
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      if (config->servers[server].type == SERVER_TYPE_PROMETHEUS || !pgexporter_server_owned(server))
+      {
+         continue;
+      }
+
+      statistics = &config->servers[server].statistics;
+
+      atomic_store(&statistics->last_scrape_duration, atomic_load(&statistics->busy_time) - busy_time[server]);
+      atomic_store(&statistics->last_scrape, (long long)now);
+      atomic_fetch_add(&statistics->scrapes, 1);
+
+      if (config->servers[server].fd != -1)
+      {
+         atomic_store(&statistics->last_success, (long long)now);
+      }
+      else
+      {
+         atomic_fetch_add(&statistics->failed_scrapes, 1);
+      }
+   }
+}
+
 int
 pgexporter_query_execute(int server, char* sql, char* tag, struct query** query)
 {
    return query_execute(server, sql, tag, -1, NULL, query);
 }
 
+int
+pgexporter_query_execute_socket(int server, SSL* ssl, int socket, char* sql, char* tag, struct query** query)
+{
+   return query_execute_socket(server, ssl, socket, sql, tag, -1, NULL, false, query);
+}
+
 int
 pgexporter_execute_command(int server, char* sql)
 {
@@ -352,6 +438,13 @@ pgexporter_query_primary(int server, struct query** query)
                         "pg_primary", 1, NULL, query);
 }
 
+int
+pgexporter_query_system_identifier(int server, struct query** query)
+{
+   return query_execute(server, "SELECT system_identifier FROM pg_control_system();",
+                        "pg_system_identifier", 1, NULL, query);
+}
+
 int
 pgexporter_query_database_size(int server, struct query** query)
 {
@@ -709,6 +802,16 @@ is_query_timeout_error(struct message* error_msg)
 
 static int
 query_execute(int server, char* qs, char* tag, int columns, char* names[], struct query** query)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return query_execute_socket(server, config->servers[server].ssl, config->servers[server].fd, qs, tag, columns, names, true, query);
+}
+
+static int
+query_execute_socket(int server, SSL* ssl, int socket, char* qs, char* tag, int columns, char* names[], bool statistics, struct query** query)
 {
    int status;
    bool cont;
@@ -726,10 +829,16 @@ query_execute(int server, char* qs, char* tag, int columns, char* names[], struc
    size_t offset = 0;
    struct configuration* config;
    bool query_timeout = false;
+   uint64_t start;
 
    config = (struct configuration*)shmem;
 
-   atomic_fetch_add(&config->query_executions_total, 1);
+   start = now_usec();
+
+   if (statistics)
+   {
+      atomic_fetch_add(&config->query_executions_total, 1);
+   }
 
    *query = NULL;
 
@@ -747,7 +856,7 @@ query_execute(int server, char* qs, char* tag, int columns, char* names[], struc
    qmsg.length = size;
    qmsg.data = content;
 
-   status = pgexporter_write_message(config->servers[server].ssl, config->servers[server].fd, &qmsg);
+   status = pgexporter_write_message(ssl, socket, &qmsg);
    if (status != MESSAGE_STATUS_OK)
    {
       goto error;
@@ -756,7 +865,7 @@ query_execute(int server, char* qs, char* tag, int columns, char* names[], struc
    cont = true;
    while (cont)
    {
-      status = pgexporter_read_block_message(config->servers[server].ssl, config->servers[server].fd, &msg);
+      status = pgexporter_read_block_message(ssl, socket, &msg);
 
       if (status == MESSAGE_STATUS_OK)
       {
@@ -858,6 +967,11 @@ query_execute(int server, char* qs, char* tag, int columns, char* names[], struc
 
    *query = q;
 
+   if (statistics)
+   {
+      query_statistics(server, start, data_size, false);
+   }
+
    pgexporter_free_message(tmsg);
 
    free(content);
@@ -866,10 +980,14 @@ query_execute(int server, char* qs, char* tag, int columns, char* names[], struc
    return 0;
 
 error:
-   atomic_fetch_add(&config->query_errors_total, 1);
-   if (query_timeout)
+   if (statistics)
    {
-      atomic_fetch_add(&config->query_timeouts_total, 1);
+      atomic_fetch_add(&config->query_errors_total, 1);
+      if (query_timeout)
+      {
+         atomic_fetch_add(&config->query_timeouts_total, 1);
+      }
+      query_statistics(server, start, data_size, true);
    }
    if (q != NULL)
    {
@@ -883,6 +1001,36 @@ error:
    return 1;
 }
 
+static void
+query_statistics(int server, uint64_t start, size_t bytes, bool error)
+{
+   struct server_statistics* statistics = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   statistics = &config->servers[server].statistics;
+
+   atomic_fetch_add(&statistics->queries, 1);
+   atomic_fetch_add(&statistics->bytes_received, bytes);
+   atomic_fetch_add(&statistics->busy_time, now_usec() - start);
+
+   if (error)
+   {
+      atomic_fetch_add(&statistics->query_errors, 1);
+   }
+}
+
+static uint64_t
+now_usec(void)
+{
+   struct timespec ts;
+
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+
+   return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 static void*
 data_append(void* orig, size_t orig_size, void* n, size_t n_size)
 {
@@ -1075,6 +1223,49 @@ process_server_parameters(int server, struct deque* server_parameters)
    return status;
 }
 
+static int
+pgexporter_detect_cluster(int server)
+{
+   struct query* query = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   /* The cluster of a server stays the same across its connections */
+   if (strlen(config->servers[server].system_identifier) > 0)
+   {
+      return 0;
+   }
+
+   if (pgexporter_query_system_identifier(server, &query) || query == NULL || query->tuples == NULL ||
+       pgexporter_get_column(0, query->tuples) == NULL)
+   {
+      if (!config->servers[server].cluster_warned)
+      {
+         pgexporter_log_warn("Failed to detect the cluster of server %s", config->servers[server].name);
+         config->servers[server].cluster_warned = true;
+      }
+      else
+      {
+         pgexporter_log_debug("Failed to detect the cluster of server %s", config->servers[server].name);
+      }
+      goto error;
+   }
+
+   pgexporter_snprintf(config->servers[server].system_identifier, MISC_LENGTH, "%s",
+                       pgexporter_get_column(0, query->tuples));
+
+   pgexporter_log_debug("Server %s: System identifier %s", config->servers[server].name,
+                        config->servers[server].system_identifier);
+
+   pgexporter_free_query(query);
+   return 0;
+
+error:
+   pgexporter_free_query(query);
+   return 1;
+}
+
 static int
 pgexporter_detect_extensions(int server)
 {
@@ -1138,6 +1329,16 @@ pgexporter_detect_extensions(int server)
       current = current->next;
    }
 
+   /* The catalogs are loaded by the main process, which is told about new ones */
+   for (int i = 0; i < config->servers[server].number_of_extensions; i++)
+   {
+      if (config->servers[server].extensions[i].enabled &&
+          !pgexporter_is_extension_yaml_loaded(config, config->servers[server].extensions[i].name))
+      {
+         atomic_store(&config->extensions_detected, true);
+      }
+   }
+
    pgexporter_log_debug("Server %s: Detected extensions:", config->servers[server].name);
    for (int i = 0; i < config->servers[server].number_of_extensions; i++)
    {
@@ -1240,15 +1441,10 @@ pgexporter_connect_db(int server, char* database)
       return AUTH_ERROR;
    }
 
-   int ret = pgexporter_server_authenticate(server, database == NULL ? "postgres" : database,
-                                            &config->users[user].username[0], &config->users[user].password[0],
-                                            &config->servers[server].ssl,
-                                            &config->servers[server].fd);
-   if (ret == 0)
-   {
-      pgexporter_apply_metrics_timeout(server);
-   }
-   return ret;
+   return pgexporter_server_authenticate(server, database == NULL ? "postgres" : database,
+                                         &config->users[user].username[0], &config->users[user].password[0],
+                                         &config->servers[server].ssl,
+                                         &config->servers[server].fd);
 }
 
 int
@@ -1286,29 +1482,3 @@ pgexporter_switch_db(int server, char* database)
 error:
    return ret;
 }
-
-static void
-pgexporter_apply_metrics_timeout(int server)
-{
-   struct configuration* config;
-
-   config = (struct configuration*)shmem;
-
-   if (pgexporter_time_is_valid(config->metrics_query_timeout))
-   {
-      char* set_query = pgexporter_append(NULL, "SET statement_timeout = ");
-      set_query = pgexporter_append_int(set_query, (int)pgexporter_time_convert(config->metrics_query_timeout, FORMAT_TIME_MS));
-      set_query = pgexporter_append(set_query, ";");
-      if (pgexporter_execute_command(server, set_query) != 0)
-      {
-         pgexporter_log_debug("Failed to set statement_timeout=%" PRId64 "ms on server '%s'",
-                              pgexporter_time_convert(config->metrics_query_timeout, FORMAT_TIME_MS), &config->servers[server].name[0]);
-      }
-      else
-      {
-         pgexporter_log_debug("Set statement_timeout=%" PRId64 "ms on server '%s'",
-                              pgexporter_time_convert(config->metrics_query_timeout, FORMAT_TIME_MS), &config->servers[server].name[0]);
-      }
-      free(set_query);
-   }
-}
@@ -29,12 +29,15 @@
 /* pgexporter */
 #include <pgexporter.h>
 #include <aes.h>
+#include <deque.h>
 #include <logging.h>
 #include <memory.h>
 #include <message.h>
 #include <network.h>
 #include <prometheus.h>
 #include <security.h>
+#include <server.h>
+#include <shmem.h>
 #include <utf8.h>
 #include <utils.h>
 
@@ -110,6 +113,14 @@ static int server_signature(char* password, char* salt, int salt_length, int ite
 
 static int create_ssl_client(SSL_CTX* ctx, char* key, char* cert, char* root, int socket, SSL** ssl);
 
+static void tls_session_lock(struct tls_session_cache* cache);
+static void tls_session_unlock(struct tls_session_cache* cache);
+static int tls_ticket_key_generate(struct tls_ticket_key* key);
+static int tls_ticket_key_cb(SSL* ssl, unsigned char* key_name, unsigned char* iv, EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int enc);
+static int tls_session_new_cb(SSL* ssl, SSL_SESSION* session);
+static SSL_SESSION* tls_session_get_cb(SSL* ssl, const unsigned char* id, int id_length, int* copy);
+static void tls_session_remove_cb(SSL_CTX* ctx, SSL_SESSION* session);
+
 int
 pgexporter_remote_management_auth(int client_fd, char* address, SSL** client_ssl)
 {
@@ -438,7 +449,7 @@ pgexporter_remote_management_scram_sha256(char* username, char* password, int se
       }
    }
 
-   status = pgexporter_create_startup_message(username, "admin", &startup_msg);
+   status = pgexporter_create_startup_message(username, "admin", NULL, &startup_msg);
    if (status != MESSAGE_STATUS_OK)
    {
       goto error;
@@ -1019,6 +1030,7 @@ pgexporter_server_authenticate(int server, char* database, char* username, char*
    struct message* ssl_msg = NULL;
    struct message* startup_msg = NULL;
    struct message* msg = NULL;
+   struct deque* parameters = NULL;
    struct configuration* config;
 
    *ssl = NULL;
@@ -1144,7 +1156,14 @@ pgexporter_server_authenticate(int server, char* database, char* username, char*
       }
    }
 
-   ret = pgexporter_create_startup_message(username, database, &startup_msg);
+   if (pgexporter_server_session(server, &parameters))
+   {
+      goto error;
+   }
+
+   ret = pgexporter_create_startup_message(username, database, parameters, &startup_msg);
+   pgexporter_deque_destroy(parameters);
+   parameters = NULL;
    if (ret != MESSAGE_STATUS_OK)
    {
       goto error;
@@ -2613,6 +2632,348 @@ error:
    return 1;
 }
 
+int
+pgexporter_enable_ktls(SSL_CTX* ctx)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+   SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+
+   return 0;
+#else
+   (void)ctx;
+
+   pgexporter_log_debug("OpenSSL was built without kernel TLS support");
+
+   return 1;
+#endif
+}
+
+bool
+pgexporter_is_ktls(SSL* ssl)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+   if (ssl != NULL && BIO_get_ktls_send(SSL_get_wbio(ssl)))
+   {
+      return true;
+   }
+#else
+   (void)ssl;
+#endif
+
+   return false;
+}
+
+int
+pgexporter_tls_session_init(size_t* p_size, void** p_shmem)
+{
+   struct tls_session_cache* cache = NULL;
+   size_t size = sizeof(struct tls_session_cache);
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   if (pgexporter_create_shared_memory(size, HUGEPAGE_OFF, (void**)&cache))
+   {
+      goto error;
+   }
+
+   memset(cache, 0, size);
+   atomic_init(&cache->lock, STATE_FREE);
+
+   /* Both slots get a key so a ticket name never matches an empty key */
+   if (tls_ticket_key_generate(&cache->keys[0]) || tls_ticket_key_generate(&cache->keys[1]))
+   {
+      pgexporter_destroy_shared_memory(cache, size);
+      goto error;
+   }
+
+   *p_size = size;
+   *p_shmem = cache;
+
+   return 0;
+
+error:
+
+   pgexporter_log_error("Cannot allocate shared memory for the TLS session cache");
+
+   return 1;
+}
+
+int
+pgexporter_tls_session_rotate(void)
+{
+   struct tls_session_cache* cache = (struct tls_session_cache*)tls_session_shmem;
+   struct tls_ticket_key key;
+
+   if (cache == NULL)
+   {
+      return 1;
+   }
+
+   if (tls_ticket_key_generate(&key))
+   {
+      pgexporter_log_error("Could not generate a TLS ticket key");
+      return 1;
+   }
+
+   /* The previous key is overwritten, the current one becomes the previous */
+   tls_session_lock(cache);
+   cache->current = 1 - cache->current;
+   memcpy(&cache->keys[cache->current], &key, sizeof(struct tls_ticket_key));
+   tls_session_unlock(cache);
+
+   OPENSSL_cleanse(&key, sizeof(struct tls_ticket_key));
+
+   pgexporter_log_debug("Rotated the TLS ticket key");
+
+   return 0;
+}
+
+int
+pgexporter_enable_tls_session_resumption(SSL_CTX* ctx)
+{
+   static const unsigned char context[] = "pgexporter";
+
+   if (tls_session_shmem == NULL)
+   {
+      return 1;
+   }
+
+   /* Sessions are shared between the forked children, so every
+    * context uses the same id context */
+   if (SSL_CTX_set_session_id_context(ctx, context, sizeof(context) - 1) != 1)
+   {
+      return 1;
+   }
+
+   /* A ticket is valid for up to two rotations of its key */
+   SSL_CTX_set_timeout(ctx, 2 * TLS_TICKET_KEY_ROTATION_MS / 1000);
+
+   SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+   SSL_CTX_set_num_tickets(ctx, 1);
+   if (SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, tls_ticket_key_cb) != 1)
+   {
+      return 1;
+   }
+
+   SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+   SSL_CTX_sess_set_new_cb(ctx, tls_session_new_cb);
+   SSL_CTX_sess_set_get_cb(ctx, tls_session_get_cb);
+   SSL_CTX_sess_set_remove_cb(ctx, tls_session_remove_cb);
+
+   return 0;
+}
+
+static void
+tls_session_lock(struct tls_session_cache* cache)
+{
+   signed char lock_free;
+
+   while (true)
+   {
+      lock_free = STATE_FREE;
+      if (atomic_compare_exchange_strong(&cache->lock, &lock_free, STATE_IN_USE))
+      {
+         return;
+      }
+
+      SLEEP(1000L);
+   }
+}
+
+static void
+tls_session_unlock(struct tls_session_cache* cache)
+{
+   atomic_store(&cache->lock, STATE_FREE);
+}
+
+static int
+tls_ticket_key_generate(struct tls_ticket_key* key)
+{
+   if (RAND_bytes(key->name, sizeof(key->name)) != 1 ||
+       RAND_bytes(key->aes_key, sizeof(key->aes_key)) != 1 ||
+       RAND_bytes(key->hmac_key, sizeof(key->hmac_key)) != 1)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+tls_ticket_key_cb(SSL* ssl __attribute__((unused)), unsigned char* key_name, unsigned char* iv,
+                  EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int enc)
+{
+   struct tls_session_cache* cache = (struct tls_session_cache*)tls_session_shmem;
+   struct tls_ticket_key key;
+   OSSL_PARAM params[2];
+   bool current = true;
+   bool found = false;
+   int ret = -1;
+
+   tls_session_lock(cache);
+   if (enc)
+   {
+      memcpy(&key, &cache->keys[cache->current], sizeof(struct tls_ticket_key));
+      found = true;
+   }
+   else
+   {
+      for (int i = 0; !found && i < 2; i++)
+      {
+         if (!memcmp(key_name, cache->keys[i].name, TLS_TICKET_KEY_NAME_LENGTH))
+         {
+            memcpy(&key, &cache->keys[i], sizeof(struct tls_ticket_key));
+            current = i == cache->current;
+            found = true;
+         }
+      }
+   }
+   tls_session_unlock(cache);
+
+   if (!found)
+   {
+      /* Unknown or expired key, do a full handshake */
+      return 0;
+   }
+
+   params[0] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0);
+   params[1] = OSSL_PARAM_construct_end();
+
+   if (enc)
+   {
+      memcpy(key_name, key.name, TLS_TICKET_KEY_NAME_LENGTH);
+
+      if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1 ||
+          EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1)
+      {
+         goto done;
+      }
+   }
+   else if (EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key.aes_key, iv) != 1)
+   {
+      goto done;
+   }
+
+   if (EVP_MAC_init(mac, key.hmac_key, sizeof(key.hmac_key), params) != 1)
+   {
+      goto done;
+   }
+
+   /* A ticket sealed with the previous key is resumed and renewed */
+   ret = current ? 1 : 2;
+
+done:
+
+   OPENSSL_cleanse(&key, sizeof(struct tls_ticket_key));
+
+   return ret;
+}
+
+static int
+tls_session_new_cb(SSL* ssl __attribute__((unused)), SSL_SESSION* session)
+{
+   struct tls_session_cache* cache = (struct tls_session_cache*)tls_session_shmem;
+   struct tls_session* slot = NULL;
+   const unsigned char* id = NULL;
+   unsigned int id_length = 0;
+   unsigned char* p = NULL;
+   int length;
+
+   id = SSL_SESSION_get_id(session, &id_length);
+   length = i2d_SSL_SESSION(session, NULL);
+
+   if (id_length == 0 || id_length > TLS_SESSION_ID_LENGTH ||
+       length <= 0 || length > TLS_SESSION_DATA_LENGTH)
+   {
+      return 0;
+   }
+
+   tls_session_lock(cache);
+
+   for (int i = 0; slot == NULL && i < TLS_SESSION_CACHE_SIZE; i++)
+   {
+      if (cache->sessions[i].id_length == id_length &&
+          !memcmp(cache->sessions[i].id, id, id_length))
+      {
+         slot = &cache->sessions[i];
+      }
+   }
+
+   /* The oldest session is replaced */
+   if (slot == NULL)
+   {
+      slot = &cache->sessions[cache->next];
+      cache->next = (cache->next + 1) % TLS_SESSION_CACHE_SIZE;
+   }
+
+   p = slot->data;
+   slot->id_length = id_length;
+   memcpy(slot->id, id, id_length);
+   slot->length = i2d_SSL_SESSION(session, &p);
+
+   tls_session_unlock(cache);
+
+   /* The session isn't kept */
+   return 0;
+}
+
+static SSL_SESSION*
+tls_session_get_cb(SSL* ssl __attribute__((unused)), const unsigned char* id, int id_length, int* copy)
+{
+   struct tls_session_cache* cache = (struct tls_session_cache*)tls_session_shmem;
+   unsigned char data[TLS_SESSION_DATA_LENGTH];
+   const unsigned char* p = data;
+   unsigned int length = 0;
+
+   *copy = 0;
+
+   tls_session_lock(cache);
+
+   for (int i = 0; length == 0 && i < TLS_SESSION_CACHE_SIZE; i++)
+   {
+      if (cache->sessions[i].id_length == (unsigned int)id_length &&
+          !memcmp(cache->sessions[i].id, id, id_length))
+      {
+         length = cache->sessions[i].length;
+         memcpy(data, cache->sessions[i].data, length);
+      }
+   }
+
+   tls_session_unlock(cache);
+
+   if (length == 0)
+   {
+      return NULL;
+   }
+
+   /* OpenSSL checks the timeout of the session */
+   return d2i_SSL_SESSION(NULL, &p, length);
+}
+
+static void
+tls_session_remove_cb(SSL_CTX* ctx __attribute__((unused)), SSL_SESSION* session)
+{
+   struct tls_session_cache* cache = (struct tls_session_cache*)tls_session_shmem;
+   const unsigned char* id = NULL;
+   unsigned int id_length = 0;
+
+   id = SSL_SESSION_get_id(session, &id_length);
+
+   tls_session_lock(cache);
+
+   for (int i = 0; i < TLS_SESSION_CACHE_SIZE; i++)
+   {
+      if (cache->sessions[i].id_length == id_length &&
+          !memcmp(cache->sessions[i].id, id, id_length))
+      {
+         memset(&cache->sessions[i], 0, sizeof(struct tls_session));
+      }
+   }
+
+   tls_session_unlock(cache);
+}
+
 static int
 create_ssl_client(SSL_CTX* ctx, char* key, char* cert, char* root, int socket, SSL** ssl)
 {
@@ -28,6 +28,7 @@
 
 /* pgexporter */
 #include <pgexporter.h>
+#include <deque.h>
 #include <logging.h>
 #include <message.h>
 #include <network.h>
@@ -37,7 +38,9 @@
 
 /* system */
 #include <ev.h>
+#include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -106,3 +109,123 @@ error:
 
    return 1;
 }
+
+int
+pgexporter_server_session(int srv, struct deque** parameters)
+{
+   struct deque* p = NULL;
+   struct server* server = NULL;
+   pgexporter_time_t statement_timeout;
+   char number[MISC_LENGTH];
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   server = &config->servers[srv];
+
+   *parameters = NULL;
+
+   if (pgexporter_deque_create(false, &p))
+   {
+      goto error;
+   }
+
+   if (pgexporter_deque_add(p, "application_name",
+                            (uintptr_t)(strlen(server->application_name) > 0 ? server->application_name : "pgexporter"),
+                            ValueString))
+   {
+      goto error;
+   }
+
+   statement_timeout = server->statement_timeout;
+   if (!pgexporter_time_is_valid(statement_timeout))
+   {
+      statement_timeout = config->metrics_query_timeout;
+   }
+
+   if (pgexporter_time_is_valid(statement_timeout))
+   {
+      pgexporter_snprintf(number, sizeof(number), "%" PRId64, pgexporter_time_convert(statement_timeout, FORMAT_TIME_MS));
+      if (pgexporter_deque_add(p, "statement_timeout", (uintptr_t)number, ValueString))
+      {
+         goto error;
+      }
+   }
+
+   if (pgexporter_time_is_valid(server->lock_timeout))
+   {
+      pgexporter_snprintf(number, sizeof(number), "%" PRId64, pgexporter_time_convert(server->lock_timeout, FORMAT_TIME_MS));
+      if (pgexporter_deque_add(p, "lock_timeout", (uintptr_t)number, ValueString))
+      {
+         goto error;
+      }
+   }
+
+   /* The catalog joins of the collectors are cheap, but big enough for JIT to compile them */
+   if (!server->jit)
+   {
+      if (pgexporter_deque_add(p, "jit", (uintptr_t)"off", ValueString))
+      {
+         goto error;
+      }
+   }
+
+   if (strlen(server->work_mem) > 0)
+   {
+      if (pgexporter_deque_add(p, "work_mem", (uintptr_t)server->work_mem, ValueString))
+      {
+         goto error;
+      }
+   }
+
+   *parameters = p;
+
+   return 0;
+
+error:
+
+   pgexporter_deque_destroy(p);
+
+   return 1;
+}
+
+bool
+pgexporter_server_cluster_leader(int srv)
+{
+   bool primary;
+   struct server* server;
+   struct server* other;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+   server = &config->servers[srv];
+
+   if (strlen(server->system_identifier) == 0)
+   {
+      return true;
+   }
+
+   primary = server->state == SERVER_PRIMARY;
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      other = &config->servers[i];
+
+      if (i == srv || other->type == SERVER_TYPE_PROMETHEUS || other->fd == -1 ||
+          strcmp(other->system_identifier, server->system_identifier))
+      {
+         continue;
+      }
+
+      if (other->state == SERVER_PRIMARY && !primary)
+      {
+         return false;
+      }
+
+      if ((other->state == SERVER_PRIMARY) == primary && i < srv)
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
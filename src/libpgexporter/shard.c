@@ -0,0 +1,1143 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <alert.h>
+#include <art.h>
+#include <history.h>
+#include <http_server.h>
+#include <logging.h>
+#include <memory.h>
+#include <message.h>
+#include <prometheus.h>
+#include <prometheus_client.h>
+#include <queries.h>
+#include <shard.h>
+#include <shmem.h>
+#include <utils.h>
+#include <value.h>
+
+/* system */
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHARD_ALIGN(n) (((n) + 7) & ~((size_t)7))
+
+/** @struct shard_record
+ * A metric family in a fragment, followed by its name, its #HELP / #TYPE
+ * lines and its samples, each zero terminated
+ */
+struct shard_record
+{
+   uint32_t name;   /**< The length of the name */
+   uint32_t header; /**< The length of the #HELP / #TYPE lines */
+   uint32_t body;   /**< The length of the samples */
+   uint32_t length; /**< The length of the record */
+};
+
+/** @struct shard_buffer
+ * A growing buffer
+ */
+struct shard_buffer
+{
+   char* data;      /**< The data */
+   size_t length;   /**< The length of the data */
+   size_t capacity; /**< The capacity of the buffer */
+};
+
+/** @struct shard_family
+ * A metric family being collected from a scrape
+ */
+struct shard_family
+{
+   char* name;                 /**< The name */
+   struct shard_buffer header; /**< The #HELP / #TYPE lines */
+   struct shard_buffer body;   /**< The samples */
+};
+
+/** @struct shard_cursor
+ * The position of a reader in a fragment
+ */
+struct shard_cursor
+{
+   struct shard_fragment* fragment; /**< The fragment */
+   int buffer;                      /**< The buffer being read */
+   int slot;                        /**< The reader slot */
+   char* p;                         /**< The current record */
+   char* end;                       /**< The end of the buffer */
+};
+
+/** @struct shard_output
+ * The pieces of the chunk being written
+ */
+struct shard_output
+{
+   SSL* ssl;                                    /**< The client SSL */
+   int fd;                                      /**< The client descriptor */
+   struct iovec iov[HTTP_SERVER_CHUNK_PIECES];  /**< The pieces */
+   int count;                                   /**< The number of pieces */
+};
+
+typedef int (*shard_emit_cb)(void* userdata, char* data, size_t length);
+
+static struct shard_fragment* fragment_of(int shard);
+static char* buffer_of(int shard, int buffer);
+static void reset_servers(uint64_t servers);
+static int collect_families(prometheus_metrics_container_t* container, struct art* families);
+static int collect_text(char* text, struct art* families);
+static struct shard_family* family_of(struct art* families, char* name, size_t length);
+static int family_compare(const void* a, const void* b);
+static int buffer_append(struct shard_buffer* buffer, char* data, size_t length);
+static int render(struct art* families, char** data, size_t* size);
+static int publish_families(int shard, struct art* families);
+static int publish(int shard, char* data, size_t size);
+static bool wait_for_readers(struct shard_fragment* fragment, int buffer);
+static int open_cursors(struct shard_cursor* cursors);
+static void close_cursors(struct shard_cursor* cursors, int number_of_cursors);
+static int acquire(struct shard_fragment* fragment, int* slot);
+static void release(struct shard_fragment* fragment, int buffer, int slot);
+static int merge(struct shard_cursor* cursors, int number_of_cursors, shard_emit_cb emit, void* userdata);
+static int output_emit(void* userdata, char* data, size_t length);
+static int output_flush(struct shard_output* output);
+static int snapshot_emit(void* userdata, char* data, size_t length);
+static void family_destroy_cb(uintptr_t data);
+static char* family_string_cb(uintptr_t data, int32_t format, char* tag, int indent);
+
+int
+pgexporter_shard_init(size_t* p_size, void** p_shmem)
+{
+   size_t size;
+   struct shard_fragment* fragment = NULL;
+   void* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   size = config->metrics_shards * (sizeof(struct shard_fragment) + 2 * (size_t)SHARD_FRAGMENT_SIZE);
+
+   if (pgexporter_create_shared_memory(size, config->hugepage, &s))
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < config->metrics_shards; i++)
+   {
+      fragment = (struct shard_fragment*)s + i;
+
+      atomic_init(&fragment->active, -1);
+      for (int j = 0; j < SHARD_READERS; j++)
+      {
+         atomic_init(&fragment->readers[0][j], 0);
+         atomic_init(&fragment->readers[1][j], 0);
+      }
+      fragment->size[0] = 0;
+      fragment->size[1] = 0;
+      atomic_init(&fragment->updated, 0);
+      atomic_init(&fragment->servers, 0);
+   }
+
+   *p_size = size;
+   *p_shmem = s;
+
+   return 0;
+}
+
+int
+pgexporter_shard_of(int server)
+{
+   uint64_t hash;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (config->metrics_shards <= 0)
+   {
+      return 0;
+   }
+
+   if (config->servers[server].shard >= 0 && config->servers[server].shard < config->metrics_shards)
+   {
+      return config->servers[server].shard;
+   }
+
+   /* FNV-1a, so a server stays on its shard when other servers come and go */
+   hash = pgexporter_hash_string(0, &config->servers[server].name[0]);
+
+   return (int)(hash % (uint64_t)config->metrics_shards);
+}
+
+uint64_t
+pgexporter_shard_servers(int shard)
+{
+   uint64_t servers = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      if (config->servers[server].type != SERVER_TYPE_PROMETHEUS && pgexporter_shard_of(server) == shard)
+      {
+         servers |= (uint64_t)1 << server;
+      }
+   }
+
+   return servers;
+}
+
+void
+pgexporter_shard_run(int shard)
+{
+   uint64_t servers;
+   time_t start;
+   time_t last_alerts = 0;
+   time_t last_history = 0;
+   int64_t interval;
+   int64_t alerts_interval;
+   int64_t history_interval;
+   bool expected;
+   struct art* families = NULL;
+   prometheus_metrics_container_t* container = NULL;
+   pid_t parent = getppid();
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgexporter_start_logging();
+   pgexporter_memory_init();
+
+   /* The handlers of the main process don't apply here, and the
+    * connections are closed by the kernel when the shard stops */
+   signal(SIGTERM, SIG_DFL);
+   signal(SIGINT, SIG_DFL);
+   signal(SIGHUP, SIG_IGN);
+
+   servers = pgexporter_shard_servers(shard);
+   pgexporter_set_server_mask(servers);
+   reset_servers(servers);
+
+   atomic_store(&fragment_of(shard)->servers, __builtin_popcountll(servers));
+
+   pgexporter_log_debug("Shard %d: %d servers", shard, __builtin_popcountll(servers));
+
+   interval = pgexporter_time_convert(config->metrics_cache_max_age, FORMAT_TIME_S);
+   if (interval <= 0)
+   {
+      interval = SHARD_DEFAULT_INTERVAL;
+   }
+
+   alerts_interval = pgexporter_time_convert(config->alerts_interval, FORMAT_TIME_S);
+   history_interval = pgexporter_time_convert(config->history_interval, FORMAT_TIME_S);
+
+   /* Also stop when the main process went away without a shutdown */
+   while (config->keep_running && getppid() == parent)
+   {
+      start = time(NULL);
+
+      /* The shards evaluate the alerts of their servers instead of the alert evaluator */
+      if (config->alerts_enabled && config->number_of_alerts > 0 && start - last_alerts >= alerts_interval)
+      {
+         pgexporter_open_connections();
+         pgexporter_alert_evaluate();
+         last_alerts = start;
+      }
+
+      if (pgexporter_prometheus_shard_scrape(&container, shard == 0) == 0)
+      {
+         if (pgexporter_art_create(&families) == 0)
+         {
+            if (collect_families(container, families) == 0 && publish_families(shard, families))
+            {
+               pgexporter_log_warn("Shard %d: metrics not published", shard);
+            }
+
+            pgexporter_art_destroy(families);
+            families = NULL;
+         }
+
+         /* Each shard stores its own servers, one store at a time */
+         if (config->history > 0 && history_interval > 0 && start - last_history >= history_interval)
+         {
+            expected = false;
+            if (atomic_compare_exchange_strong(&config->history_worker_running, &expected, true))
+            {
+               if (pgexporter_history_init() == 0 && pgexporter_history_store_metrics(container) == 0)
+               {
+                  last_history = start;
+                  atomic_store(&config->history_last_store_time, (int64_t)start);
+               }
+               atomic_store(&config->history_worker_running, false);
+            }
+         }
+
+         pgexporter_prometheus_destroy_container(container);
+         container = NULL;
+      }
+      else
+      {
+         pgexporter_log_error("Shard %d: failed to scrape", shard);
+      }
+
+      while (config->keep_running && getppid() == parent && time(NULL) - start < interval)
+      {
+         SLEEP(100000000L);
+      }
+   }
+
+   pgexporter_close_connections();
+
+   pgexporter_memory_destroy();
+   pgexporter_stop_logging();
+
+   exit(0);
+}
+
+int
+pgexporter_shard_publish(int shard, char* text)
+{
+   int status = 1;
+   struct art* families = NULL;
+
+   if (pgexporter_art_create(&families))
+   {
+      return 1;
+   }
+
+   if (collect_text(text, families) == 0)
+   {
+      status = publish_families(shard, families);
+   }
+
+   pgexporter_art_destroy(families);
+
+   return status;
+}
+
+int
+pgexporter_shard_merge(char** data, size_t* size)
+{
+   int number_of_cursors;
+   int status;
+   struct shard_buffer buffer;
+   struct shard_cursor cursors[NUMBER_OF_SHARDS];
+
+   *data = NULL;
+   *size = 0;
+
+   memset(&buffer, 0, sizeof(struct shard_buffer));
+
+   number_of_cursors = open_cursors(&cursors[0]);
+   status = merge(&cursors[0], number_of_cursors, &snapshot_emit, &buffer);
+   close_cursors(&cursors[0], number_of_cursors);
+
+   if (status == 0 && buffer.length > 0)
+   {
+      status = buffer_append(&buffer, "", 1);
+   }
+
+   if (status)
+   {
+      free(buffer.data);
+      return 1;
+   }
+
+   *data = buffer.data;
+   *size = buffer.length > 0 ? buffer.length - 1 : 0;
+
+   return 0;
+}
+
+int
+pgexporter_shard_output(SSL* client_ssl, int client_fd)
+{
+   int number_of_cursors;
+   int status;
+   struct shard_cursor cursors[NUMBER_OF_SHARDS];
+   struct shard_output output;
+
+   memset(&output, 0, sizeof(struct shard_output));
+   output.ssl = client_ssl;
+   output.fd = client_fd;
+
+   if (pgexporter_http_respond_chunked_start(client_ssl, client_fd, "text/plain; version=0.0.1; charset=utf-8") != MESSAGE_STATUS_OK)
+   {
+      return 1;
+   }
+
+   number_of_cursors = open_cursors(&cursors[0]);
+
+   status = merge(&cursors[0], number_of_cursors, &output_emit, &output);
+   if (status == 0)
+   {
+      status = output_flush(&output);
+   }
+
+   close_cursors(&cursors[0], number_of_cursors);
+
+   return status;
+}
+
+int
+pgexporter_shard_snapshot(char* endpoint, struct prometheus_bridge* bridge)
+{
+   int status;
+   char* data = NULL;
+   size_t size = 0;
+
+   /* The parser works in place, so it gets a copy */
+   status = pgexporter_shard_merge(&data, &size);
+
+   if (status == 0 && data != NULL)
+   {
+      status = pgexporter_prometheus_client_parse(endpoint, data, bridge);
+   }
+
+   free(data);
+
+   return status;
+}
+
+static struct shard_fragment*
+fragment_of(int shard)
+{
+   return (struct shard_fragment*)shard_shmem + shard;
+}
+
+static char*
+buffer_of(int shard, int buffer)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   return (char*)shard_shmem + config->metrics_shards * sizeof(struct shard_fragment) +
+          (2 * (size_t)shard + buffer) * SHARD_FRAGMENT_SIZE;
+}
+
+/**
+ * Forget the connections of a previous shard process. They belonged to that
+ * process and were closed when it stopped
+ * @param servers The servers
+ */
+static void
+reset_servers(uint64_t servers)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int server = 0; server < config->number_of_servers; server++)
+   {
+      if (servers & ((uint64_t)1 << server))
+      {
+         config->servers[server].ssl = NULL;
+         config->servers[server].fd = -1;
+         config->servers[server].new = false;
+         config->servers[server].state = SERVER_UNKNOWN;
+      }
+   }
+}
+
+/**
+ * Group the metrics of a container by family
+ * @param container The container
+ * @param families The families
+ * @return 0 upon success, otherwise 1
+ */
+static int
+collect_families(prometheus_metrics_container_t* container, struct art* families)
+{
+   char* text = NULL;
+   struct art_iterator* iter = NULL;
+   struct art* trees[] = {
+      container->general_metrics,
+      container->server_metrics,
+      container->version_metrics,
+      container->uptime_metrics,
+      container->primary_metrics,
+      container->fips_metrics,
+      container->core_metrics,
+      container->extension_metrics,
+      container->extension_list_metrics,
+      container->settings_metrics,
+      container->custom_metrics,
+      container->alert_metrics};
+
+   for (size_t i = 0; i < sizeof(trees) / sizeof(trees[0]); i++)
+   {
+      if (trees[i] == NULL)
+      {
+         continue;
+      }
+
+      if (pgexporter_art_iterator_create(trees[i], &iter))
+      {
+         return 1;
+      }
+
+      while (pgexporter_art_iterator_next(iter))
+      {
+         if (pgexporter_prometheus_iterator_value(iter, &text) && text != NULL)
+         {
+            if (collect_text(text, families))
+            {
+               pgexporter_art_iterator_destroy(iter);
+               return 1;
+            }
+         }
+      }
+
+      pgexporter_art_iterator_destroy(iter);
+      iter = NULL;
+   }
+
+   return 0;
+}
+
+/**
+ * Group metrics in the Prometheus text format by family. A family starts
+ * with its #HELP / #TYPE lines, and the header of a family seen before
+ * isn't repeated
+ * @param text The metrics
+ * @param families The families
+ * @return 0 upon success, otherwise 1
+ */
+static int
+collect_text(char* text, struct art* families)
+{
+   char* line = text;
+   char* eol = NULL;
+   char* name = NULL;
+   size_t length;
+   size_t name_length;
+   struct shard_family* family = NULL;
+
+   while (*line != '\0')
+   {
+      eol = strchr(line, '\n');
+      length = eol != NULL ? (size_t)(eol - line) + 1 : strlen(line);
+
+      if (length > 1 && line[0] == '#')
+      {
+         name = line + 1;
+         while (*name == ' ')
+         {
+            name++;
+         }
+
+         if (!strncmp(name, "HELP ", 5) || !strncmp(name, "TYPE ", 5))
+         {
+            name += 5;
+            name_length = strcspn(name, " \n");
+
+            family = family_of(families, name, name_length);
+            if (family == NULL)
+            {
+               return 1;
+            }
+
+            /* The samples of the family were already seen */
+            if (family->body.length == 0 && buffer_append(&family->header, line, length))
+            {
+               return 1;
+            }
+         }
+      }
+      else if (length > 1 || (length == 1 && line[0] != '\n'))
+      {
+         if (family == NULL)
+         {
+            family = family_of(families, line, strcspn(line, "{ \n"));
+            if (family == NULL)
+            {
+               return 1;
+            }
+         }
+
+         if (buffer_append(&family->body, line, length) ||
+             (eol == NULL && buffer_append(&family->body, "\n", 1)))
+         {
+            return 1;
+         }
+      }
+
+      line += length;
+   }
+
+   return 0;
+}
+
+/**
+ * Get a family, and create it when it is new
+ * @param families The families
+ * @param name The name, not zero terminated
+ * @param length The length of the name
+ * @return The family, or NULL upon error
+ */
+static struct shard_family*
+family_of(struct art* families, char* name, size_t length)
+{
+   char key[PROMETHEUS_LENGTH * 2];
+   struct shard_family* family = NULL;
+   struct value_config vc = {.destroy_data = &family_destroy_cb,
+                             .to_string = &family_string_cb};
+
+   if (length == 0 || length >= sizeof(key))
+   {
+      return NULL;
+   }
+
+   memcpy(key, name, length);
+   key[length] = '\0';
+
+   family = (struct shard_family*)pgexporter_art_search(families, key);
+   if (family != NULL)
+   {
+      return family;
+   }
+
+   family = (struct shard_family*)malloc(sizeof(struct shard_family));
+   if (family == NULL)
+   {
+      return NULL;
+   }
+
+   memset(family, 0, sizeof(struct shard_family));
+   family->name = pgexporter_append(NULL, key);
+
+   if (pgexporter_art_insert_with_config(families, key, (uintptr_t)family, &vc))
+   {
+      family_destroy_cb((uintptr_t)family);
+      return NULL;
+   }
+
+   return family;
+}
+
+static int
+buffer_append(struct shard_buffer* buffer, char* data, size_t length)
+{
+   size_t capacity;
+   char* d = NULL;
+
+   if (buffer->length + length > buffer->capacity)
+   {
+      capacity = buffer->capacity > 0 ? buffer->capacity : 256;
+      while (capacity < buffer->length + length)
+      {
+         capacity *= 2;
+      }
+
+      d = (char*)realloc(buffer->data, capacity);
+      if (d == NULL)
+      {
+         return 1;
+      }
+
+      buffer->data = d;
+      buffer->capacity = capacity;
+   }
+
+   memcpy(buffer->data + buffer->length, data, length);
+   buffer->length += length;
+
+   return 0;
+}
+
+static int
+family_compare(const void* a, const void* b)
+{
+   struct shard_family* f1 = *(struct shard_family**)a;
+   struct shard_family* f2 = *(struct shard_family**)b;
+
+   return strcmp(f1->name, f2->name);
+}
+
+/**
+ * Render the families of a scrape as the records of a fragment
+ * @param families The families
+ * @param data The records
+ * @param size The size of the records
+ * @return 0 upon success, otherwise 1
+ */
+static int
+render(struct art* families, char** data, size_t* size)
+{
+   int count = 0;
+   size_t total = 0;
+   size_t offset = 0;
+   char* d = NULL;
+   struct shard_family** sorted = NULL;
+   struct shard_record record;
+   struct art_iterator* iter = NULL;
+
+   *data = NULL;
+   *size = 0;
+
+   if (families->size == 0)
+   {
+      return 0;
+   }
+
+   sorted = (struct shard_family**)malloc(families->size * sizeof(struct shard_family*));
+   if (sorted == NULL)
+   {
+      goto error;
+   }
+
+   if (pgexporter_art_iterator_create(families, &iter))
+   {
+      goto error;
+   }
+
+   while (pgexporter_art_iterator_next(iter))
+   {
+      struct shard_family* family = (struct shard_family*)iter->value->data;
+
+      if (family->body.length == 0)
+      {
+         continue;
+      }
+
+      sorted[count++] = family;
+      total += SHARD_ALIGN(sizeof(struct shard_record) + strlen(family->name) + 1 +
+                           family->header.length + 1 + family->body.length + 1);
+   }
+
+   pgexporter_art_iterator_destroy(iter);
+   iter = NULL;
+
+   /* The readers merge the shards by name */
+   qsort(sorted, count, sizeof(struct shard_family*), &family_compare);
+
+   d = (char*)calloc(1, total > 0 ? total : 1);
+   if (d == NULL)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < count; i++)
+   {
+      record.name = strlen(sorted[i]->name);
+      record.header = sorted[i]->header.length;
+      record.body = sorted[i]->body.length;
+      record.length = SHARD_ALIGN(sizeof(struct shard_record) + record.name + 1 + record.header + 1 + record.body + 1);
+
+      memcpy(d + offset, &record, sizeof(struct shard_record));
+      memcpy(d + offset + sizeof(struct shard_record), sorted[i]->name, record.name);
+      if (record.header > 0)
+      {
+         memcpy(d + offset + sizeof(struct shard_record) + record.name + 1, sorted[i]->header.data, record.header);
+      }
+      memcpy(d + offset + sizeof(struct shard_record) + record.name + 1 + record.header + 1, sorted[i]->body.data, record.body);
+
+      offset += record.length;
+   }
+
+   free(sorted);
+
+   *data = d;
+   *size = total;
+
+   return 0;
+
+error:
+
+   pgexporter_art_iterator_destroy(iter);
+   free(sorted);
+   free(d);
+
+   return 1;
+}
+
+/**
+ * Render and publish the families of a scrape
+ * @param shard The shard
+ * @param families The families
+ * @return 0 upon success, otherwise 1
+ */
+static int
+publish_families(int shard, struct art* families)
+{
+   int status;
+   char* data = NULL;
+   size_t size = 0;
+
+   if (render(families, &data, &size))
+   {
+      return 1;
+   }
+
+   status = publish(shard, data, size);
+
+   free(data);
+
+   return status;
+}
+
+/**
+ * Publish the records of a scrape in the fragment of the shard. The
+ * buffer is only taken over once its readers are gone
+ * @param shard The shard
+ * @param data The records
+ * @param size The size of the records
+ * @return 0 upon success, otherwise 1
+ */
+static int
+publish(int shard, char* data, size_t size)
+{
+   int active;
+   int next;
+   struct shard_fragment* fragment = fragment_of(shard);
+
+   if (size > SHARD_FRAGMENT_SIZE)
+   {
+      return 1;
+   }
+
+   active = atomic_load(&fragment->active);
+   next = active == 0 ? 1 : 0;
+
+   /* A live reader keeps the buffer, and the current metrics stay active */
+   if (!wait_for_readers(fragment, next))
+   {
+      pgexporter_log_warn("Shard %d: the previous metrics are still read", shard);
+      return 1;
+   }
+
+   if (size > 0)
+   {
+      memcpy(buffer_of(shard, next), data, size);
+   }
+   fragment->size[next] = size;
+
+   atomic_store(&fragment->active, next);
+   atomic_store(&fragment->updated, (long long)time(NULL));
+
+   return 0;
+}
+
+/**
+ * Wait for the readers of a buffer. The slots of readers that died
+ * are freed
+ * @param fragment The fragment
+ * @param buffer The buffer
+ * @return true if the buffer has no readers, false after SHARD_PUBLISH_TIMEOUT
+ */
+static bool
+wait_for_readers(struct shard_fragment* fragment, int buffer)
+{
+   int pid;
+   bool busy;
+
+   for (int waited = 0; waited < SHARD_PUBLISH_TIMEOUT; waited++)
+   {
+      busy = false;
+
+      for (int i = 0; i < SHARD_READERS; i++)
+      {
+         pid = atomic_load(&fragment->readers[buffer][i]);
+         if (pid == 0)
+         {
+            continue;
+         }
+
+         if (kill((pid_t)pid, 0) == -1 && errno == ESRCH)
+         {
+            atomic_compare_exchange_strong(&fragment->readers[buffer][i], &pid, 0);
+            continue;
+         }
+
+         busy = true;
+      }
+
+      if (!busy)
+      {
+         return true;
+      }
+
+      SLEEP(1000000L);
+   }
+
+   return false;
+}
+
+/**
+ * Start reading all fragments that have metrics
+ * @param cursors The cursors, one per shard
+ * @return The number of cursors
+ */
+static int
+open_cursors(struct shard_cursor* cursors)
+{
+   int number_of_cursors = 0;
+   int buffer;
+   int slot;
+   struct shard_fragment* fragment = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < config->metrics_shards; i++)
+   {
+      fragment = fragment_of(i);
+      buffer = acquire(fragment, &slot);
+
+      if (buffer == -1)
+      {
+         pgexporter_log_debug("Shard %d: no metrics yet", i);
+         continue;
+      }
+
+      cursors[number_of_cursors].fragment = fragment;
+      cursors[number_of_cursors].buffer = buffer;
+      cursors[number_of_cursors].slot = slot;
+      cursors[number_of_cursors].p = buffer_of(i, buffer);
+      cursors[number_of_cursors].end = cursors[number_of_cursors].p + fragment->size[buffer];
+      number_of_cursors++;
+   }
+
+   return number_of_cursors;
+}
+
+static void
+close_cursors(struct shard_cursor* cursors, int number_of_cursors)
+{
+   for (int i = 0; i < number_of_cursors; i++)
+   {
+      release(cursors[i].fragment, cursors[i].buffer, cursors[i].slot);
+   }
+}
+
+/**
+ * Start reading a fragment
+ * @param fragment The fragment
+ * @param slot The reader slot
+ * @return The buffer to read, or -1 if there is nothing to read
+ */
+static int
+acquire(struct shard_fragment* fragment, int* slot)
+{
+   int buffer;
+   int free_slot;
+   int pid = (int)getpid();
+
+   for (;;)
+   {
+      buffer = atomic_load(&fragment->active);
+      if (buffer == -1)
+      {
+         return -1;
+      }
+
+      *slot = -1;
+      for (int i = 0; i < SHARD_READERS && *slot == -1; i++)
+      {
+         free_slot = 0;
+         if (atomic_compare_exchange_strong(&fragment->readers[buffer][i], &free_slot, pid))
+         {
+            *slot = i;
+         }
+      }
+
+      if (*slot == -1)
+      {
+         /* All slots are taken, so wait for a reader to finish */
+         SLEEP(1000000L);
+         continue;
+      }
+
+      /* The shard didn't switch over in the meantime */
+      if (atomic_load(&fragment->active) == buffer)
+      {
+         return buffer;
+      }
+
+      atomic_store(&fragment->readers[buffer][*slot], 0);
+   }
+}
+
+static void
+release(struct shard_fragment* fragment, int buffer, int slot)
+{
+   atomic_store(&fragment->readers[buffer][slot], 0);
+}
+
+/**
+ * Merge the families of the fragments by name. The header of a family
+ * is emitted once, followed by the samples of every shard
+ * @param cursors The fragments
+ * @param number_of_cursors The number of fragments
+ * @param emit The callback for each piece
+ * @param userdata The data of the callback
+ * @return 0 upon success, otherwise 1
+ */
+static int
+merge(struct shard_cursor* cursors, int number_of_cursors, shard_emit_cb emit, void* userdata)
+{
+   char* name = NULL;
+   char* n = NULL;
+   bool header;
+   struct shard_record* record = NULL;
+
+   for (;;)
+   {
+      name = NULL;
+
+      for (int i = 0; i < number_of_cursors; i++)
+      {
+         if (cursors[i].p >= cursors[i].end)
+         {
+            continue;
+         }
+
+         n = cursors[i].p + sizeof(struct shard_record);
+         if (name == NULL || strcmp(n, name) < 0)
+         {
+            name = n;
+         }
+      }
+
+      if (name == NULL)
+      {
+         break;
+      }
+
+      header = false;
+
+      for (int i = 0; i < number_of_cursors; i++)
+      {
+         if (cursors[i].p >= cursors[i].end)
+         {
+            continue;
+         }
+
+         record = (struct shard_record*)cursors[i].p;
+         n = cursors[i].p + sizeof(struct shard_record);
+
+         if (n != name && strcmp(n, name))
+         {
+            continue;
+         }
+
+         if (!header && record->header > 0)
+         {
+            if (emit(userdata, n + record->name + 1, record->header))
+            {
+               return 1;
+            }
+            header = true;
+         }
+
+         if (emit(userdata, n + record->name + 1 + record->header + 1, record->body))
+         {
+            return 1;
+         }
+
+         cursors[i].p += record->length;
+      }
+   }
+
+   return 0;
+}
+
+static int
+output_emit(void* userdata, char* data, size_t length)
+{
+   struct shard_output* output = (struct shard_output*)userdata;
+
+   if (length == 0)
+   {
+      return 0;
+   }
+
+   if (output->count == HTTP_SERVER_CHUNK_PIECES && output_flush(output))
+   {
+      return 1;
+   }
+
+   output->iov[output->count].iov_base = data;
+   output->iov[output->count].iov_len = length;
+   output->count++;
+
+   return 0;
+}
+
+static int
+output_flush(struct shard_output* output)
+{
+   int status = 0;
+
+   if (output->count > 0)
+   {
+      status = pgexporter_http_respond_chunked_writev(output->ssl, output->fd, &output->iov[0], output->count) != MESSAGE_STATUS_OK;
+      output->count = 0;
+   }
+
+   return status;
+}
+
+static int
+snapshot_emit(void* userdata, char* data, size_t length)
+{
+   struct shard_buffer* buffer = (struct shard_buffer*)userdata;
+
+   return buffer_append(buffer, data, length);
+}
+
+static void
+family_destroy_cb(uintptr_t data)
+{
+   struct shard_family* family = (struct shard_family*)data;
+
+   if (family != NULL)
+   {
+      free(family->name);
+      free(family->header.data);
+      free(family->body.data);
+      free(family);
+   }
+}
+
+static char*
+family_string_cb(uintptr_t data, int32_t format __attribute__((unused)), char* tag __attribute__((unused)), int indent __attribute__((unused)))
+{
+   struct shard_family* family = (struct shard_family*)data;
+
+   return pgexporter_append(NULL, family != NULL ? family->name : "");
+}
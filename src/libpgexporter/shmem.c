@@ -39,6 +39,12 @@ void* shmem = NULL;
 void* prometheus_cache_shmem = NULL;
 void* bridge_cache_shmem = NULL;
 void* bridge_json_cache_shmem = NULL;
+void* tls_session_shmem = NULL;
+void* shard_shmem = NULL;
+void* derive_shmem = NULL;
+void* slice_shmem = NULL;
+void* activity_shmem = NULL;
+void* console_shmem = NULL;
 
 int
 pgexporter_create_shared_memory(size_t size, unsigned char hp, void** shmem)
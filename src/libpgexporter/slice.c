@@ -0,0 +1,583 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <derive.h>
+#include <logging.h>
+#include <queries.h>
+#include <shmem.h>
+#include <slice.h>
+#include <utils.h>
+
+/* system */
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int slice_entries(void);
+static struct slice_entry* slice_find(struct slice_table* table, uint64_t key);
+static struct slice_entry* slice_take(struct slice_table* table, uint64_t key, int slices);
+static struct tuple* slice_rows(struct slice_entry* entry, int exclude, char* rows, size_t* size);
+static void slice_lock(struct slice_table* table);
+static void slice_unlock(struct slice_table* table);
+
+int
+pgexporter_slice_init(size_t* p_size, void** p_shmem)
+{
+   int number_of_entries;
+   size_t size;
+   struct slice_table* table = NULL;
+   void* s = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *p_size = 0;
+   *p_shmem = NULL;
+
+   /* Nothing is kept until a metric is sliced */
+   number_of_entries = slice_entries();
+   if (number_of_entries == 0)
+   {
+      return 0;
+   }
+
+   size = sizeof(struct slice_table) + number_of_entries * sizeof(struct slice_entry);
+
+   if (pgexporter_create_shared_memory(size, config->hugepage, &s))
+   {
+      return 1;
+   }
+
+   /* The mapping is zeroed, so every entry starts out free */
+   table = (struct slice_table*)s;
+   atomic_init(&table->lock, STATE_FREE);
+   table->number_of_entries = number_of_entries;
+
+   *p_size = size;
+   *p_shmem = s;
+
+   return 0;
+}
+
+int
+pgexporter_slice_resize(size_t* p_size, void** p_shmem)
+{
+   size_t size = 0;
+   void* s = NULL;
+   struct slice_table* table = (struct slice_table*)*p_shmem;
+
+   if (slice_entries() <= (table != NULL ? table->number_of_entries : 0))
+   {
+      return 0;
+   }
+
+   if (pgexporter_slice_init(&size, &s))
+   {
+      return 1;
+   }
+
+   pgexporter_log_debug("Slice: %d entries", ((struct slice_table*)s)->number_of_entries);
+
+   if (table != NULL)
+   {
+      pgexporter_destroy_shared_memory(*p_shmem, *p_size);
+   }
+
+   *p_size = size;
+   *p_shmem = s;
+
+   return 0;
+}
+
+int
+pgexporter_slice_validate(int slices, int derive, char* query)
+{
+   if (slices < 0 || slices > SLICE_MAX)
+   {
+      return 1;
+   }
+
+   if (slices > 1)
+   {
+      /* The rows of a slice are older than the scrape, so a rate of them is meaningless */
+      if (derive != DERIVE_NONE)
+      {
+         return 1;
+      }
+
+      if (query == NULL || strstr(query, "{slice}") == NULL)
+      {
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+uint64_t
+pgexporter_slice_key(char* tag, char* server, char* database)
+{
+   uint64_t key;
+
+   key = pgexporter_derive_hash(0, tag);
+   key = pgexporter_derive_hash(key, server);
+   key = pgexporter_derive_hash(key, database != NULL ? database : "");
+
+   /* 0 marks a free entry */
+   if (key == 0)
+   {
+      key = 1;
+   }
+
+   return key;
+}
+
+int
+pgexporter_slice_next(uint64_t key, int slices)
+{
+   struct slice_table* table = (struct slice_table*)slice_shmem;
+   struct slice_entry* entry = NULL;
+   int slice = 0;
+
+   if (table == NULL || slices <= 1)
+   {
+      return 0;
+   }
+
+   slice_lock(table);
+
+   entry = slice_find(table, key);
+   if (entry != NULL && entry->slices == slices)
+   {
+      slice = entry->cursor;
+   }
+
+   slice_unlock(table);
+
+   return slice;
+}
+
+char*
+pgexporter_slice_query(char* query, int slices, int slice)
+{
+   char* result = NULL;
+   char* segment = NULL;
+   char* p = query;
+   char* open = NULL;
+
+   while ((open = strchr(p, '{')) != NULL)
+   {
+      segment = strndup(p, open - p);
+      result = pgexporter_append(result, segment);
+      free(segment);
+
+      if (!strncmp(open, "{slices}", 8))
+      {
+         result = pgexporter_append_int(result, slices);
+         p = open + 8;
+      }
+      else if (!strncmp(open, "{slice}", 7))
+      {
+         result = pgexporter_append_int(result, slice);
+         p = open + 7;
+      }
+      else
+      {
+         result = pgexporter_append_char(result, '{');
+         p = open + 1;
+      }
+   }
+
+   result = pgexporter_append(result, p);
+
+   return result;
+}
+
+int
+pgexporter_slice_merge(uint64_t key, int slices, int slice, struct query* query)
+{
+   struct slice_table* table = (struct slice_table*)slice_shmem;
+   struct slice_entry* entry = NULL;
+   struct tuple* cached = NULL;
+   struct tuple* current = NULL;
+   char* rows = NULL;
+   size_t size = 0;
+   size_t length = 0;
+   int32_t header[2];
+   int32_t column_length;
+   bool full = false;
+
+   if (table == NULL || query == NULL)
+   {
+      return 1;
+   }
+
+   rows = (char*)malloc(SLICE_ENTRY_SIZE);
+   if (rows == NULL)
+   {
+      return 1;
+   }
+
+   slice_lock(table);
+
+   entry = slice_take(table, key, slices);
+
+   if (entry->number_of_columns != query->number_of_columns)
+   {
+      entry->number_of_columns = query->number_of_columns;
+      entry->size = 0;
+   }
+
+   memcpy(entry->names, query->names, sizeof(entry->names));
+   memcpy(entry->type_oids, query->type_oids, sizeof(entry->type_oids));
+
+   /* Keep the rows of the other slices, and serve them again */
+   cached = slice_rows(entry, slice, rows, &size);
+
+   /* Then the fresh rows of the slice */
+   for (current = query->tuples; current != NULL; current = current->next)
+   {
+      length = sizeof(header);
+      for (int i = 0; i < query->number_of_columns; i++)
+      {
+         length += sizeof(int32_t) + (current->data[i] != NULL ? strlen(current->data[i]) : 0);
+      }
+
+      if (size + length > SLICE_ENTRY_SIZE)
+      {
+         /* Served now, but not kept for the next scrapes */
+         full = true;
+         continue;
+      }
+
+      header[0] = slice;
+      header[1] = current->server;
+      memcpy(rows + size, header, sizeof(header));
+      size += sizeof(header);
+
+      for (int i = 0; i < query->number_of_columns; i++)
+      {
+         column_length = current->data[i] != NULL ? (int32_t)strlen(current->data[i]) : -1;
+         memcpy(rows + size, &column_length, sizeof(int32_t));
+         size += sizeof(int32_t);
+
+         if (column_length > 0)
+         {
+            memcpy(rows + size, current->data[i], column_length);
+            size += column_length;
+         }
+      }
+   }
+
+   memcpy(entry->data, rows, size);
+   entry->size = size;
+   entry->cursor = (slice + 1) % slices;
+   entry->used = ++table->clock;
+
+   slice_unlock(table);
+
+   if (full)
+   {
+      pgexporter_log_debug("Slice %d of %s doesn't fit in %d bytes", slice, query->tag, SLICE_ENTRY_SIZE);
+   }
+
+   if (query->tuples == NULL)
+   {
+      query->tuples = cached;
+   }
+   else
+   {
+      current = query->tuples;
+      while (current->next != NULL)
+      {
+         current = current->next;
+      }
+      current->next = cached;
+   }
+
+   free(rows);
+
+   return 0;
+}
+
+int
+pgexporter_slice_skip(uint64_t key, int slices, int slice, char* tag, struct query** query)
+{
+   struct slice_table* table = (struct slice_table*)slice_shmem;
+   struct slice_entry* entry = NULL;
+   struct query* q = NULL;
+   bool known = false;
+
+   *query = NULL;
+
+   if (table == NULL || slices <= 1)
+   {
+      return 1;
+   }
+
+   slice_lock(table);
+
+   /* A slice that keeps failing doesn't hold the others back */
+   entry = slice_take(table, key, slices);
+   entry->cursor = (slice + 1) % slices;
+   entry->used = ++table->clock;
+
+   known = entry->size > 0 && entry->number_of_columns > 0;
+   if (known)
+   {
+      q = (struct query*)malloc(sizeof(struct query));
+      if (q != NULL)
+      {
+         memset(q, 0, sizeof(struct query));
+
+         memcpy(q->tag, tag, MIN(PROMETHEUS_LENGTH - 1, strlen(tag)));
+         memcpy(q->names, entry->names, sizeof(q->names));
+         memcpy(q->type_oids, entry->type_oids, sizeof(q->type_oids));
+         q->number_of_columns = entry->number_of_columns;
+         q->tuples = slice_rows(entry, -1, NULL, NULL);
+      }
+   }
+
+   slice_unlock(table);
+
+   if (known && q == NULL)
+   {
+      return 1;
+   }
+
+   *query = q;
+
+   return 0;
+}
+
+/**
+ * Get the number of entries for the sliced metrics of the servers
+ * @return The number of entries, or 0 when no metric is sliced
+ */
+static int
+slice_entries(void)
+{
+   int sliced = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < config->number_of_metrics; i++)
+   {
+      if (config->prometheus[i].slices > 1)
+      {
+         sliced++;
+      }
+   }
+
+   for (int i = 0; i < config->number_of_extensions; i++)
+   {
+      for (int j = 0; j < config->extensions[i].number_of_metrics; j++)
+      {
+         if (config->extensions[i].metrics[j].slices > 1)
+         {
+            sliced++;
+         }
+      }
+   }
+
+   if (sliced == 0)
+   {
+      return 0;
+   }
+
+   return MAX(SLICE_NUMBER_OF_ENTRIES, sliced * config->number_of_servers);
+}
+
+static struct slice_entry*
+slice_find(struct slice_table* table, uint64_t key)
+{
+   for (int i = 0; i < table->number_of_entries; i++)
+   {
+      if (table->entries[i].key == key)
+      {
+         return &table->entries[i];
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Get the entry of a sliced result. When there is none, the least
+ * recently merged entry is taken over
+ * @param table The table
+ * @param key The key
+ * @param slices The number of slices
+ * @return The entry
+ */
+static struct slice_entry*
+slice_take(struct slice_table* table, uint64_t key, int slices)
+{
+   struct slice_entry* entry = NULL;
+
+   entry = slice_find(table, key);
+   if (entry == NULL)
+   {
+      for (int i = 0; i < table->number_of_entries; i++)
+      {
+         if (entry == NULL || table->entries[i].used < entry->used)
+         {
+            entry = &table->entries[i];
+         }
+      }
+
+      /* The slices of that result start over, so its rows go stale */
+      if (entry->key != 0)
+      {
+         pgexporter_log_warn("Slice: all %d entries are taken, a sliced result starts over (database wide metrics need an entry per database)",
+                             table->number_of_entries);
+      }
+
+      entry->key = 0;
+   }
+
+   if (entry->key != key || entry->slices != slices)
+   {
+      entry->key = key;
+      entry->slices = slices;
+      entry->cursor = 0;
+      entry->number_of_columns = 0;
+      entry->size = 0;
+   }
+
+   return entry;
+}
+
+/**
+ * Decode the rows of an entry
+ * @param entry The entry
+ * @param exclude The slice to leave out, or -1 for none
+ * @param rows The buffer for the encoded rows that are kept, or NULL
+ * @param size The size of the encoded rows that are kept, or NULL
+ * @return The rows
+ */
+static struct tuple*
+slice_rows(struct slice_entry* entry, int exclude, char* rows, size_t* size)
+{
+   struct tuple* cached = NULL;
+   struct tuple* last = NULL;
+   struct tuple* current = NULL;
+   size_t offset = 0;
+   size_t start = 0;
+   int32_t header[2];
+   int32_t column_length;
+
+   while (offset < entry->size)
+   {
+      start = offset;
+      current = NULL;
+
+      memcpy(header, entry->data + offset, sizeof(header));
+      offset += sizeof(header);
+
+      if (header[0] != exclude)
+      {
+         current = (struct tuple*)malloc(sizeof(struct tuple));
+         memset(current, 0, sizeof(struct tuple));
+
+         current->server = header[1];
+         current->data = (char**)malloc(entry->number_of_columns * sizeof(char*));
+      }
+
+      for (int i = 0; i < entry->number_of_columns; i++)
+      {
+         memcpy(&column_length, entry->data + offset, sizeof(int32_t));
+         offset += sizeof(int32_t);
+
+         if (current != NULL)
+         {
+            current->data[i] = NULL;
+
+            if (column_length >= 0)
+            {
+               current->data[i] = (char*)malloc(column_length + 1);
+               memcpy(current->data[i], entry->data + offset, column_length);
+               current->data[i][column_length] = '\0';
+            }
+         }
+
+         if (column_length > 0)
+         {
+            offset += column_length;
+         }
+      }
+
+      if (current != NULL)
+      {
+         if (rows != NULL)
+         {
+            memcpy(rows + *size, entry->data + start, offset - start);
+            *size += offset - start;
+         }
+
+         if (cached == NULL)
+         {
+            cached = current;
+         }
+         else
+         {
+            last->next = current;
+         }
+         last = current;
+      }
+   }
+
+   return cached;
+}
+
+static void
+slice_lock(struct slice_table* table)
+{
+   signed char lock_free;
+
+   while (true)
+   {
+      lock_free = STATE_FREE;
+      if (atomic_compare_exchange_strong(&table->lock, &lock_free, STATE_IN_USE))
+      {
+         return;
+      }
+
+      SLEEP(1000L);
+   }
+}
+
+static void
+slice_unlock(struct slice_table* table)
+{
+   atomic_store(&table->lock, STATE_FREE);
+}
@@ -37,6 +37,8 @@
 #include <status.h>
 #include <utils.h>
 
+static void server_statistics(struct server_statistics* statistics, time_t now, struct json* js);
+
 void
 pgexporter_status(SSL* ssl __attribute__((unused)), int client_fd, uint8_t compression, uint8_t encryption, struct json* payload)
 {
@@ -127,6 +129,7 @@ pgexporter_status_details(SSL* ssl __attribute__((unused)), int client_fd, uint8
    struct json* servers = NULL;
    struct configuration* config;
    bool openssl_fips = false;
+   time_t now;
 
    pgexporter_memory_init();
    pgexporter_start_logging();
@@ -134,6 +137,7 @@ pgexporter_status_details(SSL* ssl __attribute__((unused)), int client_fd, uint8
    config = (struct configuration*)shmem;
 
    start_time = time(NULL);
+   now = start_time;
 
    if (pgexporter_management_create_response(payload, -1, &response))
    {
@@ -160,6 +164,8 @@ pgexporter_status_details(SSL* ssl __attribute__((unused)), int client_fd, uint8
       pgexporter_fips_server(i, &pg_fips);
       pgexporter_json_put(js, MANAGEMENT_ARGUMENT_FIPS, (uintptr_t)pg_fips, ValueBool);
 
+      server_statistics(&config->servers[i].statistics, now, js);
+
       pgexporter_json_append(servers, (uintptr_t)js, ValueJSON);
    }
 
@@ -202,3 +208,24 @@ error:
 
    exit(1);
 }
+
+static void
+server_statistics(struct server_statistics* statistics, time_t now, struct json* js)
+{
+   int64_t discovery;
+
+   discovery = (int64_t)atomic_load(&statistics->discovery);
+
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_SCRAPES, (uintptr_t)atomic_load(&statistics->scrapes), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_FAILED_SCRAPES, (uintptr_t)atomic_load(&statistics->failed_scrapes), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_LAST_SCRAPE, (uintptr_t)atomic_load(&statistics->last_scrape), ValueInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_LAST_SCRAPE_DURATION, (uintptr_t)(atomic_load(&statistics->last_scrape_duration) / 1000), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_LAST_SUCCESS, (uintptr_t)atomic_load(&statistics->last_success), ValueInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_QUERIES, (uintptr_t)atomic_load(&statistics->queries), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_QUERY_ERRORS, (uintptr_t)atomic_load(&statistics->query_errors), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_BYTES_RECEIVED, (uintptr_t)atomic_load(&statistics->bytes_received), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_CONNECTIONS, (uintptr_t)atomic_load(&statistics->connections), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_CONNECTIONS_REUSED, (uintptr_t)atomic_load(&statistics->connections_reused), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_CONNECTION_ERRORS, (uintptr_t)atomic_load(&statistics->connection_errors), ValueUInt64);
+   pgexporter_json_put(js, MANAGEMENT_ARGUMENT_DISCOVERY_AGE, (uintptr_t)(discovery > 0 ? (int64_t)difftime(now, (time_t)discovery) : -1), ValueInt64);
+}
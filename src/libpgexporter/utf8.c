@@ -35,6 +35,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 /**
  * Validates a single UTF-8 sequence (1-4 bytes) according to RFC 3629.
@@ -195,6 +200,13 @@ pgexporter_utf8_valid(const unsigned char* buf, size_t len)
 
    while (i < len)
    {
+      /* Skip the ASCII runs a vector at a time */
+      i += pgexporter_ascii_length(&buf[i], len - i);
+      if (i == len)
+      {
+         break;
+      }
+
       /* Get expected sequence length */
       int seq_length = pgexporter_utf8_sequence_length(buf[i]);
 
@@ -237,9 +249,19 @@ pgexporter_utf8_char_length(const unsigned char* buf, size_t len)
 {
    size_t count = 0;
    size_t i = 0;
+   size_t ascii;
 
    while (i < len)
    {
+      /* Every ASCII byte is a character */
+      ascii = pgexporter_ascii_length(&buf[i], len - i);
+      i += ascii;
+      count += ascii;
+      if (i == len)
+      {
+         break;
+      }
+
       /* Get expected sequence length */
       int seq_length = pgexporter_utf8_sequence_length(buf[i]);
 
@@ -280,12 +302,101 @@ pgexporter_utf8_char_length(const unsigned char* buf, size_t len)
 bool
 pgexporter_is_ascii(const char* str, size_t len)
 {
-   for (size_t i = 0; i < len; i++)
+   return pgexporter_ascii_length((const unsigned char*)str, len) == len;
+}
+
+/**
+ * Get the length of the ASCII prefix of a byte buffer. Looks at 16 bytes
+ * at a time with SSE2 or NEON, and at 8 bytes at a time otherwise.
+ *
+ * @param buf pointer to the byte buffer
+ * @param len length of the buffer in bytes
+ * @return the number of bytes before the first non-ASCII byte
+ */
+size_t
+pgexporter_ascii_length(const unsigned char* buf, size_t len)
+{
+   size_t i = 0;
+   uint64_t word;
+
+#if defined(__SSE2__)
+   for (; i + 16 <= len; i += 16)
    {
-      if ((unsigned char)str[i] > 127)
+      int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)&buf[i]));
+
+      if (mask != 0)
       {
-         return false;
+         return i + (size_t)__builtin_ctz((unsigned int)mask);
       }
    }
-   return true;
+#elif defined(__aarch64__)
+   for (; i + 16 <= len; i += 16)
+   {
+      if (vmaxvq_u8(vld1q_u8(&buf[i])) >= 0x80)
+      {
+         /* The word loop finds the byte */
+         break;
+      }
+   }
+#endif
+
+   for (; i + 8 <= len; i += 8)
+   {
+      memcpy(&word, &buf[i], sizeof(word));
+
+      if (word & 0x8080808080808080ULL)
+      {
+         break;
+      }
+   }
+
+   for (; i < len; i++)
+   {
+      if (buf[i] >= 0x80)
+      {
+         break;
+      }
+   }
+
+   return i;
+}
+
+/**
+ * Replace the bytes that aren't part of a valid UTF-8 sequence with '?'.
+ * The buffer keeps its length, and a byte that follows an invalid one
+ * can start a valid sequence.
+ *
+ * @param buf pointer to the byte buffer
+ * @param len length of the buffer in bytes
+ * @return the number of bytes replaced
+ */
+size_t
+pgexporter_utf8_sanitize(unsigned char* buf, size_t len)
+{
+   size_t i = 0;
+   size_t replaced = 0;
+   int seq_length;
+
+   while (i < len)
+   {
+      i += pgexporter_ascii_length(&buf[i], len - i);
+      if (i == len)
+      {
+         break;
+      }
+
+      seq_length = pgexporter_utf8_sequence_length(buf[i]);
+
+      if (seq_length < 0 || i + seq_length > len || !pgexporter_utf8_sequence_valid(&buf[i], seq_length))
+      {
+         buf[i] = '?';
+         replaced++;
+         i++;
+         continue;
+      }
+
+      i += seq_length;
+   }
+
+   return replaced;
 }
\ No newline at end of file
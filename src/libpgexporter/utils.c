@@ -38,6 +38,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <math.h>
 #include <pwd.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -79,6 +80,8 @@ static int string_compare(const void* a, const void* b);
 
 static bool is_wal_file(char* file);
 
+static unsigned long directory_size(int fd);
+
 int32_t
 pgexporter_get_request(struct message* msg)
 {
@@ -1000,77 +1003,15 @@ pgexporter_compare_string(const char* str1, const char* str2)
 unsigned long
 pgexporter_directory_size(char* directory)
 {
-   unsigned long total_size = 0;
-   DIR* dir;
-   struct dirent* entry;
-   char* p = NULL;
-   struct stat st;
-   unsigned long l;
+   int fd;
 
-   if (!(dir = opendir(directory)))
+   fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (fd == -1)
    {
-      return total_size;
-   }
-
-   while ((entry = readdir(dir)) != NULL)
-   {
-      if (entry->d_type == DT_DIR)
-      {
-         char path[1024];
-
-         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-         {
-            continue;
-         }
-
-         snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
-
-         total_size += pgexporter_directory_size(path);
-      }
-      else if (entry->d_type == DT_REG)
-      {
-         p = NULL;
-         p = pgexporter_vappend(p, 3,
-                                directory,
-                                "/",
-                                entry->d_name);
-
-         memset(&st, 0, sizeof(struct stat));
-
-         stat(p, &st);
-
-         l = st.st_size / st.st_blksize;
-
-         if (st.st_size % st.st_blksize != 0)
-         {
-            l += 1;
-         }
-
-         total_size += (l * st.st_blksize);
-
-         free(p);
-      }
-      else if (entry->d_type == DT_LNK)
-      {
-         p = NULL;
-         p = pgexporter_vappend(p, 3,
-                                directory,
-                                "/",
-                                entry->d_name);
-
-         memset(&st, 0, sizeof(struct stat));
-
-         stat(p, &st);
-
-         total_size += st.st_blksize;
-
-         free(p);
-      }
+      return 0;
    }
 
-   closedir(dir);
-
-   return total_size;
+   return directory_size(fd);
 }
 
 int
@@ -1866,6 +1807,23 @@ pgexporter_ends_with(char* str, char* suffix)
    return (str_len >= suffix_len) && (strcmp(str + (str_len - suffix_len), suffix) == 0);
 }
 
+uint64_t
+pgexporter_hash_string(uint64_t hash, const char* str)
+{
+   if (hash == 0)
+   {
+      hash = 14695981039346656037ULL;
+   }
+
+   for (const unsigned char* p = (const unsigned char*)str; *p != '\0'; p++)
+   {
+      hash ^= *p;
+      hash *= 1099511628211ULL;
+   }
+
+   return hash;
+}
+
 void
 pgexporter_sort(size_t size, char** array)
 {
@@ -2377,6 +2335,71 @@ is_wal_file(char* file)
    return true;
 }
 
+static unsigned long
+directory_size(int fd)
+{
+   unsigned long total_size = 0;
+   unsigned long l;
+   int child;
+   DIR* dir;
+   struct dirent* entry;
+   struct stat st;
+
+   /* Relative to the directory, so no path is built for the entries */
+   if (!(dir = fdopendir(fd)))
+   {
+      close(fd);
+      return total_size;
+   }
+
+   while ((entry = readdir(dir)) != NULL)
+   {
+      if (entry->d_type == DT_DIR)
+      {
+         if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+         {
+            continue;
+         }
+
+         child = openat(dirfd(dir), entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+         if (child != -1)
+         {
+            total_size += directory_size(child);
+         }
+      }
+      else if (entry->d_type == DT_REG)
+      {
+         memset(&st, 0, sizeof(struct stat));
+
+         fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW);
+
+         if (st.st_blksize > 0)
+         {
+            l = st.st_size / st.st_blksize;
+
+            if (st.st_size % st.st_blksize != 0)
+            {
+               l += 1;
+            }
+
+            total_size += (l * st.st_blksize);
+         }
+      }
+      else if (entry->d_type == DT_LNK)
+      {
+         memset(&st, 0, sizeof(struct stat));
+
+         fstatat(dirfd(dir), entry->d_name, &st, 0);
+
+         total_size += st.st_blksize;
+      }
+   }
+
+   closedir(dir);
+
+   return total_size;
+}
+
 int
 pgexporter_resolve_path(char* orig_path, char** new_path)
 {
@@ -2831,6 +2854,95 @@ pgexporter_is_valid_metric_name(char* name)
    return true;
 }
 
+int
+pgexporter_parse_buckets(char* str, double* buckets, int* n_buckets)
+{
+   char* p = NULL;
+   char* end = NULL;
+   double bound;
+   int n = 0;
+
+   *n_buckets = 0;
+
+   if (str == NULL)
+   {
+      return 1;
+   }
+
+   p = str;
+
+   while (*p != '\0')
+   {
+      while (*p == ' ' || *p == ',' || *p == '\t')
+      {
+         p++;
+      }
+
+      if (*p == '\0')
+      {
+         break;
+      }
+
+      errno = 0;
+      bound = strtod(p, &end);
+
+      if (end == p || errno != 0 || !isfinite(bound))
+      {
+         return 1;
+      }
+
+      if (n >= MAX_NUMBER_OF_BUCKETS || (n > 0 && bound <= buckets[n - 1]))
+      {
+         return 1;
+      }
+
+      buckets[n++] = bound;
+      p = end;
+
+      while (*p == ' ' || *p == '\t')
+      {
+         p++;
+      }
+
+      if (*p != ',' && *p != '\0')
+      {
+         return 1;
+      }
+   }
+
+   if (n == 0)
+   {
+      return 1;
+   }
+
+   *n_buckets = n;
+
+   return 0;
+}
+
+int
+pgexporter_bucket_index(double* buckets, int n_buckets, double value)
+{
+   int low = 0;
+   int high = n_buckets;
+
+   while (low < high)
+   {
+      int mid = low + (high - low) / 2;
+
+      if (value <= buckets[mid])
+      {
+         high = mid;
+      }
+      else
+      {
+         low = mid + 1;
+      }
+   }
+
+   return low;
+}
+
 int
 pgexporter_normalize_path(char* directory_path, char* filename, char* default_path, char* path_buffer, size_t buffer_size)
 {
@@ -0,0 +1,704 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* pgexporter */
+#include <pgexporter.h>
+#include <ext_query_alts.h>
+#include <logging.h>
+#include <metric_names.h>
+#include <pg_query_alts.h>
+#include <shmem.h>
+#include <utils.h>
+#include <yaml_cache.h>
+
+/* system */
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/** @struct yaml_cache_header
+ * The header of a cache file
+ */
+struct yaml_cache_header
+{
+   char magic[8];                            /**< YAML_CACHE_MAGIC */
+   uint32_t format;                          /**< YAML_CACHE_VERSION */
+   uint32_t header_size;                     /**< sizeof(struct yaml_cache_header) */
+   uint32_t metric_size;                     /**< sizeof(struct yaml_cache_metric) */
+   uint32_t query_size;                      /**< sizeof(struct yaml_cache_query) */
+   char version[MISC_LENGTH];                /**< The pgexporter version */
+   char path[MAX_PATH];                      /**< The YAML file */
+   int64_t mtime_sec;                        /**< The modification time of the YAML file (seconds) */
+   int64_t mtime_nsec;                       /**< The modification time of the YAML file (nanoseconds) */
+   uint64_t file_size;                       /**< The size of the YAML file */
+   unsigned char hash[SHA256_DIGEST_LENGTH]; /**< The SHA-256 of the YAML file */
+   bool is_extension;                        /**< Is the YAML file an extension file */
+   char extension_name[MISC_LENGTH];         /**< The extension name */
+   uint32_t number_of_metrics;               /**< The number of metrics */
+   uint32_t number_of_queries;               /**< The number of query alternatives */
+   uint32_t number_of_metric_names;          /**< The number of metric names */
+   uint64_t payload_size;                    /**< The size of the data following the header */
+};
+
+/** @struct yaml_cache_metric
+ * A metric, followed by its query alternatives in version order
+ */
+struct yaml_cache_metric
+{
+   char tag[PROMETHEUS_LENGTH];          /**< The metric name */
+   char collector[MAX_COLLECTOR_LENGTH]; /**< The collector */
+   int sort_type;                        /**< The sort type */
+   int server_query_type;                /**< The server query type */
+   bool exec_on_all_dbs;                 /**< Execute on all databases */
+   bool optional;                        /**< Suppress warning on query failure */
+   int derive;                           /**< The derived gauges */
+   int slices;                           /**< The number of slices */
+   uint32_t number_of_queries;           /**< The number of query alternatives */
+};
+
+/** @struct yaml_cache_query
+ * A query alternative
+ */
+struct yaml_cache_query
+{
+   int pg_version;              /**< The PostgreSQL version */
+   struct version ext_version;  /**< The extension version */
+   struct query_alts_base node; /**< The query */
+};
+
+static int cache_file_name(struct configuration* config, char* path, char* name, size_t size);
+static int hash_file(char* path, unsigned char* hash);
+static void file_mtime(struct stat* st, int64_t* sec, int64_t* nsec);
+static void refresh_header(char* name, struct stat* yaml_st);
+static uint32_t count_pg_queries(struct pg_query_alts* root);
+static uint32_t count_ext_queries(struct ext_query_alts* root);
+static int write_pg_queries(FILE* file, struct pg_query_alts* root);
+static int write_ext_queries(FILE* file, struct ext_query_alts* root);
+
+int
+pgexporter_yaml_cache_open(struct configuration* config, char* path, struct yaml_cache** cache)
+{
+   char name[MAX_PATH];
+   unsigned char hash[SHA256_DIGEST_LENGTH];
+   struct yaml_cache_header* header = NULL;
+   struct yaml_cache* c = NULL;
+   struct stat yaml_st;
+   struct stat cache_st;
+   int64_t sec;
+   int64_t nsec;
+   void* data = MAP_FAILED;
+   int fd = -1;
+
+   *cache = NULL;
+
+   if (cache_file_name(config, path, name, sizeof(name)))
+   {
+      goto error;
+   }
+
+   if (stat(path, &yaml_st))
+   {
+      goto error;
+   }
+
+   fd = open(name, O_RDONLY);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   if (fstat(fd, &cache_st) || cache_st.st_size < (off_t)sizeof(struct yaml_cache_header))
+   {
+      goto error;
+   }
+
+   data = mmap(NULL, cache_st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   if (data == MAP_FAILED)
+   {
+      goto error;
+   }
+
+   close(fd);
+   fd = -1;
+
+   header = (struct yaml_cache_header*)data;
+
+   if (memcmp(header->magic, YAML_CACHE_MAGIC, sizeof(header->magic)) ||
+       header->format != YAML_CACHE_VERSION ||
+       header->header_size != sizeof(struct yaml_cache_header) ||
+       header->metric_size != sizeof(struct yaml_cache_metric) ||
+       header->query_size != sizeof(struct yaml_cache_query) ||
+       strncmp(header->version, PGEXPORTER_VERSION, sizeof(header->version)) ||
+       strncmp(header->path, path, sizeof(header->path)))
+   {
+      pgexporter_log_debug("YAML cache %s is not compatible with %s", name, path);
+      goto error;
+   }
+
+   if (header->payload_size != (uint64_t)cache_st.st_size - sizeof(struct yaml_cache_header) ||
+       header->payload_size != (uint64_t)header->number_of_metrics * sizeof(struct yaml_cache_metric) +
+       (uint64_t)header->number_of_queries * sizeof(struct yaml_cache_query) +
+       (uint64_t)header->number_of_metric_names * PROMETHEUS_LENGTH)
+   {
+      pgexporter_log_debug("YAML cache %s is truncated", name);
+      goto error;
+   }
+
+   file_mtime(&yaml_st, &sec, &nsec);
+
+   if (header->file_size != (uint64_t)yaml_st.st_size || header->mtime_sec != sec || header->mtime_nsec != nsec)
+   {
+      /* Touched, but the content may still be the same */
+      if (hash_file(path, hash) || memcmp(hash, header->hash, SHA256_DIGEST_LENGTH))
+      {
+         pgexporter_log_debug("YAML cache %s is stale for %s", name, path);
+         goto error;
+      }
+
+      /* The next start doesn't need the hash */
+      refresh_header(name, &yaml_st);
+   }
+
+   c = (struct yaml_cache*)malloc(sizeof(struct yaml_cache));
+   if (c == NULL)
+   {
+      goto error;
+   }
+
+   memset(c, 0, sizeof(struct yaml_cache));
+   c->data = data;
+   c->size = cache_st.st_size;
+   c->is_extension = header->is_extension;
+   memcpy(c->extension_name, header->extension_name, MISC_LENGTH - 1);
+   c->number_of_metrics = header->number_of_metrics;
+   c->number_of_metric_names = header->number_of_metric_names;
+
+   *cache = c;
+
+   return 0;
+
+error:
+   if (data != MAP_FAILED)
+   {
+      munmap(data, cache_st.st_size);
+   }
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+int
+pgexporter_yaml_cache_restore(struct configuration* config, struct yaml_cache* cache, struct prometheus* prometheus, int max)
+{
+   struct yaml_cache_header* header = NULL;
+   struct yaml_cache_metric metric;
+   struct yaml_cache_query query;
+   int restored = 0;
+   char* p = NULL;
+   char* names = NULL;
+   char* end = NULL;
+
+   header = (struct yaml_cache_header*)cache->data;
+   p = (char*)cache->data + sizeof(struct yaml_cache_header);
+   end = (char*)cache->data + cache->size;
+   names = end - (size_t)header->number_of_metric_names * PROMETHEUS_LENGTH;
+
+   if (cache->number_of_metrics > max)
+   {
+      pgexporter_log_error("The number of metrics exceed the maximum limit of %d.", NUMBER_OF_METRICS);
+      goto error;
+   }
+
+   /* Same rule as the YAML validation: no clashes with names from other files */
+   for (int i = 0; i < cache->number_of_metric_names; i++)
+   {
+      if (memchr(names + (size_t)i * PROMETHEUS_LENGTH, '\0', PROMETHEUS_LENGTH) == NULL)
+      {
+         goto error;
+      }
+
+      if (pgexporter_metric_names_contains(config->metric_names, names + (size_t)i * PROMETHEUS_LENGTH))
+      {
+         pgexporter_log_error("Duplicate metric name: pgexporter_%s", names + (size_t)i * PROMETHEUS_LENGTH);
+         goto error;
+      }
+   }
+
+   for (int i = 0; i < cache->number_of_metrics; i++)
+   {
+      struct prometheus* prom = &prometheus[i];
+
+      /* Records are not aligned in the file, so copy them out */
+      if (p + sizeof(struct yaml_cache_metric) > names)
+      {
+         goto error;
+      }
+
+      memcpy(&metric, p, sizeof(struct yaml_cache_metric));
+      p += sizeof(struct yaml_cache_metric);
+
+      if (p + (size_t)metric.number_of_queries * sizeof(struct yaml_cache_query) > names)
+      {
+         goto error;
+      }
+
+      restored = i + 1;
+
+      memcpy(prom->tag, metric.tag, PROMETHEUS_LENGTH);
+      memcpy(prom->collector, metric.collector, MAX_COLLECTOR_LENGTH);
+      prom->sort_type = metric.sort_type;
+      prom->server_query_type = metric.server_query_type;
+      prom->exec_on_all_dbs = metric.exec_on_all_dbs;
+      prom->optional = metric.optional;
+      prom->derive = metric.derive;
+      prom->slices = metric.slices;
+
+      for (uint32_t j = 0; j < metric.number_of_queries; j++)
+      {
+         void* new_query_shmem = NULL;
+
+         memcpy(&query, p, sizeof(struct yaml_cache_query));
+         p += sizeof(struct yaml_cache_query);
+
+         if (cache->is_extension)
+         {
+            struct ext_query_alts* new_query = NULL;
+
+            if (pgexporter_create_shared_memory(sizeof(struct ext_query_alts), HUGEPAGE_OFF, &new_query_shmem))
+            {
+               goto error;
+            }
+            new_query = (struct ext_query_alts*)new_query_shmem;
+
+            memcpy(&new_query->ext_version, &query.ext_version, sizeof(struct version));
+            memcpy(&new_query->node, &query.node, sizeof(struct query_alts_base));
+
+            prom->ext_root = pgexporter_insert_extension_node_avl(prom->ext_root, &new_query);
+         }
+         else
+         {
+            struct pg_query_alts* new_query = NULL;
+
+            if (pgexporter_create_shared_memory(sizeof(struct pg_query_alts), HUGEPAGE_OFF, &new_query_shmem))
+            {
+               goto error;
+            }
+            new_query = (struct pg_query_alts*)new_query_shmem;
+
+            new_query->pg_version = (char)query.pg_version;
+            memcpy(&new_query->node, &query.node, sizeof(struct query_alts_base));
+
+            prom->pg_root = pgexporter_insert_pg_node_avl(prom->pg_root, &new_query);
+         }
+      }
+   }
+
+   /* The names were validated above, so this only fails when out of memory */
+   for (int i = 0; i < cache->number_of_metric_names; i++)
+   {
+      if (pgexporter_metric_names_add(&config->metric_names, names + (size_t)i * PROMETHEUS_LENGTH))
+      {
+         goto error;
+      }
+   }
+
+   return 0;
+
+error:
+
+   /* Leave no half restored metric behind in the slots */
+   for (int i = 0; i < restored; i++)
+   {
+      pgexporter_free_pg_node_avl(&prometheus[i].pg_root);
+      pgexporter_free_extension_node_avl(&prometheus[i].ext_root);
+      memset(&prometheus[i], 0, sizeof(struct prometheus));
+   }
+
+   return 1;
+}
+
+void
+pgexporter_yaml_cache_close(struct yaml_cache* cache)
+{
+   if (cache == NULL)
+   {
+      return;
+   }
+
+   munmap(cache->data, cache->size);
+   free(cache);
+}
+
+int
+pgexporter_yaml_cache_store(struct configuration* config, char* path, char* extension_name,
+                            struct prometheus* prometheus, int number_of_metrics, int metric_names_start)
+{
+   char name[MAX_PATH];
+   char tmp[MAX_PATH];
+   char dir[MAX_PATH];
+   char metric_name[PROMETHEUS_LENGTH];
+   struct yaml_cache_header header;
+   struct yaml_cache_metric metric;
+   struct stat yaml_st;
+   FILE* file = NULL;
+
+   memset(tmp, 0, sizeof(tmp));
+
+   if (cache_file_name(config, path, name, sizeof(name)))
+   {
+      return 0;
+   }
+
+   memset(dir, 0, sizeof(dir));
+   memcpy(dir, config->yaml_cache_path, MAX_PATH - 1);
+   if (pgexporter_mkdir(dir))
+   {
+      pgexporter_log_debug("YAML cache: unable to create %s (%s)", config->yaml_cache_path, strerror(errno));
+      goto error;
+   }
+
+   memset(&header, 0, sizeof(struct yaml_cache_header));
+   memcpy(header.magic, YAML_CACHE_MAGIC, sizeof(header.magic));
+   header.format = YAML_CACHE_VERSION;
+   header.header_size = sizeof(struct yaml_cache_header);
+   header.metric_size = sizeof(struct yaml_cache_metric);
+   header.query_size = sizeof(struct yaml_cache_query);
+   pgexporter_snprintf(header.version, sizeof(header.version), "%s", PGEXPORTER_VERSION);
+   pgexporter_snprintf(header.path, sizeof(header.path), "%s", path);
+
+   if (stat(path, &yaml_st) || hash_file(path, header.hash))
+   {
+      goto error;
+   }
+
+   file_mtime(&yaml_st, &header.mtime_sec, &header.mtime_nsec);
+   header.file_size = yaml_st.st_size;
+
+   if (extension_name != NULL)
+   {
+      header.is_extension = true;
+      pgexporter_snprintf(header.extension_name, sizeof(header.extension_name), "%s", extension_name);
+   }
+
+   header.number_of_metrics = number_of_metrics;
+   for (int i = 0; i < number_of_metrics; i++)
+   {
+      header.number_of_queries += header.is_extension ? count_ext_queries(prometheus[i].ext_root) : count_pg_queries(prometheus[i].pg_root);
+   }
+   header.number_of_metric_names = MAX(pgexporter_metric_names_count(config->metric_names) - metric_names_start, 0);
+   header.payload_size = (uint64_t)header.number_of_metrics * sizeof(struct yaml_cache_metric) +
+                         (uint64_t)header.number_of_queries * sizeof(struct yaml_cache_query) +
+                         (uint64_t)header.number_of_metric_names * PROMETHEUS_LENGTH;
+
+   /* Write next to the final file and rename, so readers never see a partial cache */
+   pgexporter_snprintf(tmp, sizeof(tmp), "%s.%d", name, (int)getpid());
+
+   file = fopen(tmp, "w");
+   if (file == NULL)
+   {
+      pgexporter_log_debug("YAML cache: unable to create %s (%s)", tmp, strerror(errno));
+      goto error;
+   }
+
+   if (fwrite(&header, sizeof(struct yaml_cache_header), 1, file) != 1)
+   {
+      goto error;
+   }
+
+   for (int i = 0; i < number_of_metrics; i++)
+   {
+      memset(&metric, 0, sizeof(struct yaml_cache_metric));
+      memcpy(metric.tag, prometheus[i].tag, PROMETHEUS_LENGTH);
+      memcpy(metric.collector, prometheus[i].collector, MAX_COLLECTOR_LENGTH);
+      metric.sort_type = prometheus[i].sort_type;
+      metric.server_query_type = prometheus[i].server_query_type;
+      metric.exec_on_all_dbs = prometheus[i].exec_on_all_dbs;
+      metric.optional = prometheus[i].optional;
+      metric.derive = prometheus[i].derive;
+      metric.slices = prometheus[i].slices;
+      metric.number_of_queries = header.is_extension ? count_ext_queries(prometheus[i].ext_root) : count_pg_queries(prometheus[i].pg_root);
+
+      if (fwrite(&metric, sizeof(struct yaml_cache_metric), 1, file) != 1)
+      {
+         goto error;
+      }
+
+      if (header.is_extension ? write_ext_queries(file, prometheus[i].ext_root) : write_pg_queries(file, prometheus[i].pg_root))
+      {
+         goto error;
+      }
+   }
+
+   for (uint32_t i = 0; i < header.number_of_metric_names; i++)
+   {
+      memset(metric_name, 0, sizeof(metric_name));
+      pgexporter_snprintf(metric_name, sizeof(metric_name), "%s",
+                          pgexporter_metric_names_get(config->metric_names, metric_names_start + (int)i));
+
+      if (fwrite(metric_name, PROMETHEUS_LENGTH, 1, file) != 1)
+      {
+         goto error;
+      }
+   }
+
+   if (fclose(file))
+   {
+      file = NULL;
+      goto error;
+   }
+   file = NULL;
+
+   if (rename(tmp, name))
+   {
+      goto error;
+   }
+
+   pgexporter_log_debug("YAML cache: stored %s for %s", name, path);
+
+   return 0;
+
+error:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   if (tmp[0] != '\0')
+   {
+      unlink(tmp);
+   }
+
+   pgexporter_log_debug("YAML cache: unable to store cache for %s", path);
+
+   return 1;
+}
+
+static int
+cache_file_name(struct configuration* config, char* path, char* name, size_t size)
+{
+   unsigned char digest[SHA256_DIGEST_LENGTH];
+   char hex[2 * 16 + 1];
+   unsigned int length = 0;
+
+   if (config == NULL || config->yaml_cache_path[0] == '\0' || path == NULL)
+   {
+      return 1;
+   }
+
+   if (EVP_Digest(path, strlen(path), digest, &length, EVP_sha256(), NULL) != 1)
+   {
+      return 1;
+   }
+
+   for (int i = 0; i < 16; i++)
+   {
+      pgexporter_snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+   }
+
+   if (pgexporter_snprintf(name, size, "%s/%s%s", config->yaml_cache_path, hex, YAML_CACHE_SUFFIX) >= (int)size)
+   {
+      return 1;
+   }
+
+   return 0;
+}
+
+static int
+hash_file(char* path, unsigned char* hash)
+{
+   unsigned char buffer[65536];
+   unsigned int length = 0;
+   EVP_MD_CTX* ctx = NULL;
+   ssize_t n;
+   int fd = -1;
+
+   fd = open(path, O_RDONLY);
+   if (fd == -1)
+   {
+      goto error;
+   }
+
+   ctx = EVP_MD_CTX_new();
+   if (ctx == NULL || EVP_DigestInit_ex(ctx, EVP_sha256(), NULL) != 1)
+   {
+      goto error;
+   }
+
+   while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+   {
+      if (EVP_DigestUpdate(ctx, buffer, n) != 1)
+      {
+         goto error;
+      }
+   }
+
+   if (n < 0 || EVP_DigestFinal_ex(ctx, hash, &length) != 1)
+   {
+      goto error;
+   }
+
+   EVP_MD_CTX_free(ctx);
+   close(fd);
+
+   return 0;
+
+error:
+   EVP_MD_CTX_free(ctx);
+
+   if (fd != -1)
+   {
+      close(fd);
+   }
+
+   return 1;
+}
+
+static void
+file_mtime(struct stat* st, int64_t* sec, int64_t* nsec)
+{
+#if defined(HAVE_DARWIN)
+   *sec = st->st_mtimespec.tv_sec;
+   *nsec = st->st_mtimespec.tv_nsec;
+#else
+   *sec = st->st_mtim.tv_sec;
+   *nsec = st->st_mtim.tv_nsec;
+#endif
+}
+
+/**
+ * Record the modification time and the size of an unchanged YAML file in
+ * the header of its cache
+ * @param name The cache file
+ * @param yaml_st The status of the YAML file
+ */
+static void
+refresh_header(char* name, struct stat* yaml_st)
+{
+   int64_t sec;
+   int64_t nsec;
+   uint64_t file_size;
+   int fd = -1;
+
+   file_mtime(yaml_st, &sec, &nsec);
+   file_size = yaml_st->st_size;
+
+   fd = open(name, O_WRONLY);
+   if (fd == -1)
+   {
+      pgexporter_log_debug("YAML cache: unable to open %s (%s)", name, strerror(errno));
+      return;
+   }
+
+   if (pwrite(fd, &sec, sizeof(sec), offsetof(struct yaml_cache_header, mtime_sec)) != sizeof(sec) ||
+       pwrite(fd, &nsec, sizeof(nsec), offsetof(struct yaml_cache_header, mtime_nsec)) != sizeof(nsec) ||
+       pwrite(fd, &file_size, sizeof(file_size), offsetof(struct yaml_cache_header, file_size)) != sizeof(file_size))
+   {
+      pgexporter_log_debug("YAML cache: unable to update %s (%s)", name, strerror(errno));
+   }
+
+   close(fd);
+}
+
+static uint32_t
+count_pg_queries(struct pg_query_alts* root)
+{
+   return root == NULL ? 0 : 1 + count_pg_queries(root->left) + count_pg_queries(root->right);
+}
+
+static uint32_t
+count_ext_queries(struct ext_query_alts* root)
+{
+   return root == NULL ? 0 : 1 + count_ext_queries(root->left) + count_ext_queries(root->right);
+}
+
+static int
+write_pg_queries(FILE* file, struct pg_query_alts* root)
+{
+   struct yaml_cache_query query;
+
+   if (root == NULL)
+   {
+      return 0;
+   }
+
+   if (write_pg_queries(file, root->left))
+   {
+      return 1;
+   }
+
+   memset(&query, 0, sizeof(struct yaml_cache_query));
+   query.pg_version = root->pg_version;
+   memcpy(&query.node, &root->node, sizeof(struct query_alts_base));
+
+   if (fwrite(&query, sizeof(struct yaml_cache_query), 1, file) != 1)
+   {
+      return 1;
+   }
+
+   return write_pg_queries(file, root->right);
+}
+
+static int
+write_ext_queries(FILE* file, struct ext_query_alts* root)
+{
+   struct yaml_cache_query query;
+
+   if (root == NULL)
+   {
+      return 0;
+   }
+
+   if (write_ext_queries(file, root->left))
+   {
+      return 1;
+   }
+
+   memset(&query, 0, sizeof(struct yaml_cache_query));
+   memcpy(&query.ext_version, &root->ext_version, sizeof(struct version));
+   memcpy(&query.node, &root->node, sizeof(struct query_alts_base));
+
+   if (fwrite(&query, sizeof(struct yaml_cache_query), 1, file) != 1)
+   {
+      return 1;
+   }
+
+   return write_ext_queries(file, root->right);
+}
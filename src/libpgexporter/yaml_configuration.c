@@ -29,23 +29,32 @@
 /* pgexporter */
 #include <pgexporter.h>
 #include <art.h>
+#include <derive.h>
 #include <extension.h>
 #include <ext_query_alts.h>
 #include <internal.h>
+#include <internal_metrics.h>
 #include <logging.h>
+#include <metric_names.h>
 #include <pg_query_alts.h>
 #include <shmem.h>
+#include <slice.h>
 #include <stdlib.h>
 #include <string.h>
 #include <utils.h>
 #include <value.h>
+#include <yaml_cache.h>
 #include <yaml_configuration.h>
 
 /* system */
 #include <yaml.h>
 #include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
-static int pgexporter_read_yaml(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, char* filename, int* number_of_metrics);
+/* Upper bound of threads parsing YAML files */
+#define NUMBER_OF_YAML_WORKERS 8
 
 static int get_yaml_files(char* base, int* number_of_yaml_files, char*** files);
 static bool is_yaml_file(char* filename);
@@ -60,6 +69,7 @@ typedef struct yaml_column
    char* name;
    char* description;
    char* type;
+   char* buckets;
 } __attribute__((aligned(64))) yaml_column_t;
 
 // Query's Value's Structure
@@ -86,6 +96,8 @@ typedef struct yaml_metric
    char* server;
    bool exec_on_all_dbs;
    bool optional;
+   char* derive;
+   int slices;
 } __attribute__((aligned(64))) yaml_metric_t;
 
 // Config's Structure
@@ -141,6 +153,7 @@ static int parse_exec_all_dbs(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr
 
 // Parse 'optional' key in YAML
 static int parse_optional(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t* state_ptr, bool* optional);
+static int parse_buckets(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t* state_ptr, char** dest);
 
 // Parse a scalar value in YAML
 static int parse_value(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t* state_ptr);
@@ -158,63 +171,110 @@ static void free_yaml_queries(yaml_query_t** queries, size_t n_queries);
 static void free_yaml_columns(yaml_column_t** columns, size_t n_columns);
 
 // Extract the meaning of the `yaml_config` and load the metrics into `prometheus`
-static int semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t* yaml_config);
+static int semantics_yaml(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, yaml_config_t* yaml_config);
 
 // Extension helper functions
+static bool is_duplicate_query(yaml_config_t* yaml_config, int metric, int query);
 static struct extension_metrics* search_or_add_extension(struct configuration* config, char* extension_name);
+static int reserve_extension_metrics(struct extension_metrics* ext, int number_of_metrics);
 static int semantics_extension_yaml(struct configuration* config, yaml_config_t* yaml_config);
 static int pgexporter_validate_yaml_metrics(struct configuration* config, yaml_config_t* yaml_config);
 
+// A YAML file being loaded
+typedef struct yaml_file
+{
+   char* path;                /**< The YAML file */
+   char* extension_name;      /**< The expected extension, or NULL */
+   struct yaml_cache* cache;  /**< The valid cache of the file, or NULL */
+   yaml_config_t yaml_config; /**< The parsed file */
+   int status;                /**< 0 if the file is ready to be merged, otherwise 1 */
+} yaml_file_t;
+
+// The shared state of the threads preparing YAML files
+typedef struct yaml_pool
+{
+   struct configuration* config; /**< The configuration */
+   yaml_file_t* files;           /**< The files */
+   int n_files;                  /**< The number of files */
+   atomic_int next;              /**< The next file to prepare */
+} yaml_pool_t;
+
+// Parse a file pointer and load it into the configuration
+static int read_yaml_from_file_pointer(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, FILE* file, char* filename);
+
+// Prepare the files in parallel and merge them into the configuration in file order
+static int read_yaml_files(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, yaml_file_t* files, int n_files, bool stop_on_error);
+
+// Prepare the files on a bounded number of threads
+static void prepare_yaml_files(struct configuration* config, yaml_file_t* files, int n_files);
+
+// Thread body preparing files until none are left
+static void* prepare_yaml_worker(void* arg);
+
+// Open the cache of a file, or parse it. Doesn't touch the configuration
+static void prepare_yaml_file(struct configuration* config, yaml_file_t* file, bool use_cache);
+
+// Validate a parsed file and load it into the configuration
+static int load_yaml_config(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, yaml_config_t* yaml_config, char* filename);
+
+// Load the metrics of a cache into the configuration
+static int restore_yaml_cache(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, struct yaml_cache* cache);
+
+// Release the resources of the files
+static void free_yaml_files(yaml_file_t* files, int n_files);
+
+// The number of extension catalog loads of this process, inherited by the forked processes
+static unsigned int extension_generation = 0;
+
 int
 pgexporter_read_metrics_configuration(void* shmem)
 {
    struct configuration* config;
-   int idx_metrics = 0;
-   int number_of_metrics = 0;
    int number_of_yaml_files = 0;
    char** yaml_files = NULL;
-   char* yaml_path = NULL;
+   yaml_file_t* files = NULL;
+   int ret = 0;
 
    config = (struct configuration*)shmem;
-   idx_metrics = config->number_of_metrics;
 
    if (pgexporter_is_file(config->metrics_path))
    {
-      number_of_metrics = 0;
-      if (pgexporter_read_yaml(config, config->prometheus, idx_metrics, config->metrics_path, &number_of_metrics))
+      files = (yaml_file_t*)calloc(1, sizeof(yaml_file_t));
+      if (files == NULL)
       {
          return 1;
       }
-      idx_metrics += number_of_metrics;
+
+      files[0].path = pgexporter_append(NULL, config->metrics_path);
+
+      ret = read_yaml_files(config, config->prometheus, config->number_of_metrics, files, 1, true);
+
+      free_yaml_files(files, 1);
    }
    else if (pgexporter_is_directory(config->metrics_path))
    {
       get_yaml_files(config->metrics_path, &number_of_yaml_files, &yaml_files);
-      for (int i = 0; i < number_of_yaml_files; i++)
-      {
-         number_of_metrics = 0;
-
-         yaml_path = pgexporter_vappend(yaml_path, 3,
-                                        config->metrics_path,
-                                        "/",
-                                        yaml_files[i]);
 
-         if (pgexporter_read_yaml(config, config->prometheus, idx_metrics, yaml_path, &number_of_metrics))
+      files = (yaml_file_t*)calloc(MAX(number_of_yaml_files, 1), sizeof(yaml_file_t));
+      if (files == NULL)
+      {
+         ret = 1;
+      }
+      else
+      {
+         for (int i = 0; i < number_of_yaml_files; i++)
          {
-            free(yaml_path);
-            yaml_path = NULL;
-            for (int j = 0; j < number_of_yaml_files; j++)
-            {
-               free(yaml_files[j]);
-            }
-            free(yaml_files);
-            yaml_files = NULL;
-            return 1;
+            files[i].path = pgexporter_vappend(NULL, 3,
+                                               config->metrics_path,
+                                               "/",
+                                               yaml_files[i]);
          }
-         idx_metrics += number_of_metrics;
-         free(yaml_path);
-         yaml_path = NULL;
+
+         ret = read_yaml_files(config, config->prometheus, config->number_of_metrics, files, number_of_yaml_files, true);
+
+         free_yaml_files(files, number_of_yaml_files);
       }
+
       for (int j = 0; j < number_of_yaml_files; j++)
       {
          free(yaml_files[j]);
@@ -222,15 +282,29 @@ pgexporter_read_metrics_configuration(void* shmem)
       free(yaml_files);
       yaml_files = NULL;
    }
-   config->number_of_metrics = idx_metrics;
 
-   return 0;
+   return ret;
 }
 
 int
 pgexporter_read_internal_yaml_metrics(struct configuration* config, bool start)
 {
    int number_of_metrics = 0;
+#ifdef HAVE_INTERNAL_METRICS
+   /* The catalog was parsed and validated at build time */
+   number_of_metrics = pgexporter_internal_number_of_metrics;
+
+   memcpy(config->prometheus, pgexporter_internal_metrics, number_of_metrics * sizeof(struct prometheus));
+
+   for (int i = 0; i < pgexporter_internal_number_of_metric_names; i++)
+   {
+      if (pgexporter_metric_names_add(&config->metric_names, (char*)pgexporter_internal_metric_names[i]))
+      {
+         pgexporter_log_error("Failed to register metric name: %s", pgexporter_internal_metric_names[i]);
+         return 1;
+      }
+   }
+#else
    int ret;
    FILE* internal_yaml_ptr = fmemopen(INTERNAL_YAML, strlen(INTERNAL_YAML), "r");
 
@@ -241,6 +315,7 @@ pgexporter_read_internal_yaml_metrics(struct configuration* config, bool start)
    {
       return 1;
    }
+#endif
 
    if (start)
    {
@@ -252,29 +327,9 @@ pgexporter_read_internal_yaml_metrics(struct configuration* config, bool start)
    return 0;
 }
 
-static int
-pgexporter_read_yaml(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, char* filename, int* number_of_metrics)
-{
-   FILE* file;
-
-   file = fopen(filename, "r");
-   if (file == NULL)
-   {
-      pgexporter_log_error("pgexporter: fopen error %s", strerror(errno));
-      return 1;
-   }
-
-   int ret = pgexporter_read_yaml_from_file_pointer(config, prometheus, prometheus_idx, number_of_metrics, file);
-
-   fclose(file);
-
-   return ret;
-}
-
 static int
 pgexporter_validate_yaml_metrics(struct configuration* config, yaml_config_t* yaml_config)
 {
-   struct art* existing_metrics_art = NULL;
    struct art* temp_art = NULL;
    struct art* metric_columns_art = NULL;
    struct art* processed_columns = NULL;
@@ -282,21 +337,6 @@ pgexporter_validate_yaml_metrics(struct configuration* config, yaml_config_t* ya
    char final_metric_name[PROMETHEUS_LENGTH];
    int i, j, k;
 
-   if (pgexporter_art_create(&existing_metrics_art))
-   {
-      pgexporter_log_error("Failed to create temporary ART");
-      goto error;
-   }
-
-   for (int idx = 0; idx < config->number_of_metric_names; idx++)
-   {
-      if (pgexporter_art_insert(existing_metrics_art, config->metric_names[idx], 1, ValueInt32))
-      {
-         pgexporter_log_error("Failed to insert metric name into temporary ART");
-         goto error;
-      }
-   }
-
    if (pgexporter_art_create(&temp_art))
    {
       pgexporter_log_error("Failed to create temporary ART");
@@ -422,7 +462,7 @@ pgexporter_validate_yaml_metrics(struct configuration* config, yaml_config_t* ya
             }
 
             /* Check for duplicates against global ART */
-            if (pgexporter_art_contains_key(existing_metrics_art, final_metric_name))
+            if (pgexporter_metric_names_contains(config->metric_names, final_metric_name))
             {
                pgexporter_log_error("Duplicate metric name with previously loaded files: pgexporter_%s", final_metric_name);
                goto error;
@@ -450,12 +490,10 @@ pgexporter_validate_yaml_metrics(struct configuration* config, yaml_config_t* ya
       metric_columns_art = NULL;
    }
 
-   pgexporter_art_destroy(existing_metrics_art);
    pgexporter_art_destroy(temp_art);
    return 0;
 
 error:
-   pgexporter_art_destroy(existing_metrics_art);
    pgexporter_art_destroy(processed_columns);
    pgexporter_art_destroy(metric_columns_art);
    pgexporter_art_destroy(temp_art);
@@ -464,6 +502,12 @@ error:
 
 int
 pgexporter_read_yaml_from_file_pointer(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, FILE* file)
+{
+   return read_yaml_from_file_pointer(config, prometheus, prometheus_idx, number_of_metrics, file, NULL);
+}
+
+static int
+read_yaml_from_file_pointer(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, FILE* file, char* filename)
 {
    int ret = 0;
    yaml_config_t yaml_config;
@@ -476,37 +520,295 @@ pgexporter_read_yaml_from_file_pointer(struct configuration* config, struct prom
       goto end;
    }
 
-   *number_of_metrics += yaml_config.n_metrics;
+   ret = load_yaml_config(config, prometheus, prometheus_idx, number_of_metrics, &yaml_config, filename);
+
+end:
+   free_yaml_config(&yaml_config);
+
+   return ret;
+}
+
+static int
+load_yaml_config(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, yaml_config_t* yaml_config, char* filename)
+{
+   int metric_names_start = pgexporter_metric_names_count(config->metric_names);
+   int extension_start = 0;
+   struct extension_metrics* ext = NULL;
+
+   *number_of_metrics += yaml_config->n_metrics;
 
    /* Validate before inserting them */
-   if (pgexporter_validate_yaml_metrics(config, &yaml_config))
+   if (pgexporter_validate_yaml_metrics(config, yaml_config))
+   {
+      return 1;
+   }
+
+   if (yaml_config->is_extension)
+   {
+      ext = search_or_add_extension(config, yaml_config->extension_name);
+      if (ext == NULL)
+      {
+         return 1;
+      }
+      extension_start = ext->number_of_metrics;
+
+      if (semantics_extension_yaml(config, yaml_config))
+      {
+         return 1;
+      }
+
+      if (filename != NULL)
+      {
+         pgexporter_yaml_cache_store(config, filename, yaml_config->extension_name, &ext->metrics[extension_start],
+                                     ext->number_of_metrics - extension_start, metric_names_start);
+      }
+   }
+   else
    {
-      pgexporter_log_error("YAML contains duplicate metric names");
+      if (prometheus == NULL)
+      {
+         pgexporter_log_error("YAML file %s is not an extension file", filename != NULL ? filename : "");
+         return 1;
+      }
+
+      if (semantics_yaml(config, prometheus, prometheus_idx, yaml_config))
+      {
+         return 1;
+      }
+
+      if (filename != NULL)
+      {
+         pgexporter_yaml_cache_store(config, filename, NULL, &prometheus[prometheus_idx],
+                                     yaml_config->n_metrics, metric_names_start);
+      }
+   }
+
+   return 0;
+}
+
+static int
+read_yaml_files(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, yaml_file_t* files, int n_files, bool stop_on_error)
+{
+   int idx_metrics = prometheus_idx;
+   int number_of_metrics = 0;
+   int failed = 0;
+   int ret;
+
+   /* Parsing is independent per file ... */
+   prepare_yaml_files(config, files, n_files);
+
+   /* ... but the merge depends on the files before, so it happens in file order */
+   for (int i = 0; i < n_files; i++)
+   {
+      number_of_metrics = 0;
       ret = 1;
-      goto end;
+
+      if (files[i].status == 0 && files[i].cache != NULL)
+      {
+         ret = restore_yaml_cache(config, prometheus, idx_metrics, &number_of_metrics, files[i].cache);
+
+         if (!ret)
+         {
+            pgexporter_log_debug("Loaded %d metrics for %s from the YAML cache", number_of_metrics, files[i].path);
+         }
+         else
+         {
+            /* Let the parser decide */
+            pgexporter_yaml_cache_close(files[i].cache);
+            files[i].cache = NULL;
+            number_of_metrics = 0;
+            prepare_yaml_file(config, &files[i], false);
+         }
+      }
+
+      if (ret && files[i].status == 0 && files[i].cache == NULL)
+      {
+         ret = load_yaml_config(config, prometheus, idx_metrics, &number_of_metrics, &files[i].yaml_config, files[i].path);
+
+         if (!ret)
+         {
+            pgexporter_log_debug("Loaded %d metrics from %s", number_of_metrics, files[i].path);
+         }
+      }
+
+      if (ret)
+      {
+         if (stop_on_error)
+         {
+            return 1;
+         }
+
+         pgexporter_log_debug("Failed to load YAML file %s", files[i].path);
+         failed++;
+         continue;
+      }
+
+      if (prometheus != NULL)
+      {
+         idx_metrics += number_of_metrics;
+         config->number_of_metrics = idx_metrics;
+      }
    }
 
-   if (yaml_config.is_extension)
+   return failed > 0;
+}
+
+static void
+prepare_yaml_files(struct configuration* config, yaml_file_t* files, int n_files)
+{
+   pthread_t workers[NUMBER_OF_YAML_WORKERS];
+   int n_workers = 0;
+   int max_workers;
+   long cpus;
+   yaml_pool_t pool;
+
+   pool.config = config;
+   pool.files = files;
+   pool.n_files = n_files;
+   atomic_init(&pool.next, 0);
+
+   cpus = sysconf(_SC_NPROCESSORS_ONLN);
+   max_workers = MIN(n_files, MIN(cpus > 0 ? (int)cpus : 1, NUMBER_OF_YAML_WORKERS));
+
+   /* The calling thread is one of the workers */
+   for (int i = 1; i < max_workers; i++)
    {
-      if (semantics_extension_yaml(config, &yaml_config))
+      if (pthread_create(&workers[n_workers], NULL, prepare_yaml_worker, &pool))
       {
-         ret = 1;
-         goto end;
+         break;
+      }
+      n_workers++;
+   }
+
+   if (n_workers > 0)
+   {
+      pgexporter_log_debug("Parsing %d YAML files on %d threads", n_files, n_workers + 1);
+   }
+
+   prepare_yaml_worker(&pool);
+
+   for (int i = 0; i < n_workers; i++)
+   {
+      pthread_join(workers[i], NULL);
+   }
+}
+
+static void*
+prepare_yaml_worker(void* arg)
+{
+   yaml_pool_t* pool = (yaml_pool_t*)arg;
+   int i;
+
+   while ((i = atomic_fetch_add(&pool->next, 1)) < pool->n_files)
+   {
+      prepare_yaml_file(pool->config, &pool->files[i], true);
+   }
+
+   return NULL;
+}
+
+static void
+prepare_yaml_file(struct configuration* config, yaml_file_t* file, bool use_cache)
+{
+   FILE* fp = NULL;
+
+   file->status = 1;
+   free_yaml_config(&file->yaml_config);
+   memset(&file->yaml_config, 0, sizeof(yaml_config_t));
+
+   if (use_cache && config->yaml_cache_path[0] != '\0' &&
+       !pgexporter_yaml_cache_open(config, file->path, &file->cache))
+   {
+      if (file->extension_name == NULL ||
+          (file->cache->is_extension && !strcmp(file->extension_name, file->cache->extension_name)))
+      {
+         file->status = 0;
+         return;
+      }
+
+      pgexporter_yaml_cache_close(file->cache);
+      file->cache = NULL;
+   }
+
+   fp = fopen(file->path, "r");
+   if (fp == NULL)
+   {
+      if (file->extension_name != NULL)
+      {
+         pgexporter_log_debug("Extension YAML file not found: %s (extension: %s)", file->path, file->extension_name);
+      }
+      else
+      {
+         pgexporter_log_error("pgexporter: fopen error %s", strerror(errno));
       }
+      return;
+   }
+
+   if (parse_yaml(fp, &file->yaml_config))
+   {
+      fclose(fp);
+      return;
+   }
+
+   fclose(fp);
+
+   if (file->extension_name != NULL && file->yaml_config.is_extension && file->yaml_config.extension_name &&
+       strcmp(file->extension_name, file->yaml_config.extension_name))
+   {
+      pgexporter_log_error("Extension name mismatch: file '%s.yaml' declares extension '%s'",
+                           file->extension_name, file->yaml_config.extension_name);
+      return;
+   }
+
+   file->status = 0;
+}
+
+static int
+restore_yaml_cache(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, int* number_of_metrics, struct yaml_cache* cache)
+{
+   struct extension_metrics* ext = NULL;
+
+   if (cache->is_extension)
+   {
+      ext = search_or_add_extension(config, cache->extension_name);
+      if (ext == NULL || reserve_extension_metrics(ext, ext->number_of_metrics + cache->number_of_metrics))
+      {
+         return 1;
+      }
+
+      if (pgexporter_yaml_cache_restore(config, cache, &ext->metrics[ext->number_of_metrics], NUMBER_OF_METRICS - ext->number_of_metrics))
+      {
+         return 1;
+      }
+
+      ext->number_of_metrics += cache->number_of_metrics;
    }
    else
    {
-      if (semantics_yaml(prometheus, prometheus_idx, &yaml_config))
+      if (prometheus == NULL ||
+          pgexporter_yaml_cache_restore(config, cache, &prometheus[prometheus_idx], NUMBER_OF_METRICS - prometheus_idx))
       {
-         ret = 1;
-         goto end;
+         return 1;
       }
    }
 
-end:
-   free_yaml_config(&yaml_config);
+   *number_of_metrics += cache->number_of_metrics;
 
-   return ret;
+   return 0;
+}
+
+static void
+free_yaml_files(yaml_file_t* files, int n_files)
+{
+   for (int i = 0; i < n_files; i++)
+   {
+      free(files[i].path);
+      free(files[i].extension_name);
+      pgexporter_yaml_cache_close(files[i].cache);
+      free_yaml_config(&files[i].yaml_config);
+   }
+
+   free(files);
 }
 
 static int
@@ -855,6 +1157,20 @@ parse_metrics(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t
                   goto error;
                }
             }
+            else if (!strcmp(buf, "derive"))
+            {
+               if (parse_string(parser_ptr, event_ptr, state_ptr, &(*metrics)[*n_metrics].derive))
+               {
+                  goto error;
+               }
+            }
+            else if (!strcmp(buf, "slices"))
+            {
+               if (parse_int(parser_ptr, event_ptr, state_ptr, &(*metrics)[*n_metrics].slices))
+               {
+                  goto error;
+               }
+            }
             else
             {
                goto error;
@@ -1127,6 +1443,13 @@ parse_columns(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t
                   goto error;
                }
             }
+            else if (!strcmp(buf, "buckets"))
+            {
+               if (parse_buckets(parser_ptr, event_ptr, state_ptr, &(*columns)[*n_columns].buckets))
+               {
+                  goto error;
+               }
+            }
             else
             {
                goto error;
@@ -1279,6 +1602,72 @@ error:
    return 1;
 }
 
+static int
+parse_buckets(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t* state_ptr, char** dest)
+{
+   yaml_event_delete(event_ptr);
+
+   *dest = NULL;
+
+   if (!yaml_parser_parse(parser_ptr, event_ptr) || *state_ptr != PARSER_KEY)
+   {
+      goto error;
+   }
+
+   /* Either a scalar such as "1, 2, 5" or a sequence such as [1, 2, 5] */
+   if (event_ptr->type == YAML_SCALAR_EVENT)
+   {
+      *dest = pgexporter_append(*dest, (char*)event_ptr->data.scalar.value);
+   }
+   else if (event_ptr->type == YAML_SEQUENCE_START_EVENT)
+   {
+      while (true)
+      {
+         yaml_event_delete(event_ptr);
+
+         if (!yaml_parser_parse(parser_ptr, event_ptr))
+         {
+            goto error;
+         }
+
+         if (event_ptr->type == YAML_SEQUENCE_END_EVENT)
+         {
+            break;
+         }
+
+         if (event_ptr->type != YAML_SCALAR_EVENT)
+         {
+            goto error;
+         }
+
+         if (*dest != NULL)
+         {
+            *dest = pgexporter_append_char(*dest, ',');
+         }
+         *dest = pgexporter_append(*dest, (char*)event_ptr->data.scalar.value);
+      }
+   }
+   else
+   {
+      goto error;
+   }
+
+   if (*dest == NULL)
+   {
+      *dest = pgexporter_append(*dest, "");
+   }
+
+   *state_ptr = PARSER_VALUE;
+   yaml_event_delete(event_ptr);
+   return 0;
+
+error:
+   free(*dest);
+   *dest = NULL;
+   yaml_event_delete(event_ptr);
+   return 1;
+}
+
 static int
 parse_value(yaml_parser_t* parser_ptr, yaml_event_t* event_ptr, parser_state_t* state_ptr)
 {
@@ -1342,6 +1731,10 @@ free_yaml_metrics(yaml_metric_t** metrics, size_t n_metrics)
       {
          free((*metrics)[i].server);
       }
+      if ((*metrics)[i].derive)
+      {
+         free((*metrics)[i].derive);
+      }
       if ((*metrics)[i].queries)
       {
          free_yaml_queries(&(*metrics)[i].queries, (*metrics)[i].n_queries);
@@ -1392,6 +1785,10 @@ free_yaml_columns(yaml_column_t** columns, size_t n_columns)
       {
          free((*columns)[i].type);
       }
+      if ((*columns)[i].buckets)
+      {
+         free((*columns)[i].buckets);
+      }
    }
 
    free(*columns);
@@ -1399,10 +1796,9 @@ free_yaml_columns(yaml_column_t** columns, size_t n_columns)
 }
 
 static int
-semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t* yaml_config)
+semantics_yaml(struct configuration* config, struct prometheus* prometheus, int prometheus_idx, yaml_config_t* yaml_config)
 {
    struct prometheus* prom = NULL;
-   struct configuration* config = (struct configuration*)shmem;
 
    for (int i = 0; i < yaml_config->n_metrics; i++)
    {
@@ -1461,12 +1857,25 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
       {
          prom->server_query_type = SERVER_QUERY_REPLICA;
       }
+      else if (!strcmp(yaml_config->metrics[i].server, "cluster"))
+      {
+         prom->server_query_type = SERVER_QUERY_CLUSTER;
+      }
       else
       {
          pgexporter_log_error("pgexporter: unexpected server %s", yaml_config->metrics[i].server);
          return 1;
       }
 
+      // Derived gauges
+      if (pgexporter_derive_parse(yaml_config->metrics[i].derive, &prom->derive))
+      {
+         pgexporter_log_error("pgexporter: unexpected derive %s", yaml_config->metrics[i].derive);
+         return 1;
+      }
+
+      prom->slices = yaml_config->metrics[i].slices;
+
       prom->exec_on_all_dbs = yaml_config->metrics[i].exec_on_all_dbs;
       prom->optional = yaml_config->metrics[i].optional;
 
@@ -1476,6 +1885,12 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
          struct pg_query_alts* new_query = NULL;
          void* new_query_shmem = NULL;
 
+         if (pgexporter_slice_validate(prom->slices, prom->derive, yaml_config->metrics[i].queries[j].query))
+         {
+            pgexporter_log_error("pgexporter: unexpected slices %d for %s", prom->slices, prom->tag);
+            return 1;
+         }
+
          pgexporter_create_shared_memory(sizeof(struct pg_query_alts), HUGEPAGE_OFF, &new_query_shmem);
          new_query = (struct pg_query_alts*)new_query_shmem;
 
@@ -1523,6 +1938,19 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
                pgexporter_log_error("pgexporter: unexpected type %s", yaml_config->metrics[i].queries[j].columns[k].type);
                return 1;
             }
+
+            // Buckets
+            if (yaml_config->metrics[i].queries[j].columns[k].buckets)
+            {
+               if (new_query->node.columns[k].type != HISTOGRAM_TYPE ||
+                   pgexporter_parse_buckets(yaml_config->metrics[i].queries[j].columns[k].buckets,
+                                            new_query->node.columns[k].buckets,
+                                            &new_query->node.columns[k].n_buckets))
+               {
+                  pgexporter_log_error("pgexporter: unexpected buckets %s", yaml_config->metrics[i].queries[j].columns[k].buckets);
+                  return 1;
+               }
+            }
          }
 
          if (yaml_config->metrics[i].queries[j].version == 0)
@@ -1534,10 +1962,15 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
       }
       for (int j = 0; j < yaml_config->metrics[i].n_queries; j++)
       {
+         /* The tree keeps the first query of a version, so the others never produce a metric */
+         if (is_duplicate_query(yaml_config, i, j))
+         {
+            continue;
+         }
+
          for (int k = 0; k < yaml_config->metrics[i].queries[j].n_columns; k++)
          {
             if (!strcmp(yaml_config->metrics[i].queries[j].columns[k].type, "label"))
-
             {
                continue;
             }
@@ -1553,17 +1986,10 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
                                    "_%s", yaml_config->metrics[i].queries[j].columns[k].name);
             }
 
-            if (config->number_of_metric_names < NUMBER_OF_METRIC_NAMES)
-            {
-               pgexporter_snprintf(config->metric_names[config->number_of_metric_names],
-                                   PROMETHEUS_LENGTH,
-                                   "%s",
-                                   final_metric_name);
-               config->number_of_metric_names++;
-            }
-            else
+            if (pgexporter_metric_names_add(&config->metric_names, final_metric_name))
             {
-               pgexporter_log_warn("Maximum metric names reached (%d), skipping: %s", NUMBER_OF_METRIC_NAMES, final_metric_name);
+               pgexporter_log_error("Failed to register metric name: %s", final_metric_name);
+               return 1;
             }
          }
       }
@@ -1572,6 +1998,34 @@ semantics_yaml(struct prometheus* prometheus, int prometheus_idx, yaml_config_t*
    return 0;
 }
 
+static bool
+is_duplicate_query(yaml_config_t* yaml_config, int metric, int query)
+{
+   int version = yaml_config->metrics[metric].queries[query].version;
+
+   if (version == 0)
+   {
+      version = yaml_config->default_version;
+   }
+
+   for (int j = 0; j < query; j++)
+   {
+      int other = yaml_config->metrics[metric].queries[j].version;
+
+      if (other == 0)
+      {
+         other = yaml_config->default_version;
+      }
+
+      if (other == version)
+      {
+         return true;
+      }
+   }
+
+   return false;
+}
+
 static struct extension_metrics*
 search_or_add_extension(struct configuration* config, char* extension_name)
 {
@@ -1592,83 +2046,140 @@ search_or_add_extension(struct configuration* config, char* extension_name)
    struct extension_metrics* ext = &config->extensions[config->number_of_extensions];
    memcpy(ext->extension_name, extension_name, MIN(PROMETHEUS_LENGTH - 1, strlen(extension_name)));
    ext->number_of_metrics = 0;
+   ext->capacity = 0;
+   ext->metrics = NULL;
    config->number_of_extensions++;
 
    return ext;
 }
 
+static int
+reserve_extension_metrics(struct extension_metrics* ext, int number_of_metrics)
+{
+   void* metrics = NULL;
+
+   if (number_of_metrics <= ext->capacity)
+   {
+      return 0;
+   }
+
+   if (number_of_metrics > NUMBER_OF_METRICS)
+   {
+      pgexporter_log_error("Maximum metrics per extension exceeded for %s", ext->extension_name);
+      return 1;
+   }
+
+   /* The processes forked since the load use the catalog, so it never moves */
+   if (ext->number_of_metrics > 0)
+   {
+      pgexporter_log_error("The metrics of extension %s are already loaded", ext->extension_name);
+      return 1;
+   }
+
+   /* Only what the catalog needs, the query alternatives are separate segments */
+   if (pgexporter_create_shared_memory(number_of_metrics * sizeof(struct prometheus), HUGEPAGE_OFF, &metrics))
+   {
+      pgexporter_log_error("Unable to allocate the metrics of extension %s", ext->extension_name);
+      return 1;
+   }
+
+   if (ext->metrics != NULL)
+   {
+      pgexporter_destroy_shared_memory(ext->metrics, ext->capacity * sizeof(struct prometheus));
+   }
+
+   ext->generation = extension_generation;
+   ext->metrics = (struct prometheus*)metrics;
+   ext->capacity = number_of_metrics;
+
+   return 0;
+}
+
+bool
+pgexporter_is_extension_mapped(struct extension_metrics* ext)
+{
+   /* A forked process keeps the generation of its parent at the fork */
+   return ext->metrics != NULL && ext->generation <= extension_generation;
+}
+
+bool
+pgexporter_is_extension_yaml_loaded(struct configuration* config, char* extension_name)
+{
+   for (int i = 0; i < config->number_of_extensions; i++)
+   {
+      if (!strcmp(config->extensions[i].extension_name, extension_name))
+      {
+         return config->extensions[i].number_of_metrics > 0;
+      }
+   }
+
+   return false;
+}
+
 int
 pgexporter_load_single_extension_yaml(char* extensions_path, char* extension_name, struct configuration* config)
+{
+   return pgexporter_load_extension_yaml_list(extensions_path, &extension_name, 1, config);
+}
+
+int
+pgexporter_load_extension_yaml_list(char* extensions_path, char** extension_names, int number_of_extensions, struct configuration* config)
 {
    char yaml_path[MAX_PATH];
-   FILE* file = NULL;
-   int number_of_metrics = 0;
+   yaml_file_t* files = NULL;
+   int number_of_files = 0;
    int ret = 0;
-   yaml_config_t temp_config;
 
-   if (!extensions_path || !extension_name || !config)
+   if (!extensions_path || !extension_names || !config || number_of_extensions <= 0)
    {
       pgexporter_log_debug("Invalid parameters for loading extension YAML");
       goto error;
    }
 
-   /* Construct the YAML file path */
-   ret = pgexporter_snprintf(yaml_path, MAX_PATH, "%s/%s.yaml", extensions_path, extension_name);
-   if (ret >= MAX_PATH)
+   files = (yaml_file_t*)calloc(number_of_extensions, sizeof(yaml_file_t));
+   if (files == NULL)
    {
-      pgexporter_log_debug("Extension YAML path too long for extension %s", extension_name);
       goto error;
    }
 
-   pgexporter_log_debug("Looking for extension YAML at: %s", yaml_path);
+   /* The catalogs of this load aren't mapped in the processes forked before it */
+   extension_generation++;
 
-   file = fopen(yaml_path, "r");
-   if (file == NULL)
+   for (int i = 0; i < number_of_extensions; i++)
    {
-      pgexporter_log_debug("Extension YAML file not found: %s (extension: %s)",
-                           yaml_path, extension_name);
-      goto error;
-   }
-
-   pgexporter_log_debug("Found and opened extension YAML: %s", yaml_path);
+      if (pgexporter_is_extension_yaml_loaded(config, extension_names[i]))
+      {
+         pgexporter_log_debug("Extension YAML for %s is already loaded", extension_names[i]);
+         continue;
+      }
 
-   /* parse just enough to check extension name */
-   memset(&temp_config, 0, sizeof(yaml_config_t));
-   if (parse_yaml(file, &temp_config) == 0)
-   {
-      if (temp_config.is_extension && temp_config.extension_name)
+      /* Construct the YAML file path */
+      ret = pgexporter_snprintf(yaml_path, MAX_PATH, "%s/%s.yaml", extensions_path, extension_names[i]);
+      if (ret >= MAX_PATH)
       {
-         if (strcmp(extension_name, temp_config.extension_name) != 0)
-         {
-            pgexporter_log_error("Extension name mismatch: file '%s.yaml' declares extension '%s'",
-                                 extension_name, temp_config.extension_name);
-            free_yaml_config(&temp_config);
-            goto error;
-         }
+         pgexporter_log_debug("Extension YAML path too long for extension %s", extension_names[i]);
+         goto error;
       }
-   }
-   free_yaml_config(&temp_config);
-   rewind(file);
 
-   ret = pgexporter_read_yaml_from_file_pointer(config, NULL, 0, &number_of_metrics, file);
-   if (ret != 0)
-   {
-      pgexporter_log_debug("Failed to parse extension YAML: %s (extension: %s)",
-                           yaml_path, extension_name);
-      goto error;
+      pgexporter_log_debug("Looking for extension YAML at: %s", yaml_path);
+
+      files[number_of_files].path = pgexporter_append(NULL, yaml_path);
+      files[number_of_files].extension_name = pgexporter_append(NULL, extension_names[i]);
+      number_of_files++;
    }
 
-   pgexporter_log_debug("Successfully loaded %d metrics from extension YAML: %s",
-                        number_of_metrics, extension_name);
+   ret = number_of_files > 0 ? read_yaml_files(config, NULL, 0, files, number_of_files, false) : 0;
 
-   fclose(file);
-   return 0;
+   free_yaml_files(files, number_of_extensions);
+
+   return ret;
 
 error:
-   if (file != NULL)
+   if (files != NULL)
    {
-      fclose(file);
+      free_yaml_files(files, number_of_extensions);
    }
+
    return 1;
 }
 
@@ -1681,6 +2192,11 @@ semantics_extension_yaml(struct configuration* config, yaml_config_t* yaml_confi
       return 1;
    }
 
+   if (reserve_extension_metrics(ext, ext->number_of_metrics + yaml_config->n_metrics))
+   {
+      return 1;
+   }
+
    for (int i = 0; i < yaml_config->n_metrics; i++)
    {
       if (ext->number_of_metrics >= NUMBER_OF_METRICS)
@@ -1734,17 +2250,36 @@ semantics_extension_yaml(struct configuration* config, yaml_config_t* yaml_confi
       {
          prom->server_query_type = SERVER_QUERY_REPLICA;
       }
+      else if (!strcmp(yaml_config->metrics[i].server, "cluster"))
+      {
+         prom->server_query_type = SERVER_QUERY_CLUSTER;
+      }
       else
       {
          pgexporter_log_error("pgexporter: unexpected server %s", yaml_config->metrics[i].server);
          return 1;
       }
 
+      // Derived gauges
+      if (pgexporter_derive_parse(yaml_config->metrics[i].derive, &prom->derive))
+      {
+         pgexporter_log_error("pgexporter: unexpected derive %s", yaml_config->metrics[i].derive);
+         return 1;
+      }
+
+      prom->slices = yaml_config->metrics[i].slices;
+
       for (int j = 0; j < yaml_config->metrics[i].n_queries; j++)
       {
          struct ext_query_alts* new_query = NULL;
          void* new_query_shmem = NULL;
 
+         if (pgexporter_slice_validate(prom->slices, prom->derive, yaml_config->metrics[i].queries[j].query))
+         {
+            pgexporter_log_error("pgexporter: unexpected slices %d for %s", prom->slices, prom->tag);
+            return 1;
+         }
+
          pgexporter_create_shared_memory(sizeof(struct ext_query_alts), HUGEPAGE_OFF, &new_query_shmem);
          new_query = (struct ext_query_alts*)new_query_shmem;
 
@@ -1796,6 +2331,19 @@ semantics_extension_yaml(struct configuration* config, yaml_config_t* yaml_confi
                pgexporter_log_error("pgexporter: unexpected type %s", yaml_config->metrics[i].queries[j].columns[k].type);
                return 1;
             }
+
+            // Buckets
+            if (yaml_config->metrics[i].queries[j].columns[k].buckets)
+            {
+               if (new_query->node.columns[k].type != HISTOGRAM_TYPE ||
+                   pgexporter_parse_buckets(yaml_config->metrics[i].queries[j].columns[k].buckets,
+                                            new_query->node.columns[k].buckets,
+                                            &new_query->node.columns[k].n_buckets))
+               {
+                  pgexporter_log_error("pgexporter: unexpected buckets %s", yaml_config->metrics[i].queries[j].columns[k].buckets);
+                  return 1;
+               }
+            }
          }
 
          prom->ext_root = pgexporter_insert_extension_node_avl(prom->ext_root, &new_query);
@@ -1823,17 +2371,10 @@ semantics_extension_yaml(struct configuration* config, yaml_config_t* yaml_confi
                                    "_%s", yaml_config->metrics[i].queries[j].columns[k].name);
             }
 
-            if (config->number_of_metric_names < NUMBER_OF_METRIC_NAMES)
-            {
-               pgexporter_snprintf(config->metric_names[config->number_of_metric_names],
-                                   PROMETHEUS_LENGTH,
-                                   "%s",
-                                   final_metric_name);
-               config->number_of_metric_names++;
-            }
-            else
+            if (pgexporter_metric_names_add(&config->metric_names, final_metric_name))
             {
-               pgexporter_log_warn("Maximum metric names reached (%d), skipping: %s", NUMBER_OF_METRIC_NAMES, final_metric_name);
+               pgexporter_log_error("Failed to register metric name: %s", final_metric_name);
+               return 1;
             }
          }
       }
@@ -28,12 +28,15 @@
 
 /* pgexporter */
 #include <pgexporter.h>
+#include <activity.h>
 #include <art.h>
 #include <bridge.h>
 #include <cmd.h>
 #include <console.h>
 #include <configuration.h>
 #include <connection.h>
+#include <derive.h>
+#include <disk.h>
 #include <extension.h>
 #include <ext_query_alts.h>
 #include <fips.h>
@@ -50,10 +53,13 @@
 #include <remote.h>
 #include <security.h>
 #include <server.h>
+#include <shard.h>
 #include <shmem.h>
+#include <slice.h>
 #include <status.h>
 #include <utils.h>
 #include <yaml_configuration.h>
+#include <alert.h>
 #include <alert_configuration.h>
 #include <json_configuration.h>
 
@@ -126,11 +132,28 @@ static void accept_http_cb(struct io_watcher* watcher,
                            void (*restart_fn)(void));
 static void restart_metrics(void);
 static void restart_console(void);
+static void start_console_stream(void);
+static void restart_console_stream(void);
+static void shutdown_console_stream(bool remove);
+static void start_shard(int shard);
+static void start_shards(void);
+static void restart_shards(void);
+static void shutdown_shards(void);
+static void start_disk(void);
+static void restart_disk(void);
+static void shutdown_disk(void);
+static void start_activity(void);
+static void restart_activity(void);
+static void shutdown_activity(void);
 static void restart_history(void);
 static void restart_bridge(void);
 static void restart_bridge_json(void);
 static void bridge_serve(SSL* ssl, int fd);
 static void bridge_json_serve(SSL* ssl, int fd);
+static void tls_ticket_rotation_cb(void);
+static void start_alerts(void);
+static void restart_alerts(void);
+static void extension_detection_cb(void);
 
 static volatile int stop = 0;
 static char** argv_ptr;
@@ -144,6 +167,20 @@ static int metrics_fds_length = -1;
 static struct accept_io io_console[MAX_FDS];
 static int* console_fds = NULL;
 static int console_fds_length = -1;
+static int unix_stream_socket = -1;
+static pid_t console_stream_pid = 0;
+static time_t console_stream_start = 0;
+static bool console_stream_restart = false;
+static pid_t shard_pids[NUMBER_OF_SHARDS];
+static time_t shard_starts[NUMBER_OF_SHARDS];
+static bool shard_restart[NUMBER_OF_SHARDS];
+static size_t slice_shmem_size = 0;
+static pid_t disk_pid = 0;
+static time_t disk_start = 0;
+static bool disk_restart = false;
+static pid_t activity_pid = 0;
+static time_t activity_start = 0;
+static bool activity_restart = false;
 static struct accept_io io_history[MAX_FDS];
 static int* history_fds = NULL;
 static int history_fds_length = -1;
@@ -338,6 +375,263 @@ start_console(void)
    }
 }
 
+static void
+start_console_stream(void)
+{
+   pid_t pid;
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgexporter_log_error("Console stream: No fork");
+      return;
+   }
+
+   if (pid == 0)
+   {
+      if (main_loop)
+      {
+         pgexporter_event_loop_fork();
+      }
+
+      shutdown_ports(false);
+
+      pgexporter_set_proc_title(1, argv_ptr, "console", "stream");
+      pgexporter_console_stream(unix_stream_socket);
+   }
+
+   console_stream_pid = pid;
+   console_stream_start = time(NULL);
+   console_stream_restart = false;
+}
+
+static void
+restart_console_stream(void)
+{
+   /* The worker maps the shared memory of the configuration it was forked with */
+   if (console_stream_pid > 0)
+   {
+      console_stream_restart = true;
+      kill(console_stream_pid, SIGTERM);
+   }
+}
+
+static void
+shutdown_console_stream(bool remove)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (console_stream_pid > 0)
+   {
+      kill(console_stream_pid, SIGTERM);
+      console_stream_pid = 0;
+   }
+
+   if (unix_stream_socket != -1)
+   {
+      pgexporter_disconnect(unix_stream_socket);
+      unix_stream_socket = -1;
+      errno = 0;
+      if (remove)
+      {
+         pgexporter_remove_unix_socket(config->unix_socket_dir, STREAM_UDS);
+      }
+      errno = 0;
+   }
+}
+
+static void
+start_shard(int shard)
+{
+   pid_t pid;
+   char title[16];
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgexporter_log_error("Shard %d: No fork", shard);
+      return;
+   }
+
+   if (pid == 0)
+   {
+      if (main_loop)
+      {
+         pgexporter_event_loop_fork();
+      }
+
+      shutdown_ports(false);
+
+      pgexporter_snprintf(&title[0], sizeof(title), "%d", shard);
+      pgexporter_set_proc_title(1, argv_ptr, "shard", &title[0]);
+      pgexporter_shard_run(shard);
+   }
+
+   shard_pids[shard] = pid;
+   shard_starts[shard] = time(NULL);
+   shard_restart[shard] = false;
+}
+
+static void
+start_shards(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < config->metrics_shards; i++)
+   {
+      start_shard(i);
+   }
+}
+
+static void
+restart_shards(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   /* The servers may have moved, so the shards start over */
+   for (int i = 0; i < config->metrics_shards; i++)
+   {
+      if (shard_pids[i] > 0)
+      {
+         shard_restart[i] = true;
+         kill(shard_pids[i], SIGTERM);
+      }
+   }
+}
+
+static void
+shutdown_shards(void)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   for (int i = 0; i < config->metrics_shards; i++)
+   {
+      if (shard_pids[i] > 0)
+      {
+         kill(shard_pids[i], SIGTERM);
+         shard_pids[i] = 0;
+      }
+   }
+}
+
+static void
+start_disk(void)
+{
+   pid_t pid;
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgexporter_log_error("Disk: No fork");
+      return;
+   }
+
+   if (pid == 0)
+   {
+      if (main_loop)
+      {
+         pgexporter_event_loop_fork();
+      }
+
+      shutdown_ports(false);
+
+      pgexporter_set_proc_title(1, argv_ptr, "disk", NULL);
+      pgexporter_disk_run();
+   }
+
+   disk_pid = pid;
+   disk_start = time(NULL);
+   disk_restart = false;
+}
+
+static void
+restart_disk(void)
+{
+   /* The directories may have changed, so the trees are built again */
+   if (disk_pid > 0)
+   {
+      disk_restart = true;
+      kill(disk_pid, SIGTERM);
+   }
+   else if (pgexporter_disk_enabled())
+   {
+      start_disk();
+   }
+}
+
+static void
+shutdown_disk(void)
+{
+   if (disk_pid > 0)
+   {
+      kill(disk_pid, SIGTERM);
+      disk_pid = 0;
+   }
+}
+
+static void
+start_activity(void)
+{
+   pid_t pid;
+
+   pid = fork();
+   if (pid == -1)
+   {
+      pgexporter_log_error("Activity: No fork");
+      return;
+   }
+
+   if (pid == 0)
+   {
+      if (main_loop)
+      {
+         pgexporter_event_loop_fork();
+      }
+
+      shutdown_ports(false);
+
+      pgexporter_set_proc_title(1, argv_ptr, "activity", NULL);
+      pgexporter_activity_run();
+   }
+
+   activity_pid = pid;
+   activity_start = time(NULL);
+   activity_restart = false;
+}
+
+static void
+restart_activity(void)
+{
+   /* The servers and the users may have changed */
+   if (activity_pid > 0)
+   {
+      activity_restart = true;
+      kill(activity_pid, SIGTERM);
+   }
+   else if (pgexporter_activity_enabled())
+   {
+      start_activity();
+   }
+}
+
+static void
+shutdown_activity(void)
+{
+   if (activity_pid > 0)
+   {
+      kill(activity_pid, SIGTERM);
+      activity_pid = 0;
+   }
+}
+
 static void
 shutdown_console(bool remove __attribute__((unused)))
 {
@@ -484,6 +778,9 @@ usage(void)
    printf("Report bugs: %s\n", PGEXPORTER_ISSUES);
 }
 
+/* Interval of the check for extensions detected by the scrape processes (in ms) */
+#define EXTENSION_DETECTION_INTERVAL_MS 1000
+
 /* Fixed interval for the history retention pruning tick (1 hour, in ms) */
 #define HISTORY_RETENTION_PRUNE_INTERVAL_MS (60 * 60 * 1000)
 
@@ -491,6 +788,12 @@ static struct periodic_watcher history_watcher;
 static struct periodic_watcher history_retention_watcher;
 static bool history_started = false;
 static bool history_retention_started = false;
+static struct periodic_watcher tls_ticket_watcher;
+static bool tls_ticket_started = false;
+static struct periodic_watcher alert_watcher;
+static bool alert_started = false;
+static struct periodic_watcher extension_watcher;
+static bool extension_started = false;
 
 int
 main(int argc, char** argv)
@@ -512,6 +815,11 @@ main(int argc, char** argv)
    size_t prometheus_cache_shmem_size = 0;
    size_t bridge_cache_shmem_size = 0;
    size_t bridge_json_cache_shmem_size = 0;
+   size_t tls_session_shmem_size = 0;
+   size_t shard_shmem_size = 0;
+   size_t derive_shmem_size = 0;
+   size_t activity_shmem_size = 0;
+   size_t console_shmem_size = 0;
    struct configuration* config = NULL;
    int ret;
    int allowed_collectors_idx = 0;
@@ -1200,6 +1508,58 @@ main(int argc, char** argv)
       errx(1, "Error in creating and initializing prometheus cache shared memory");
    }
 
+   if (config->metrics > 0 && config->metrics_shards > 0)
+   {
+      if (pgexporter_shard_init(&shard_shmem_size, &shard_shmem))
+      {
+#ifdef HAVE_SYSTEMD
+         sd_notifyf(0, "STATUS=Error in creating and initializing shard shared memory");
+#endif
+         errx(1, "Error in creating and initializing shard shared memory");
+      }
+   }
+
+   if (config->metrics > 0)
+   {
+      if (pgexporter_derive_init(&derive_shmem_size, &derive_shmem))
+      {
+#ifdef HAVE_SYSTEMD
+         sd_notifyf(0, "STATUS=Error in creating and initializing derive shared memory");
+#endif
+         errx(1, "Error in creating and initializing derive shared memory");
+      }
+
+      if (pgexporter_slice_init(&slice_shmem_size, &slice_shmem))
+      {
+#ifdef HAVE_SYSTEMD
+         sd_notifyf(0, "STATUS=Error in creating and initializing slice shared memory");
+#endif
+         errx(1, "Error in creating and initializing slice shared memory");
+      }
+   }
+
+   if (config->console > 0)
+   {
+      if (pgexporter_console_init(&console_shmem_size, &console_shmem))
+      {
+#ifdef HAVE_SYSTEMD
+         sd_notifyf(0, "STATUS=Error in creating and initializing console shared memory");
+#endif
+         errx(1, "Error in creating and initializing console shared memory");
+      }
+   }
+
+   if (config->activity_sampling > 0)
+   {
+      if (pgexporter_activity_init(&activity_shmem_size, &activity_shmem))
+      {
+#ifdef HAVE_SYSTEMD
+         sd_notifyf(0, "STATUS=Error in creating and initializing activity shared memory");
+#endif
+         errx(1, "Error in creating and initializing activity shared memory");
+      }
+   }
+
    if (config->bridge > 0 && pgexporter_time_is_valid(config->bridge_cache_max_age) && config->bridge_cache_max_size > 0)
    {
       if (pgexporter_bridge_init_cache(&bridge_cache_shmem_size, &bridge_cache_shmem))
@@ -1222,6 +1582,12 @@ main(int argc, char** argv)
       }
    }
 
+   /* Resumption is best effort, the listeners work without it */
+   if (strlen(config->metrics_cert_file) > 0 || strlen(config->history_cert_file) > 0)
+   {
+      pgexporter_tls_session_init(&tls_session_shmem_size, &tls_session_shmem);
+   }
+
    /* Bind Unix Domain Socket: Main */
    if (pgexporter_bind_unix_socket(config->unix_socket_dir, MAIN_UDS, &unix_management_socket))
    {
@@ -1327,6 +1693,17 @@ main(int argc, char** argv)
       }
 
       start_console();
+
+      /* Bind console stream socket */
+      if (pgexporter_bind_unix_socket(config->unix_socket_dir, STREAM_UDS, &unix_stream_socket))
+      {
+         pgexporter_log_warn("pgexporter: Could not bind to %s/%s, console stream disabled", config->unix_socket_dir, STREAM_UDS);
+         unix_stream_socket = -1;
+      }
+      else
+      {
+         start_console_stream();
+      }
    }
 
    if (config->history > 0)
@@ -1472,6 +1849,40 @@ main(int argc, char** argv)
          }
       }
    }
+
+   /* The ticket keys are rotated from the event loop */
+   if (tls_session_shmem != NULL)
+   {
+      if (pgexporter_periodic_init(&tls_ticket_watcher, tls_ticket_rotation_cb, TLS_TICKET_KEY_ROTATION_MS) == 0)
+      {
+         pgexporter_periodic_start(&tls_ticket_watcher);
+         tls_ticket_started = true;
+      }
+      else
+      {
+         pgexporter_log_error("TLS: failed to initialize the ticket key rotation watcher; session resumption disabled");
+         pgexporter_destroy_shared_memory(tls_session_shmem, tls_session_shmem_size);
+         tls_session_shmem = NULL;
+         tls_session_shmem_size = 0;
+      }
+   }
+
+   /* The scrape processes detect extensions, and their catalogs are loaded here */
+   if (config->metrics > 0)
+   {
+      if (pgexporter_periodic_init(&extension_watcher, extension_detection_cb, EXTENSION_DETECTION_INTERVAL_MS) == 0)
+      {
+         pgexporter_periodic_start(&extension_watcher);
+         extension_started = true;
+      }
+      else
+      {
+         pgexporter_log_error("Extensions: failed to initialize the detection watcher; catalogs load on reload");
+      }
+   }
+
+   start_alerts();
+
    pgexporter_log_debug("Management: %d", unix_management_socket);
    pgexporter_log_debug("Transfer: %d", unix_transfer_socket);
    pgexporter_os_kernel_version(&os, &kernel_major, &kernel_minor, &kernel_patch);
@@ -1532,6 +1943,12 @@ main(int argc, char** argv)
       exit(1);
    }
 
+   /* The extension catalogs may add sliced metrics */
+   if (config->metrics > 0 && pgexporter_slice_resize(&slice_shmem_size, &slice_shmem))
+   {
+      pgexporter_log_warn("Failed to resize the slice shared memory");
+   }
+
    for (int i = 0; i < config->number_of_servers; i++)
    {
       if (config->servers[i].fd != -1)
@@ -1547,6 +1964,23 @@ main(int argc, char** argv)
 
    pgexporter_close_connections();
 
+   /* The shards own the connections from now on */
+   if (shard_shmem != NULL)
+   {
+      pgexporter_set_server_mask(0);
+      start_shards();
+   }
+
+   if (pgexporter_disk_enabled())
+   {
+      start_disk();
+   }
+
+   if (pgexporter_activity_enabled())
+   {
+      start_activity();
+   }
+
    /* Run event loop */
    pgexporter_event_loop_run();
 
@@ -1580,16 +2014,44 @@ main(int argc, char** argv)
       pgexporter_periodic_stop(&history_retention_watcher);
    }
 
+   if (tls_ticket_started)
+   {
+      pgexporter_periodic_stop(&tls_ticket_watcher);
+   }
+
    if (history_started)
    {
       pgexporter_periodic_stop(&history_watcher);
    }
 
+   if (alert_started)
+   {
+      pgexporter_periodic_stop(&alert_watcher);
+   }
+
+   if (extension_started)
+   {
+      pgexporter_periodic_stop(&extension_watcher);
+   }
+
    if (config->history != -1)
    {
       shutdown_history(true);
    }
 
+   if (config->console > 0)
+   {
+      shutdown_console_stream(true);
+   }
+
+   if (shard_shmem != NULL)
+   {
+      shutdown_shards();
+   }
+
+   shutdown_disk();
+   shutdown_activity();
+
    for (int i = 0; i < 7; i++)
    {
       pgexporter_signal_stop(&signal_watchers[i]);
@@ -1621,6 +2083,36 @@ main(int argc, char** argv)
    pgexporter_destroy_shared_memory(prometheus_cache_shmem,
                                     prometheus_cache_shmem_size);
 
+   if (shard_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(shard_shmem, shard_shmem_size);
+   }
+
+   if (derive_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(derive_shmem, derive_shmem_size);
+   }
+
+   if (slice_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(slice_shmem, slice_shmem_size);
+   }
+
+   if (activity_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(activity_shmem, activity_shmem_size);
+   }
+
+   if (console_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(console_shmem, console_shmem_size);
+   }
+
+   if (tls_session_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(tls_session_shmem, tls_session_shmem_size);
+   }
+
 #ifdef HAVE_LINUX
    pgexporter_free_proc_title();
 #endif
@@ -2018,6 +2510,9 @@ http_child_serve(int client_fd, struct accept_io* ai, const char* title,
 {
    SSL_CTX* ctx = NULL;
    SSL* client_ssl = NULL;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
 
    if (main_loop)
    {
@@ -2035,6 +2530,16 @@ http_child_serve(int client_fd, struct accept_io* ai, const char* title,
          exit(1);
       }
 
+      if (config->metrics_ktls)
+      {
+         pgexporter_enable_ktls(ctx);
+      }
+
+      if (tls_session_shmem != NULL && pgexporter_enable_tls_session_resumption(ctx))
+      {
+         pgexporter_log_debug("http_child_serve: session resumption not available for %s", title);
+      }
+
       if (pgexporter_create_ssl_server(ctx, (char*)key_file, (char*)cert_file, (char*)ca_file, client_fd, &client_ssl))
       {
          pgexporter_log_error("http_child_serve: could not create SSL server for %s", title);
@@ -2059,6 +2564,61 @@ bridge_json_serve(SSL* ssl __attribute__((unused)), int fd)
    pgexporter_bridge_json(fd);
 }
 
+static void
+tls_ticket_rotation_cb(void)
+{
+   pgexporter_tls_session_rotate();
+}
+
+static void
+extension_detection_cb(void)
+{
+   int before = 0;
+   int after = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (!atomic_exchange(&config->extensions_detected, false))
+   {
+      return;
+   }
+
+   for (int i = 0; i < config->number_of_extensions; i++)
+   {
+      before += config->extensions[i].number_of_metrics > 0 ? 1 : 0;
+   }
+
+   if (pgexporter_load_extension_yamls(config))
+   {
+      pgexporter_log_warn("Failed to load extension YAMLs");
+   }
+
+   for (int i = 0; i < config->number_of_extensions; i++)
+   {
+      after += config->extensions[i].number_of_metrics > 0 ? 1 : 0;
+   }
+
+   /* A catalog without a file is looked for again on the next detection */
+   if (after == before)
+   {
+      return;
+   }
+
+   pgexporter_log_debug("Extensions: %d catalogs loaded after a detection", after - before);
+
+   if (config->metrics > 0 && pgexporter_slice_resize(&slice_shmem_size, &slice_shmem))
+   {
+      pgexporter_log_warn("Failed to resize the slice shared memory");
+   }
+
+   /* The shards were forked before the catalogs were mapped */
+   if (shard_shmem != NULL)
+   {
+      restart_shards();
+   }
+}
+
 static void
 restart_metrics(void)
 {
@@ -2463,12 +3023,123 @@ sigchld_cb(void)
          atomic_store(&config->history_worker_running, false);
       }
 
+      /* Same safeguard for the alert evaluator. */
+      if (config != NULL && pid == (pid_t)atomic_load(&config->alerts_worker_pid))
+      {
+         atomic_store(&config->alerts_worker_pid, 0);
+         atomic_store(&config->alerts_worker_running, false);
+      }
+
       /* Same safeguard for the retention pruner worker. */
       if (config != NULL && pid == (pid_t)atomic_load(&config->history_retention_worker_pid))
       {
          atomic_store(&config->history_retention_worker_pid, 0);
          atomic_store(&config->history_retention_worker_running, false);
       }
+
+      /* The shards are long-lived too */
+      for (int i = 0; config != NULL && i < config->metrics_shards; i++)
+      {
+         if (shard_pids[i] > 0 && pid == shard_pids[i])
+         {
+            shard_pids[i] = 0;
+
+            if (!config->keep_running)
+            {
+               break;
+            }
+
+            if (shard_restart[i])
+            {
+               start_shard(i);
+            }
+            else if (time(NULL) - shard_starts[i] < 5)
+            {
+               pgexporter_log_error("Shard %d: exited right away, not restarting", i);
+            }
+            else
+            {
+               pgexporter_log_warn("Shard %d: exited, restarting", i);
+               start_shard(i);
+            }
+         }
+      }
+
+      /* The disk process too */
+      if (disk_pid > 0 && pid == disk_pid)
+      {
+         disk_pid = 0;
+
+         if (config != NULL && config->keep_running)
+         {
+            if (disk_restart)
+            {
+               if (pgexporter_disk_enabled())
+               {
+                  start_disk();
+               }
+            }
+            else if (time(NULL) - disk_start < 5)
+            {
+               pgexporter_log_error("Disk: exited right away, not restarting");
+            }
+            else
+            {
+               pgexporter_log_warn("Disk: exited, restarting");
+               start_disk();
+            }
+         }
+      }
+
+      /* The sampler too */
+      if (activity_pid > 0 && pid == activity_pid)
+      {
+         activity_pid = 0;
+
+         if (config != NULL && config->keep_running)
+         {
+            if (activity_restart)
+            {
+               if (pgexporter_activity_enabled())
+               {
+                  start_activity();
+               }
+            }
+            else if (time(NULL) - activity_start < 5)
+            {
+               pgexporter_log_error("Activity: exited right away, not restarting");
+            }
+            else
+            {
+               pgexporter_log_warn("Activity: exited, restarting");
+               start_activity();
+            }
+         }
+      }
+
+      /* The console stream worker is long-lived, so bring it back */
+      if (pid == console_stream_pid)
+      {
+         console_stream_pid = 0;
+
+         if (config != NULL && config->keep_running && unix_stream_socket != -1)
+         {
+            if (console_stream_restart)
+            {
+               start_console_stream();
+            }
+            /* Don't spin on a worker that can't start */
+            else if (time(NULL) - console_stream_start < 5)
+            {
+               pgexporter_log_error("Console stream: worker exited right away, not restarting");
+            }
+            else
+            {
+               pgexporter_log_warn("Console stream: worker exited, restarting");
+               start_console_stream();
+            }
+         }
+      }
    }
 }
 
@@ -2544,9 +3215,65 @@ reload_set_configuration(SSL* ssl, int client_fd, uint8_t compression, uint8_t e
    exit(exit_code);
 }
 
+static void
+start_alerts(void)
+{
+   int64_t alerts_interval_ms;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   /* The shards evaluate the alerts of their own servers */
+   if (!config->alerts_enabled || config->number_of_alerts <= 0 || shard_shmem != NULL)
+   {
+      return;
+   }
+
+   alerts_interval_ms = pgexporter_time_convert(config->alerts_interval, FORMAT_TIME_MS);
+
+   if (alerts_interval_ms <= 0)
+   {
+      alerts_interval_ms = 30000;
+   }
+   else if (alerts_interval_ms > INT_MAX)
+   {
+      alerts_interval_ms = INT_MAX;
+   }
+
+   if (pgexporter_periodic_init(&alert_watcher, pgexporter_alert_tick_cb, (int)alerts_interval_ms) == 0)
+   {
+      pgexporter_periodic_start(&alert_watcher);
+      alert_started = true;
+
+      /* Evaluate once when started */
+      pgexporter_alert_tick_cb();
+   }
+   else
+   {
+      pgexporter_log_error("Alerts: failed to initialize the evaluation watcher; alerts disabled");
+   }
+}
+
+static void
+restart_alerts(void)
+{
+   /* The reloaded configuration may change the alerts and their interval */
+   if (alert_started)
+   {
+      pgexporter_periodic_stop(&alert_watcher);
+      alert_started = false;
+   }
+
+   start_alerts();
+}
+
 static int
 reload_configuration(bool* restart)
 {
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
    errno = 0;
 
    *restart = false;
@@ -2567,6 +3294,28 @@ reload_configuration(bool* restart)
    /* Non-structural configuration changes have been applied successfully */
    pgexporter_log_info("Configuration reloaded successfully");
 
+   /* Load the catalogs of extensions detected since the last load */
+   if (pgexporter_load_extension_yamls(config))
+   {
+      pgexporter_log_warn("Failed to load extension YAMLs");
+   }
+
+   /* The restarted shards map the new table */
+   if (config->metrics > 0 && pgexporter_slice_resize(&slice_shmem_size, &slice_shmem))
+   {
+      pgexporter_log_warn("Failed to resize the slice shared memory");
+   }
+
+   if (shard_shmem != NULL)
+   {
+      restart_shards();
+   }
+
+   restart_disk();
+   restart_activity();
+   restart_console_stream();
+   restart_alerts();
+
    return 0;
 }
 
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pgexporter.h>
+#include <activity.h>
+#include <mctf.h>
+#include <shmem.h>
+#include <tscommon.h>
+#include <utils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void
+session(struct activity_session* s, int pid, char* state, char* type, char* event, char* backend_type)
+{
+   memset(s, 0, sizeof(struct activity_session));
+   s->pid = pid;
+   pgexporter_snprintf(s->state, ACTIVITY_NAME_LENGTH, "%s", state);
+   pgexporter_snprintf(s->wait_event_type, ACTIVITY_NAME_LENGTH, "%s", type);
+   pgexporter_snprintf(s->wait_event, ACTIVITY_NAME_LENGTH, "%s", event);
+   pgexporter_snprintf(s->backend_type, ACTIVITY_NAME_LENGTH, "%s", backend_type);
+}
+
+MCTF_TEST(test_activity_record)
+{
+   size_t size = 0;
+   int lock = -1;
+   struct activity_session sessions[3];
+   struct activity_server* aggregates = NULL;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_activity_init(&size, &activity_shmem), 0, cleanup, "activity init");
+
+   aggregates = pgexporter_activity_server(0);
+   MCTF_ASSERT_PTR_NONNULL(aggregates, cleanup, "aggregates of the server");
+
+   /* Out of pid order, the checkpointer has no state */
+   session(&sessions[0], 12, "", "Activity", "CheckpointerMain", "checkpointer");
+   session(&sessions[1], 10, "active", "Lock", "transactionid", "client backend");
+   session(&sessions[2], 11, "idle", "Client", "ClientRead", "client backend");
+   MCTF_ASSERT_INT_EQ(pgexporter_activity_record(0, sessions, 3, 1000), 0, cleanup, "first sample");
+
+   session(&sessions[0], 10, "active", "Lock", "transactionid", "client backend");
+   session(&sessions[1], 11, "active", "", "", "client backend");
+   session(&sessions[2], 12, "", "Activity", "CheckpointerMain", "checkpointer");
+   MCTF_ASSERT_INT_EQ(pgexporter_activity_record(0, sessions, 3, 1100), 0, cleanup, "second sample");
+
+   session(&sessions[0], 10, "active", "", "", "client backend");
+   session(&sessions[1], 12, "", "Activity", "CheckpointerMain", "checkpointer");
+   MCTF_ASSERT_INT_EQ(pgexporter_activity_record(0, sessions, 2, 1200), 0, cleanup, "third sample");
+
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->samples), 3, cleanup, "three samples");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->states[0]), 4, cleanup, "active sessions over the samples");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->states[1]), 1, cleanup, "idle sessions over the samples");
+
+   /* 1, 2 and 1 active sessions */
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->active.count), 3, cleanup, "one observation per sample");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->active.sum), 4, cleanup, "active sessions sum");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->active.buckets[1]), 2, cleanup, "samples with one active session");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->active.buckets[2]), 1, cleanup, "samples with two active sessions");
+
+   for (int i = 0; i < ACTIVITY_NUMBER_OF_WAIT_EVENTS; i++)
+   {
+      if (atomic_load(&aggregates->wait_events[i].used) && !strcmp(aggregates->wait_events[i].name, "transactionid"))
+      {
+         lock = i;
+      }
+   }
+   MCTF_ASSERT(lock != -1, cleanup, "the lock wait should be counted");
+   MCTF_ASSERT_STR_EQ(aggregates->wait_events[lock].type, "Lock", cleanup, "wait event type");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->wait_events[lock].samples), 2, cleanup, "the lock was seen twice");
+
+   /* The lock wait lasted from the first to the third sample, the client wait to the second */
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->waits[7].count), 1, cleanup, "one lock wait");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->waits[7].sum), 200, cleanup, "lock wait duration");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->waits[7].buckets[1]), 1, cleanup, "lock wait bucket");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->waits[2].count), 1, cleanup, "one client wait");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->waits[2].sum), 100, cleanup, "client wait duration");
+   MCTF_ASSERT_INT_EQ(atomic_load(&aggregates->waits[0].count), 0, cleanup, "the checkpointer is still waiting");
+
+cleanup:
+   pgexporter_activity_clear();
+   if (activity_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(activity_shmem, size);
+      activity_shmem = NULL;
+   }
+   MCTF_FINISH();
+}
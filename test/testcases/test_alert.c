@@ -28,6 +28,7 @@
  */
 
 #include <pgexporter.h>
+#include <alert.h>
 #include <alert_configuration.h>
 #include <configuration.h>
 #include <memory.h>
@@ -622,3 +623,67 @@ MCTF_TEST(test_alert_merge_combined)
 cleanup:
    MCTF_FINISH();
 }
+
+// Test parsing the for duration and the clear threshold
+MCTF_TEST(test_alert_parse_hysteresis)
+{
+   struct configuration* config;
+   char path[MAX_PATH];
+
+   config = (struct configuration*)shmem;
+
+   config->alerts_enabled = true;
+   MCTF_ASSERT(build_test_conf_path("alert", "hysteresis.yaml", path, sizeof(path)) == 0,
+               cleanup, "Failed to build config path");
+
+   memset(config->alerts_path, 0, MAX_PATH);
+   memcpy(config->alerts_path, path, strlen(path));
+   config->number_of_alerts = 0;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_read_alerts_configuration(shmem), 0, cleanup, "read_alerts_configuration failed");
+   MCTF_ASSERT_INT_EQ(config->number_of_alerts, 1, cleanup, "expected 1 alert");
+   MCTF_ASSERT_INT_EQ(config->alerts[0].for_duration.ms, 120000, cleanup, "for mismatch");
+   MCTF_ASSERT_INT_EQ(config->alerts[0].hysteresis, true, cleanup, "hysteresis mismatch");
+   MCTF_ASSERT_INT_EQ(config->alerts[0].clear_threshold, 70, cleanup, "clear_threshold mismatch");
+
+cleanup:
+   MCTF_FINISH();
+}
+
+// Test the inactive, pending and firing transitions with hysteresis
+MCTF_TEST(test_alert_transition)
+{
+   struct configuration* config;
+   struct alert_definition* alert = NULL;
+   time_t now = 1000000;
+
+   config = (struct configuration*)shmem;
+
+   MCTF_ASSERT(config->number_of_servers > 0, cleanup, "expected at least 1 server");
+
+   alert = &config->alerts[0];
+   memset(alert, 0, sizeof(struct alert_definition));
+   pgexporter_snprintf(alert->name, sizeof(alert->name), "%s", "test_transition");
+   alert->alert_type = ALERT_TYPE_QUERY;
+   alert->operator = ALERT_OPERATOR_GT;
+   alert->threshold = 80;
+   alert->hysteresis = true;
+   alert->clear_threshold = 70;
+   alert->for_duration = PGEXPORTER_TIME_SEC(60);
+   alert->servers_all = true;
+   config->number_of_alerts = 1;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 50, now), ALERT_STATE_INACTIVE, cleanup, "below threshold should be inactive");
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 85, now), ALERT_STATE_PENDING, cleanup, "above threshold should be pending");
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 85, now + 30), ALERT_STATE_PENDING, cleanup, "should stay pending within for");
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 85, now + 60), ALERT_STATE_FIRING, cleanup, "should fire after for");
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 75, now + 90), ALERT_STATE_FIRING, cleanup, "should keep firing above clear threshold");
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 65, now + 120), ALERT_STATE_INACTIVE, cleanup, "should resolve below clear threshold");
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 85, now + 150), ALERT_STATE_PENDING, cleanup, "should be pending again");
+   MCTF_ASSERT_INT_EQ(pgexporter_alert_transition(alert, 0, 75, now + 180), ALERT_STATE_INACTIVE, cleanup, "pending should reset below threshold");
+   MCTF_ASSERT_INT_EQ(atomic_load(&alert->status[0].valid), true, cleanup, "status should be valid");
+   MCTF_ASSERT_INT_EQ(atomic_load(&alert->status[0].value), 75, cleanup, "value mismatch");
+
+cleanup:
+   MCTF_FINISH();
+}
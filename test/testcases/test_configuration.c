@@ -29,9 +29,12 @@
 
 #include <pgexporter.h>
 #include <configuration.h>
+#include <deque.h>
 #include <json.h>
 #include <management.h>
+#include <message.h>
 #include <network.h>
+#include <server.h>
 #include <shmem.h>
 #include <tsclient.h>
 #include <tscommon.h>
@@ -419,6 +422,82 @@ cleanup:
    MCTF_FINISH();
 }
 
+MCTF_TEST(test_configuration_server_session)
+{
+   struct configuration* config = NULL;
+   struct deque* parameters = NULL;
+   struct message* msg = NULL;
+   char expected[] = "application_name\0pgexporter_test\0statement_timeout\0" "1500\0jit\0off\0work_mem\0" "8MB\0\0";
+
+   pgexporter_test_setup();
+   pgexporter_test_config_save();
+
+   config = (struct configuration*)shmem;
+   pgexporter_snprintf(config->servers[0].application_name, MISC_LENGTH, "%s", "pgexporter_test");
+   config->servers[0].statement_timeout = PGEXPORTER_TIME_MS(1500);
+   config->servers[0].lock_timeout = PGEXPORTER_TIME_DISABLED;
+   config->servers[0].jit = false;
+   pgexporter_snprintf(config->servers[0].work_mem, MISC_LENGTH, "%s", "8MB");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_server_session(0, &parameters), 0, cleanup, "session parameters");
+   MCTF_ASSERT_INT_EQ((int)pgexporter_deque_size(parameters), 4, cleanup, "no lock_timeout");
+   MCTF_ASSERT_STR_EQ((char*)pgexporter_deque_get(parameters, "statement_timeout"), "1500", cleanup, "statement_timeout in milliseconds");
+   MCTF_ASSERT_STR_EQ((char*)pgexporter_deque_get(parameters, "jit"), "off", cleanup, "JIT is off by default");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_create_startup_message("user", "db", parameters, &msg), MESSAGE_STATUS_OK, cleanup, "startup message");
+   MCTF_ASSERT_INT_EQ((int)msg->length, 8 + 5 + 5 + 9 + 3 + (int)sizeof(expected) - 1, cleanup, "startup message length");
+   MCTF_ASSERT(!memcmp((char*)msg->data + 8 + 5 + 5 + 9 + 3, expected, sizeof(expected) - 1), cleanup,
+               "the parameters follow the database");
+
+cleanup:
+   pgexporter_free_message(msg);
+   pgexporter_deque_destroy(parameters);
+   pgexporter_test_config_restore();
+   pgexporter_test_teardown();
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_configuration_server_cluster_leader)
+{
+   struct configuration* config = NULL;
+
+   pgexporter_test_setup();
+   pgexporter_test_config_save();
+
+   config = (struct configuration*)shmem;
+   config->number_of_servers = 4;
+
+   for (int i = 0; i < config->number_of_servers; i++)
+   {
+      config->servers[i].type = SERVER_TYPE_POSTGRESQL;
+      config->servers[i].fd = 100 + i;
+      config->servers[i].state = SERVER_REPLICA;
+      pgexporter_snprintf(config->servers[i].system_identifier, MISC_LENGTH, "%s", "7000000000000000001");
+   }
+
+   /* A standby and its primary, a standby of another cluster and a server of unknown cluster */
+   config->servers[1].state = SERVER_PRIMARY;
+   pgexporter_snprintf(config->servers[2].system_identifier, MISC_LENGTH, "%s", "7000000000000000002");
+   memset(config->servers[3].system_identifier, 0, MISC_LENGTH);
+
+   MCTF_ASSERT(!pgexporter_server_cluster_leader(0), cleanup, "the primary leads the cluster");
+   MCTF_ASSERT(pgexporter_server_cluster_leader(1), cleanup, "the primary leads the cluster");
+   MCTF_ASSERT(pgexporter_server_cluster_leader(2), cleanup, "a cluster of its own");
+   MCTF_ASSERT(pgexporter_server_cluster_leader(3), cleanup, "an unknown cluster is collected");
+
+   /* Without a connected primary the first standby leads */
+   config->servers[1].fd = -1;
+   pgexporter_snprintf(config->servers[3].system_identifier, MISC_LENGTH, "%s", "7000000000000000001");
+
+   MCTF_ASSERT(pgexporter_server_cluster_leader(0), cleanup, "the first standby leads the cluster");
+   MCTF_ASSERT(!pgexporter_server_cluster_leader(3), cleanup, "only one standby leads the cluster");
+
+cleanup:
+   pgexporter_test_config_restore();
+   pgexporter_test_teardown();
+   MCTF_FINISH();
+}
+
 MCTF_TEST_NEGATIVE(test_configuration_server_tls_mode_reject_invalid)
 {
    pgexporter_test_setup();
@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pgexporter.h>
+#include <derive.h>
+#include <mctf.h>
+#include <shmem.h>
+#include <tscommon.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+MCTF_TEST(test_derive_parse)
+{
+   int derive = -1;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_derive_parse(NULL, &derive), 0, cleanup, "no setting");
+   MCTF_ASSERT_INT_EQ(derive, DERIVE_NONE, cleanup, "no setting means no derived gauge");
+   MCTF_ASSERT_INT_EQ(pgexporter_derive_parse("rate", &derive), 0, cleanup, "rate");
+   MCTF_ASSERT_INT_EQ(derive, DERIVE_RATE, cleanup, "rate");
+   MCTF_ASSERT_INT_EQ(pgexporter_derive_parse("delta_only", &derive), 0, cleanup, "delta_only");
+   MCTF_ASSERT_INT_EQ(derive, DERIVE_DELTA | DERIVE_ONLY, cleanup, "delta_only");
+   MCTF_ASSERT_STR_EQ(pgexporter_derive_suffix(DERIVE_RATE | DERIVE_ONLY), "rate", cleanup, "rate suffix");
+   MCTF_ASSERT_STR_EQ(pgexporter_derive_suffix(DERIVE_DELTA), "delta", cleanup, "delta suffix");
+   MCTF_ASSERT_INT_EQ(pgexporter_derive_parse("irate", &derive), 1, cleanup, "unknown setting");
+
+   MCTF_ASSERT(pgexporter_derive_hash(pgexporter_derive_hash(0, "ab"), "c") !=
+                  pgexporter_derive_hash(pgexporter_derive_hash(0, "a"), "bc"),
+               cleanup, "the strings of a key are separated");
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_derive_sample)
+{
+   size_t size = 0;
+   uint64_t key;
+   double result = -1.0;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_derive_init(&size, &derive_shmem), 0, cleanup, "derive init");
+
+   key = pgexporter_derive_hash(0, "pg_stat_database_xact_commit{server=\"primary\", database=\"postgres\"}");
+
+   MCTF_ASSERT(!pgexporter_derive_sample(key, DERIVE_RATE, 10000, 100.0, 0, &result), cleanup,
+               "the first sample has nothing to derive from");
+   MCTF_ASSERT(pgexporter_derive_sample(key, DERIVE_RATE, 12000, 200.0, 0, &result), cleanup, "second sample");
+   MCTF_ASSERT(result == 50.0, cleanup, "rate should be 50/s, got %f", result);
+
+   MCTF_ASSERT(!pgexporter_derive_sample(key, DERIVE_RATE, 12000, 300.0, 0, &result), cleanup,
+               "no time passed since the previous sample");
+
+   MCTF_ASSERT(pgexporter_derive_sample(key, DERIVE_DELTA, 13000, 260.0, 0, &result), cleanup, "delta");
+   MCTF_ASSERT(result == 60.0, cleanup, "delta should be 60, got %f", result);
+
+   /* The counter went backwards */
+   MCTF_ASSERT(pgexporter_derive_sample(key, DERIVE_DELTA, 14000, 15.0, 0, &result), cleanup, "restart");
+   MCTF_ASSERT(result == 15.0, cleanup, "a restarted counter counts from zero, got %f", result);
+
+   /* The statistics were reset and the counter already passed its previous value */
+   MCTF_ASSERT(pgexporter_derive_sample(key, DERIVE_DELTA, 15000, 20.0, 1000, &result), cleanup, "reset known");
+   MCTF_ASSERT(result == 5.0, cleanup, "delta should be 5, got %f", result);
+   MCTF_ASSERT(pgexporter_derive_sample(key, DERIVE_DELTA, 16000, 21.0, 1000 + DERIVE_RESET_TOLERANCE, &result), cleanup,
+               "reset within the tolerance");
+   MCTF_ASSERT(result == 1.0, cleanup, "jitter of the reset is not a reset, got %f", result);
+   MCTF_ASSERT(pgexporter_derive_sample(key, DERIVE_DELTA, 17000, 40.0, 1500, &result), cleanup, "reset moved");
+   MCTF_ASSERT(result == 40.0, cleanup, "a reset of the statistics restarts the counter, got %f", result);
+
+   /* Series that collide on their slots all get one */
+   for (uint64_t i = 1; i <= DERIVE_PROBE; i++)
+   {
+      pgexporter_derive_sample(key + i * DERIVE_NUMBER_OF_SERIES, DERIVE_DELTA, 18000, 1.0, 0, &result);
+   }
+   MCTF_ASSERT(pgexporter_derive_sample(key + DERIVE_NUMBER_OF_SERIES, DERIVE_DELTA, 19000, 3.0, 0, &result), cleanup,
+               "a colliding series keeps its slot");
+   MCTF_ASSERT(result == 2.0, cleanup, "delta should be 2, got %f", result);
+
+cleanup:
+   if (derive_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(derive_shmem, size);
+      derive_shmem = NULL;
+   }
+   MCTF_FINISH();
+}
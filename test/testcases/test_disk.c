@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pgexporter.h>
+#include <disk.h>
+#include <memory.h>
+#include <mctf.h>
+#include <tscommon.h>
+#include <utils.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * A data directory with a subdirectory, a pg_wal directory and a tablespace
+ * outside of it. Created in setup and removed in teardown.
+ */
+static char base[MAX_PATH];
+
+static int write_file(char* directory, char* name, size_t size, bool append);
+static uint64_t allocated(char* directory, char* name);
+
+MCTF_TEST_SETUP(disk)
+{
+   char path[MAX_PATH];
+   char target[MAX_PATH];
+
+   pgexporter_test_config_save();
+   pgexporter_memory_init();
+
+   pgexporter_snprintf(base, MAX_PATH, "/tmp/pgexporter-test/disk-%d", (int)getpid());
+   pgexporter_delete_directory(base);
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/1/", base);
+   pgexporter_mkdir(path);
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/pg_wal/", base);
+   pgexporter_mkdir(path);
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/pg_tblspc/", base);
+   pgexporter_mkdir(path);
+   pgexporter_snprintf(path, MAX_PATH, "%s/tablespace/", base);
+   pgexporter_mkdir(path);
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/data", base);
+   write_file(path, "PG_VERSION", 3, false);
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/1", base);
+   write_file(path, "16384", 10000, false);
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/pg_wal", base);
+   write_file(path, "000000010000000000000001", 20000, false);
+   pgexporter_snprintf(path, MAX_PATH, "%s/tablespace", base);
+   write_file(path, "16385", 5000, false);
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/pg_tblspc/16386", base);
+   pgexporter_snprintf(target, MAX_PATH, "%s/tablespace", base);
+   symlink(target, path);
+}
+
+MCTF_TEST_TEARDOWN(disk)
+{
+   pgexporter_delete_directory(base);
+   base[0] = '\0';
+   pgexporter_memory_destroy();
+   pgexporter_test_config_restore();
+}
+
+MCTF_TEST(test_disk_directory_size)
+{
+   char path[MAX_PATH];
+   unsigned long expected;
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/1", base);
+   expected = (unsigned long)allocated(path, "16384");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_directory_size(path), expected, cleanup,
+                      "directory size should be %lu", expected);
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_disk_usage)
+{
+   char path[MAX_PATH];
+   uint64_t bytes = 0;
+   uint64_t files = 0;
+   uint64_t expected;
+   struct disk* disk = NULL;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_create(&disk), 0, cleanup, "create failed");
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/data", base);
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_add(disk, 0, DISK_DATA, path, true), 0, cleanup, "add data failed");
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/pg_wal", base);
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_add(disk, 0, DISK_WAL, path, false), 0, cleanup, "add wal failed");
+
+   MCTF_ASSERT(pgexporter_disk_refresh(disk, 0) > 0, cleanup, "the first refresh should scan the directories");
+
+   /* pg_wal is skipped, the tablespace is included */
+   expected = 0;
+   pgexporter_snprintf(path, MAX_PATH, "%s/data", base);
+   expected += allocated(path, "PG_VERSION");
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/1", base);
+   expected += allocated(path, "16384");
+   pgexporter_snprintf(path, MAX_PATH, "%s/tablespace", base);
+   expected += allocated(path, "16385");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_usage(disk, 0, DISK_DATA, &bytes, &files), 0, cleanup, "no data usage");
+   MCTF_ASSERT_INT_EQ(files, 3, cleanup, "data should have 3 files, got %d", (int)files);
+   MCTF_ASSERT_INT_EQ(bytes, expected, cleanup, "data usage should be %llu", (unsigned long long)expected);
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/pg_wal", base);
+   expected = allocated(path, "000000010000000000000001");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_usage(disk, 0, DISK_WAL, &bytes, &files), 0, cleanup, "no wal usage");
+   MCTF_ASSERT_INT_EQ(files, 1, cleanup, "wal should have 1 file, got %d", (int)files);
+   MCTF_ASSERT_INT_EQ(bytes, expected, cleanup, "wal usage should be %llu", (unsigned long long)expected);
+
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_usage(disk, 1, DISK_DATA, &bytes, &files), 1, cleanup, "server 1 has no directories");
+
+cleanup:
+   pgexporter_disk_destroy(disk);
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_disk_refresh_changes)
+{
+   char path[MAX_PATH];
+   int scans;
+   uint64_t before = 0;
+   uint64_t bytes = 0;
+   uint64_t files = 0;
+   struct disk* disk = NULL;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_create(&disk), 0, cleanup, "create failed");
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/data", base);
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_add(disk, 0, DISK_DATA, path, true), 0, cleanup, "add failed");
+
+   pgexporter_disk_refresh(disk, 0);
+   pgexporter_disk_usage(disk, 0, DISK_DATA, &before, &files);
+
+   /* Nothing changed, so nothing is scanned */
+   MCTF_ASSERT_INT_EQ(pgexporter_disk_refresh(disk, 0), 0, cleanup, "an unchanged tree should not be scanned");
+
+   /* A new directory with a file */
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/2/", base);
+   pgexporter_mkdir(path);
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/2", base);
+   write_file(path, "16387", 100, false);
+
+   pgexporter_disk_refresh(disk, 100);
+   pgexporter_disk_usage(disk, 0, DISK_DATA, &bytes, &files);
+#if defined(__linux__)
+   MCTF_ASSERT_INT_EQ(files, 4, cleanup, "the new file should be counted, got %d", (int)files);
+   MCTF_ASSERT(bytes > before, cleanup, "the usage should grow");
+
+   /* A file that grows is stat'ed without scanning its directory */
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/1", base);
+   before = bytes - allocated(path, "16384");
+   write_file(path, "16384", 100000, true);
+
+   scans = pgexporter_disk_refresh(disk, 100);
+   MCTF_ASSERT_INT_EQ(scans, 0, cleanup, "no directory should be scanned for a modified file, got %d", scans);
+   pgexporter_disk_usage(disk, 0, DISK_DATA, &bytes, &files);
+   MCTF_ASSERT_INT_EQ(bytes, before + allocated(path, "16384"), cleanup, "the usage should include the growth");
+#endif
+
+   /* A removed directory */
+   pgexporter_snprintf(path, MAX_PATH, "%s/data/base/2", base);
+   pgexporter_delete_directory(path);
+
+   pgexporter_disk_refresh(disk, 100);
+   pgexporter_disk_usage(disk, 0, DISK_DATA, &bytes, &files);
+   MCTF_ASSERT_INT_EQ(files, 3, cleanup, "the removed file should not be counted, got %d", (int)files);
+
+cleanup:
+   pgexporter_disk_destroy(disk);
+   MCTF_FINISH();
+}
+
+static int
+write_file(char* directory, char* name, size_t size, bool append)
+{
+   char path[MAX_PATH];
+   char buffer[1024];
+   FILE* f = NULL;
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/%s", directory, name);
+
+   f = fopen(path, append ? "a" : "w");
+   if (f == NULL)
+   {
+      return 1;
+   }
+
+   memset(buffer, 'x', sizeof(buffer));
+
+   while (size > 0)
+   {
+      size_t n = size < sizeof(buffer) ? size : sizeof(buffer);
+
+      fwrite(buffer, 1, n, f);
+      size -= n;
+   }
+
+   fclose(f);
+
+   return 0;
+}
+
+static uint64_t
+allocated(char* directory, char* name)
+{
+   char path[MAX_PATH];
+   uint64_t blocks;
+   struct stat st;
+
+   pgexporter_snprintf(path, MAX_PATH, "%s/%s", directory, name);
+
+   if (stat(path, &st))
+   {
+      return 0;
+   }
+
+   blocks = (uint64_t)st.st_size / (uint64_t)st.st_blksize;
+   if ((uint64_t)st.st_size % (uint64_t)st.st_blksize != 0)
+   {
+      blocks++;
+   }
+
+   return blocks * (uint64_t)st.st_blksize;
+}
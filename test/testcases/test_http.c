@@ -29,10 +29,15 @@
 
 #include <pgexporter.h>
 #include <configuration.h>
+#include <gzip_compression.h>
 #include <http.h>
+#include <http_server.h>
 #include <json.h>
 #include <management.h>
+#include <message.h>
 #include <network.h>
+#include <prometheus_client.h>
+#include <security.h>
 #include <shmem.h>
 #include <tsclient.h>
 #include <tscommon.h>
@@ -40,7 +45,10 @@
 
 #include <mctf.h>
 #include <arpa/inet.h>
+#include <fcntl.h>
 #include <netinet/in.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -422,7 +430,7 @@ echo_server_thread(void* arg)
 }
 
 static int
-start_echo_server(int port, char* response)
+start_echo_server(int port, char* response, size_t response_len)
 {
    struct sockaddr_in addr;
 
@@ -435,7 +443,7 @@ start_echo_server(int port, char* response)
    test_server->port = port;
    test_server->running = false;
    test_server->response = response;
-   test_server->response_len = strlen(response);
+   test_server->response_len = response_len;
 
    test_server->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
    if (test_server->socket_fd < 0)
@@ -520,7 +528,7 @@ MCTF_TEST(test_http_write_cb_content_length)
       "\r\n"
       "Hello, World!";
 
-   MCTF_ASSERT(start_echo_server(9999, response_text) == 0, cleanup, "failed to start echo server");
+   MCTF_ASSERT(start_echo_server(9999, response_text, strlen(response_text)) == 0, cleanup, "failed to start echo server");
 
    response = calloc(1, sizeof(struct http_response));
    MCTF_ASSERT_PTR_NONNULL(response, cleanup, "failed to allocate response");
@@ -564,7 +572,7 @@ MCTF_TEST(test_http_write_cb_chunked)
       "0\r\n"
       "\r\n";
 
-   MCTF_ASSERT(start_echo_server(9999, response_text) == 0, cleanup, "failed to start echo server");
+   MCTF_ASSERT(start_echo_server(9999, response_text, strlen(response_text)) == 0, cleanup, "failed to start echo server");
 
    response = calloc(1, sizeof(struct http_response));
    MCTF_ASSERT_PTR_NONNULL(response, cleanup, "failed to allocate response");
@@ -589,6 +597,468 @@ cleanup:
    MCTF_FINISH();
 }
 
+static int
+count_line_cb(char* line, void* userdata)
+{
+   struct write_cb_context* context = (struct write_cb_context*)userdata;
+   size_t length = strlen(line);
+
+   if (context->data_size + length + 2 > sizeof(context->data))
+   {
+      return 1;
+   }
+
+   memcpy(context->data + context->data_size, line, length);
+   context->data_size += length;
+   context->data[context->data_size++] = '|';
+   context->data[context->data_size] = '\0';
+
+   return 0;
+}
+
+// Test a gzip encoded body is decoded and split into lines as it arrives
+MCTF_TEST(test_http_write_cb_gzip)
+{
+   int status;
+   struct http* connection = NULL;
+   struct http_request* request = NULL;
+   struct http_response* response = NULL;
+   struct http_line_sink sink = {0};
+   struct write_cb_context write_context = {0};
+   unsigned char* compressed = NULL;
+   size_t compressed_size = 0;
+   char* response_text = NULL;
+   int header_length;
+   char header[128];
+
+   MCTF_ASSERT(pgexporter_gzip_string("# HELP a A\n# TYPE a gauge\na 1\nb 2", &compressed, &compressed_size) == 0, cleanup, "gzip failed");
+
+   header_length = snprintf(header, sizeof(header),
+                            "HTTP/1.1 200 OK\r\n"
+                            "Content-Encoding: gzip\r\n"
+                            "Content-Length: %zu\r\n"
+                            "\r\n",
+                            compressed_size);
+
+   response_text = malloc(header_length + compressed_size);
+   MCTF_ASSERT_PTR_NONNULL(response_text, cleanup, "failed to allocate response text");
+   memcpy(response_text, header, header_length);
+   memcpy(response_text + header_length, compressed, compressed_size);
+
+   MCTF_ASSERT(start_echo_server(9999, response_text, header_length + compressed_size) == 0, cleanup, "failed to start echo server");
+
+   /* Buffered */
+   response = calloc(1, sizeof(struct http_response));
+   MCTF_ASSERT_PTR_NONNULL(response, cleanup, "failed to allocate response");
+   response->decompress = true;
+
+   MCTF_ASSERT(pgexporter_http_create("localhost", 9999, false, &connection) == 0, cleanup, "failed to establish connection");
+   MCTF_ASSERT(pgexporter_http_request_create(PGEXPORTER_HTTP_GET, "/test", &request) == 0, cleanup, "failed to create request");
+
+   status = pgexporter_http_invoke(connection, request, &response);
+   MCTF_ASSERT(status == PGEXPORTER_HTTP_STATUS_OK, cleanup, "HTTP gzip request failed");
+   MCTF_ASSERT_PTR_NONNULL(response->payload.data, cleanup, "payload should be buffered");
+   MCTF_ASSERT_STR_EQ((char*)response->payload.data, "# HELP a A\n# TYPE a gauge\na 1\nb 2", cleanup, "decoded payload mismatch");
+
+   pgexporter_http_request_destroy(request);
+   pgexporter_http_response_destroy(response);
+   pgexporter_http_destroy(connection);
+   request = NULL;
+   response = NULL;
+   connection = NULL;
+
+   /* Streamed through the line sink */
+   sink.line_cb = count_line_cb;
+   sink.userdata = &write_context;
+
+   response = calloc(1, sizeof(struct http_response));
+   MCTF_ASSERT_PTR_NONNULL(response, cleanup, "failed to allocate response");
+   response->write_cb = pgexporter_http_line_sink_write;
+   response->write_userdata = &sink;
+   response->decompress = true;
+
+   MCTF_ASSERT(pgexporter_http_create("localhost", 9999, false, &connection) == 0, cleanup, "failed to establish connection");
+   MCTF_ASSERT(pgexporter_http_request_create(PGEXPORTER_HTTP_GET, "/test", &request) == 0, cleanup, "failed to create request");
+
+   status = pgexporter_http_invoke(connection, request, &response);
+   MCTF_ASSERT(status == PGEXPORTER_HTTP_STATUS_OK, cleanup, "HTTP gzip request failed");
+   MCTF_ASSERT(pgexporter_http_line_sink_finish(&sink) == PGEXPORTER_HTTP_STATUS_OK, cleanup, "line sink finish failed");
+   MCTF_ASSERT_STR_EQ(write_context.data, "# HELP a A|# TYPE a gauge|a 1|b 2|", cleanup, "line split mismatch");
+   MCTF_ASSERT(response->payload.data_size == 0, cleanup, "write_cb should prevent buffering for gzip response");
+
+cleanup:
+   pgexporter_http_line_sink_finish(&sink);
+   pgexporter_http_request_destroy(request);
+   pgexporter_http_response_destroy(response);
+   pgexporter_http_destroy(connection);
+   stop_echo_server();
+   free(response_text);
+   free(compressed);
+   MCTF_FINISH();
+}
+
+// Test requests are parsed in place, also when incomplete or pipelined
+MCTF_TEST(test_http_server_parse)
+{
+   struct http_server_request req;
+   struct http_server_slice value;
+   char data[] = "GET /history/pgexporter_state?timestamp=10&duration=-60 HTTP/1.1\r\n"
+                 "Host: localhost\r\n"
+                 "connection:  Keep-Alive \r\n"
+                 "Content-Length: 4\r\n"
+                 "\r\n"
+                 "body"
+                 "GET /metrics HTTP/1.0\r\n"
+                 "\r\n";
+   char malformed[] = "GET metrics HTTP/1.1\r\n\r\n";
+   size_t first = strlen(data) - strlen("GET /metrics HTTP/1.0\r\n\r\n");
+   size_t consumed = 0;
+
+   pgexporter_test_setup();
+
+   /* Every prefix of the first request is incomplete */
+   for (size_t i = 0; i < first; i++)
+   {
+      MCTF_ASSERT_INT_EQ(pgexporter_http_server_parse(data, i, &req, &consumed), MESSAGE_STATUS_ZERO, cleanup, "prefix %zu not incomplete", i);
+   }
+
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parse(data, strlen(data), &req, &consumed), MESSAGE_STATUS_OK, cleanup, "parse failed");
+   MCTF_ASSERT_INT_EQ((int)consumed, (int)first, cleanup, "consumed mismatch");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req.method, "GET"), cleanup, "method mismatch");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req.path, "/history/pgexporter_state"), cleanup, "path mismatch");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req.query, "timestamp=10&duration=-60"), cleanup, "query mismatch");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req.body, "body"), cleanup, "body mismatch");
+   MCTF_ASSERT(req.keep_alive, cleanup, "keep-alive expected");
+
+   /* Views point into the buffer */
+   MCTF_ASSERT(req.path.data == data + 4, cleanup, "path is not a view");
+
+   MCTF_ASSERT(pgexporter_http_server_header(&req, "HOST", &value), cleanup, "header not found");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&value, "localhost"), cleanup, "header mismatch");
+   MCTF_ASSERT(pgexporter_http_server_query_param(&req, "duration", &value), cleanup, "duration not found");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&value, "-60"), cleanup, "duration mismatch");
+   MCTF_ASSERT(!pgexporter_http_server_query_param(&req, "time", &value), cleanup, "prefix of a parameter found");
+
+   /* The pipelined request follows */
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parse(data + consumed, strlen(data) - consumed, &req, &consumed), MESSAGE_STATUS_OK, cleanup, "second parse failed");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req.path, "/metrics"), cleanup, "second path mismatch");
+   MCTF_ASSERT_INT_EQ(req.query.length, 0, cleanup, "second query not empty");
+   MCTF_ASSERT(!req.keep_alive, cleanup, "HTTP/1.0 is not keep-alive");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parse(malformed, strlen(malformed), &req, &consumed), MESSAGE_STATUS_ERROR, cleanup, "malformed request accepted");
+
+cleanup:
+   pgexporter_test_teardown();
+   MCTF_FINISH();
+}
+
+// Test a connection with split and pipelined requests
+MCTF_TEST(test_http_server_parser_pipelining)
+{
+   struct http_server_parser* parser = NULL;
+   struct http_server_request* req = NULL;
+   void* saved_shmem = shmem;
+   void* config_shmem = NULL;
+   int fds[2] = {-1, -1};
+   char* pipelined = "GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\nGET /c HT";
+   char* rest = "TP/1.1\r\nConnection: close\r\n\r\n";
+
+   pgexporter_test_setup();
+
+   pgexporter_create_shared_memory(sizeof(struct configuration), HUGEPAGE_OFF, &config_shmem);
+   MCTF_ASSERT_PTR_NONNULL(config_shmem, cleanup, "shared memory failed");
+   pgexporter_init_configuration(config_shmem);
+   ((struct configuration*)config_shmem)->authentication_timeout = PGEXPORTER_TIME_SEC(1);
+   shmem = config_shmem;
+
+   MCTF_ASSERT_INT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0, cleanup, "socketpair failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parser_create(NULL, fds[0], &parser), 0, cleanup, "parser failed");
+
+   MCTF_ASSERT(write(fds[1], pipelined, strlen(pipelined)) == (ssize_t)strlen(pipelined), cleanup, "write failed");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parser_next(parser, &req), MESSAGE_STATUS_OK, cleanup, "first request failed");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req->path, "/a"), cleanup, "first path mismatch");
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parser_next(parser, &req), MESSAGE_STATUS_OK, cleanup, "second request failed");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req->path, "/b"), cleanup, "second path mismatch");
+
+   /* The third request is split across reads */
+   MCTF_ASSERT(write(fds[1], rest, strlen(rest)) == (ssize_t)strlen(rest), cleanup, "write failed");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parser_next(parser, &req), MESSAGE_STATUS_OK, cleanup, "third request failed");
+   MCTF_ASSERT(pgexporter_http_server_slice_equals(&req->path, "/c"), cleanup, "third path mismatch");
+   MCTF_ASSERT(!req->keep_alive, cleanup, "Connection: close ignored");
+
+   /* The client closes the connection */
+   close(fds[1]);
+   fds[1] = -1;
+   MCTF_ASSERT_INT_EQ(pgexporter_http_server_parser_next(parser, &req), MESSAGE_STATUS_ZERO, cleanup, "end of connection not detected");
+
+cleanup:
+   pgexporter_http_server_parser_destroy(parser);
+   if (fds[0] != -1)
+   {
+      close(fds[0]);
+   }
+   if (fds[1] != -1)
+   {
+      close(fds[1]);
+   }
+   shmem = saved_shmem;
+   if (config_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(config_shmem, sizeof(struct configuration));
+   }
+   pgexporter_test_teardown();
+   MCTF_FINISH();
+}
+
+static int
+tls_write_certificate(char* key_path, char* cert_path)
+{
+   EVP_PKEY* pkey = NULL;
+   X509* x509 = NULL;
+   FILE* f = NULL;
+   int ret = 1;
+
+   pkey = EVP_RSA_gen(2048);
+   x509 = X509_new();
+   if (pkey == NULL || x509 == NULL)
+   {
+      goto done;
+   }
+
+   ASN1_INTEGER_set(X509_get_serialNumber(x509), 1);
+   X509_gmtime_adj(X509_getm_notBefore(x509), 0);
+   X509_gmtime_adj(X509_getm_notAfter(x509), 3600);
+   X509_set_pubkey(x509, pkey);
+   X509_NAME_add_entry_by_txt(X509_get_subject_name(x509), "CN", MBSTRING_ASC, (unsigned char*)"localhost", -1, -1, 0);
+   X509_set_issuer_name(x509, X509_get_subject_name(x509));
+   if (X509_sign(x509, pkey, EVP_sha256()) == 0)
+   {
+      goto done;
+   }
+
+   if ((f = fopen(key_path, "w")) == NULL || !PEM_write_PrivateKey(f, pkey, NULL, NULL, 0, NULL, NULL))
+   {
+      goto done;
+   }
+   fclose(f);
+
+   if ((f = fopen(cert_path, "w")) == NULL || !PEM_write_X509(f, x509))
+   {
+      goto done;
+   }
+
+   ret = 0;
+
+done:
+   if (f != NULL)
+   {
+      fclose(f);
+   }
+   X509_free(x509);
+   EVP_PKEY_free(pkey);
+
+   return ret;
+}
+
+/* Connect to a freshly created server context, like a forked child, and report resumption */
+static int
+tls_connect(SSL_CTX* client_ctx, char* key_path, char* cert_path, SSL_SESSION** session, bool* reused)
+{
+   SSL_CTX* server_ctx = NULL;
+   SSL* server = NULL;
+   SSL* client = NULL;
+   int fds[2] = {-1, -1};
+   bool server_done = false;
+   bool client_done = false;
+   char c;
+   int ret = 1;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds))
+   {
+      goto done;
+   }
+   fcntl(fds[0], F_SETFL, O_NONBLOCK);
+   fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+   if (pgexporter_create_ssl_ctx(false, &server_ctx) ||
+       pgexporter_enable_tls_session_resumption(server_ctx) ||
+       pgexporter_create_ssl_server(server_ctx, key_path, cert_path, "", fds[0], &server))
+   {
+      goto done;
+   }
+
+   client = SSL_new(client_ctx);
+   SSL_set_fd(client, fds[1]);
+   if (*session != NULL)
+   {
+      SSL_set_session(client, *session);
+   }
+
+   for (int i = 0; i < 1000 && !(server_done && client_done); i++)
+   {
+      client_done = client_done || SSL_connect(client) == 1;
+      server_done = server_done || SSL_accept(server) == 1;
+   }
+
+   if (!server_done || !client_done || SSL_write(server, "x", 1) != 1)
+   {
+      goto done;
+   }
+
+   /* The session ticket arrives before the data */
+   for (int i = 0; i < 1000; i++)
+   {
+      if (SSL_read(client, &c, 1) == 1)
+      {
+         ret = 0;
+         break;
+      }
+   }
+
+   *reused = SSL_session_reused(client);
+   SSL_SESSION_free(*session);
+   *session = SSL_get1_session(client);
+
+   /* A session of a connection that isn't shut down can't be resumed */
+   SSL_shutdown(client);
+
+done:
+   SSL_free(client);
+   SSL_free(server);
+   SSL_CTX_free(server_ctx);
+   if (fds[0] != -1)
+   {
+      close(fds[0]);
+   }
+   if (fds[1] != -1)
+   {
+      close(fds[1]);
+   }
+
+   return ret;
+}
+
+// Test sessions resume across server contexts and survive one ticket key rotation
+MCTF_TEST(test_http_tls_session_resumption)
+{
+   void* saved_shmem = shmem;
+   void* config_shmem = NULL;
+   size_t tls_size = 0;
+   SSL_CTX* client_ctx = NULL;
+   SSL_SESSION* session = NULL;
+   bool reused = false;
+   char dir[] = "/tmp/pgexporter_tls_XXXXXX";
+   char key_path[MAX_PATH];
+   char cert_path[MAX_PATH];
+
+   pgexporter_test_setup();
+
+   memset(key_path, 0, sizeof(key_path));
+   memset(cert_path, 0, sizeof(cert_path));
+
+   pgexporter_create_shared_memory(sizeof(struct configuration), HUGEPAGE_OFF, &config_shmem);
+   MCTF_ASSERT_PTR_NONNULL(config_shmem, cleanup, "shared memory failed");
+   pgexporter_init_configuration(config_shmem);
+   shmem = config_shmem;
+
+   MCTF_ASSERT_PTR_NONNULL(mkdtemp(dir), cleanup, "mkdtemp failed");
+   pgexporter_snprintf(key_path, sizeof(key_path), "%s/server.key", dir);
+   pgexporter_snprintf(cert_path, sizeof(cert_path), "%s/server.crt", dir);
+   MCTF_ASSERT_INT_EQ(tls_write_certificate(key_path, cert_path), 0, cleanup, "certificate failed");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_tls_session_init(&tls_size, &tls_session_shmem), 0, cleanup, "session cache failed");
+
+   client_ctx = SSL_CTX_new(TLS_client_method());
+   MCTF_ASSERT_PTR_NONNULL(client_ctx, cleanup, "client context failed");
+
+   MCTF_ASSERT_INT_EQ(tls_connect(client_ctx, key_path, cert_path, &session, &reused), 0, cleanup, "first handshake failed");
+   MCTF_ASSERT(!reused, cleanup, "first handshake resumed");
+
+   MCTF_ASSERT_INT_EQ(tls_connect(client_ctx, key_path, cert_path, &session, &reused), 0, cleanup, "second handshake failed");
+   MCTF_ASSERT(reused, cleanup, "session not resumed");
+
+   /* A ticket of the previous key resumes and is renewed */
+   MCTF_ASSERT_INT_EQ(pgexporter_tls_session_rotate(), 0, cleanup, "rotation failed");
+   MCTF_ASSERT_INT_EQ(tls_connect(client_ctx, key_path, cert_path, &session, &reused), 0, cleanup, "third handshake failed");
+   MCTF_ASSERT(reused, cleanup, "session not resumed after a rotation");
+
+   /* Both keys are replaced */
+   MCTF_ASSERT_INT_EQ(pgexporter_tls_session_rotate(), 0, cleanup, "rotation failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_tls_session_rotate(), 0, cleanup, "rotation failed");
+   MCTF_ASSERT_INT_EQ(tls_connect(client_ctx, key_path, cert_path, &session, &reused), 0, cleanup, "fourth handshake failed");
+   MCTF_ASSERT(!reused, cleanup, "session resumed with an expired key");
+
+cleanup:
+   SSL_SESSION_free(session);
+   SSL_CTX_free(client_ctx);
+   if (tls_session_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(tls_session_shmem, tls_size);
+      tls_session_shmem = NULL;
+   }
+   if (strlen(key_path) > 0)
+   {
+      unlink(key_path);
+      unlink(cert_path);
+      rmdir(dir);
+   }
+   shmem = saved_shmem;
+   if (config_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(config_shmem, sizeof(struct configuration));
+   }
+   pgexporter_test_teardown();
+   MCTF_FINISH();
+}
+
+// Test metrics text is parsed into a bridge in place and left intact
+MCTF_TEST(test_http_prometheus_client_parse)
+{
+   struct prometheus_bridge* bridge = NULL;
+   struct prometheus_metric* metric = NULL;
+   struct prometheus_attributes* attrs = NULL;
+   struct prometheus_value* value = NULL;
+   char data[] = "HTTP/1.1 200 OK\r\n"
+                 "Date: now\r\n"
+                 "#HELP pgexporter_state The state of pgexporter\n"
+                 "#TYPE pgexporter_state gauge\n"
+                 "pgexporter_state{server=\"primary\"} 1\n"
+                 "\n"
+                 "#HELP pgexporter_logging_info The number of INFO logging statements\n"
+                 "#TYPE pgexporter_logging_info gauge\n"
+                 "pgexporter_logging_info 42\n";
+   char copy[sizeof(data)];
+
+   pgexporter_test_setup();
+
+   memcpy(copy, data, sizeof(data));
+
+   MCTF_ASSERT_INT_EQ(pgexporter_prometheus_client_create_bridge(&bridge), 0, cleanup, "bridge failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_prometheus_client_parse("localhost:5002", data, bridge), 0, cleanup, "parse failed");
+   MCTF_ASSERT(!memcmp(copy, data, sizeof(data)), cleanup, "data not restored");
+
+   metric = (struct prometheus_metric*)pgexporter_art_search(bridge->metrics, "pgexporter_state");
+   MCTF_ASSERT_PTR_NONNULL(metric, cleanup, "pgexporter_state missing");
+   MCTF_ASSERT_STR_EQ(metric->type, "gauge", cleanup, "type mismatch");
+   MCTF_ASSERT_INT_EQ((int)pgexporter_deque_size(metric->definitions), 1, cleanup, "definitions mismatch");
+
+   attrs = (struct prometheus_attributes*)pgexporter_deque_peek(metric->definitions, NULL);
+   MCTF_ASSERT_INT_EQ((int)pgexporter_deque_size(attrs->attributes), 2, cleanup, "endpoint and server labels expected");
+
+   metric = (struct prometheus_metric*)pgexporter_art_search(bridge->metrics, "pgexporter_logging_info");
+   MCTF_ASSERT_PTR_NONNULL(metric, cleanup, "pgexporter_logging_info missing");
+   attrs = (struct prometheus_attributes*)pgexporter_deque_peek(metric->definitions, NULL);
+   value = (struct prometheus_value*)pgexporter_deque_peek_last(attrs->values, NULL);
+   MCTF_ASSERT_STR_EQ(value->value, "42", cleanup, "value mismatch");
+
+cleanup:
+   pgexporter_prometheus_client_destroy_bridge(bridge);
+   pgexporter_test_teardown();
+   MCTF_FINISH();
+}
+
 /* Must run last: shuts down the daemon. Defined last so it registers last and runs last. */
 MCTF_TEST(test_http_shutdown)
 {
@@ -30,12 +30,14 @@
 #include <ev.h>
 #include <memory.h>
 #include <message.h>
+#include <network.h>
 #include <utils.h>
 #include <mctf.h>
 
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/wait.h>
+#include <time.h>
 #include <unistd.h>
 
 /*
@@ -243,3 +245,93 @@ cleanup:
    pgexporter_memory_destroy();
    MCTF_FINISH();
 }
+
+/* A silent peer hits the deadline instead of blocking the reader. */
+MCTF_TEST(test_timeout_message_silent_peer)
+{
+   int sv[2] = {-1, -1};
+   int status;
+   time_t start;
+   struct message* msg = NULL;
+
+   pgexporter_memory_init();
+
+   MCTF_ASSERT_INT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0, cleanup, "socketpair failed");
+
+   start = time(NULL);
+   status = pgexporter_read_timeout_message(NULL, sv[0], 1, &msg);
+
+   MCTF_ASSERT_INT_EQ(status, MESSAGE_STATUS_ZERO, cleanup, "silent peer should time out");
+   MCTF_ASSERT(msg == NULL, cleanup, "no message should be returned");
+   MCTF_ASSERT(difftime(time(NULL), start) <= 3, cleanup, "timeout should be honoured");
+
+cleanup:
+   if (sv[0] >= 0)
+   {
+      close(sv[0]);
+   }
+   if (sv[1] >= 0)
+   {
+      close(sv[1]);
+   }
+   pgexporter_memory_destroy();
+   MCTF_FINISH();
+}
+
+/* A non-blocking socket waits for readiness between partial segments. */
+MCTF_TEST(test_complete_message_nonblocking_split)
+{
+   int sv[2] = {-1, -1};
+   char buffer[128];
+   ssize_t total;
+   int status;
+   pid_t pid = -1;
+   struct message* msg = NULL;
+
+   pgexporter_memory_init();
+
+   total = build_sasl_continue(buffer, sizeof(buffer));
+   MCTF_ASSERT(total > 0, cleanup, "failed to build test message");
+
+   MCTF_ASSERT_INT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0, cleanup, "socketpair failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_socket_nonblocking(sv[0], true), 0, cleanup, "nonblocking failed");
+
+   pid = fork();
+   MCTF_ASSERT(pid >= 0, cleanup, "fork failed");
+
+   if (pid == 0)
+   {
+      close(sv[0]);
+      usleep(50 * 1000);
+      write(sv[1], buffer, 3);
+      usleep(50 * 1000);
+      write(sv[1], buffer + 3, total - 3);
+      close(sv[1]);
+      _exit(0);
+   }
+
+   close(sv[1]);
+   sv[1] = -1;
+
+   status = pgexporter_read_complete_message(NULL, sv[0], &msg);
+
+   MCTF_ASSERT_INT_EQ(status, MESSAGE_STATUS_OK, cleanup, "message should be assembled on a non-blocking socket");
+   MCTF_ASSERT(msg != NULL, cleanup, "message should be returned");
+   MCTF_ASSERT_INT_EQ((int)msg->length, (int)total, cleanup, "all declared bytes should have been read");
+
+cleanup:
+   if (pid > 0)
+   {
+      waitpid(pid, NULL, 0);
+   }
+   if (sv[0] >= 0)
+   {
+      close(sv[0]);
+   }
+   if (sv[1] >= 0)
+   {
+      close(sv[1]);
+   }
+   pgexporter_memory_destroy();
+   MCTF_FINISH();
+}
@@ -0,0 +1,739 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+#include <pgexporter.h>
+#include <configuration.h>
+#include <ext_query_alts.h>
+#include <internal.h>
+#include <metric_names.h>
+#include <pg_query_alts.h>
+#include <shmem.h>
+#include <tscommon.h>
+#include <utils.h>
+#include <yaml_cache.h>
+#include <yaml_configuration.h>
+
+#include <mctf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MAX_TREE_NODES 64
+#define NUMBER_OF_DIRECTORY_FILES 12
+
+#define CACHE_TEST_YAML                                  \
+   "metrics:\n"                                          \
+   "  - tag: cache_test\n"                               \
+   "    collector: cache_test\n"                         \
+   "    sort: data\n"                                    \
+   "    queries:\n"                                      \
+   "      - version: 14\n"                               \
+   "        query: SELECT datname, 1 FROM pg_database;\n" \
+   "        columns:\n"                                  \
+   "          - name: database\n"                        \
+   "            type: label\n"                           \
+   "          - name: value\n"                           \
+   "            type: gauge\n"                           \
+   "            description: Cached value\n"             \
+   "      - version: 12\n"                               \
+   "        query: SELECT datname, 0 FROM pg_database;\n" \
+   "        columns:\n"                                  \
+   "          - name: database\n"                        \
+   "            type: label\n"                           \
+   "          - name: value\n"                           \
+   "            type: gauge\n"                           \
+   "  - tag: cache_other\n"                              \
+   "    collector: cache_test\n"                         \
+   "    server: primary\n"                               \
+   "    queries:\n"                                      \
+   "      - query: SELECT 1;\n"                          \
+   "        columns:\n"                                  \
+   "          - type: counter\n"
+
+static void* saved_shmem = NULL;
+static void* metrics_shmem = NULL;
+
+static int collect_nodes(struct pg_query_alts* root, struct pg_query_alts** nodes, int* n);
+static int write_file(char* path, char* content);
+static void reset_metrics(struct configuration* config);
+
+MCTF_TEST_SETUP(metrics)
+{
+   pgexporter_test_setup();
+
+   /* Run against a private configuration so the test does not depend on the environment */
+   saved_shmem = shmem;
+   pgexporter_create_shared_memory(sizeof(struct configuration), HUGEPAGE_OFF, &metrics_shmem);
+   pgexporter_init_configuration(metrics_shmem);
+   shmem = metrics_shmem;
+}
+
+MCTF_TEST_TEARDOWN(metrics)
+{
+   shmem = saved_shmem;
+   pgexporter_destroy_shared_memory(metrics_shmem, sizeof(struct configuration));
+   metrics_shmem = NULL;
+
+   pgexporter_test_teardown();
+}
+
+// Test the built-in catalog matches a runtime parse of INTERNAL_YAML
+MCTF_TEST(test_metrics_internal_catalog)
+{
+   struct configuration* config = NULL;
+   struct prometheus* parsed = NULL;
+   struct metric_names* parsed_names = NULL;
+   void* parsed_shmem = NULL;
+   size_t parsed_size = NUMBER_OF_METRICS * sizeof(struct prometheus);
+   struct pg_query_alts* expected[MAX_TREE_NODES];
+   struct pg_query_alts* actual[MAX_TREE_NODES];
+   int number_of_parsed = 0;
+   int number_of_parsed_names = 0;
+   int n_expected;
+   int n_actual;
+   FILE* file = NULL;
+
+   config = (struct configuration*)shmem;
+
+   MCTF_ASSERT(!pgexporter_create_shared_memory(parsed_size, HUGEPAGE_OFF, &parsed_shmem), cleanup, "shared memory failed");
+   parsed = (struct prometheus*)parsed_shmem;
+
+   file = fmemopen(INTERNAL_YAML, strlen(INTERNAL_YAML), "r");
+   MCTF_ASSERT_PTR_NONNULL(file, cleanup, "fmemopen failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_read_yaml_from_file_pointer(config, parsed, 0, &number_of_parsed, file), 0, cleanup, "parse of INTERNAL_YAML failed");
+   fclose(file);
+   file = NULL;
+
+   parsed_names = config->metric_names;
+   number_of_parsed_names = pgexporter_metric_names_count(parsed_names);
+   config->metric_names = NULL;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_read_internal_yaml_metrics(config, true), 0, cleanup, "read internal metrics failed");
+   MCTF_ASSERT_INT_EQ(config->number_of_metrics, number_of_parsed, cleanup, "metric count mismatch");
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_count(config->metric_names), number_of_parsed_names, cleanup, "metric name count mismatch");
+
+   for (int i = 0; i < number_of_parsed_names; i++)
+   {
+      MCTF_ASSERT_STR_EQ(pgexporter_metric_names_get(config->metric_names, i), pgexporter_metric_names_get(parsed_names, i),
+                         cleanup, "metric name mismatch at %d", i);
+   }
+
+   for (int i = 0; i < config->number_of_metrics; i++)
+   {
+      struct prometheus* p = &config->prometheus[i];
+
+      MCTF_ASSERT_STR_EQ(p->tag, parsed[i].tag, cleanup, "tag mismatch at %d", i);
+      MCTF_ASSERT_STR_EQ(p->collector, parsed[i].collector, cleanup, "collector mismatch for %s", parsed[i].tag);
+      MCTF_ASSERT_INT_EQ(p->sort_type, parsed[i].sort_type, cleanup, "sort mismatch for %s", parsed[i].tag);
+      MCTF_ASSERT_INT_EQ(p->server_query_type, parsed[i].server_query_type, cleanup, "server mismatch for %s", parsed[i].tag);
+      MCTF_ASSERT(p->exec_on_all_dbs == parsed[i].exec_on_all_dbs, cleanup, "database mismatch for %s", parsed[i].tag);
+      MCTF_ASSERT(p->optional == parsed[i].optional, cleanup, "optional mismatch for %s", parsed[i].tag);
+      MCTF_ASSERT_INT_EQ(p->derive, parsed[i].derive, cleanup, "derive mismatch for %s", parsed[i].tag);
+      MCTF_ASSERT_INT_EQ(p->slices, parsed[i].slices, cleanup, "slices mismatch for %s", parsed[i].tag);
+
+      n_expected = 0;
+      n_actual = 0;
+      MCTF_ASSERT(!collect_nodes(parsed[i].pg_root, expected, &n_expected), cleanup, "tree too large for %s", parsed[i].tag);
+      MCTF_ASSERT(!collect_nodes(p->pg_root, actual, &n_actual), cleanup, "tree too large for %s", parsed[i].tag);
+      MCTF_ASSERT_INT_EQ(n_actual, n_expected, cleanup, "query count mismatch for %s", parsed[i].tag);
+
+      for (int j = 0; j < n_expected; j++)
+      {
+         MCTF_ASSERT_INT_EQ(actual[j]->pg_version, expected[j]->pg_version, cleanup, "version mismatch for %s", parsed[i].tag);
+         MCTF_ASSERT_STR_EQ(actual[j]->node.query, expected[j]->node.query, cleanup, "query mismatch for %s", parsed[i].tag);
+         MCTF_ASSERT_INT_EQ(actual[j]->node.n_columns, expected[j]->node.n_columns, cleanup, "column count mismatch for %s", parsed[i].tag);
+         MCTF_ASSERT(actual[j]->node.is_histogram == expected[j]->node.is_histogram, cleanup, "histogram mismatch for %s", parsed[i].tag);
+         MCTF_ASSERT(!memcmp(actual[j]->node.columns, expected[j]->node.columns, sizeof(actual[j]->node.columns)),
+                     cleanup, "columns mismatch for %s", parsed[i].tag);
+      }
+   }
+
+cleanup:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   if (parsed != NULL)
+   {
+      for (int i = 0; i < number_of_parsed; i++)
+      {
+         pgexporter_free_pg_node_avl(&parsed[i].pg_root);
+      }
+      pgexporter_destroy_shared_memory(parsed_shmem, parsed_size);
+   }
+
+   pgexporter_metric_names_destroy(parsed_names);
+   pgexporter_free_pg_query_alts(config);
+
+   MCTF_FINISH();
+}
+
+// Test the built-in catalog resolves the newest query supported by a server
+MCTF_TEST(test_metrics_internal_catalog_lookup)
+{
+   struct configuration* config = NULL;
+   struct pg_query_alts* nodes[MAX_TREE_NODES];
+   struct pg_query_alts* alt = NULL;
+   int n;
+
+   config = (struct configuration*)shmem;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_read_internal_yaml_metrics(config, true), 0, cleanup, "read internal metrics failed");
+   MCTF_ASSERT(config->number_of_metrics > 0, cleanup, "no internal metrics");
+
+   for (int i = 0; i < config->number_of_metrics; i++)
+   {
+      n = 0;
+      MCTF_ASSERT(!collect_nodes(config->prometheus[i].pg_root, nodes, &n), cleanup, "tree too large");
+      MCTF_ASSERT(n > 0, cleanup, "no queries for %s", config->prometheus[i].tag);
+
+      for (int j = 0; j < n; j++)
+      {
+         config->servers[0].version = nodes[j]->pg_version;
+         alt = pgexporter_get_pg_query_alt(config->prometheus[i].pg_root, 0);
+         MCTF_ASSERT(alt == nodes[j], cleanup, "wrong alternative for %s version %d", config->prometheus[i].tag, nodes[j]->pg_version);
+
+         if (j > 0)
+         {
+            config->servers[0].version = nodes[j]->pg_version - 1;
+            alt = pgexporter_get_pg_query_alt(config->prometheus[i].pg_root, 0);
+            MCTF_ASSERT(alt == nodes[j - 1], cleanup, "wrong fallback for %s version %d", config->prometheus[i].tag, nodes[j]->pg_version - 1);
+         }
+      }
+
+      config->servers[0].version = nodes[0]->pg_version - 1;
+      MCTF_ASSERT_PTR_NULL(pgexporter_get_pg_query_alt(config->prometheus[i].pg_root, 0), cleanup, "unexpected alternative for %s", config->prometheus[i].tag);
+   }
+
+cleanup:
+   pgexporter_free_pg_query_alts(config);
+
+   MCTF_FINISH();
+}
+
+// Test a YAML metrics file is restored from its cache
+MCTF_TEST(test_metrics_yaml_cache)
+{
+   struct configuration* config = NULL;
+   struct yaml_cache* cache = NULL;
+   struct yaml_cache truncated;
+   struct pg_query_alts* nodes[MAX_TREE_NODES];
+   struct timeval times[2];
+   char dir[] = "/tmp/pgexporter_yaml_cache_XXXXXX";
+   char yaml[MAX_PATH];
+   char* same_size = NULL;
+   bool created = false;
+   int n;
+
+   config = (struct configuration*)shmem;
+
+   MCTF_ASSERT_PTR_NONNULL(mkdtemp(dir), cleanup, "mkdtemp failed");
+   created = true;
+
+   pgexporter_snprintf(yaml, sizeof(yaml), "%s/metrics.yaml", dir);
+   pgexporter_snprintf(config->metrics_path, MAX_PATH, "%s", yaml);
+   pgexporter_snprintf(config->yaml_cache_path, MAX_PATH, "%s/cache", dir);
+   MCTF_ASSERT(!write_file(yaml, CACHE_TEST_YAML), cleanup, "write YAML failed");
+
+   /* First load parses the file and writes the cache */
+   MCTF_ASSERT(pgexporter_yaml_cache_open(config, yaml, &cache), cleanup, "unexpected cache before first load");
+   MCTF_ASSERT_INT_EQ(pgexporter_read_metrics_configuration(shmem), 0, cleanup, "first load failed");
+   MCTF_ASSERT_INT_EQ(config->number_of_metrics, 2, cleanup, "first load metric count");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_yaml_cache_open(config, yaml, &cache), 0, cleanup, "cache missing after first load");
+   MCTF_ASSERT_INT_EQ(cache->number_of_metrics, 2, cleanup, "cache metric count");
+   MCTF_ASSERT_INT_EQ(cache->number_of_metric_names, 2, cleanup, "cache metric name count");
+   pgexporter_yaml_cache_close(cache);
+   cache = NULL;
+
+   /* Second load is served from the cache */
+   reset_metrics(config);
+   MCTF_ASSERT_INT_EQ(pgexporter_read_metrics_configuration(shmem), 0, cleanup, "cached load failed");
+   MCTF_ASSERT_INT_EQ(config->number_of_metrics, 2, cleanup, "cached load metric count");
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_count(config->metric_names), 2, cleanup, "cached load metric name count");
+   MCTF_ASSERT_STR_EQ(pgexporter_metric_names_get(config->metric_names, 0), "cache_test_value", cleanup, "metric name mismatch");
+   MCTF_ASSERT_STR_EQ(config->prometheus[0].tag, "cache_test", cleanup, "tag mismatch");
+   MCTF_ASSERT_INT_EQ(config->prometheus[0].sort_type, SORT_DATA0, cleanup, "sort mismatch");
+   MCTF_ASSERT_INT_EQ(config->prometheus[1].server_query_type, SERVER_QUERY_PRIMARY, cleanup, "server mismatch");
+
+   n = 0;
+   MCTF_ASSERT(!collect_nodes(config->prometheus[0].pg_root, nodes, &n), cleanup, "tree too large");
+   MCTF_ASSERT_INT_EQ(n, 2, cleanup, "query count mismatch");
+   MCTF_ASSERT_INT_EQ(nodes[0]->pg_version, 12, cleanup, "first version mismatch");
+   MCTF_ASSERT_INT_EQ(nodes[1]->pg_version, 14, cleanup, "second version mismatch");
+   MCTF_ASSERT_STR_EQ(nodes[1]->node.query, "SELECT datname, 1 FROM pg_database;", cleanup, "query mismatch");
+   MCTF_ASSERT_STR_EQ(nodes[1]->node.columns[1].description, "Cached value", cleanup, "description mismatch");
+
+   /* A cache that fails half way leaves no metric behind */
+   reset_metrics(config);
+   MCTF_ASSERT_INT_EQ(pgexporter_yaml_cache_open(config, yaml, &cache), 0, cleanup, "cache missing before truncation");
+   truncated = *cache;
+   truncated.size -= 1;
+   MCTF_ASSERT_INT_EQ(pgexporter_yaml_cache_restore(config, &truncated, config->prometheus, NUMBER_OF_METRICS), 1, cleanup,
+                      "truncated cache restored");
+   MCTF_ASSERT_STR_EQ(config->prometheus[0].tag, "", cleanup, "a metric of a failed restore is kept");
+   MCTF_ASSERT_PTR_NULL(config->prometheus[0].pg_root, cleanup, "the queries of a failed restore are kept");
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_count(config->metric_names), 0, cleanup, "the names of a failed restore are kept");
+   pgexporter_yaml_cache_close(cache);
+   cache = NULL;
+
+   /* A new modification time with the same content keeps the cache */
+   times[0].tv_sec = 1000000000;
+   times[0].tv_usec = 0;
+   times[1] = times[0];
+   MCTF_ASSERT(!utimes(yaml, times), cleanup, "utimes failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_yaml_cache_open(config, yaml, &cache), 0, cleanup, "cache rejected after touch");
+   pgexporter_yaml_cache_close(cache);
+   cache = NULL;
+
+   /* The header took the new modification time, so the file isn't hashed again */
+   same_size = strdup(CACHE_TEST_YAML);
+   MCTF_ASSERT_PTR_NONNULL(same_size, cleanup, "strdup failed");
+   memcpy(strstr(same_size, "Cached value"), "Cached VALUE", strlen("Cached VALUE"));
+   MCTF_ASSERT(!write_file(yaml, same_size), cleanup, "write YAML failed");
+   MCTF_ASSERT(!utimes(yaml, times), cleanup, "utimes failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_yaml_cache_open(config, yaml, &cache), 0, cleanup, "header not refreshed after touch");
+   pgexporter_yaml_cache_close(cache);
+   cache = NULL;
+
+   /* Changed content invalidates the cache */
+   MCTF_ASSERT(!write_file(yaml, CACHE_TEST_YAML "          - name: extra\n            type: gauge\n"), cleanup, "write YAML failed");
+   MCTF_ASSERT(pgexporter_yaml_cache_open(config, yaml, &cache), cleanup, "stale cache accepted");
+
+   reset_metrics(config);
+   MCTF_ASSERT_INT_EQ(pgexporter_read_metrics_configuration(shmem), 0, cleanup, "reload after change failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_count(config->metric_names), 3, cleanup, "changed file not parsed");
+
+cleanup:
+   free(same_size);
+   pgexporter_yaml_cache_close(cache);
+   reset_metrics(config);
+
+   if (created)
+   {
+      pgexporter_delete_directory(dir);
+   }
+
+   MCTF_FINISH();
+}
+
+// Test a metrics directory is parsed in parallel and merged in file order
+MCTF_TEST(test_metrics_yaml_directory)
+{
+   struct configuration* config = NULL;
+   char dir[] = "/tmp/pgexporter_yaml_dir_XXXXXX";
+   char yaml[MAX_PATH];
+   char tag[MISC_LENGTH];
+   char* content = NULL;
+   bool created = false;
+
+   config = (struct configuration*)shmem;
+
+   MCTF_ASSERT_PTR_NONNULL(mkdtemp(dir), cleanup, "mkdtemp failed");
+   created = true;
+
+   pgexporter_snprintf(config->metrics_path, MAX_PATH, "%s", dir);
+
+   for (int i = 0; i < NUMBER_OF_DIRECTORY_FILES; i++)
+   {
+      pgexporter_snprintf(yaml, sizeof(yaml), "%s/%02d.yaml", dir, i);
+      content = pgexporter_append(NULL, "metrics:\n");
+
+      for (int j = 0; j < 2; j++)
+      {
+         pgexporter_snprintf(tag, sizeof(tag), "dir_test_%02d_%d", i, j);
+         content = pgexporter_vappend(content, 3,
+                                      "  - tag: ", tag, "\n"
+                                                        "    collector: dir_test\n"
+                                                        "    queries:\n"
+                                                        "      - query: SELECT 1;\n"
+                                                        "        columns:\n"
+                                                        "          - type: gauge\n");
+      }
+
+      MCTF_ASSERT(!write_file(yaml, content), cleanup, "write YAML failed");
+      free(content);
+      content = NULL;
+   }
+
+   MCTF_ASSERT_INT_EQ(pgexporter_read_metrics_configuration(shmem), 0, cleanup, "directory load failed");
+   MCTF_ASSERT_INT_EQ(config->number_of_metrics, 2 * NUMBER_OF_DIRECTORY_FILES, cleanup, "metric count mismatch");
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_count(config->metric_names), 2 * NUMBER_OF_DIRECTORY_FILES, cleanup, "metric name count mismatch");
+
+   for (int i = 0; i < NUMBER_OF_DIRECTORY_FILES; i++)
+   {
+      for (int j = 0; j < 2; j++)
+      {
+         pgexporter_snprintf(tag, sizeof(tag), "dir_test_%02d_%d", i, j);
+         MCTF_ASSERT_STR_EQ(config->prometheus[2 * i + j].tag, tag, cleanup, "metric out of order at %d", 2 * i + j);
+         MCTF_ASSERT_STR_EQ(pgexporter_metric_names_get(config->metric_names, 2 * i + j), tag, cleanup, "metric name out of order at %d", 2 * i + j);
+         MCTF_ASSERT_PTR_NONNULL(config->prometheus[2 * i + j].pg_root, cleanup, "no query for %s", tag);
+      }
+   }
+
+   /* A duplicate in a later file fails the load */
+   reset_metrics(config);
+   pgexporter_snprintf(yaml, sizeof(yaml), "%s/99.yaml", dir);
+   MCTF_ASSERT(!write_file(yaml, "metrics:\n"
+                                 "  - tag: dir_test_00_0\n"
+                                 "    collector: dir_test\n"
+                                 "    queries:\n"
+                                 "      - query: SELECT 1;\n"
+                                 "        columns:\n"
+                                 "          - type: gauge\n"),
+               cleanup, "write YAML failed");
+   MCTF_ASSERT(pgexporter_read_metrics_configuration(shmem), cleanup, "duplicate metric accepted");
+
+cleanup:
+   free(content);
+   reset_metrics(config);
+
+   if (created)
+   {
+      pgexporter_delete_directory(dir);
+   }
+
+   MCTF_FINISH();
+}
+
+// Test the bucket bounds of a histogram are parsed and validated
+MCTF_TEST(test_metrics_histogram_buckets)
+{
+   struct configuration* config = NULL;
+   struct column* column = NULL;
+   double bounds[] = {0.5, 1, 5, 300};
+   int number_of_metrics = 0;
+   FILE* file = NULL;
+   char* yaml = "metrics:\n"
+                "  - tag: bucket_test\n"
+                "    collector: bucket_test\n"
+                "    queries:\n"
+                "      - query: SELECT datname, 1.5 FROM pg_database;\n"
+                "        columns:\n"
+                "          - name: database\n"
+                "            type: label\n"
+                "          - name: seconds\n"
+                "            type: histogram\n"
+                "            buckets:\n"
+                "              - 0.5\n"
+                "              - 1\n"
+                "              - 5\n"
+                "              - 300\n"
+                "            description: Bucketed\n";
+   char* decreasing = "metrics:\n"
+                      "  - tag: bucket_bad\n"
+                      "    collector: bucket_test\n"
+                      "    queries:\n"
+                      "      - query: SELECT 1;\n"
+                      "        columns:\n"
+                      "          - type: histogram\n"
+                      "            buckets: [5, 1]\n";
+
+   config = (struct configuration*)shmem;
+
+   file = fmemopen(yaml, strlen(yaml), "r");
+   MCTF_ASSERT_PTR_NONNULL(file, cleanup, "fmemopen failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_read_yaml_from_file_pointer(config, config->prometheus, 0, &number_of_metrics, file), 0, cleanup, "parse failed");
+   fclose(file);
+   file = NULL;
+
+   MCTF_ASSERT_INT_EQ(number_of_metrics, 1, cleanup, "metric count mismatch");
+   MCTF_ASSERT_PTR_NONNULL(config->prometheus[0].pg_root, cleanup, "no query");
+
+   column = &config->prometheus[0].pg_root->node.columns[1];
+   MCTF_ASSERT_INT_EQ(column->type, HISTOGRAM_TYPE, cleanup, "type mismatch");
+   MCTF_ASSERT_INT_EQ(column->n_buckets, 4, cleanup, "bucket count mismatch");
+   for (int i = 0; i < 4; i++)
+   {
+      MCTF_ASSERT(column->buckets[i] == bounds[i], cleanup, "bucket %d mismatch", i);
+   }
+   MCTF_ASSERT_INT_EQ(config->prometheus[0].pg_root->node.columns[0].n_buckets, 0, cleanup, "label has buckets");
+
+   /* An observation goes into the first bucket whose bound holds it */
+   MCTF_ASSERT_INT_EQ(pgexporter_bucket_index(column->buckets, column->n_buckets, 0.1), 0, cleanup, "below first bound");
+   MCTF_ASSERT_INT_EQ(pgexporter_bucket_index(column->buckets, column->n_buckets, 1), 1, cleanup, "on a bound");
+   MCTF_ASSERT_INT_EQ(pgexporter_bucket_index(column->buckets, column->n_buckets, 1.5), 2, cleanup, "between bounds");
+   MCTF_ASSERT_INT_EQ(pgexporter_bucket_index(column->buckets, column->n_buckets, 301), 4, cleanup, "above last bound");
+
+   /* Bounds must increase */
+   reset_metrics(config);
+   number_of_metrics = 0;
+   file = fmemopen(decreasing, strlen(decreasing), "r");
+   MCTF_ASSERT_PTR_NONNULL(file, cleanup, "fmemopen failed");
+   MCTF_ASSERT(pgexporter_read_yaml_from_file_pointer(config, config->prometheus, 0, &number_of_metrics, file), cleanup, "decreasing buckets accepted");
+
+cleanup:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   reset_metrics(config);
+
+   MCTF_FINISH();
+}
+
+// Test extension catalogs are sized to their metrics and loaded once
+MCTF_TEST(test_metrics_extension_catalog)
+{
+   struct configuration* config = NULL;
+   struct extension_metrics* ext = NULL;
+   char dir[] = "/tmp/pgexporter_ext_dir_XXXXXX";
+   char yaml[MAX_PATH];
+   char* names[2] = {"ext_test", "ext_missing"};
+   bool created = false;
+
+   config = (struct configuration*)shmem;
+
+   MCTF_ASSERT_PTR_NONNULL(mkdtemp(dir), cleanup, "mkdtemp failed");
+   created = true;
+
+   pgexporter_snprintf(yaml, sizeof(yaml), "%s/ext_test.yaml", dir);
+   MCTF_ASSERT(!write_file(yaml, "extension: ext_test\n"
+                                 "metrics:\n"
+                                 "  - metric: first\n"
+                                 "    queries:\n"
+                                 "      - query: SELECT 1;\n"
+                                 "        version: \"1.0\"\n"
+                                 "        columns:\n"
+                                 "          - type: gauge\n"
+                                 "  - metric: second\n"
+                                 "    queries:\n"
+                                 "      - query: SELECT 2;\n"
+                                 "        version: \"1.0\"\n"
+                                 "        columns:\n"
+                                 "          - type: gauge\n"),
+               cleanup, "write YAML failed");
+
+   MCTF_ASSERT(!pgexporter_is_extension_yaml_loaded(config, "ext_test"), cleanup, "catalog loaded before the load");
+
+   /* A missing catalog is reported, the others are still loaded */
+   pgexporter_load_extension_yaml_list(dir, names, 2, config);
+
+   MCTF_ASSERT(pgexporter_is_extension_yaml_loaded(config, "ext_test"), cleanup, "catalog not loaded");
+   MCTF_ASSERT(!pgexporter_is_extension_yaml_loaded(config, "ext_missing"), cleanup, "missing catalog loaded");
+
+   for (int i = 0; i < config->number_of_extensions; i++)
+   {
+      if (!strcmp(config->extensions[i].extension_name, "ext_test"))
+      {
+         ext = &config->extensions[i];
+      }
+   }
+
+   MCTF_ASSERT_PTR_NONNULL(ext, cleanup, "extension not registered");
+   MCTF_ASSERT_INT_EQ(ext->number_of_metrics, 2, cleanup, "metric count mismatch");
+   MCTF_ASSERT_INT_EQ(ext->capacity, 2, cleanup, "catalog not sized to its metrics");
+   MCTF_ASSERT_PTR_NONNULL(ext->metrics[1].ext_root, cleanup, "no query for second");
+   MCTF_ASSERT(pgexporter_is_extension_mapped(ext), cleanup, "catalog not mapped in the loading process");
+
+   /* As seen by a process forked before the load */
+   ext->generation++;
+   MCTF_ASSERT(!pgexporter_is_extension_mapped(ext), cleanup, "catalog of a later load mapped");
+   ext->generation--;
+
+   /* A loaded catalog isn't read again */
+   MCTF_ASSERT_INT_EQ(pgexporter_load_extension_yaml_list(dir, names, 1, config), 0, cleanup, "second load failed");
+   MCTF_ASSERT_INT_EQ(ext->number_of_metrics, 2, cleanup, "catalog loaded twice");
+
+cleanup:
+   pgexporter_free_extension_query_alts(config);
+   config->number_of_extensions = 0;
+   memset(config->extensions, 0, sizeof(config->extensions));
+   reset_metrics(config);
+
+   if (created)
+   {
+      pgexporter_delete_directory(dir);
+   }
+
+   MCTF_FINISH();
+}
+
+// Test query alternatives are compared by content
+MCTF_TEST(test_metrics_same_query_alts)
+{
+   struct configuration* config = NULL;
+   struct prometheus* first = NULL;
+   struct prometheus* second = NULL;
+   void* first_shmem = NULL;
+   void* second_shmem = NULL;
+   size_t size = NUMBER_OF_METRICS * sizeof(struct prometheus);
+   int number_of_first = 0;
+   int number_of_second = 0;
+   FILE* file = NULL;
+
+   config = (struct configuration*)shmem;
+
+   MCTF_ASSERT(!pgexporter_create_shared_memory(size, HUGEPAGE_OFF, &first_shmem), cleanup, "shared memory failed");
+   MCTF_ASSERT(!pgexporter_create_shared_memory(size, HUGEPAGE_OFF, &second_shmem), cleanup, "shared memory failed");
+   first = (struct prometheus*)first_shmem;
+   second = (struct prometheus*)second_shmem;
+
+   file = fmemopen(CACHE_TEST_YAML, strlen(CACHE_TEST_YAML), "r");
+   MCTF_ASSERT_PTR_NONNULL(file, cleanup, "fmemopen failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_read_yaml_from_file_pointer(config, first, 0, &number_of_first, file), 0, cleanup, "first parse failed");
+   fclose(file);
+   file = NULL;
+
+   /* The names of the first parse would be duplicates */
+   pgexporter_metric_names_destroy(config->metric_names);
+   config->metric_names = NULL;
+
+   file = fmemopen(CACHE_TEST_YAML, strlen(CACHE_TEST_YAML), "r");
+   MCTF_ASSERT_PTR_NONNULL(file, cleanup, "fmemopen failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_read_yaml_from_file_pointer(config, second, 0, &number_of_second, file), 0, cleanup, "second parse failed");
+   fclose(file);
+   file = NULL;
+
+   MCTF_ASSERT_INT_EQ(number_of_first, number_of_second, cleanup, "metric count mismatch");
+   MCTF_ASSERT(first[0].pg_root != second[0].pg_root, cleanup, "trees are shared");
+
+   for (int i = 0; i < number_of_first; i++)
+   {
+      MCTF_ASSERT(pgexporter_is_same_pg_query_alts(first[i].pg_root, second[i].pg_root), cleanup, "trees differ for %s", first[i].tag);
+   }
+
+   MCTF_ASSERT(!pgexporter_is_same_pg_query_alts(first[0].pg_root, second[1].pg_root), cleanup, "different trees are the same");
+   MCTF_ASSERT(!pgexporter_is_same_pg_query_alts(first[0].pg_root, NULL), cleanup, "tree is the same as no tree");
+
+   second[0].pg_root->node.columns[1].description[0] = '\0';
+   MCTF_ASSERT(!pgexporter_is_same_pg_query_alts(first[0].pg_root, second[0].pg_root), cleanup, "changed description not detected");
+
+cleanup:
+   if (file != NULL)
+   {
+      fclose(file);
+   }
+
+   for (int i = 0; first != NULL && i < number_of_first; i++)
+   {
+      pgexporter_free_pg_node_avl(&first[i].pg_root);
+   }
+
+   for (int i = 0; second != NULL && i < number_of_second; i++)
+   {
+      pgexporter_free_pg_node_avl(&second[i].pg_root);
+   }
+
+   pgexporter_destroy_shared_memory(first_shmem, size);
+   pgexporter_destroy_shared_memory(second_shmem, size);
+   reset_metrics(config);
+
+   MCTF_FINISH();
+}
+
+// Test the metric name registry grows past its initial size and keeps the insertion order
+MCTF_TEST(test_metrics_names_registry)
+{
+   struct metric_names* names = NULL;
+   char name[PROMETHEUS_LENGTH];
+   int n = 4 * METRIC_NAMES_INITIAL_CAPACITY;
+
+   MCTF_ASSERT(!pgexporter_metric_names_contains(names, "pgexporter"), cleanup, "empty registry contains a name");
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_count(names), 0, cleanup, "empty registry has names");
+
+   for (int i = 0; i < n; i++)
+   {
+      pgexporter_snprintf(name, sizeof(name), "registry_test_%d", i);
+      MCTF_ASSERT_INT_EQ(pgexporter_metric_names_add(&names, name), 0, cleanup, "add %s failed", name);
+   }
+
+   /* Adding a name again doesn't change the registry */
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_add(&names, "registry_test_0"), 0, cleanup, "add duplicate failed");
+   MCTF_ASSERT_INT_EQ(pgexporter_metric_names_count(names), n, cleanup, "name count mismatch");
+
+   for (int i = 0; i < n; i++)
+   {
+      pgexporter_snprintf(name, sizeof(name), "registry_test_%d", i);
+      MCTF_ASSERT(pgexporter_metric_names_contains(names, name), cleanup, "%s missing", name);
+      MCTF_ASSERT_STR_EQ(pgexporter_metric_names_get(names, i), name, cleanup, "order mismatch at %d", i);
+   }
+
+   MCTF_ASSERT(!pgexporter_metric_names_contains(names, "registry_test"), cleanup, "prefix found");
+   MCTF_ASSERT_PTR_NULL(pgexporter_metric_names_get(names, n), cleanup, "name past the end");
+
+cleanup:
+   pgexporter_metric_names_destroy(names);
+
+   MCTF_FINISH();
+}
+
+static int
+write_file(char* path, char* content)
+{
+   FILE* file = NULL;
+
+   file = fopen(path, "w");
+   if (file == NULL)
+   {
+      return 1;
+   }
+
+   if (fputs(content, file) < 0)
+   {
+      fclose(file);
+      return 1;
+   }
+
+   return fclose(file) != 0;
+}
+
+static void
+reset_metrics(struct configuration* config)
+{
+   pgexporter_free_pg_query_alts(config);
+   memset(config->prometheus, 0, sizeof(config->prometheus));
+   config->number_of_metrics = 0;
+   pgexporter_metric_names_destroy(config->metric_names);
+   config->metric_names = NULL;
+}
+
+static int
+collect_nodes(struct pg_query_alts* root, struct pg_query_alts** nodes, int* n)
+{
+   if (root == NULL)
+   {
+      return 0;
+   }
+
+   if (collect_nodes(root->left, nodes, n))
+   {
+      return 1;
+   }
+
+   if (*n >= MAX_TREE_NODES)
+   {
+      return 1;
+   }
+   nodes[(*n)++] = root;
+
+   return collect_nodes(root->right, nodes, n);
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <pgexporter.h>
+#include <mctf.h>
+#include <shard.h>
+#include <shmem.h>
+#include <tscommon.h>
+#include <utils.h>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SHARD_TEST_SAMPLES 200
+
+static int shard_start(int shards, int* previous, size_t* size);
+static void shard_stop(int previous, size_t size);
+static char* shard_text(int value);
+
+MCTF_TEST(test_shard_merge)
+{
+   int previous = 0;
+   size_t size = 0;
+   size_t length = 0;
+   char* data = NULL;
+
+   MCTF_ASSERT_INT_EQ(shard_start(2, &previous, &size), 0, cleanup, "shard init");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_merge(&data, &length), 0, cleanup, "merge before the first scrape");
+   MCTF_ASSERT_PTR_NULL(data, cleanup, "nothing is published yet");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0,
+                                               "#HELP pgexporter_b B\n#TYPE pgexporter_b gauge\npgexporter_b{server=\"s0\"} 2\n"
+                                               "#HELP pgexporter_a A\n#TYPE pgexporter_a gauge\npgexporter_a{server=\"s0\"} 1\n"),
+                      0, cleanup, "publish shard 0");
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(1,
+                                               "#HELP pgexporter_a A\n#TYPE pgexporter_a gauge\npgexporter_a{server=\"s1\"} 3\n"),
+                      0, cleanup, "publish shard 1");
+
+   /* A family split across the shards has its header once */
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_merge(&data, &length), 0, cleanup, "merge");
+   MCTF_ASSERT_STR_EQ(data,
+                      "#HELP pgexporter_a A\n#TYPE pgexporter_a gauge\npgexporter_a{server=\"s0\"} 1\npgexporter_a{server=\"s1\"} 3\n"
+                      "#HELP pgexporter_b B\n#TYPE pgexporter_b gauge\npgexporter_b{server=\"s0\"} 2\n",
+                      cleanup, "merged families");
+   MCTF_ASSERT_INT_EQ((int)length, (int)strlen(data), cleanup, "merged length");
+
+cleanup:
+   free(data);
+   shard_stop(previous, size);
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_shard_empty)
+{
+   int previous = 0;
+   size_t size = 0;
+   size_t length = 0;
+   char* data = NULL;
+
+   MCTF_ASSERT_INT_EQ(shard_start(2, &previous, &size), 0, cleanup, "shard init");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0, ""), 0, cleanup, "publish an empty fragment");
+   MCTF_ASSERT_INT_EQ(atomic_load(&((struct shard_fragment*)shard_shmem)->active), 0, cleanup, "an empty fragment is published");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_merge(&data, &length), 0, cleanup, "merge an empty fragment");
+   MCTF_ASSERT_PTR_NULL(data, cleanup, "an empty fragment has no metrics");
+   MCTF_ASSERT_INT_EQ((int)length, 0, cleanup, "an empty fragment has no length");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(1, "#TYPE pgexporter_a gauge\npgexporter_a 1\n"), 0, cleanup, "publish shard 1");
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_merge(&data, &length), 0, cleanup, "merge");
+   MCTF_ASSERT_STR_EQ(data, "#TYPE pgexporter_a gauge\npgexporter_a 1\n", cleanup, "the empty fragment adds nothing");
+
+cleanup:
+   free(data);
+   shard_stop(previous, size);
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_shard_readers)
+{
+   int previous = 0;
+   int status = 0;
+   size_t size = 0;
+   size_t length = 0;
+   pid_t pid;
+   char* data = NULL;
+   struct shard_fragment* fragment = NULL;
+
+   MCTF_ASSERT_INT_EQ(shard_start(1, &previous, &size), 0, cleanup, "shard init");
+   fragment = (struct shard_fragment*)shard_shmem;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0, "pgexporter_a 1\n"), 0, cleanup, "publish into buffer 0");
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0, "pgexporter_a 2\n"), 0, cleanup, "publish into buffer 1");
+
+   /* A reader that died is no reason to keep a buffer */
+   pid = fork();
+   if (pid == 0)
+   {
+      _exit(0);
+   }
+   MCTF_ASSERT(pid > 0, cleanup, "fork failed");
+   waitpid(pid, &status, 0);
+
+   atomic_store(&fragment->readers[0][0], (int)pid);
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0, "pgexporter_a 3\n"), 0, cleanup, "the buffer of a dead reader is taken over");
+   MCTF_ASSERT_INT_EQ(atomic_load(&fragment->readers[0][0]), 0, cleanup, "the slot of a dead reader is freed");
+
+   /* The buffer of a live reader is never taken over */
+   atomic_store(&fragment->readers[1][0], (int)getpid());
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0, "pgexporter_a 4\n"), 1, cleanup, "a live reader keeps its buffer");
+   atomic_store(&fragment->readers[1][0], 0);
+
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_merge(&data, &length), 0, cleanup, "merge");
+   MCTF_ASSERT_STR_EQ(data, "pgexporter_a 3\n", cleanup, "the previous metrics stay");
+
+cleanup:
+   if (fragment != NULL)
+   {
+      atomic_store(&fragment->readers[0][0], 0);
+      atomic_store(&fragment->readers[1][0], 0);
+   }
+   free(data);
+   shard_stop(previous, size);
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_shard_concurrent)
+{
+   int previous = 0;
+   int status = -1;
+   size_t size = 0;
+   pid_t pid = -1;
+   char* texts[2] = {NULL, NULL};
+   struct shard_fragment* fragment = NULL;
+
+   MCTF_ASSERT_INT_EQ(shard_start(1, &previous, &size), 0, cleanup, "shard init");
+   fragment = (struct shard_fragment*)shard_shmem;
+
+   texts[0] = shard_text(1);
+   texts[1] = shard_text(2);
+   MCTF_ASSERT(texts[0] != NULL && texts[1] != NULL, cleanup, "out of memory");
+   MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0, texts[0]), 0, cleanup, "first publish");
+
+   /* The reader only ever sees whole scrapes while the shard publishes */
+   pid = fork();
+   if (pid == 0)
+   {
+      char* data = NULL;
+      size_t length = 0;
+
+      for (int i = 0; i < 2000; i++)
+      {
+         if (pgexporter_shard_merge(&data, &length) || data == NULL ||
+             (strcmp(data, texts[0]) && strcmp(data, texts[1])))
+         {
+            _exit(1);
+         }
+         free(data);
+         data = NULL;
+      }
+
+      _exit(0);
+   }
+   MCTF_ASSERT(pid > 0, cleanup, "fork failed");
+
+   for (int i = 0; i < 200; i++)
+   {
+      MCTF_ASSERT_INT_EQ(pgexporter_shard_publish(0, texts[i % 2]), 0, cleanup, "publish %d", i);
+   }
+
+   MCTF_ASSERT(waitpid(pid, &status, 0) == pid, cleanup, "waitpid failed");
+   pid = -1;
+   MCTF_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0, cleanup, "the reader saw a partial scrape");
+
+   for (int i = 0; i < SHARD_READERS; i++)
+   {
+      MCTF_ASSERT_INT_EQ(atomic_load(&fragment->readers[0][i]) + atomic_load(&fragment->readers[1][i]), 0, cleanup,
+                         "reader slot %d is released", i);
+   }
+
+cleanup:
+   if (pid > 0)
+   {
+      waitpid(pid, &status, 0);
+   }
+   free(texts[0]);
+   free(texts[1]);
+   shard_stop(previous, size);
+   MCTF_FINISH();
+}
+
+static int
+shard_start(int shards, int* previous, size_t* size)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   *previous = config->metrics_shards;
+   config->metrics_shards = shards;
+
+   return pgexporter_shard_init(size, &shard_shmem);
+}
+
+static void
+shard_stop(int previous, size_t size)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   if (shard_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(shard_shmem, size);
+      shard_shmem = NULL;
+   }
+
+   config->metrics_shards = previous;
+}
+
+static char*
+shard_text(int value)
+{
+   char line[128];
+   char* text = NULL;
+
+   text = pgexporter_append(text, "#HELP pgexporter_a A\n#TYPE pgexporter_a gauge\n");
+
+   for (int i = 0; i < SHARD_TEST_SAMPLES; i++)
+   {
+      pgexporter_snprintf(line, sizeof(line), "pgexporter_a{sample=\"%d\"} %d\n", i, value);
+      text = pgexporter_append(text, line);
+   }
+
+   return text;
+}
@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <pgexporter.h>
+#include <derive.h>
+#include <mctf.h>
+#include <queries.h>
+#include <shmem.h>
+#include <slice.h>
+#include <tscommon.h>
+#include <utils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int slice_start(size_t* size);
+static void slice_stop(size_t size);
+static struct query* slice_result(int n_rows, char** names);
+static int slice_rows(struct query* query);
+
+MCTF_TEST(test_slice_query)
+{
+   char* query = NULL;
+
+   query = pgexporter_slice_query("SELECT relname FROM pg_class WHERE oid::bigint % {slices} = {slice} AND relname LIKE '{x}%'", 8, 3);
+   MCTF_ASSERT_STR_EQ(query, "SELECT relname FROM pg_class WHERE oid::bigint % 8 = 3 AND relname LIKE '{x}%'", cleanup, "placeholders");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_validate(0, DERIVE_NONE, "SELECT 1"), 0, cleanup, "not sliced");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_validate(4, DERIVE_NONE, "SELECT {slice}"), 0, cleanup, "sliced");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_validate(4, DERIVE_NONE, "SELECT 1"), 1, cleanup, "a sliced query needs {slice}");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_validate(4, DERIVE_RATE, "SELECT {slice}"), 1, cleanup, "slices and derive");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_validate(SLICE_MAX + 1, DERIVE_NONE, "SELECT {slice}"), 1, cleanup, "too many slices");
+
+cleanup:
+   free(query);
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_slice_init)
+{
+   size_t size = 0;
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgexporter_test_config_save();
+
+   /* Nothing is kept while no metric is sliced */
+   config->number_of_metrics = 0;
+   config->number_of_extensions = 0;
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_init(&size, &slice_shmem), 0, cleanup, "slice init");
+   MCTF_ASSERT_PTR_NULL(slice_shmem, cleanup, "no table without a sliced metric");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_resize(&size, &slice_shmem), 0, cleanup, "slice resize");
+   MCTF_ASSERT_PTR_NULL(slice_shmem, cleanup, "still no table");
+
+   /* The first sliced metric creates the table */
+   config->number_of_metrics = 1;
+   config->prometheus[0].slices = 2;
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_resize(&size, &slice_shmem), 0, cleanup, "slice resize");
+   MCTF_ASSERT_PTR_NONNULL(slice_shmem, cleanup, "the table is created");
+   MCTF_ASSERT(((struct slice_table*)slice_shmem)->number_of_entries >= SLICE_NUMBER_OF_ENTRIES, cleanup, "entries");
+
+cleanup:
+   slice_stop(size);
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_slice_merge)
+{
+   size_t size = 0;
+   uint64_t key;
+   struct query* query = NULL;
+   char* first[] = {"a", "b"};
+   char* second[] = {"c"};
+   char* again[] = {"d"};
+
+   MCTF_ASSERT_INT_EQ(slice_start(&size), 0, cleanup, "slice init");
+
+   key = pgexporter_slice_key("pgstattuple_table_bloat_stats", "primary", "postgres");
+
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_next(key, 2), 0, cleanup, "the first slice");
+   query = slice_result(2, first);
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_merge(key, 2, 0, query), 0, cleanup, "merge slice 0");
+   MCTF_ASSERT_INT_EQ(slice_rows(query), 2, cleanup, "nothing known of slice 1");
+   pgexporter_free_query(query);
+
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_next(key, 2), 1, cleanup, "the second slice");
+   query = slice_result(1, second);
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_merge(key, 2, 1, query), 0, cleanup, "merge slice 1");
+   MCTF_ASSERT_INT_EQ(slice_rows(query), 3, cleanup, "slice 0 is served again");
+   MCTF_ASSERT_STR_EQ(query->tuples->next->data[0], "a", cleanup, "the kept row");
+   MCTF_ASSERT(query->tuples->next->data[1] == NULL, cleanup, "NULL is kept");
+   MCTF_ASSERT_INT_EQ(query->tuples->next->server, 1, cleanup, "the server is kept");
+   pgexporter_free_query(query);
+
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_next(key, 2), 0, cleanup, "back to the first slice");
+   query = slice_result(1, again);
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_merge(key, 2, 0, query), 0, cleanup, "merge slice 0 again");
+   MCTF_ASSERT_INT_EQ(slice_rows(query), 2, cleanup, "the old rows of slice 0 are replaced");
+   MCTF_ASSERT_STR_EQ(query->tuples->next->data[0], "c", cleanup, "the row of slice 1");
+   pgexporter_free_query(query);
+   query = NULL;
+
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_next(key, 3), 0, cleanup, "other slices start over");
+
+cleanup:
+   pgexporter_free_query(query);
+   slice_stop(size);
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_slice_skip)
+{
+   size_t size = 0;
+   uint64_t key;
+   struct query* query = NULL;
+   char* first[] = {"a", "b"};
+
+   MCTF_ASSERT_INT_EQ(slice_start(&size), 0, cleanup, "slice init");
+   MCTF_ASSERT(((struct slice_table*)slice_shmem)->number_of_entries >= SLICE_NUMBER_OF_ENTRIES, cleanup, "entries");
+
+   /* A failing slice moves on even before anything is known */
+   key = pgexporter_slice_key("pgstattuple_table_bloat_stats", "replica", "postgres");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_skip(key, 3, 0, "pgstattuple_table_bloat_stats", &query), 0, cleanup, "skip slice 0");
+   MCTF_ASSERT_PTR_NULL(query, cleanup, "nothing is known yet");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_next(key, 3), 1, cleanup, "the failed slice is passed");
+
+   query = slice_result(2, first);
+   pgexporter_snprintf(query->names[0], PROMETHEUS_LENGTH, "relname");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_merge(key, 3, 1, query), 0, cleanup, "merge slice 1");
+   pgexporter_free_query(query);
+   query = NULL;
+
+   /* The known rows are served when a slice fails */
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_skip(key, 3, 2, "pgstattuple_table_bloat_stats", &query), 0, cleanup, "skip slice 2");
+   MCTF_ASSERT_PTR_NONNULL(query, cleanup, "the rows of slice 1");
+   MCTF_ASSERT_INT_EQ(slice_rows(query), 2, cleanup, "the rows of slice 1 are served");
+   MCTF_ASSERT_INT_EQ(query->number_of_columns, 2, cleanup, "the columns are kept");
+   MCTF_ASSERT_STR_EQ(query->names[0], "relname", cleanup, "the column names are kept");
+   MCTF_ASSERT_STR_EQ(query->tag, "pgstattuple_table_bloat_stats", cleanup, "the tag");
+   MCTF_ASSERT_INT_EQ(pgexporter_slice_next(key, 3), 0, cleanup, "back to the first slice");
+
+cleanup:
+   pgexporter_free_query(query);
+   slice_stop(size);
+   MCTF_FINISH();
+}
+
+static int
+slice_start(size_t* size)
+{
+   struct configuration* config;
+
+   config = (struct configuration*)shmem;
+
+   pgexporter_test_config_save();
+
+   config->number_of_metrics = 1;
+   config->prometheus[0].slices = 2;
+
+   return pgexporter_slice_init(size, &slice_shmem);
+}
+
+static void
+slice_stop(size_t size)
+{
+   if (slice_shmem != NULL)
+   {
+      pgexporter_destroy_shared_memory(slice_shmem, size);
+      slice_shmem = NULL;
+   }
+
+   pgexporter_test_config_restore();
+}
+
+static struct query*
+slice_result(int n_rows, char** names)
+{
+   struct query* query = NULL;
+   struct tuple* last = NULL;
+
+   query = (struct query*)calloc(1, sizeof(struct query));
+   query->number_of_columns = 2;
+
+   for (int i = 0; i < n_rows; i++)
+   {
+      struct tuple* tuple = (struct tuple*)calloc(1, sizeof(struct tuple));
+
+      tuple->server = 1;
+      tuple->data = (char**)calloc(2, sizeof(char*));
+      tuple->data[0] = strdup(names[i]);
+
+      if (last == NULL)
+      {
+         query->tuples = tuple;
+      }
+      else
+      {
+         last->next = tuple;
+      }
+      last = tuple;
+   }
+
+   return query;
+}
+
+static int
+slice_rows(struct query* query)
+{
+   int rows = 0;
+
+   for (struct tuple* tuple = query->tuples; tuple != NULL; tuple = tuple->next)
+   {
+      rows++;
+   }
+
+   return rows;
+}
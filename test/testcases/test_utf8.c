@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2026 The pgexporter community
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this list
+ * of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice, this
+ * list of conditions and the following disclaimer in the documentation and/or other
+ * materials provided with the distribution.
+ *
+ * 3. Neither the name of the copyright holder nor the names of its contributors may
+ * be used to endorse or promote products derived from this software without specific
+ * prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY
+ * EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT
+ * OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR
+ * TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pgexporter.h>
+#include <mctf.h>
+#include <tscommon.h>
+#include <utf8.h>
+#include <utils.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+MCTF_TEST(test_utf8_ascii_length)
+{
+   unsigned char buf[100];
+
+   memset(buf, 'a', sizeof(buf));
+
+   MCTF_ASSERT_INT_EQ(pgexporter_ascii_length(buf, 0), 0, cleanup, "empty buffer");
+   MCTF_ASSERT_INT_EQ(pgexporter_ascii_length(buf, sizeof(buf)), sizeof(buf), cleanup, "all ASCII");
+
+   /* Every position, across the vector and word boundaries */
+   for (size_t i = 0; i < sizeof(buf); i++)
+   {
+      buf[i] = 0xC3;
+      MCTF_ASSERT_INT_EQ(pgexporter_ascii_length(buf, sizeof(buf)), i, cleanup,
+                         "non-ASCII byte at %d", (int)i);
+      MCTF_ASSERT(!pgexporter_is_ascii((char*)buf, sizeof(buf)), cleanup, "not ASCII at %d", (int)i);
+      buf[i] = 'a';
+   }
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_utf8_valid)
+{
+   const char* valid[] = {
+      "",
+      "pg_stat_activity",
+      "caf\xC3\xA9",
+      "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E",
+      "emoji \xF0\x9F\x98\x80 in a string that is longer than sixteen bytes",
+      "\xF4\x8F\xBF\xBF",
+   };
+   const char* invalid[] = {
+      "\x80",
+      "overlong \xC0\xAF",
+      "surrogate \xED\xA0\x80",
+      "beyond \xF4\x90\x80\x80",
+      "truncated at the end of a long ASCII prefix \xE6\x97",
+      "latin1 caf\xE9 name",
+   };
+
+   for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+   {
+      MCTF_ASSERT(pgexporter_utf8_valid((const unsigned char*)valid[i], strlen(valid[i])), cleanup,
+                  "valid string %d", (int)i);
+   }
+
+   for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+   {
+      MCTF_ASSERT(!pgexporter_utf8_valid((const unsigned char*)invalid[i], strlen(invalid[i])), cleanup,
+                  "invalid string %d", (int)i);
+   }
+
+   MCTF_ASSERT_INT_EQ(pgexporter_utf8_char_length((const unsigned char*)valid[3], strlen(valid[3])), 3, cleanup,
+                      "three characters");
+
+cleanup:
+   MCTF_FINISH();
+}
+
+MCTF_TEST(test_utf8_sanitize)
+{
+   char buf[128];
+   size_t replaced;
+
+   pgexporter_snprintf(buf, sizeof(buf), "%s", "plain ascii application name");
+   replaced = pgexporter_utf8_sanitize((unsigned char*)buf, strlen(buf));
+   MCTF_ASSERT_INT_EQ(replaced, 0, cleanup, "ASCII is left alone");
+   MCTF_ASSERT_STR_EQ(buf, "plain ascii application name", cleanup, "ASCII is left alone");
+
+   /* A Latin-1 name from a database in another encoding */
+   pgexporter_snprintf(buf, sizeof(buf), "%s", "caf\xE9 cr\xE8me caf\xC3\xA9");
+   replaced = pgexporter_utf8_sanitize((unsigned char*)buf, strlen(buf));
+   MCTF_ASSERT_INT_EQ(replaced, 2, cleanup, "two bytes should be replaced");
+   MCTF_ASSERT_STR_EQ(buf, "caf? cr?me caf\xC3\xA9", cleanup, "only the invalid bytes are replaced");
+   MCTF_ASSERT(pgexporter_utf8_valid((const unsigned char*)buf, strlen(buf)), cleanup, "the result is valid");
+
+   /* A truncated sequence followed by a valid one */
+   pgexporter_snprintf(buf, sizeof(buf), "%s", "\xE6\x97\xE6\x97\xA5");
+   replaced = pgexporter_utf8_sanitize((unsigned char*)buf, strlen(buf));
+   MCTF_ASSERT_INT_EQ(replaced, 2, cleanup, "the truncated sequence should be replaced");
+   MCTF_ASSERT_STR_EQ(buf, "??\xE6\x97\xA5", cleanup, "the valid sequence is kept");
+
+cleanup:
+   MCTF_FINISH();
+}